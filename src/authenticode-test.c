@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-v3-or-later
+/*
+ * authenticode-test.c - check and benchmark the authenticode digests
+ */
+
+#include "sbchooser.h" // IWYU pragma: keep
+
+#include <time.h>
+
+#define LOOP_COUNT 20
+
+static int verbosity = 0;
+
+static const struct {
+	authenticode_threads_t threads;
+	const char *name;
+} modes[] = {
+	{ AUTHENTICODE_THREADS_NEVER, "chunked" },
+	{ AUTHENTICODE_THREADS_ALWAYS, "threaded" },
+};
+
+static void NORETURN
+usage(int ret)
+{
+	FILE *out = ret == EXIT_SUCCESS ? stdout : stderr;
+
+	fprintf(out,
+		"Usage: %s [OPTION...] <efi file>...\n"
+		"Compute the authenticode digests of each file single-threaded\n"
+		"and with one thread per digest, check that they match, and\n"
+		"with -v, report how long each took.\n"
+		"\n"
+		"  -n, --iterations=<n>  Compute each digest <n> times (default %d)\n"
+		"  -v, --verbose         Report timings\n"
+		"  -?, --help            Show this help message\n",
+		program_invocation_short_name, LOOP_COUNT);
+	exit(ret);
+}
+
+static void
+free_digest(digest_data_t *dgst)
+{
+	free(dgst->data);
+	dgst->data = NULL;
+	dgst->datasz = 0;
+}
+
+static bool
+digests_equal(digest_data_t *dgst0, digest_data_t *dgst1)
+{
+	return dgst0->datasz == dgst1->datasz &&
+	       memcmp(dgst0->data, dgst1->data, dgst0->datasz) == 0;
+}
+
+static int
+test_one_file(const char *filename, unsigned long iterations)
+{
+	sbchooser_context_t ctx;
+	pe_file_t *pe = NULL;
+	digest_data_t ref[3];
+	int rc;
+
+	memset(&ctx, 0, sizeof(ctx));
+	rc = load_pe(&ctx, filename, &pe);
+	if (rc < 0) {
+		warn("Could not load \"%s\"", filename);
+		return -1;
+	}
+
+	/*
+	 * load_pe() already computed the digests the normal way; keep those
+	 * to compare against.
+	 */
+	ref[0] = pe->sha256;
+	ref[1] = pe->sha384;
+	ref[2] = pe->sha512;
+	memset(&pe->sha256, 0, sizeof(pe->sha256));
+	memset(&pe->sha384, 0, sizeof(pe->sha384));
+	memset(&pe->sha512, 0, sizeof(pe->sha512));
+
+	for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		struct timespec start, end;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (unsigned long j = 0; j < iterations; j++) {
+			free_digest(&pe->sha256);
+			free_digest(&pe->sha384);
+			free_digest(&pe->sha512);
+
+			rc = generate_authenticode_ex(pe, modes[i].threads);
+			if (rc < 0) {
+				warnx("%s: %s digest failed", filename,
+				      modes[i].name);
+				goto out;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (!digests_equal(&pe->sha256, &ref[0]) ||
+		    !digests_equal(&pe->sha384, &ref[1]) ||
+		    !digests_equal(&pe->sha512, &ref[2])) {
+			warnx("%s: %s digests do not match", filename,
+			      modes[i].name);
+			rc = -1;
+			goto out;
+		}
+
+		if (verbosity >= 1) {
+			double secs = (end.tv_sec - start.tv_sec) +
+				      (end.tv_nsec - start.tv_nsec) / 1e9;
+
+			printf("%-44s %-8s %8.3fms (%.0f MB/s)\n", filename,
+			       modes[i].name, secs * 1000 / iterations,
+			       (double)pe->mapsz * iterations / secs / 1e6);
+		}
+	}
+	rc = 0;
+out:
+	for (size_t i = 0; i < sizeof(ref) / sizeof(ref[0]); i++)
+		free_digest(&ref[i]);
+	free_pe(&pe);
+	return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long iterations = LOOP_COUNT;
+	const char sopts[] = "n:v?";
+	const struct option lopts[] = {
+		{"help", no_argument, 0, '?'},
+		{"iterations", required_argument, 0, 'n'},
+		{"verbose", no_argument, 0, 'v'},
+		{0, 0, 0, 0}
+	};
+	int ret = EXIT_SUCCESS;
+	int c;
+
+	while ((c = getopt_long(argc, argv, sopts, lopts, NULL)) != -1) {
+		char *end = NULL;
+
+		switch (c) {
+		case 'n':
+			errno = 0;
+			iterations = strtoul(optarg, &end, 10);
+			if (errno || !end || *end || iterations == 0)
+				errx(EXIT_FAILURE, "invalid iteration count \"%s\"",
+				     optarg);
+			break;
+		case 'v':
+			verbosity += 1;
+			break;
+		case '?':
+			usage(optopt ? EXIT_FAILURE : EXIT_SUCCESS);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	if (optind == argc)
+		usage(EXIT_FAILURE);
+
+	for (int i = optind; i < argc; i++) {
+		if (test_one_file(argv[i], iterations) < 0)
+			ret = EXIT_FAILURE;
+	}
+
+	return ret;
+}
+
+// vim:fenc=utf-8:tw=75:noet
@@ -107,22 +107,157 @@ err:
 
 }
 
+/*
+ * The parts of the image that make up the authenticode digest, in order.
+ */
+struct hash_region {
+	const void *base;
+	size_t size;
+};
+
+struct hash_regions {
+	size_t n_regions;
+	size_t max_regions;
+	struct hash_region *regions;
+	size_t total_size;
+};
+
+static int
+add_hash_region(struct hash_regions *hr, const void *base, size_t size)
+{
+	if (size == 0)
+		return 0;
+	if (hr->n_regions == hr->max_regions) {
+		warnx("Too many regions to hash");
+		errno = EINVAL;
+		return -1;
+	}
+
+	hr->regions[hr->n_regions].base = base;
+	hr->regions[hr->n_regions].size = size;
+	hr->n_regions += 1;
+	hr->total_size += size;
+	return 0;
+}
+
+/*
+ * Feed every digest from the same chunk before moving on to the next one,
+ * so each chunk is only pulled into cache once.
+ */
+#define AUTHENTICODE_CHUNK_SIZE (64 * 1024)
+
 static void
-update_all_hashes(digest_buffer_t **dbufs, void *data, size_t size)
+update_all_hashes(digest_buffer_t **dbufs, struct hash_regions *hr)
 {
-	for (size_t i = 0; dbufs[i] != NULL; i++) {
-		digest_buffer_t *dbp = dbufs[i];
+	for (size_t i = 0; i < hr->n_regions; i++) {
+		const uint8_t *base = hr->regions[i].base;
+		size_t size = hr->regions[i].size;
+
+		for (size_t off = 0; off < size; off += AUTHENTICODE_CHUNK_SIZE) {
+			size_t chunksz = MIN(size - off, AUTHENTICODE_CHUNK_SIZE);
+
+			for (size_t j = 0; dbufs[j] != NULL; j++) {
+				digest_buffer_t *dbp = dbufs[j];
+
+				if (dbp->mdctx == NULL)
+					continue;
+
+				EVP_DigestUpdate(dbp->mdctx, base + off, chunksz);
+			}
+		}
+	}
+}
+
+struct hash_thread {
+	pthread_t thread;
+	digest_buffer_t *dbp;
+	struct hash_regions *hr;
+};
+
+static void *
+update_one_hash(void *arg)
+{
+	struct hash_thread *ht = arg;
+	struct hash_regions *hr = ht->hr;
+
+	for (size_t i = 0; i < hr->n_regions; i++)
+		EVP_DigestUpdate(ht->dbp->mdctx, hr->regions[i].base,
+				 hr->regions[i].size);
+
+	return NULL;
+}
+
+/*
+ * Images at least this large are hashed with one thread per digest, when
+ * there's more than one CPU to run them on.
+ */
+#define AUTHENTICODE_THREAD_MIN_SIZE (8 * 1024 * 1024)
+
+static bool
+use_hash_threads(authenticode_threads_t threads, struct hash_regions *hr)
+{
+	switch (threads) {
+	case AUTHENTICODE_THREADS_NEVER:
+		return false;
+	case AUTHENTICODE_THREADS_ALWAYS:
+		return true;
+	case AUTHENTICODE_THREADS_AUTO:
+	default:
+		break;
+	}
 
-		if (dbp->mdctx == NULL)
+	if (hr->total_size < AUTHENTICODE_THREAD_MIN_SIZE)
+		return false;
+	return sysconf(_SC_NPROCESSORS_ONLN) > 1;
+}
+
+/*
+ * Run each digest over all of the regions on its own thread, with the
+ * calling thread taking the first one.  If a thread can't be started,
+ * its digest is run here instead.
+ */
+static void
+update_all_hashes_threaded(digest_buffer_t **dbufs, struct hash_regions *hr)
+{
+	struct hash_thread hts[8];
+	bool started[8] = { false, };
+	size_t n_threads = 0;
+
+	for (size_t i = 0; dbufs[i] != NULL && n_threads < 8; i++) {
+		if (dbufs[i]->mdctx == NULL)
 			continue;
 
-		EVP_DigestUpdate(dbp->mdctx, data, size);
+		hts[n_threads].dbp = dbufs[i];
+		hts[n_threads].hr = hr;
+		n_threads += 1;
+	}
+
+	for (size_t i = 1; i < n_threads; i++) {
+		int rc = pthread_create(&hts[i].thread, NULL, update_one_hash,
+					&hts[i]);
+		if (rc == 0)
+			started[i] = true;
+		else
+			debug("pthread_create() failed: %s", strerror(rc));
+	}
+
+	for (size_t i = 0; i < n_threads; i++) {
+		if (!started[i])
+			update_one_hash(&hts[i]);
+	}
+
+	for (size_t i = 1; i < n_threads; i++) {
+		if (started[i])
+			pthread_join(hts[i].thread, NULL);
 	}
 }
 
 static int
-generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs)
+generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs,
+			     authenticode_threads_t threads)
 {
+	static const char padbuf[8] = { 0, };
+	struct hash_regions hr = { 0, };
 	char *hashbase;
 	unsigned int hashsize;
 
@@ -136,17 +271,28 @@ generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs)
 
 	pe_image_context_t *ctx = &pe->ctx;
 
+	/*
+	 * 3 header regions, then the sections, then whatever follows them
+	 * and its padding.
+	 */
+	hr.max_regions = ctx->number_of_sections + 6;
+	hr.regions = calloc(hr.max_regions, sizeof(*hr.regions));
+	if (!hr.regions)
+		return -1;
+
 	errno = EINVAL;
 
 	// hash start to checksum
 	hashbase = pe->map;
 	hashsize = (char *)&ctx->pe_header->pe32.optional_header.checksum - hashbase;
-	update_all_hashes(dbufs, hashbase, hashsize);
+	if (add_hash_region(&hr, hashbase, hashsize) < 0)
+		goto err;
 
 	// hash post-checksum to start of cert table
 	hashbase = (char *)&ctx->pe_header->pe32.optional_header.checksum + sizeof (int);
 	hashsize = (char *)ctx->sec_dir - hashbase;
-	update_all_hashes(dbufs, hashbase, hashsize);
+	if (add_hash_region(&hr, hashbase, hashsize) < 0)
+		goto err;
 
 	// hash end of cert table to end of image header
 	efi_image_data_directory_t *dd = ctx->sec_dir + 1;
@@ -156,7 +302,8 @@ generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs)
 		warnx("Data directory is invalid");
 		goto err;
 	}
-	update_all_hashes(dbufs, hashbase, hashsize);
+	if (add_hash_region(&hr, hashbase, hashsize) < 0)
+		goto err;
 
 	// sort sections...
 	sum_of_bytes_hashed = ctx->size_of_headers;
@@ -223,7 +370,8 @@ generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs)
 			goto err;
 		}
 		hashsize = (unsigned int)section->size_of_raw_data;
-		update_all_hashes(dbufs, hashbase, hashsize);
+		if (add_hash_region(&hr, hashbase, hashsize) < 0)
+			goto err;
 
 		sum_of_bytes_hashed += section->size_of_raw_data;
 	}
@@ -233,7 +381,8 @@ generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs)
 		hashbase = pe->map + sum_of_bytes_hashed;
 		hashsize = pe->mapsz - ctx->sec_dir->size - sum_of_bytes_hashed;
 
-		update_all_hashes(dbufs, hashbase, hashsize);
+		if (add_hash_region(&hr, hashbase, hashsize) < 0)
+			goto err;
 
 		sum_of_bytes_hashed += hashsize;
 	}
@@ -249,20 +398,26 @@ generate_authenticode_digest(pe_file_t *pe, digest_buffer_t **dbufs)
 		hashbase = pe->map + sum_of_bytes_hashed;
 		hashsize = pe->mapsz - sum_of_bytes_hashed - ctx->sec_dir->size;
 
-		update_all_hashes(dbufs, hashbase, hashsize);
+		if (add_hash_region(&hr, hashbase, hashsize) < 0)
+			goto err;
 		sum_of_bytes_hashed += hashsize;
 		if (sum_of_bytes_hashed % 8 != 0) {
-			char padbuf[8];
-
-			memset(padbuf, 0, sizeof(padbuf));
 			hashsize = ALIGNMENT_PADDING(sum_of_bytes_hashed, 8);
-			update_all_hashes(dbufs, padbuf, hashsize);
+			if (add_hash_region(&hr, padbuf, hashsize) < 0)
+				goto err;
 		}
 	}
 
+	if (use_hash_threads(threads, &hr))
+		update_all_hashes_threaded(dbufs, &hr);
+	else
+		update_all_hashes(dbufs, &hr);
+
+	free(hr.regions);
 	free(section_header);
 	return 0;
 err:
+	free(hr.regions);
 	if (section_header)
 		free(section_header);
 	return -1;
@@ -283,6 +438,12 @@ generate_authenticode_final(digest_buffer_t **dbufs)
 
 int
 generate_authenticode(pe_file_t *pe)
+{
+	return generate_authenticode_ex(pe, AUTHENTICODE_THREADS_AUTO);
+}
+
+int
+generate_authenticode_ex(pe_file_t *pe, authenticode_threads_t threads)
 {
 	int rc;
 
@@ -323,7 +484,7 @@ generate_authenticode(pe_file_t *pe)
 	if (rc < 0)
 		goto err;
 
-	rc = generate_authenticode_digest(pe, dbufs);
+	rc = generate_authenticode_digest(pe, dbufs, threads);
 	if (rc < 0)
 		goto err;
 
@@ -49,8 +49,22 @@
 /*  --------------------------------------------------------------------  */
 
 #include <stdint.h>
+#include <string.h>
 
-static uint32_t crc32_tab[] = {
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__AARCH64EL__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#include "compiler.h"
+#include "crc32.h"
+
+static const uint32_t crc32_tab[] = {
 	0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
 	0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
 	0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L,
@@ -105,10 +119,14 @@ static uint32_t crc32_tab[] = {
 	0x2d02ef8dL
 };
 
-/* Return a 32-bit CRC of the contents of the buffer. */
+/*
+ * crc32_tab shifted through 1..7 more zero bytes, for slicing-by-8:
+ * crc32_slice_tab[k - 1][b] is the CRC of byte b followed by k zeros.
+ */
+static uint32_t crc32_slice_tab[7][256];
 
-uint32_t
-crc32(const void *buf, unsigned long len, uint32_t seed)
+static uint32_t
+crc32_bytes(const void *buf, unsigned long len, uint32_t seed)
 {
 	unsigned long i;
 	register uint32_t val;
@@ -121,4 +139,233 @@ crc32(const void *buf, unsigned long len, uint32_t seed)
 	return val;
 }
 
+static uint32_t
+crc32_slice8(const void *buf, unsigned long len, uint32_t seed)
+{
+	const unsigned char *s = buf;
+	uint32_t val = seed;
+
+	while (len >= 8) {
+		uint32_t lo = (uint32_t)s[0] | (uint32_t)s[1] << 8 |
+			      (uint32_t)s[2] << 16 | (uint32_t)s[3] << 24;
+		uint32_t hi = (uint32_t)s[4] | (uint32_t)s[5] << 8 |
+			      (uint32_t)s[6] << 16 | (uint32_t)s[7] << 24;
+
+		lo ^= val;
+		val = crc32_slice_tab[6][lo & 0xff] ^
+		      crc32_slice_tab[5][(lo >> 8) & 0xff] ^
+		      crc32_slice_tab[4][(lo >> 16) & 0xff] ^
+		      crc32_slice_tab[3][lo >> 24] ^
+		      crc32_slice_tab[2][hi & 0xff] ^
+		      crc32_slice_tab[1][(hi >> 8) & 0xff] ^
+		      crc32_slice_tab[0][(hi >> 16) & 0xff] ^
+		      crc32_tab[hi >> 24];
+		s += 8;
+		len -= 8;
+	}
+
+	return crc32_bytes(s, len, val);
+}
+
+#if defined(__x86_64__)
+/*
+ * Fold 64 byte blocks with carry-less multiplies, as in Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction", then
+ * fold down to 32 bits and do a Barrett reduction.  The constants are the
+ * bit-reflected x^n mod P(x) values from that paper, as Linux's
+ * crc32-pclmul uses them.  len must be at least 64 and a multiple of 16.
+ */
+static __attribute__((__target__("pclmul,sse4.1"))) uint32_t
+crc32_pclmul_blocks(const unsigned char *s, unsigned long len, uint32_t seed)
+{
+	const __m128i r2r1 = _mm_set_epi64x(0x1c6e41596, 0x154442bd4);
+	const __m128i r4r3 = _mm_set_epi64x(0x0ccaa009e, 0x1751997d0);
+	const __m128i r5 = _mm_set_epi64x(0, 0x163cd6124);
+	const __m128i rupoly = _mm_set_epi64x(0x1f7011641, 0x1db710641);
+	const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+	__m128i x1, x2, x3, x4, t1, t2, t3, t4;
+
+	x1 = _mm_loadu_si128((const __m128i *)(s + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(s + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(s + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(s + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)seed));
+	s += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		t1 = _mm_clmulepi64_si128(x1, r2r1, 0x00);
+		t2 = _mm_clmulepi64_si128(x2, r2r1, 0x00);
+		t3 = _mm_clmulepi64_si128(x3, r2r1, 0x00);
+		t4 = _mm_clmulepi64_si128(x4, r2r1, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, r2r1, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, r2r1, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, r2r1, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, r2r1, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, t1),
+			_mm_loadu_si128((const __m128i *)(s + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, t2),
+			_mm_loadu_si128((const __m128i *)(s + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, t3),
+			_mm_loadu_si128((const __m128i *)(s + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, t4),
+			_mm_loadu_si128((const __m128i *)(s + 0x30)));
+		s += 64;
+		len -= 64;
+	}
+
+	/* Fold the four lanes into one, then any 16 byte blocks left. */
+	t1 = _mm_clmulepi64_si128(x1, r4r3, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, r4r3, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, t1), x2);
+	t1 = _mm_clmulepi64_si128(x1, r4r3, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, r4r3, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, t1), x3);
+	t1 = _mm_clmulepi64_si128(x1, r4r3, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, r4r3, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, t1), x4);
+
+	while (len >= 16) {
+		t1 = _mm_clmulepi64_si128(x1, r4r3, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, r4r3, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, t1),
+			_mm_loadu_si128((const __m128i *)s));
+		s += 16;
+		len -= 16;
+	}
+
+	/* 128 bits to 64 */
+	x2 = _mm_srli_si128(x1, 8);
+	x1 = _mm_clmulepi64_si128(x1, r4r3, 0x10);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* 64 bits to 32 */
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, r5, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction */
+	x2 = x1;
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, rupoly, 0x10);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, rupoly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t
+crc32_pclmul(const void *buf, unsigned long len, uint32_t seed)
+{
+	const unsigned char *s = buf;
+	unsigned long n = len & ~15ul;
+
+	if (len < 64)
+		return crc32_slice8(buf, len, seed);
+
+	seed = crc32_pclmul_blocks(s, n, seed);
+	return crc32_slice8(s + n, len - n, seed);
+}
+
+static int
+crc32_pclmul_supported(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") &&
+	       __builtin_cpu_supports("sse4.1");
+}
+#elif defined(__aarch64__) && defined(__AARCH64EL__)
+static __attribute__((__target__("+crc"))) uint32_t
+crc32_armv8(const void *buf, unsigned long len, uint32_t seed)
+{
+	const unsigned char *s = buf;
+	uint32_t val = seed;
+
+	while (len >= 8) {
+		uint64_t d;
+
+		memcpy(&d, s, sizeof(d));
+		val = __crc32d(val, d);
+		s += 8;
+		len -= 8;
+	}
+	while (len--)
+		val = __crc32b(val, *s++);
+
+	return val;
+}
+
+static int
+crc32_armv8_supported(void)
+{
+	return !!(getauxval(AT_HWCAP) & HWCAP_CRC32);
+}
+#endif
+
+/*
+ * The implementations this machine can run, fastest first.  Until the
+ * constructor has run, crc32() uses the plain table loop.
+ */
+static struct crc32_impl crc32_impl_list[] = {
+#if defined(__x86_64__)
+	{ "pclmul", NULL },
+#elif defined(__aarch64__) && defined(__AARCH64EL__)
+	{ "armv8", NULL },
+#endif
+	{ "slice8", crc32_slice8 },
+	{ "bytes", crc32_bytes },
+};
+static size_t crc32_n_impls =
+	sizeof(crc32_impl_list) / sizeof(crc32_impl_list[0]);
+static crc32_fn_t crc32_fn = crc32_bytes;
+
+static void CONSTRUCTOR
+crc32_init(void)
+{
+	struct crc32_impl *impls = crc32_impl_list;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t val = crc32_tab[i];
+
+		for (unsigned int k = 0; k < 7; k++) {
+			val = crc32_tab[val & 0xff] ^ (val >> 8);
+			crc32_slice_tab[k][i] = val;
+		}
+	}
+
+#if defined(__x86_64__)
+	if (crc32_pclmul_supported())
+		impls[0].crc32 = crc32_pclmul;
+#elif defined(__aarch64__) && defined(__AARCH64EL__)
+	if (crc32_armv8_supported())
+		impls[0].crc32 = crc32_armv8;
+#endif
+	if (!impls[0].crc32) {
+		memmove(&impls[0], &impls[1],
+			sizeof(impls[0]) * (crc32_n_impls - 1));
+		crc32_n_impls -= 1;
+	}
+
+	__atomic_store_n(&crc32_fn, impls[0].crc32, __ATOMIC_RELEASE);
+}
+
+size_t
+crc32_get_impls(const struct crc32_impl **impls)
+{
+	*impls = crc32_impl_list;
+	return crc32_n_impls;
+}
+
+/* Return a 32-bit CRC of the contents of the buffer. */
+
+uint32_t
+crc32(const void *buf, unsigned long len, uint32_t seed)
+{
+	crc32_fn_t fn = __atomic_load_n(&crc32_fn, __ATOMIC_ACQUIRE);
+
+	return fn(buf, len, seed);
+}
+
 // vim:fenc=utf-8:tw=75:noet
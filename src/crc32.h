@@ -5,6 +5,7 @@
  */
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 /*
@@ -14,6 +15,21 @@
 
 extern uint32_t crc32 (const void *buf, unsigned long len, uint32_t seed);
 
+/*
+ * crc32() uses the fastest of these the CPU supports; they all compute
+ * the same thing.  crc32_get_impls() lists the ones this machine can run,
+ * fastest first, so they can be tested and compared against each other.
+ */
+typedef uint32_t (*crc32_fn_t)(const void *buf, unsigned long len,
+			       uint32_t seed);
+
+struct crc32_impl {
+	const char *name;
+	crc32_fn_t crc32;
+};
+
+extern size_t crc32_get_impls(const struct crc32_impl **impls);
+
 /**
  * efi_crc32() - EFI version of crc32 function
  * @buf: buffer to calculate crc32 of
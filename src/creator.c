@@ -12,11 +12,14 @@
 #include <mntent.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
 
 #include "efiboot.h"
 
@@ -153,53 +156,214 @@ tilt_slashes(char *s)
 	return s;
 }
 
-ssize_t
-efi_va_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
-				       const char *devpath, int partition,
-				       const char *relpath,
-				       uint32_t options, va_list ap)
+/*
+ * Everything we learn about one disk while making File() device paths on
+ * it: the probed topology, the block device part of the path, and its
+ * partition table.  efi_generate_file_device_paths() keeps one of these
+ * per disk for every request on that disk; a single call just uses one
+ * for its own request.
+ */
+struct esp_disk {
+	struct device *dev;
+	bool batch;
+
+	int fd;
+	int fd_flags;
+
+	ssize_t blockdev_size;
+	uint8_t *blockdev;
+
+	/*
+	 * The table we read depends on how we're told to treat a bad
+	 * protective MBR and a missing MBR signature, so keep one for each
+	 * combination we're asked for.
+	 */
+	struct partition_table tables[4];
+	bool tables_read[4];
+	int table_errors[4];
+};
+
+#define esp_disk_table_idx(options)					\
+	((((options) & EFIBOOT_OPTIONS_IGNORE_PMBR_ERR) ? 1 : 0) |	\
+	 (((options) & EFIBOOT_OPTIONS_WRITE_SIGNATURE) ? 2 : 0))
+
+static int
+esp_disk_init(struct esp_disk *disk, const char *devpath, int partition,
+	      bool batch)
 {
-	ssize_t ret = -1, off = 0, sz;
-	struct device *dev = NULL;
-	int fd = -1;
+	int fd;
 	int saved_errno;
 
-	debug("partition:%d", partition);
-
-	if (buf && size)
-		memset(buf, '\0', size);
+	memset(disk, 0, sizeof(*disk));
+	disk->fd = -1;
+	disk->blockdev_size = -1;
+	disk->batch = batch;
 
 	fd = open(devpath, O_RDONLY);
 	if (fd < 0) {
 		efi_error("could not open device for ESP");
-		goto err;
+		return -1;
 	}
 
-	dev = device_get(fd, partition);
-	if (dev == NULL) {
+	disk->dev = device_get(fd, partition);
+	saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	if (disk->dev == NULL) {
 		efi_error("could not get ESP disk info");
-		goto err;
+		return -1;
 	}
 
-	if (partition < 0) {
-		int disk_fd;
+	return 0;
+}
+
+static void
+esp_disk_fini(struct esp_disk *disk)
+{
+	int saved_errno = errno;
+
+	for (unsigned int i = 0; i < 4; i++) {
+		if (disk->tables_read[i] && !disk->table_errors[i])
+			free_partition_table(&disk->tables[i]);
+	}
+	if (disk->blockdev)
+		free(disk->blockdev);
+	if (disk->fd >= 0)
+		close(disk->fd);
+	if (disk->dev)
+		device_free(disk->dev);
+	memset(disk, 0, sizeof(*disk));
+	disk->fd = -1;
+	errno = saved_errno;
+}
 
+static int
+esp_disk_open(struct esp_disk *disk, uint32_t options)
+{
+	int flags = (options & EFIBOOT_OPTIONS_WRITE_SIGNATURE)
+		    ? O_RDWR : O_RDONLY;
+
+	if (disk->fd >= 0 && (disk->fd_flags == O_RDWR || flags == O_RDONLY))
+		return disk->fd;
+
+	if (disk->fd >= 0) {
+		close(disk->fd);
+		disk->fd = -1;
+	}
+
+	disk->fd = open_disk(disk->dev, flags);
+	if (disk->fd < 0) {
+		efi_error("could not open disk");
+		return -1;
+	}
+	disk->fd_flags = flags;
+	return disk->fd;
+}
+
+/*
+ * Returns -1 if the disk can't be opened at all.  Otherwise returns 0,
+ * with *ptp pointing at the partition table, or NULL and errno set if the
+ * disk has no table we understand.
+ */
+static int
+esp_disk_get_table(struct esp_disk *disk, uint32_t options,
+		   struct partition_table **ptp)
+{
+	unsigned int i = esp_disk_table_idx(options);
+	int fd;
+	int rc;
+
+	*ptp = NULL;
+	if (!disk->tables_read[i]) {
+		fd = esp_disk_open(disk, options);
+		if (fd < 0)
+			return -1;
+
+		rc = read_partition_table(fd, options, &disk->tables[i]);
+		disk->tables_read[i] = true;
+		disk->table_errors[i] = rc < 0 ? (errno ? errno : EINVAL) : 0;
+	}
+
+	if (disk->table_errors[i]) {
+		errno = disk->table_errors[i];
+		return 0;
+	}
+
+	*ptp = &disk->tables[i];
+	return 0;
+}
+
+static ssize_t
+esp_disk_make_blockdev_path(struct esp_disk *disk, uint8_t *buf,
+			    ssize_t size)
+{
+	ssize_t sz;
+
+	/*
+	 * The probes' part of the path doesn't depend on the partition,
+	 * so in a batch make it once and copy it for every request.
+	 */
+	if (!disk->batch)
+		return make_blockdev_path(buf, size, disk->dev);
+
+	if (disk->blockdev_size < 0) {
+		sz = make_blockdev_path(NULL, 0, disk->dev);
+		if (sz < 0)
+			return sz;
+
+		disk->blockdev = calloc(1, sz ? sz : 1);
+		if (!disk->blockdev) {
+			efi_error("could not allocate %zd bytes", sz);
+			return -1;
+		}
+
+		sz = make_blockdev_path(disk->blockdev, sz, disk->dev);
+		if (sz < 0) {
+			free(disk->blockdev);
+			disk->blockdev = NULL;
+			return sz;
+		}
+		disk->blockdev_size = sz;
+	}
+
+	if (!size)
+		return disk->blockdev_size;
+
+	if (size < disk->blockdev_size) {
+		errno = ENOSPC;
+		efi_error("total size is bigger than size limit");
+		return -1;
+	}
+
+	memcpy(buf, disk->blockdev, disk->blockdev_size);
+	return disk->blockdev_size;
+}
+
+static ssize_t
+esp_disk_make_path(struct esp_disk *disk, uint8_t *buf, ssize_t size,
+		   int partition, const char *relpath, uint32_t options,
+		   uint32_t edd10_devicenum)
+{
+	struct device *dev = disk->dev;
+	struct partition_table *pt = NULL;
+	ssize_t ret = -1, off = 0, sz;
+	int rc;
+
+	debug("partition:%d", partition);
+
+	if (partition < 0) {
 		debug("partition: %d", partition);
-		disk_fd = open_disk(dev,
-				    (options & EFIBOOT_OPTIONS_WRITE_SIGNATURE)
-				     ? O_RDWR : O_RDONLY);
-		if (disk_fd < 0) {
+		rc = esp_disk_get_table(disk, 0, &pt);
+		if (rc < 0) {
 			efi_error("could not open disk");
 			goto err;
 		}
 
-		if (is_partitioned(disk_fd))
+		if (pt)
 			partition = 1;
 		else
 			partition = 0;
 		debug("is_partitioned(): partition -> %d", partition);
-
-		close(disk_fd);
 	}
 
 	set_part(dev, partition);
@@ -221,7 +385,7 @@ efi_va_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
 		debug("EFIBOOT_ABBREV_EDD10");
 
 	if (options & EFIBOOT_ABBREV_EDD10) {
-		dev->edd10_devicenum = va_arg(ap, uint32_t);
+		dev->edd10_devicenum = edd10_devicenum;
 	}
 
 	if (!(options & (EFIBOOT_ABBREV_FILE|EFIBOOT_ABBREV_HD))
@@ -249,7 +413,7 @@ efi_va_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
 		 * symlink from /sys/dev/block/$major:$minor and get it
 		 * from there.
 		 */
-		sz = make_blockdev_path(buf, size, dev);
+		sz = esp_disk_make_blockdev_path(disk, buf, size);
 		if (sz < 0) {
 			efi_error("could not create device path");
 			goto err;
@@ -257,24 +421,22 @@ efi_va_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
 		off += sz;
 	}
 
-	if ((!(options & EFIBOOT_ABBREV_FILE) && dev->part_name) ||
-	    ((options & EFIBOOT_ABBREV_HD) && ! dev->part_name)) {
-		int disk_fd;
-		int saved_errno;
-
-		disk_fd = open_disk(dev,
-				    (options & EFIBOOT_OPTIONS_WRITE_SIGNATURE)
-				     ? O_RDWR : O_RDONLY);
-		if (disk_fd < 0) {
+	if (((!(options & EFIBOOT_ABBREV_FILE) && dev->part_name) ||
+	     ((options & EFIBOOT_ABBREV_HD) && ! dev->part_name)) &&
+	    dev->part > 0) {
+		rc = esp_disk_get_table(disk, options, &pt);
+		if (rc < 0) {
 			efi_error("could not open disk");
 			goto err;
 		}
+		if (!pt) {
+			efi_error("could not get partition info");
+			efi_error("could not make HD() DP node");
+			goto err;
+		}
 
 		sz = make_hd_dn(buf+off, size?size-off:0,
-				disk_fd, dev->part, options);
-		saved_errno = errno;
-		close(disk_fd);
-		errno = saved_errno;
+				pt, dev->part);
 		if (sz < 0) {
 			efi_error("could not make HD() DP node");
 			goto err;
@@ -299,16 +461,35 @@ efi_va_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
 	off += sz;
 	ret = off;
 err:
-	saved_errno = errno;
-	if (dev)
-		device_free(dev);
-	if (fd >= 0)
-		close(fd);
-	errno = saved_errno;
 	debug("= %zd", ret);
 	return ret;
 }
 
+ssize_t
+efi_va_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
+				       const char *devpath, int partition,
+				       const char *relpath,
+				       uint32_t options, va_list ap)
+{
+	struct esp_disk disk;
+	uint32_t edd10_devicenum = 0;
+	ssize_t ret = -1;
+	int rc;
+
+	if (buf && size)
+		memset(buf, '\0', size);
+
+	if (options & EFIBOOT_ABBREV_EDD10)
+		edd10_devicenum = va_arg(ap, uint32_t);
+
+	rc = esp_disk_init(&disk, devpath, partition, false);
+	if (rc >= 0)
+		ret = esp_disk_make_path(&disk, buf, size, partition, relpath,
+					 options, edd10_devicenum);
+	esp_disk_fini(&disk);
+	return ret;
+}
+
 ssize_t NONNULL(3, 5) PUBLIC
 efi_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
 				       const char *devpath, int partition,
@@ -331,6 +512,226 @@ efi_generate_file_device_path_from_esp(uint8_t *buf, ssize_t size,
 	return ret;
 }
 
+/*
+ * Find the whole disk a device (or a file on it) lives on, so requests
+ * for different partitions of the same disk land in the same group.
+ */
+static int
+get_disk_devt(const char *devpath, dev_t *devt)
+{
+	struct stat sb;
+	unsigned int maj, min;
+	char *buf = NULL;
+	int rc;
+
+	rc = stat(devpath, &sb);
+	if (rc < 0) {
+		efi_error("could not stat \"%s\"", devpath);
+		return -1;
+	}
+
+	if (S_ISBLK(sb.st_mode)) {
+		*devt = sb.st_rdev;
+	} else if (S_ISREG(sb.st_mode)) {
+		*devt = sb.st_dev;
+	} else {
+		errno = ENOTBLK;
+		efi_error("device is not a block device or regular file");
+		return -1;
+	}
+
+	/*
+	 * A partition's sysfs directory lives inside its disk's, so if
+	 * this is a partition, the disk is "..".  If we can't tell, the
+	 * device just gets a group of its own.
+	 */
+	rc = sysfs_access(F_OK, "dev/block/%u:%u/partition",
+			  major(*devt), minor(*devt));
+	if (rc < 0)
+		return 0;
+
+	rc = read_sysfs_file(&buf, "dev/block/%u:%u/../dev",
+			     major(*devt), minor(*devt));
+	if (rc < 0 || !buf || sscanf(buf, "%u:%u", &maj, &min) != 2)
+		return 0;
+
+	*devt = makedev(maj, min);
+	return 0;
+}
+
+struct esp_batch_entry {
+	dev_t disk;
+	size_t req;
+};
+
+struct esp_batch {
+	efi_file_dp_request_t *reqs;
+	struct esp_batch_entry *entries;
+	size_t *groups;
+	size_t n_groups;
+	size_t next_group;
+};
+
+static int
+esp_batch_entry_cmp(const void *ap, const void *bp)
+{
+	const struct esp_batch_entry *a = ap, *b = bp;
+
+	if (a->disk != b->disk)
+		return a->disk < b->disk ? -1 : 1;
+	if (a->req != b->req)
+		return a->req < b->req ? -1 : 1;
+	return 0;
+}
+
+static void
+esp_batch_run_group(struct esp_batch *batch, size_t group)
+{
+	size_t first = batch->groups[group];
+	size_t last = batch->groups[group + 1];
+	efi_file_dp_request_t *req = &batch->reqs[batch->entries[first].req];
+	struct esp_disk disk;
+	int rc;
+
+	rc = esp_disk_init(&disk, req->devpath, req->partition, true);
+	for (size_t i = first; i < last; i++) {
+		req = &batch->reqs[batch->entries[i].req];
+		if (rc < 0) {
+			req->ret = -1;
+			req->error = errno;
+			continue;
+		}
+
+		req->ret = esp_disk_make_path(&disk, req->buf, req->size,
+					      req->partition, req->relpath,
+					      req->options,
+					      req->edd10_devicenum);
+		req->error = req->ret < 0 ? errno : 0;
+	}
+	esp_disk_fini(&disk);
+}
+
+static void
+esp_batch_worker(struct esp_batch *batch)
+{
+	size_t group;
+
+	while ((group = __atomic_fetch_add(&batch->next_group, 1,
+					   __ATOMIC_RELAXED)) < batch->n_groups)
+		esp_batch_run_group(batch, group);
+}
+
+/*
+ * Nobody ever reads the efi_error() entries left on the threads we start,
+ * so free them before each one exits.
+ */
+static void *
+esp_batch_thread(void *arg)
+{
+	esp_batch_worker(arg);
+	efi_error_clear();
+	return NULL;
+}
+
+#define ESP_BATCH_MAX_THREADS 8
+
+ssize_t NONNULL(1) PUBLIC
+efi_generate_file_device_paths(efi_file_dp_request_t *reqs, size_t n_reqs,
+			       unsigned int max_threads)
+{
+	struct esp_batch batch = { .reqs = reqs, };
+	pthread_t *threads = NULL;
+	unsigned int n_threads = 0;
+	size_t n_entries = 0;
+	ssize_t failed = 0;
+	int rc;
+
+	if (n_reqs == 0)
+		return 0;
+
+	batch.entries = calloc(n_reqs, sizeof(*batch.entries));
+	batch.groups = calloc(n_reqs + 1, sizeof(*batch.groups));
+	if (!batch.entries || !batch.groups) {
+		efi_error("could not allocate batch for %zd requests", n_reqs);
+		failed = -1;
+		goto err;
+	}
+
+	for (size_t i = 0; i < n_reqs; i++) {
+		efi_file_dp_request_t *req = &reqs[i];
+
+		if (req->buf && req->size)
+			memset(req->buf, '\0', req->size);
+
+		if (!req->devpath || !req->relpath) {
+			req->ret = -1;
+			req->error = EINVAL;
+			continue;
+		}
+
+		rc = get_disk_devt(req->devpath, &batch.entries[n_entries].disk);
+		if (rc < 0) {
+			req->ret = -1;
+			req->error = errno;
+			continue;
+		}
+		batch.entries[n_entries++].req = i;
+	}
+
+	qsort(batch.entries, n_entries, sizeof(*batch.entries),
+	      esp_batch_entry_cmp);
+	for (size_t i = 0; i < n_entries; i++) {
+		if (i == 0 || batch.entries[i].disk != batch.entries[i-1].disk)
+			batch.groups[batch.n_groups++] = i;
+	}
+	batch.groups[batch.n_groups] = n_entries;
+	debug("%zd requests on %zd disks", n_reqs, batch.n_groups);
+
+	if (max_threads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		max_threads = ncpus > 0 ? (unsigned int)ncpus : 1;
+		if (max_threads > ESP_BATCH_MAX_THREADS)
+			max_threads = ESP_BATCH_MAX_THREADS;
+	}
+	if (max_threads > batch.n_groups)
+		max_threads = batch.n_groups;
+
+	/*
+	 * This thread does its share of the work too, so we only start
+	 * max_threads - 1 others.  If we can't start them, the ones we
+	 * have just do more of the disks.
+	 */
+	if (max_threads > 1) {
+		threads = calloc(max_threads - 1, sizeof(*threads));
+		for (n_threads = 0; threads && n_threads < max_threads - 1;
+		     n_threads++) {
+			rc = pthread_create(&threads[n_threads], NULL,
+					    esp_batch_thread, &batch);
+			if (rc != 0) {
+				debug("pthread_create() failed: %s",
+				      strerror(rc));
+				break;
+			}
+		}
+	}
+
+	esp_batch_worker(&batch);
+
+	for (unsigned int i = 0; i < n_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (size_t i = 0; i < n_reqs; i++) {
+		if (reqs[i].ret < 0)
+			failed++;
+	}
+err:
+	free(threads);
+	free(batch.groups);
+	free(batch.entries);
+	return failed;
+}
+
 static int
 get_part(char *devpath)
 {
@@ -75,25 +75,20 @@ msdos_disk_get_extended_partition_info (int fd UNUSED,
 }
 
 /************************************************************
- * msdos_disk_get_partition_info()
+ * msdos_disk_check_signature()
  * Requires:
  *  - mbr
- *  - open file descriptor fd (for extended partitions)
- *  - start, size, signature, mbr_type, signature_type
- * Modifies: all these
+ *  - open file descriptor fd (for writing the signature)
+ * Modifies: mbr, and the disk if write_signature is set
  * Returns:
  *  0 on success
  *  non-zero on failure
  *
  ************************************************************/
 static int
-msdos_disk_get_partition_info (int fd, int write_signature,
-			       legacy_mbr *mbr, uint32_t num, uint64_t *start,
-			       uint64_t *size, uint32_t *signature,
-			       uint8_t *mbr_type, uint8_t *signature_type)
+msdos_disk_check_signature(int fd, int write_signature, legacy_mbr *mbr)
 {
 	int rc;
-	long disk_size=0;
 	struct stat stat;
 	struct timeval tv;
 
@@ -108,9 +103,6 @@ msdos_disk_get_partition_info (int fd, int write_signature,
 		return -1;
 	}
 
-	*mbr_type = 0x01;
-	*signature_type = 0x01;
-
 	if (!mbr->unique_mbr_signature && !write_signature) {
 		efi_error("\n******************************************************\n"
 			  "Warning! This MBR disk does not have a unique signature.\n"
@@ -148,11 +140,42 @@ msdos_disk_get_partition_info (int fd, int write_signature,
 			return rc;
 		}
 	}
+	return 0;
+}
+
+/************************************************************
+ * msdos_disk_get_partition_info()
+ * Requires:
+ *  - mbr, already checked by msdos_disk_check_signature()
+ *  - disk_size, the size of the whole disk in sectors
+ *  - start, size, signature, mbr_type, signature_type
+ * Modifies: all these
+ * Returns:
+ *  0 on success
+ *  non-zero on failure
+ *
+ ************************************************************/
+static int
+msdos_disk_get_partition_info (legacy_mbr *mbr, uint64_t disk_size,
+			       uint32_t num, uint64_t *start,
+			       uint64_t *size, uint32_t *signature,
+			       uint8_t *mbr_type, uint8_t *signature_type)
+{
+	int rc;
+
+	if (!is_mbr_valid(mbr)) {
+		errno = ENOENT;
+		efi_error("mbr is not valid");
+		return -1;
+	}
+
+	*mbr_type = 0x01;
+	*signature_type = 0x01;
 	*signature = mbr->unique_mbr_signature;
 
 	if (num > 4) {
 		/* Extended partition */
-		rc = msdos_disk_get_extended_partition_info(fd, mbr, num,
+		rc = msdos_disk_get_extended_partition_info(-1, mbr, num,
 							    start, size);
 		if (rc < 0) {
 			efi_error("could not get extended partition info");
@@ -161,18 +184,7 @@ msdos_disk_get_partition_info (int fd, int write_signature,
 	} else if (num == 0) {
 		/* Whole disk */
 		*start = 0;
-#if defined(__linux__)
-		ioctl(fd, BLKGETSIZE, &disk_size);
 		*size = disk_size;
-#elif defined(__FreeBSD__)
-		long sector_size=0;
-		ioctl(fd, DIOCGMEDIASIZE, &disk_size);
-		ioctl(fd, DIOCGSECTORSIZE, &sector_size);
-		*size = disk_size / sector_size;
-#else
-		efi_error("could not get disk size (not implemented on your OS)");
-		return -1;
-#endif
 	} else if (num >= 1 && num <= 4) {
 		/* Primary partition */
 		*start = mbr->partition[num-1].starting_lba;
@@ -182,78 +194,122 @@ msdos_disk_get_partition_info (int fd, int write_signature,
 }
 
 static int
-get_partition_info(int fd, uint32_t options,
-		   uint32_t part, uint64_t *start, uint64_t *size,
-		   partition_signature_t *signature, uint8_t *mbr_type,
-		   uint8_t *signature_type)
+get_disk_size(int fd, uint64_t *disk_size)
+{
+	long size = 0;
+
+#if defined(__linux__)
+	ioctl(fd, BLKGETSIZE, &size);
+	*disk_size = size;
+#elif defined(__FreeBSD__)
+	long sector_size=0;
+	ioctl(fd, DIOCGMEDIASIZE, &size);
+	ioctl(fd, DIOCGSECTORSIZE, &sector_size);
+	*disk_size = size / sector_size;
+#else
+	efi_error("could not get disk size (not implemented on your OS)");
+	return -1;
+#endif
+	return 0;
+}
+
+/*
+ * read_partition_table(): read the MBR and, if present, the GPT of the
+ * disk open on fd, so that partition_table_get_info() can answer for any
+ * number of partitions without going back to the disk.
+ */
+int HIDDEN
+read_partition_table(int fd, uint32_t options, struct partition_table *pt)
 {
-	legacy_mbr *mbr;
-	void *mbr_sector;
 	size_t mbr_size;
-	off_t offset UNUSED;
 	int this_bytes_read = 0;
-	int gpt_invalid=0, mbr_invalid=0;
-	int rc=0;
-	int sector_size = get_sector_size(fd);
+	int rc;
 
-	mbr_size = lcm(sizeof(*mbr), sector_size);
-	if ((rc = posix_memalign(&mbr_sector, sector_size, mbr_size)) != 0) {
+	memset(pt, 0, sizeof(*pt));
+	pt->sector_size = get_sector_size(fd);
+
+	mbr_size = lcm(sizeof(*pt->mbr), pt->sector_size);
+	if ((rc = posix_memalign(&pt->mbr_sector, pt->sector_size,
+				 mbr_size)) != 0) {
+		pt->mbr_sector = NULL;
+		errno = rc;
 		efi_error("posix_memalign failed");
-		goto error;
+		return -1;
 	}
-	memset(mbr_sector, '\0', mbr_size);
+	memset(pt->mbr_sector, '\0', mbr_size);
 
-	offset = lseek(fd, 0, SEEK_SET);
-	this_bytes_read = read(fd, mbr_sector, mbr_size);
-	if (this_bytes_read < (ssize_t)sizeof(*mbr)) {
+	lseek(fd, 0, SEEK_SET);
+	this_bytes_read = read(fd, pt->mbr_sector, mbr_size);
+	if (this_bytes_read < (ssize_t)sizeof(*pt->mbr)) {
 		efi_error("short read trying to read mbr data");
-		rc = -1;
-		goto error_free_mbr;
+		goto err;
 	}
-	mbr = (legacy_mbr *)mbr_sector;
-	gpt_invalid = gpt_disk_get_partition_info(
-	    fd, part, start, size, &signature->gpt_signature, mbr_type,
-	    signature_type, (options & EFIBOOT_OPTIONS_IGNORE_PMBR_ERR) ? 1 : 0,
-	    sector_size);
-	if (gpt_invalid < 0) {
-		mbr_invalid = msdos_disk_get_partition_info(
-		    fd, (options & EFIBOOT_OPTIONS_WRITE_SIGNATURE) ? 1 : 0,
-		    mbr, part, start, size, &signature->mbr_signature, mbr_type,
-		    signature_type);
-		if (mbr_invalid < 0) {
+	pt->mbr = (legacy_mbr *)pt->mbr_sector;
+
+	rc = get_disk_size(fd, &pt->disk_size);
+	if (rc < 0)
+		goto err;
+
+	rc = gpt_disk_read_table(fd, &pt->gpt, &pt->ptes,
+		(options & EFIBOOT_OPTIONS_IGNORE_PMBR_ERR) ? 1 : 0,
+		pt->sector_size);
+	if (rc < 0) {
+		rc = msdos_disk_check_signature(fd,
+			(options & EFIBOOT_OPTIONS_WRITE_SIGNATURE) ? 1 : 0,
+			pt->mbr);
+		if (rc < 0) {
 			efi_error("neither MBR nor GPT is valid");
-			rc = -1;
-			goto error_free_mbr;
+			goto err;
 		}
 		efi_error_clear();
 	}
- error_free_mbr:
-	free(mbr_sector);
- error:
-	return rc;
+	return 0;
+err:
+	free_partition_table(pt);
+	return -1;
+}
+
+void HIDDEN
+free_partition_table(struct partition_table *pt)
+{
+	free(pt->ptes);
+	free(pt->gpt);
+	free(pt->mbr_sector);
+	memset(pt, 0, sizeof(*pt));
 }
 
-bool HIDDEN
-is_partitioned(int fd)
+int HIDDEN
+partition_table_get_info(struct partition_table *pt, uint32_t part,
+			 uint64_t *start, uint64_t *size,
+			 partition_signature_t *signature, uint8_t *mbr_type,
+			 uint8_t *signature_type)
 {
 	int rc;
-	uint32_t options = 0;
-	uint32_t part = 1;
-	uint64_t start = 0, size = 0;
-	uint8_t mbr_type = 0, signature_type = 0;
-	partition_signature_t signature;
 
-	memset(&signature, 0, sizeof(signature));
-	rc = get_partition_info(fd, options, part, &start, &size,
-				&signature, &mbr_type, &signature_type);
-	if (rc < 0)
-		return false;
-	return true;
+	if (pt->gpt) {
+		rc = gpt_table_get_partition_info(pt->gpt, pt->ptes, part,
+						  start, size,
+						  &signature->gpt_signature,
+						  mbr_type, signature_type);
+		if (rc >= 0)
+			return rc;
+	}
+
+	rc = msdos_disk_get_partition_info(pt->mbr, pt->disk_size, part,
+					   start, size,
+					   &signature->mbr_signature,
+					   mbr_type, signature_type);
+	if (rc < 0) {
+		efi_error("neither MBR nor GPT is valid");
+		return rc;
+	}
+	efi_error_clear();
+	return 0;
 }
 
 ssize_t HIDDEN
-make_hd_dn(uint8_t *buf, ssize_t size, int fd, int32_t partition,
-	   uint32_t options)
+make_hd_dn(uint8_t *buf, ssize_t size, struct partition_table *pt,
+	   int32_t partition)
 {
 	uint64_t part_start=0, part_size = 0;
 	partition_signature_t signature;
@@ -266,9 +322,9 @@ make_hd_dn(uint8_t *buf, ssize_t size, int fd, int32_t partition,
 		return 0;
 
 	memset(&signature, 0, sizeof(signature));
-	rc = get_partition_info(fd, options, partition, &part_start,
-				&part_size, &signature, &format,
-				&signature_type);
+	rc = partition_table_get_info(pt, partition, &part_start,
+				      &part_size, &signature, &format,
+				      &signature_type);
 	if (rc < 0) {
 		efi_error("could not get partition info");
 		return rc;
@@ -281,4 +337,40 @@ make_hd_dn(uint8_t *buf, ssize_t size, int fd, int32_t partition,
 	return rc;
 }
 
+int NONNULL(1, 2) PUBLIC
+efi_find_gpt_partition(const char *devpath, const efi_guid_t *guid,
+		       uint32_t options, int after)
+{
+	gpt_header *gpt = NULL;
+	gpt_entry *ptes = NULL;
+	int saved_errno;
+	int fd;
+	int rc = -1;
+
+	fd = open(devpath, O_RDONLY);
+	if (fd < 0) {
+		efi_error("could not open \"%s\"", devpath);
+		return -1;
+	}
+
+	rc = gpt_disk_read_table(fd, &gpt, &ptes,
+		(options & EFIBOOT_OPTIONS_IGNORE_PMBR_ERR) ? 1 : 0,
+		get_sector_size(fd));
+	if (rc < 0) {
+		efi_error("could not read GPT from \"%s\"", devpath);
+		goto err;
+	}
+
+	rc = gpt_table_find_partition(gpt, ptes, guid,
+		(options & EFIBOOT_OPTIONS_MATCH_TYPE_GUID) ? true : false,
+		after > 0 ? after : 0);
+err:
+	saved_errno = errno;
+	free(ptes);
+	free(gpt);
+	close(fd);
+	errno = saved_errno;
+	return rc;
+}
+
 // vim:fenc=utf-8:tw=75:noet
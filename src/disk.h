@@ -6,9 +6,31 @@
  */
 #pragma once
 
-extern bool HIDDEN is_partitioned(int fd);
+/*
+ * The partition table of one disk, read once so that HD() nodes for any
+ * number of its partitions can be made without going back to the disk.
+ */
+struct partition_table {
+	int sector_size;
+	uint64_t disk_size;
+	void *mbr_sector;
+	legacy_mbr *mbr;
+	gpt_header *gpt;
+	gpt_entry *ptes;
+};
+
+extern int HIDDEN read_partition_table(int fd, uint32_t options,
+				       struct partition_table *pt);
+extern void HIDDEN free_partition_table(struct partition_table *pt);
+extern int HIDDEN partition_table_get_info(struct partition_table *pt,
+					   uint32_t part, uint64_t *start,
+					   uint64_t *size,
+					   partition_signature_t *signature,
+					   uint8_t *mbr_type,
+					   uint8_t *signature_type);
 
-extern HIDDEN ssize_t make_hd_dn(uint8_t *buf, ssize_t size, int fd,
-				 int32_t partition, uint32_t options);
+extern HIDDEN ssize_t make_hd_dn(uint8_t *buf, ssize_t size,
+				 struct partition_table *pt,
+				 int32_t partition);
 
 // vim:fenc=utf-8:tw=75:noet
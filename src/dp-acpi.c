@@ -13,189 +13,175 @@
 
 #include "efivar.h"
 
-static ssize_t
-_format_acpi_adr(unsigned char *buf, size_t size,
-		 const char *dp_type UNUSED,
-		 const_efidp dp)
+static void
+format_acpi_adr(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
-	format(buf, size, off, "AcpiAdr", "AcpiAdr(");
-	format_array(buf, size, off, "AcpiAdr", "0x%"PRIx32,
+	format(buf, "AcpiAdr(");
+	format_array(buf, "0x%"PRIx32,
 		     __typeof__(dp->acpi_adr.adr[0]), dp->acpi_adr.adr,
 		     (efidp_node_size(dp)-4) / sizeof (dp->acpi_adr.adr[0]));
-	format(buf, size, off, "AcpiAdr", ")");
-	return off;
+	format(buf, ")");
 }
 
-#define format_acpi_adr(buf, size, off, dp)				\
-	format_helper(_format_acpi_adr, buf, size, off, "AcpiAdr", dp)
-
-static ssize_t
-_format_acpi_hid_ex(unsigned char *buf, size_t size,
-		    const char *dp_type UNUSED, const_efidp dp,
-		    const char *hidstr, const char *cidstr,
-		    const char *uidstr)
+static void
+format_acpi_hid_ex(struct dp_buf *buf, const_efidp dp,
+		   const char *hidstr, const char *cidstr,
+		   const char *uidstr)
 {
-	ssize_t off = 0;
-
 	debug("hid:0x%08x hidstr:'%s'", dp->acpi_hid_ex.hid, hidstr);
 	debug("cid:0x%08x cidstr:'%s'", dp->acpi_hid_ex.cid, cidstr);
 	debug("uid:0x%08x uidstr:'%s'", dp->acpi_hid_ex.uid, uidstr);
 
 	if (!hidstr && !cidstr && (uidstr || dp->acpi_hid_ex.uid)) {
-		format(buf, size, off, "AcpiExp",
-		       "AcpiExp(0x%"PRIx32",0x%"PRIx32",",
+		format(buf, "AcpiExp(0x%"PRIx32",0x%"PRIx32",",
 		       dp->acpi_hid_ex.hid, dp->acpi_hid_ex.cid);
 		if (uidstr) {
-			format(buf, size, off, "AcpiExp", "%s)", uidstr);
+			format(buf, "%s)", uidstr);
 		} else {
-			format(buf, size, off, "AcpiExp", "0x%"PRIx32")",
+			format(buf, "0x%"PRIx32")",
 			       dp->acpi_hid_ex.uid);
 		}
-		return off;
+		return;
 	}
 
-	format(buf, size, off, "AcpiEx", "AcpiEx(");
+	format(buf, "AcpiEx(");
 	if (hidstr) {
-		format(buf, size, off, "AcpiEx", "%s,", hidstr);
+		format(buf, "%s,", hidstr);
 	} else {
-		format(buf, size, off, "AcpiEx", "0x%"PRIx32",",
+		format(buf, "0x%"PRIx32",",
 		       dp->acpi_hid_ex.hid);
 	}
 
 	if (cidstr) {
-		format(buf, size, off, "AcpiEx", "%s,", cidstr);
+		format(buf, "%s,", cidstr);
 	} else {
-		format(buf, size, off, "AcpiEx", "0x%"PRIx32",",
+		format(buf, "0x%"PRIx32",",
 		       dp->acpi_hid_ex.cid);
 	}
 
 	if (uidstr) {
-		format(buf, size, off, "AcpiEx", "%s)", uidstr);
+		format(buf, "%s)", uidstr);
 	} else {
-		format(buf, size, off, "AcpiEx", "0x%"PRIx32")",
+		format(buf, "0x%"PRIx32")",
 		       dp->acpi_hid_ex.uid);
 	}
-
-	return off;
 }
 
-#define format_acpi_hid_ex(buf, size, off, dp, hidstr, cidstr, uidstr)  \
-	format_helper(_format_acpi_hid_ex, buf, size, off, "AcpiEx", dp,\
-		      hidstr, cidstr, uidstr)
-
-ssize_t
-_format_acpi_dn(unsigned char *buf, size_t size, const_efidp dp)
+int
+_format_acpi_dn(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
 	const char *hidstr = NULL;
 	size_t hidlen = 0;
 	const char *uidstr = NULL;
 	size_t uidlen = 0;
 	const char *cidstr = NULL;
-	// size_t cidlen = 0;
+	size_t cidlen = 0;
 
 	if (dp->subtype == EFIDP_ACPI_ADR) {
 		debug("formatting ACPI _ADR");
-		format_acpi_adr(buf, size, off, dp);
-		return off;
+		format_acpi_adr(buf, dp);
+		return 0;
 	} else if (dp->subtype != EFIDP_ACPI_HID_EX &&
 		   dp->subtype != EFIDP_ACPI_HID) {
 		ssize_t limit = efidp_node_size(dp);
 
 		debug("DP subtype %d, formatting as ACPI Path", dp->subtype);
 		if (SUB(limit, 4, &limit) ||
-		    DIV(limit, 2, &limit) ||
 		    limit < 0) {
 			efi_error("bad DP node size");
 			return -1;
 		}
-		format(buf, size, off, "AcpiPath", "AcpiPath(%d,", dp->subtype);
-		format_hex(buf, size, off, "AcpiPath", (uint8_t *)dp+4, limit);
-		format(buf, size, off, "AcpiPath", ")");
-		return off;
+		format(buf, "AcpiPath(%d,", dp->subtype);
+		format_hex(buf, (uint8_t *)dp+4, limit);
+		format(buf, ")");
+		return 0;
 	} else if (dp->subtype == EFIDP_ACPI_HID_EX) {
 		ssize_t limit = efidp_node_size(dp)
 				- offsetof(efidp_acpi_hid_ex, hidstr);
 
 		debug("formatting ACPI HID EX");
+		if (limit < 0) {
+			efi_error("bad DP node size");
+			return -1;
+		}
 		hidstr = dp->acpi_hid_ex.hidstr;
 		hidlen = strnlen(hidstr, limit);
 		limit -= hidlen + 1;
 
-		if (limit) {
+		if (limit > 0) {
 			uidstr = hidstr + hidlen + 1;
 			uidlen = strnlen(uidstr, limit);
 			limit -= uidlen + 1;
 		}
 
-		if (limit) {
+		if (limit > 0) {
 			cidstr = uidstr + uidlen + 1;
-			// cidlen = strnlen(cidstr, limit);
-			// limit -= cidlen + 1;
+			cidlen = strnlen(cidstr, limit);
 		}
 
-		if (uidstr) {
-			switch (dp->acpi_hid.hid) {
-			case EFIDP_ACPI_PCI_ROOT_HID:
-				format(buf, size, off, "PciRoot",
-				       "PciRoot(%s)", uidstr);
-				return off;
-			case EFIDP_ACPI_CONTAINER_0A05_HID:
-			case EFIDP_ACPI_CONTAINER_0A06_HID:
-				format(buf, size, off, "AcpiContainer",
-				       "AcpiContainer(%s)", uidstr);
-				break;
-			case EFIDP_ACPI_PCIE_ROOT_HID:
-				format(buf, size, off, "PcieRoot",
-				       "PcieRoot(%s)", uidstr);
-				return off;
-			case EFIDP_ACPI_EC_HID:
-				format(buf, size, off, "EmbeddedController",
-				       "EmbeddedController()");
-				return off;
-			default:
-				format_acpi_hid_ex(buf, size, off, dp,
-						   hidstr, cidstr, uidstr);
-				return off;
-			}
+		/*
+		 * An empty string means the node uses the numeric field
+		 * instead.
+		 */
+		if (!hidlen)
+			hidstr = NULL;
+		if (!uidlen)
+			uidstr = NULL;
+		if (!cidlen)
+			cidstr = NULL;
+
+		if (!uidstr) {
+			format_acpi_hid_ex(buf, dp, hidstr, cidstr, uidstr);
+			return 0;
+		}
+
+		switch (dp->acpi_hid.hid) {
+		case EFIDP_ACPI_PCI_ROOT_HID:
+			format(buf, "PciRoot(%s)", uidstr);
+			return 0;
+		case EFIDP_ACPI_CONTAINER_0A05_HID:
+		case EFIDP_ACPI_CONTAINER_0A06_HID:
+			format(buf, "AcpiContainer(%s)", uidstr);
+			break;
+		case EFIDP_ACPI_PCIE_ROOT_HID:
+			format(buf, "PcieRoot(%s)", uidstr);
+			return 0;
+		case EFIDP_ACPI_EC_HID:
+			format(buf, "EmbeddedController()");
+			return 0;
+		default:
+			format_acpi_hid_ex(buf, dp, hidstr, cidstr, uidstr);
+			return 0;
 		}
 	} else if (dp->subtype == EFIDP_ACPI_HID) {
 		debug("formatting ACPI HID 0x%08x", dp->acpi_hid.hid);
 
 		switch (dp->acpi_hid.hid) {
 		case EFIDP_ACPI_PCI_ROOT_HID:
-			format(buf, size, off, "PciRoot",
-			       "PciRoot(0x%"PRIx32")",
+			format(buf, "PciRoot(0x%"PRIx32")",
 			       dp->acpi_hid.uid);
 			break;
 		case EFIDP_ACPI_CONTAINER_0A05_HID:
 		case EFIDP_ACPI_CONTAINER_0A06_HID:
-			format(buf, size, off, "AcpiContainer",
-			       "AcpiContainer()");
+			format(buf, "AcpiContainer()");
 			break;
 		case EFIDP_ACPI_PCIE_ROOT_HID:
-			format(buf, size, off, "PcieRoot",
-			       "PcieRoot(0x%"PRIx32")",
+			format(buf, "PcieRoot(0x%"PRIx32")",
 			       dp->acpi_hid.uid);
 			break;
 		case EFIDP_ACPI_EC_HID:
-			format(buf, size, off, "EmbeddedController",
-			       "EmbeddedController()");
+			format(buf, "EmbeddedController()");
 			break;
 		case EFIDP_ACPI_FLOPPY_HID:
-			format(buf, size, off, "Floppy",
-			       "Floppy(0x%"PRIx32")",
+			format(buf, "Floppy(0x%"PRIx32")",
 			       dp->acpi_hid.uid);
 			break;
 		case EFIDP_ACPI_KEYBOARD_HID:
-			format(buf, size, off, "Keyboard",
-			       "Keyboard(0x%"PRIx32")",
+			format(buf, "Keyboard(0x%"PRIx32")",
 			       dp->acpi_hid.uid);
 			break;
 		case EFIDP_ACPI_SERIAL_HID:
-			format(buf, size, off, "Serial",
-			       "Serial(0x%"PRIx32")",
+			format(buf, "Serial(0x%"PRIx32")",
 			       dp->acpi_hid.uid);
 			break;
 		case EFIDP_ACPI_NVDIMM_HID: {
@@ -204,7 +190,7 @@ _format_acpi_dn(unsigned char *buf, size_t size, const_efidp dp)
 			efidp_acpi_adr *adrdp;
 			int end;
 
-			format(buf, size, off, "NvRoot()", "NvRoot()");
+			format(buf, "NvRoot()");
 
 			rc = efidp_next_node(dp, &next);
 			if (rc < 0 || !next) {
@@ -234,10 +220,9 @@ _format_acpi_dn(unsigned char *buf, size_t size, const_efidp dp)
 					&dimm);
 
 				if (i != 0)
-					format(buf, size, off, "NvDimm", ",");
+					format(buf, ",");
 
-				format(buf, size, off, "NvDimm",
-				       "NvDimm(0x%03x,0x%01x,0x%01x,0x%01x,0x%01x)",
+				format(buf, "NvDimm(0x%03x,0x%01x,0x%01x,0x%01x,0x%01x)",
 				       node_controller, socket, memory_controller,
 				       memory_channel, dimm);
 			}
@@ -247,13 +232,12 @@ _format_acpi_dn(unsigned char *buf, size_t size, const_efidp dp)
 			debug("Decoding non-well-known HID");
 			switch (dp->subtype) {
 			case EFIDP_ACPI_HID_EX:
-				format_acpi_hid_ex(buf, size, off, dp,
+				format_acpi_hid_ex(buf, dp,
 						   hidstr, cidstr, uidstr);
 				break;
 			case EFIDP_ACPI_HID:
 				debug("Decoding ACPI HID");
-				format(buf, size, off, "Acpi",
-				       "Acpi(0x%08x,0x%"PRIx32")",
+				format(buf, "Acpi(0x%08x,0x%"PRIx32")",
 				       dp->acpi_hid.hid, dp->acpi_hid.uid);
 				break;
 			default:
@@ -268,7 +252,7 @@ _format_acpi_dn(unsigned char *buf, size_t size, const_efidp dp)
 		      dp->type, dp->subtype);
 	}
 
-	return off;
+	return 0;
 }
 
 ssize_t PUBLIC
@@ -11,51 +11,44 @@
 
 #include "efivar.h"
 
-ssize_t
-format_edd10_guid(unsigned char *buf, size_t size,
-		  const char *dp_type, const_efidp dp)
+static void
+format_edd10_guid(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
 	efidp_edd10 const *edd_dp = (efidp_edd10 *)dp;
-	format(buf, size, off, dp_type, "EDD10(0x%"PRIx32")",
-		    edd_dp->hardware_device);
-	return off;
+	format(buf, "EDD10(0x%"PRIx32")", edd_dp->hardware_device);
 }
 
-ssize_t
-_format_hw_dn(unsigned char *buf, size_t size, const_efidp dp)
+int
+_format_hw_dn(struct dp_buf *buf, const_efidp dp)
 {
 	efi_guid_t edd10_guid = EDD10_HARDWARE_VENDOR_PATH_GUID;
-	ssize_t off = 0;
 	switch (dp->subtype) {
 	case EFIDP_HW_PCI:
-		format(buf, size, off, "Pci", "Pci(0x%"PRIx32",0x%"PRIx32")",
+		format(buf, "Pci(0x%"PRIx32",0x%"PRIx32")",
 		       dp->pci.device, dp->pci.function);
 		break;
 	case EFIDP_HW_PCCARD:
-		format(buf, size, off, "PcCard", "PcCard(0x%"PRIx32")",
+		format(buf, "PcCard(0x%"PRIx32")",
 		       dp->pccard.function);
 		break;
 	case EFIDP_HW_MMIO:
-		format(buf, size, off, "MemoryMapped",
-		       "MemoryMapped(%"PRIu32",0x%"PRIx64",0x%"PRIx64")",
+		format(buf, "MemoryMapped(%"PRIu32",0x%"PRIx64",0x%"PRIx64")",
 		       dp->mmio.memory_type, dp->mmio.starting_address,
 		       dp->mmio.ending_address);
 		break;
 	case EFIDP_HW_VENDOR:
 		if (!efi_guid_cmp(&dp->hw_vendor.vendor_guid, &edd10_guid)) {
-			format_helper(format_edd10_guid, buf, size, off,
-				      "EDD 1.0", dp);
+			format_edd10_guid(buf, dp);
 		} else {
-			format_vendor(buf, size, off, "VenHw", dp);
+			format_vendor(buf, "VenHw", dp);
 		}
 		break;
 	case EFIDP_HW_CONTROLLER:
-		format(buf, size, off, "Ctrl", "Ctrl(0x%"PRIx32")",
+		format(buf, "Ctrl(0x%"PRIx32")",
 		       dp->controller.controller);
 		break;
 	case EFIDP_HW_BMC:
-		format(buf, size, off, "BMC", "BMC(%d,0x%"PRIx64")",
+		format(buf, "BMC(%d,0x%"PRIx64")",
 		       dp->bmc.interface_type, dp->bmc.base_addr);
 		break;
 	default: {
@@ -66,14 +59,13 @@ _format_hw_dn(unsigned char *buf, size_t size, const_efidp dp)
 			efi_error("bad DP node size");
 			return -1;
 		}
-		format(buf, size, off, "Hardware",
-		       "HardwarePath(%d,", dp->subtype);
-		format_hex(buf, size, off, "Hardware", (uint8_t *)dp+4, sz);
-		format(buf, size, off, "Hardware", ")");
+		format(buf, "HardwarePath(%d,", dp->subtype);
+		format_hex(buf, (uint8_t *)dp+4, sz);
+		format(buf, ")");
 		break;
 		 }
 	}
-	return off;
+	return 0;
 }
 
 ssize_t PUBLIC
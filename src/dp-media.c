@@ -13,17 +13,15 @@
 
 #include "efivar.h"
 
-ssize_t
-_format_media_dn(unsigned char *buf, size_t size, const_efidp dp)
+int
+_format_media_dn(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
 	switch (dp->subtype) {
 	case EFIDP_MEDIA_HD:
-		format(buf, size, off, "HD", "HD(%d,", dp->hd.partition_number);
+		format(buf, "HD(%"PRIu32",", dp->hd.partition_number);
 		switch (dp->hd.signature_type) {
 		case EFIDP_HD_SIGNATURE_MBR:
-			format(buf, size, off, "HD",
-			       "MBR,0x%"PRIx32",0x%"PRIx64",0x%"PRIx64")",
+			format(buf, "MBR,0x%"PRIx32",0x%"PRIx64",0x%"PRIx64")",
 			       (uint32_t)dp->hd.signature[0] |
 			       ((uint32_t)dp->hd.signature[1] << 8) |
 			       ((uint32_t)dp->hd.signature[2] << 16) |
@@ -31,65 +29,58 @@ _format_media_dn(unsigned char *buf, size_t size, const_efidp dp)
 			       dp->hd.start, dp->hd.size);
 			break;
 		case EFIDP_HD_SIGNATURE_GUID:
-			format(buf, size, off, "HD", "GPT,");
-			format_guid(buf, size, off, "HD", dp->hd.signature);
-			format(buf, size, off, "HD",
-			       ",0x%"PRIx64",0x%"PRIx64")",
+			format(buf, "GPT,");
+			format_guid(buf, dp->hd.signature);
+			format(buf, ",0x%"PRIx64",0x%"PRIx64")",
 			       dp->hd.start, dp->hd.size);
 			break;
 		default:
-			format(buf, size, off, "HD", "%d,",
+			format(buf, "%d,",
 			       dp->hd.signature_type);
-			format_hex(buf, size, off, "HD", dp->hd.signature,
+			format_hex(buf, dp->hd.signature,
 				   sizeof(dp->hd.signature));
-			format(buf, size, off, "HD",
-			       ",0x%"PRIx64",0x%"PRIx64")",
+			format(buf, ",0x%"PRIx64",0x%"PRIx64")",
 			       dp->hd.start, dp->hd.size);
 			break;
 		}
 		break;
 	case EFIDP_MEDIA_CDROM:
-		format(buf, size, off, "CDROM",
-		       "CDROM(%d,0x%"PRIx64",0x%"PRIx64")",
+		format(buf, "CDROM(%"PRIu32",0x%"PRIx64",0x%"PRIx64")",
 		       dp->cdrom.boot_catalog_entry,
 		       dp->cdrom.partition_rba, dp->cdrom.sectors);
 		break;
 	case EFIDP_MEDIA_VENDOR:
-		format_vendor(buf, size, off, "VenMedia", dp);
+		format_vendor(buf, "VenMedia", dp);
 		break;
 	case EFIDP_MEDIA_FILE: {
 		ssize_t limit = efidp_node_size(dp);
-		size_t offset = offsetof(efidp_usb_wwid, serial_number);
+		size_t offset = offsetof(efidp_file, name);
 		if (limit < 0 ||
 		    SUB(limit,  offset, &limit) ||
 		    DIV(limit, 2, &limit)) {
 			efi_error("bad DP node size");
 			return -1;
 		}
-		format_ucs2(buf, size, off, "File", dp->file.name, limit);
+		format_ucs2(buf, dp->file.name, limit);
 		break;
 			       }
 	case EFIDP_MEDIA_PROTOCOL:
-		format(buf, size, off, "Media", "Media(");
-		format_guid(buf, size, off, "Media",
-			    &dp->protocol.protocol_guid);
-		format(buf, size, off, "Media", ")");
+		format(buf, "Media(");
+		format_guid(buf, &dp->protocol.protocol_guid);
+		format(buf, ")");
 		break;
 	case EFIDP_MEDIA_FIRMWARE_FILE:
-		format(buf, size, off, "FvFile", "FvFile(");
-		format_guid(buf, size, off, "FvFile",
-			    &dp->protocol.protocol_guid);
-		format(buf, size, off, "FvFile", ")");
+		format(buf, "FvFile(");
+		format_guid(buf, &dp->protocol.protocol_guid);
+		format(buf, ")");
 		break;
 	case EFIDP_MEDIA_FIRMWARE_VOLUME:
-		format(buf, size, off, "FvVol", "FvVol(");
-		format_guid(buf, size, off, "FvVol",
-			    &dp->protocol.protocol_guid);
-		format(buf, size, off, "FvVol", ")");
+		format(buf, "FvVol(");
+		format_guid(buf, &dp->protocol.protocol_guid);
+		format(buf, ")");
 		break;
 	case EFIDP_MEDIA_RELATIVE_OFFSET:
-		format(buf, size, off, "Offset",
-		       "Offset(0x%"PRIx64",0x%"PRIx64")",
+		format(buf, "Offset(0x%"PRIx64",0x%"PRIx64")",
 		       dp->relative_offset.first_byte,
 		       dp->relative_offset.last_byte);
 		break;
@@ -116,37 +107,33 @@ _format_media_dn(unsigned char *buf, size_t size, const_efidp dp)
 		}
 
 		if (label) {
-			format(buf, size, off, label,
-			       "%s(0x%"PRIx64",0x%"PRIx64",%d)", label,
+			format(buf, "%s(0x%"PRIx64",0x%"PRIx64",%d)", label,
 			       dp->ramdisk.start_addr,
 			       dp->ramdisk.end_addr,
 			       dp->ramdisk.instance_number);
 			break;
 		}
-		format(buf, size, off, "Ramdisk",
-		       "Ramdisk(0x%"PRIx64",0x%"PRIx64",%d,",
+		format(buf, "Ramdisk(0x%"PRIx64",0x%"PRIx64",%d,",
 		       dp->ramdisk.start_addr, dp->ramdisk.end_addr,
 		       dp->ramdisk.instance_number);
-		format_guid(buf, size, off, "Ramdisk",
-			    &dp->ramdisk.disk_type_guid);
-		format(buf, size, off, "Ramdisk", ")");
+		format_guid(buf, &dp->ramdisk.disk_type_guid);
+		format(buf, ")");
 		break;
 					   }
 	default: {
 		ssize_t limit = efidp_node_size(dp);
 		if (limit < 0 ||
-		    SUB(limit,  4, &limit) ||
-		    DIV(limit, 2, &limit)) {
+		    SUB(limit,  4, &limit)) {
 			efi_error("bad DP node size");
 			return -1;
 		}
-		format(buf, size, off, "Media", "MediaPath(%d,", dp->subtype);
-		format_hex(buf, size, off, "Media", (uint8_t *)dp+4, limit);
-		format(buf,size,off, "Media",")");
+		format(buf, "MediaPath(%d,", dp->subtype);
+		format_hex(buf, (uint8_t *)dp+4, limit);
+		format(buf, ")");
 		break;
 		 }
 	}
-	return off;
+	return 0;
 }
 
 ssize_t PUBLIC
@@ -13,26 +13,21 @@
 
 #include "efivar.h"
 
-static ssize_t
-format_ipv4_addr_helper(unsigned char *buf, size_t size, const char *dp_type,
-			const uint8_t *ipaddr, int32_t port)
+static void
+format_ipv4_addr(struct dp_buf *buf, const uint8_t *ipaddr, int32_t port)
 {
-	ssize_t off = 0;
-	format(buf, size, off, dp_type, "%hhu.%hhu.%hhu.%hhu",
+	format(buf, "%hhu.%hhu.%hhu.%hhu",
 	       ipaddr[0], ipaddr[1], ipaddr[2], ipaddr[3]);
 	if (port > 0)
-		format(buf, size, off, dp_type, ":%hu", (uint16_t)port);
-	return off;
+		format(buf, ":%hu", (uint16_t)port);
 }
 
-static ssize_t
-format_ipv6_addr_helper(unsigned char *buf, size_t size, const char *dp_type,
-			const uint8_t *ipaddr, int32_t port)
+static void
+format_ipv6_addr(struct dp_buf *buf, const uint8_t *ipaddr, int32_t port)
 {
 	uint16_t *ip = (uint16_t *)ipaddr;
-	ssize_t off = 0;
 
-	format(buf, size, off, dp_type, "[");
+	format(buf, "[");
 
 	// deciding how to print an ipv6 ip requires 2 passes, because
 	// RFC5952 says we have to use :: a) only once and b) to maximum effect.
@@ -83,91 +78,62 @@ format_ipv6_addr_helper(unsigned char *buf, size_t size, const char *dp_type,
 
 	for (i = 0; i < 8; i++) {
 		if (largest_zero_block_offset == i) {
-			format(buf, size, off, dp_type, "::");
+			format(buf, "::");
 			i += largest_zero_block_size -1;
 			continue;
 		} else if (i > 0) {
-			format(buf, size, off, dp_type, ":");
+			format(buf, ":");
 		}
 
-		format(buf, size, off, dp_type, "%x", ip[i]);
+		format(buf, "%x", ip[i]);
 	}
 
-	format(buf, size, off, dp_type, "]");
+	format(buf, "]");
 	if (port > 0)
-		format(buf, size, off, dp_type, ":%hu", (uint16_t)port);
-
-	return off;
+		format(buf, ":%hu", (uint16_t)port);
 }
 
-#define format_ip_protocol(buf, size, off, dp_type, proto)	\
+#define format_ip_protocol(buf, proto)				\
 ({								\
 	switch(proto) {						\
 	case 6:							\
-		format(buf, size, off, dp_type, "TCP");		\
+		format(buf, "TCP");				\
 		break;						\
 	case 17:						\
-		format(buf, size, off, dp_type, "UDP");		\
+		format(buf, "UDP");				\
 		break;						\
 	default:						\
-		format(buf, size, off, dp_type, "%u", proto);	\
+		format(buf, "%u", proto);			\
 		break;						\
 	}							\
 })
 
-#define format_ipv4_addr(buf, size, off, addr, port)		\
-	format_helper(format_ipv4_addr_helper, buf, size, off,	\
-		      "IPv4", addr, port)
-
-#define format_ipv6_addr(buf, size, off, addr, port)		\
-	format_helper(format_ipv6_addr_helper, buf, size, off,	\
-		      "IPv6", addr, port)
-
-static ssize_t
-format_ip_addr_helper(unsigned char *buf, size_t size,
-		      const char *dp_type UNUSED,
-		      int is_ipv6, const efi_ip_addr_t *addr)
+static void
+format_ip_addr(struct dp_buf *buf, int is_ipv6, const efi_ip_addr_t *addr)
 {
-	ssize_t off = 0;
 	if (is_ipv6)
-		format_helper(format_ipv6_addr_helper, buf, size, off, "IPv6",
-			      (const uint8_t *)&addr->v6, -1);
+		format_ipv6_addr(buf, (const uint8_t *)&addr->v6, -1);
 	else
-		format_helper(format_ipv4_addr_helper, buf, size, off, "IPv4",
-			      (const uint8_t *)&addr->v4, -1);
-	return off;
+		format_ipv4_addr(buf, (const uint8_t *)&addr->v4, -1);
 }
 
-#define format_ip_addr(buf, size, off, dp_type, is_ipv6, addr)		\
-	format_helper(format_ip_addr_helper, buf, size, off,		\
-		      dp_type, is_ipv6, addr)
-
-static ssize_t
-format_uart(unsigned char *buf, size_t size,
-	    const char *dp_type UNUSED,
-	    const_efidp dp)
+static void
+format_uart(struct dp_buf *buf, const_efidp dp)
 {
 	uint32_t value;
-	ssize_t off = 0;
 	char *labels[] = {"None", "Hardware", "XonXoff", ""};
 
 	value = dp->uart_flow_control.flow_control_map;
 	if (value > 2) {
-		format(buf, size, off, "UartFlowControl",
-			    "UartFlowControl(%d)", value);
-		return off;
+		format(buf, "UartFlowControl(%"PRIu32")", value);
+		return;
 	}
-	format(buf, size, off, "UartFlowControl", "UartFlowControl(%s)",
-	       labels[value]);
-	return off;
+	format(buf, "UartFlowControl(%s)", labels[value]);
 }
 
-static ssize_t
-format_sas(unsigned char *buf, size_t size,
-	   const char *dp_type UNUSED,
-	   const_efidp dp)
+static void
+format_sas(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
 	const efidp_sas * const s = &dp->sas;
 
 	int more_info = 0;
@@ -201,7 +167,7 @@ format_sas(unsigned char *buf, size_t size,
 			drive_bay = s->drive_bay_id + 1;
 	}
 
-	format(buf, size, off, "SAS", "SAS(%"PRIx64",%"PRIx64",%"PRIx16",%s",
+	format(buf, "SAS(%"PRIx64",%"PRIx64",%"PRIx16",%s",
 	       dp->subtype == EFIDP_MSG_SAS_EX ?
 			be64_to_cpu(s->sas_address) :
 			le64_to_cpu(s->sas_address),
@@ -211,89 +177,81 @@ format_sas(unsigned char *buf, size_t size,
 		s->rtp, sassata_label[sassata]);
 
 	if (more_info) {
-		format(buf, size, off, "SAS", ",%s,%s",
+		format(buf, ",%s,%s",
 		       location_label[location], connect_label[connect]);
 	}
 
 	if (more_info == 2 && drive_bay >= 0) {
-		format(buf, size, off, "SAS", ",%d", drive_bay);
+		format(buf, ",%d", drive_bay);
 	}
 
-	format(buf, size, off, "SAS", ")");
-	return off;
+	format(buf, ")");
 }
 
-#define class_helper(buf, size, off, label, dp)			\
-	format(buf, size, off, label,				\
-	       "%s(0x%"PRIx16",0x%"PRIx16",%d,%d)",		\
+#define class_helper(buf, label, dp)				\
+	format(buf, "%s(0x%"PRIx16",0x%"PRIx16",%d,%d)",	\
 	       label,						\
 	       dp->usb_class.vendor_id,				\
 	       dp->usb_class.product_id,			\
 	       dp->usb_class.device_subclass,			\
 	       dp->usb_class.device_protocol)
 
-static ssize_t
-format_usb_class(unsigned char *buf, size_t size,
-		 const char *dp_type UNUSED,
-		 const_efidp dp)
+static void
+format_usb_class(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
 	switch (dp->usb_class.device_class) {
 	case EFIDP_USB_CLASS_AUDIO:
-		class_helper(buf, size, off, "UsbAudio", dp);
+		class_helper(buf, "UsbAudio", dp);
 		break;
 	case EFIDP_USB_CLASS_CDC_CONTROL:
-		class_helper(buf, size, off, "UsbCDCControl", dp);
+		class_helper(buf, "UsbCDCControl", dp);
 		break;
 	case EFIDP_USB_CLASS_HID:
-		class_helper(buf, size, off, "UsbHID", dp);
+		class_helper(buf, "UsbHID", dp);
 		break;
 	case EFIDP_USB_CLASS_IMAGE:
-		class_helper(buf, size, off, "UsbImage", dp);
+		class_helper(buf, "UsbImage", dp);
 		break;
 	case EFIDP_USB_CLASS_PRINTER:
-		class_helper(buf, size, off, "UsbPrinter", dp);
+		class_helper(buf, "UsbPrinter", dp);
 		break;
 	case EFIDP_USB_CLASS_MASS_STORAGE:
-		class_helper(buf, size, off, "UsbMassStorage", dp);
+		class_helper(buf, "UsbMassStorage", dp);
 		break;
 	case EFIDP_USB_CLASS_HUB:
-		class_helper(buf, size, off, "UsbHub", dp);
+		class_helper(buf, "UsbHub", dp);
 		break;
 	case EFIDP_USB_CLASS_CDC_DATA:
-		class_helper(buf, size, off, "UsbCDCData", dp);
+		class_helper(buf, "UsbCDCData", dp);
 		break;
 	case EFIDP_USB_CLASS_SMARTCARD:
-		class_helper(buf, size, off, "UsbSmartCard", dp);
+		class_helper(buf, "UsbSmartCard", dp);
 		break;
 	case EFIDP_USB_CLASS_VIDEO:
-		class_helper(buf, size, off, "UsbVideo", dp);
+		class_helper(buf, "UsbVideo", dp);
 		break;
 	case EFIDP_USB_CLASS_DIAGNOSTIC:
-		class_helper(buf, size, off, "UsbDiagnostic", dp);
+		class_helper(buf, "UsbDiagnostic", dp);
 		break;
 	case EFIDP_USB_CLASS_WIRELESS:
-		class_helper(buf, size, off, "UsbWireless", dp);
+		class_helper(buf, "UsbWireless", dp);
 		break;
 	case EFIDP_USB_CLASS_254:
 		switch (dp->usb_class.device_subclass) {
 		case EFIDP_USB_SUBCLASS_FW_UPDATE:
-			format(buf, size, off, "UsbDeviceFirmwareUpdate",
-			  "UsbDeviceFirmwareUpdate(0x%"PRIx16",0x%"PRIx16",%d)",
+			format(buf, "UsbDeviceFirmwareUpdate(0x%"PRIx16",0x%"PRIx16",%d)",
 			  dp->usb_class.vendor_id,
 			  dp->usb_class.product_id,
 			  dp->usb_class.device_protocol);
 			break;
 		case EFIDP_USB_SUBCLASS_IRDA_BRIDGE:
-			format(buf, size, off, "UsbIrdaBridge",
-			       "UsbIrdaBridge(0x%"PRIx16",0x%"PRIx16",%d)",
+			format(buf, "UsbIrdaBridge(0x%"PRIx16",0x%"PRIx16",%d)",
 			       dp->usb_class.vendor_id,
 			       dp->usb_class.product_id,
 			       dp->usb_class.device_protocol);
 			break;
 		case EFIDP_USB_SUBCLASS_TEST_AND_MEASURE:
-			format(buf, size, off, "UsbTestAndMeasurement",
-			  "UsbTestAndMeasurement(0x%"PRIx16",0x%"PRIx16",%d)",
+			format(buf, "UsbTestAndMeasurement(0x%"PRIx16",0x%"PRIx16",%d)",
 			  dp->usb_class.vendor_id,
 			  dp->usb_class.product_id,
 			  dp->usb_class.device_protocol);
@@ -301,55 +259,51 @@ format_usb_class(unsigned char *buf, size_t size,
 		}
 		break;
 	default:
-		format(buf, size, off, "UsbClass",
-		       "UsbClass(%"PRIx16",%"PRIx16",%d,%d)",
+		format(buf, "UsbClass(%"PRIx16",%"PRIx16",%d,%d)",
 		       dp->usb_class.vendor_id,
 		       dp->usb_class.product_id,
 		       dp->usb_class.device_subclass,
 		       dp->usb_class.device_protocol);
 		break;
 	}
-	return off;
 }
 
-ssize_t
-_format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
+int
+_format_message_dn(struct dp_buf *buf, const_efidp dp)
 {
-	ssize_t off = 0;
 	switch (dp->subtype) {
 	case EFIDP_MSG_ATAPI:
-		format(buf, size, off, "Ata", "Ata(%d,%d,%d)",
+		format(buf, "Ata(%d,%d,%d)",
 			      dp->atapi.primary, dp->atapi.slave,
 			      dp->atapi.lun);
 		break;
 	case EFIDP_MSG_SCSI:
-		format(buf, size, off, "SCSI", "SCSI(%d,%d)",
+		format(buf, "SCSI(%d,%d)",
 			      dp->scsi.target, dp->scsi.lun);
 		break;
 	case EFIDP_MSG_FIBRECHANNEL:
-		format(buf, size, off, "Fibre", "Fibre(%"PRIx64",%"PRIx64")",
+		format(buf, "Fibre(%"PRIx64",%"PRIx64")",
 			      le64_to_cpu(dp->fc.wwn),
 			      le64_to_cpu(dp->fc.lun));
 		break;
 	case EFIDP_MSG_FIBRECHANNELEX:
-		format(buf, size, off, "Fibre", "Fibre(%"PRIx64",%"PRIx64")",
+		format(buf, "Fibre(%"PRIx64",%"PRIx64")",
 			      be64_to_cpu(dp->fc.wwn),
 			      be64_to_cpu(dp->fc.lun));
 		break;
 	case EFIDP_MSG_1394:
-		format(buf, size, off, "I1394", "I1394(0x%"PRIx64")",
+		format(buf, "I1394(0x%"PRIx64")",
 			      dp->firewire.guid);
 		break;
 	case EFIDP_MSG_USB:
-		format(buf, size, off, "USB", "USB(%d,%d)",
+		format(buf, "USB(%d,%d)",
 			      dp->usb.parent_port, dp->usb.interface);
 		break;
 	case EFIDP_MSG_I2O:
-		format(buf, size, off, "I2O", "I2O(%d)", dp->i2o.target);
+		format(buf, "I2O(%d)", dp->i2o.target);
 		break;
 	case EFIDP_MSG_INFINIBAND:
-		format(buf, size, off, "Infiniband",
-		       "Infiniband(%08x,%"PRIx64"%"PRIx64",%"PRIx64",%"PRIu64",%"PRIu64")",
+		format(buf, "Infiniband(%08x,%"PRIx64"%"PRIx64",%"PRIx64",%"PRIu64",%"PRIu64")",
 		       dp->infiniband.resource_flags,
 		       dp->infiniband.port_gid[1],
 		       dp->infiniband.port_gid[0],
@@ -358,37 +312,33 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 		       dp->infiniband.device_id);
 		break;
 	case EFIDP_MSG_MAC_ADDR:
-		format(buf, size, off, "MAC", "MAC(");
-		format_hex(buf, size, off, "MAC", dp->mac_addr.mac_addr,
+		format(buf, "MAC(");
+		format_hex(buf, dp->mac_addr.mac_addr,
 				  dp->mac_addr.if_type < 2 ? 6
 					: sizeof(dp->mac_addr.mac_addr));
-		format(buf, size, off, "MAC", ",%d)", dp->mac_addr.if_type);
+		format(buf, ",%d)", dp->mac_addr.if_type);
 		break;
 	case EFIDP_MSG_IPv4: {
 		efidp_ipv4_addr const *a = &dp->ipv4_addr;
-		format(buf, size, off, "IPv4", "IPv4(");
-		format_ipv4_addr(buf, size, off,
-				 a->remote_ipv4_addr, a->remote_port);
-		format(buf, size, off, "IPv4", ",");
-		format_ip_protocol(buf, size, off, "IPv4", a->protocol);
-		format(buf, size, off, "IPv4", ",%s,", a->static_ip_addr
+		format(buf, "IPv4(");
+		format_ipv4_addr(buf, a->remote_ipv4_addr, a->remote_port);
+		format(buf, ",");
+		format_ip_protocol(buf, a->protocol);
+		format(buf, ",%s,", a->static_ip_addr
 						      ?"Static" :"DHCP");
-		format_ipv4_addr(buf, size, off,
-				 a->local_ipv4_addr, a->local_port);
-		format(buf, size, off, "IPv4", ",");
-		format_ipv4_addr(buf, size, off, a->gateway, 0);
-		format(buf, size, off, "IPv4", ",");
-		format_ipv4_addr(buf, size, off, a->netmask, 0);
-		format(buf, size, off, "IPv4", ")");
+		format_ipv4_addr(buf, a->local_ipv4_addr, a->local_port);
+		format(buf, ",");
+		format_ipv4_addr(buf, a->gateway, 0);
+		format(buf, ",");
+		format_ipv4_addr(buf, a->netmask, 0);
+		format(buf, ")");
 		break;
 			     }
 	case EFIDP_MSG_VENDOR: {
 		struct {
 			efi_guid_t guid;
 			char label[40];
-			ssize_t (*formatter)(unsigned char *buf, size_t size,
-				const char *dp_type UNUSED,
-				const_efidp dp);
+			void (*formatter)(struct dp_buf *buf, const_efidp dp);
 		} subtypes[] = {
 			{ .guid = EFIDP_PC_ANSI_GUID,
 			  .label = "VenPcAnsi" },
@@ -410,9 +360,7 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 			  .label = "" }
 		};
 		char *label = NULL;
-		ssize_t (*formatter)(unsigned char *buf, size_t size,
-			const char *dp_type UNUSED,
-			const_efidp dp) = NULL;
+		void (*formatter)(struct dp_buf *buf, const_efidp dp) = NULL;
 
 		for (int i = 0; !efi_guid_is_zero(&subtypes[i].guid); i++) {
 			if (efi_guid_cmp(&subtypes[i].guid,
@@ -426,58 +374,54 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 		}
 
 		if (!label && !formatter) {
-			format_vendor(buf, size, off, "VenMsg", dp);
+			format_vendor(buf, "VenMsg", dp);
 			break;
 		} else if (!label && formatter) {
-			format_helper(formatter, buf, size, off, "VenMsg", dp);
+			formatter(buf, dp);
 			break;
 		}
 
-		format(buf, size, off, label, "%s(", label);
+		format(buf, "%s(", label);
 		if (efidp_node_size(dp) >
 				(ssize_t)(sizeof (efidp_header)
 					  + sizeof (efi_guid_t))) {
-			format_hex(buf, size, off, label,
-					  dp->msg_vendor.vendor_data,
+			format_hex(buf, dp->msg_vendor.vendor_data,
 					  efidp_node_size(dp)
 						- sizeof (efidp_header)
 						- sizeof (efi_guid_t));
 		}
-		format(buf, size, off, label, ")");
+		format(buf, ")");
 		break;
 			       }
 	case EFIDP_MSG_IPv6: {
 		efidp_ipv6_addr const *a = &dp->ipv6_addr;
 
-		format(buf, size, off, "IPv6", "IPv6(");
-		format_ipv6_addr(buf, size, off, a->remote_ipv6_addr,
+		format(buf, "IPv6(");
+		format_ipv6_addr(buf, a->remote_ipv6_addr,
 				 a->remote_port);
-		format(buf, size, off, "IPv6",",");
-		format_ip_protocol(buf, size, off, "IPv6", a->protocol);
-		format(buf, size, off, "IPv6",",");
+		format(buf, ",");
+		format_ip_protocol(buf, a->protocol);
+		format(buf, ",");
 		switch (a->ip_addr_origin) {
 		case EFIDP_IPv6_ORIGIN_STATIC:
-			format(buf, size, off, "IPv6", "Static,");
+			format(buf, "Static,");
 			break;
 		case EFIDP_IPv6_ORIGIN_AUTOCONF:
-			format(buf, size, off, "IPv6",
-			       "StatelessAutoConfigure,");
+			format(buf, "StatelessAutoConfigure,");
 			break;
 		case EFIDP_IPv6_ORIGIN_STATEFUL:
-			format(buf, size, off, "IPv6",
-			       "StatefulAutoConfigure,");
+			format(buf, "StatefulAutoConfigure,");
 			break;
 		default:
-			format(buf, size, off, "IPv6",
-			       "0x%hx,", a->ip_addr_origin);
+			format(buf, "0x%hx,", a->ip_addr_origin);
 			break;
 		}
 
-		format_ipv6_addr(buf, size, off, a->local_ipv6_addr,
+		format_ipv6_addr(buf, a->local_ipv6_addr,
 				 a->local_port);
-		format(buf, size, off, "IPv6",",");
-		format_ipv6_addr(buf, size, off, a->gateway_ipv6_addr, 0);
-		format(buf, size, off, "IPv6",",%u)", a->prefix_length);
+		format(buf, ",");
+		format_ipv6_addr(buf, a->gateway_ipv6_addr, 0);
+		format(buf, ",%u)", a->prefix_length);
 
 		break;
 			     }
@@ -487,21 +431,20 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 		int stop_bits = dp->uart.stop_bits;
 		char *sb_label[] = {"D", "1", "1.5", "2"};
 
-		format(buf, size, off, "Uart", "Uart(%"PRIu64",%d,",
+		format(buf, "Uart(%"PRIu64",%d,",
 			    dp->uart.baud_rate ? dp->uart.baud_rate : 115200,
 			    dp->uart.data_bits ? dp->uart.data_bits : 8);
-		format(buf, size, off, "Uart",
-			    parity > 5 ? "%d," : "%c,",
+		format(buf, parity > 5 ? "%d," : "%c,",
 			    parity > 5 ? parity : parity_label[parity]);
 		if (stop_bits > 3)
-			format(buf, size, off, "Uart", "%d)", stop_bits);
+			format(buf, "%d)", stop_bits);
 		else
-			format(buf, size, off, "Uart", "%s)",
+			format(buf, "%s)",
 			       sb_label[stop_bits]);
 		break;
 			     }
 	case EFIDP_MSG_USB_CLASS:
-		format_helper(format_usb_class, buf, size, off, "UsbClass", dp);
+		format_usb_class(buf, dp);
 		break;
 	case EFIDP_MSG_USB_WWID: {
 		ssize_t limit = efidp_node_size(dp);
@@ -512,20 +455,18 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 			efi_error("bad DP node size");
 			return -1;
 		}
-		format(buf, size, off, "UsbWwid",
-			    "UsbWwid(%"PRIx16",%"PRIx16",%d,",
+		format(buf, "UsbWwid(%"PRIx16",%"PRIx16",%d,",
 			    dp->usb_wwid.vendor_id, dp->usb_wwid.product_id,
 			    dp->usb_wwid.interface);
-		format_ucs2(buf, size, off, "UsbWwid",
-			    dp->usb_wwid.serial_number, limit);
-		format(buf, size, off, "UsbWwid", ")");
+		format_ucs2(buf, dp->usb_wwid.serial_number, limit);
+		format(buf, ")");
 		break;
 				 }
 	case EFIDP_MSG_LUN:
-		format(buf, size, off, "Unit", "Unit(%d)", dp->lun.lun);
+		format(buf, "Unit(%d)", dp->lun.lun);
 		break;
 	case EFIDP_MSG_SATA:
-		format(buf, size, off, "Sata", "Sata(%d,%d,%d)",
+		format(buf, "Sata(%d,%d,%d)",
 			    dp->sata.hba_port, dp->sata.port_multiplier_port,
 			    dp->sata.lun);
 		break;
@@ -547,8 +488,7 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 
 		memcpy(&lun, dp->iscsi.lun, sizeof (lun));
 
-		format(buf, size, off, "iSCSI",
-			      "iSCSI(%s,%d,0x%"PRIx64",%s,%s,%s,%s)",
+		format(buf, "iSCSI(%s,%d,0x%"PRIx64",%s,%s,%s,%s)",
 			      target_name, dp->iscsi.tpgt,
 			      be64_to_cpu(lun),
 			      (dp->iscsi.options >> EFIDP_ISCSI_HEADER_DIGEST_SHIFT) & EFIDP_ISCSI_HEADER_CRC32 ? "CRC32" : "None",
@@ -559,13 +499,13 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 		break;
 			      }
 	case EFIDP_MSG_VLAN:
-		format(buf, size, off, "Vlan", "Vlan(%d)", dp->vlan.vlan_id);
+		format(buf, "Vlan(%d)", dp->vlan.vlan_id);
 		break;
 	case EFIDP_MSG_SAS_EX:
-		format_sas(buf, size, NULL, dp);
+		format_sas(buf, dp);
 		break;
 	case EFIDP_MSG_NVME:
-		format(buf, size, off, "NVMe", "NVMe(0x%"PRIx32","
+		format(buf, "NVMe(0x%"PRIx32","
 			   "%02X-%02X-%02X-%02X-%02X-%02X-%02X-%02X)",
 			   dp->nvme.namespace_id, dp->nvme.ieee_eui_64[0],
 			   dp->nvme.ieee_eui_64[1], dp->nvme.ieee_eui_64[2],
@@ -583,36 +523,36 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 		char uri[sz + 1];
 		memcpy(uri, dp->uri.uri, sz);
 		uri[sz] = '\0';
-		format(buf, size, off, "Uri", "Uri(%s)", uri);
+		format(buf, "Uri(%s)", uri);
 		break;
 			    }
 	case EFIDP_MSG_UFS:
-		format(buf, size, off, "UFS", "UFS(%d,0x%02x)",
+		format(buf, "UFS(%d,0x%02x)",
 			    dp->ufs.target_id, dp->ufs.lun);
 		break;
 	case EFIDP_MSG_SD:
-		format(buf, size, off, "SD", "SD(%d)", dp->sd.slot_number);
+		format(buf, "SD(%d)", dp->sd.slot_number);
 		break;
 	case EFIDP_MSG_BT:
-		format(buf, size, off, "Bluetooth", "Bluetooth(");
-		format_hex_separated(buf, size, off, "Bluetooth", ":", 1,
+		format(buf, "Bluetooth(");
+		format_hex_separated(buf, ":", 1,
 				     dp->bt.addr, sizeof(dp->bt.addr));
-		format(buf, size, off, "Bluetooth", ")");
+		format(buf, ")");
 		break;
 	case EFIDP_MSG_WIFI:
-		format(buf, size, off, "Wi-Fi", "Wi-Fi(");
-		format_hex_separated(buf, size, off, "Wi-Fi", ":", 1,
+		format(buf, "Wi-Fi(");
+		format_hex_separated(buf, ":", 1,
 				     dp->wifi.ssid, sizeof(dp->wifi.ssid));
-		format(buf, size, off, "Wi-Fi", ")");
+		format(buf, ")");
 		break;
 	case EFIDP_MSG_EMMC:
-		format(buf, size, off, "eMMC", "eMMC(%d)", dp->emmc.slot);
+		format(buf, "eMMC(%d)", dp->emmc.slot);
 		break;
 	case EFIDP_MSG_BTLE:
-		format(buf, size, off, "BluetoothLE", "BluetoothLE(");
-		format_hex_separated(buf, size, off, "BluetoothLE", ":", 1,
+		format(buf, "BluetoothLE(");
+		format_hex_separated(buf, ":", 1,
 				     dp->btle.addr, sizeof(dp->btle.addr));
-		format(buf, size, off, "BluetoothLE", ",%d)",
+		format(buf, ",%d)",
 		       dp->btle.addr_type);
 		break;
 	case EFIDP_MSG_DNS: {
@@ -620,23 +560,22 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 			   - sizeof(dp->dns.header)
 			   - sizeof(dp->dns.is_ipv6)
 			  ) / sizeof(efi_ip_addr_t);
-		format(buf, size, off, "Dns", "Dns(");
+		format(buf, "Dns(");
 		for (int i=0; i < end; i++) {
 			efi_ip_addr_t addr;
 
 			memcpy(&addr, &dp->dns.addrs[i], sizeof(addr));
 			if (i != 0)
-				format(buf, size, off, "Dns", ",");
-			format_ip_addr(buf, size, off, "Dns",
-				       dp->dns.is_ipv6, &addr);
+				format(buf, ",");
+			format_ip_addr(buf, dp->dns.is_ipv6, &addr);
 		}
-		format(buf, size, off, "Dns", ")");
+		format(buf, ")");
 		break;
 	}
 	case EFIDP_MSG_NVDIMM:
-		format(buf, size, off, "NVDIMM", "NVDIMM(");
-		format_guid(buf, size, off, "NVDIMM", &dp->nvdimm.uuid);
-		format(buf, size, off, "NVDIMM", ")");
+		format(buf, "NVDIMM(");
+		format_guid(buf, &dp->nvdimm.uuid);
+		format(buf, ")");
 		break;
 	default: {
 		ssize_t limit = efidp_node_size(dp);
@@ -645,13 +584,13 @@ _format_message_dn(unsigned char *buf, size_t size, const_efidp dp)
 			efi_error("bad DP node size");
 			return -1;
 		}
-		format(buf, size, off, "Msg", "Msg(%d,", dp->subtype);
-		format_hex(buf, size, off, "Msg", (uint8_t *)dp+4, limit);
-		format(buf, size, off, "Msg", ")");
+		format(buf, "Msg(%d,", dp->subtype);
+		format_hex(buf, (uint8_t *)dp+4, limit);
+		format(buf, ")");
 		break;
 		 }
 	}
-	return off;
+	return 0;
 }
 
 ssize_t PUBLIC
@@ -0,0 +1,1499 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * dp-parse.c - parse the text form of device paths without sysfs
+ */
+
+#include "fix_coverity.h" // IWYU pragma: keep
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "efivar.h"
+
+/*
+ * Parsing the text form of device paths, as efidp_format_device_path()
+ * writes it.
+ *
+ * The text is read in one forward pass.  A node's name is looked up in
+ * dp_node_types[], and its parser reads the arguments it expects straight
+ * off the text and then writes the node to the output buffer.  Fixed size
+ * nodes are assembled in the parser's node and copied out; variable
+ * length data, such as hex strings and file names, is measured while it
+ * is read, and decoded directly into the output once the node header is
+ * in place.  As with the efidp_make_*() functions, a size of 0 means only
+ * to compute how much space the result needs.
+ */
+struct dp_parser {
+	const char *text;
+	const char *pos;
+	const char *name;
+	size_t namelen;
+	efidp_data node;
+};
+
+struct dp_node_type {
+	const char *name;
+	uint8_t type;
+	uint8_t subtype;
+	uint32_t arg;
+	const efi_guid_t *guid;
+	ssize_t (*parse)(struct dp_parser *p, const struct dp_node_type *nt,
+			 uint8_t *out, ssize_t size);
+};
+
+static int
+parse_error(struct dp_parser *p, const char *expected)
+{
+	errno = EINVAL;
+	efi_error("%.*s: expected %s at offset %td of \"%s\"",
+		  (int)p->namelen, p->name, expected, p->pos - p->text,
+		  p->text);
+	return -1;
+}
+
+static int
+expect(struct dp_parser *p, char c)
+{
+	char what[] = "'?'";
+
+	if (*p->pos != c) {
+		what[1] = c;
+		return parse_error(p, what);
+	}
+	p->pos++;
+	return 0;
+}
+
+#define need(p, c) ({							\
+		if (expect(p, c) < 0)					\
+			return -1;					\
+	})
+
+/*
+ * Read an unsigned number no bigger than max.  With base 0, a 0x prefix
+ * means hex and anything else is decimal; with base 16, the prefix is
+ * optional.
+ */
+static int
+parse_uint(struct dp_parser *p, unsigned int base, uint64_t max,
+	   uint64_t *val)
+{
+	const char *s = p->pos;
+	const char *digits;
+	uint64_t v = 0;
+
+	if (base != 10 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		base = 16;
+		s += 2;
+	} else if (base == 0) {
+		base = 10;
+	}
+
+	for (digits = s; ; s++) {
+		unsigned int d;
+
+		if (base == 16) {
+			d = guid_hex_values[(uint8_t)*s];
+			if (!d)
+				break;
+			d &= 0xf;
+		} else if (*s >= '0' && *s <= '9') {
+			d = *s - '0';
+		} else {
+			break;
+		}
+
+		if (d > max || v > (max - d) / base)
+			return parse_error(p, "a smaller number");
+		v = v * base + d;
+	}
+	if (s == digits)
+		return parse_error(p, "a number");
+
+	p->pos = s;
+	*val = v;
+	return 0;
+}
+
+/*
+ * Parse a number into field, which is what bounds it.  Device path node
+ * fields are all unsigned.
+ */
+#define parse_field(p, base, field) ({					\
+		uint64_t _v;						\
+		if (parse_uint(p, base,					\
+			       (uint64_t)(__typeof__(field))-1, &_v) < 0) \
+			return -1;					\
+		(field) = _v;						\
+	})
+
+/*
+ * The length of the argument at the cursor.
+ */
+static size_t
+arg_len(struct dp_parser *p)
+{
+	return strcspn(p->pos, ",)");
+}
+
+static bool
+arg_is_number(struct dp_parser *p)
+{
+	const char *s = p->pos;
+	const char *end = s + arg_len(p);
+
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X') && end > s + 2) {
+		for (s += 2; s < end; s++)
+			if (!guid_hex_values[(uint8_t)*s])
+				return false;
+		return true;
+	}
+	if (s == end)
+		return false;
+	for (; s < end; s++)
+		if (*s < '0' || *s > '9')
+			return false;
+	return true;
+}
+
+/*
+ * If the argument at the cursor is one of words, consume it and return
+ * its index; otherwise return -1 and leave the cursor alone.
+ */
+static int
+parse_keyword(struct dp_parser *p, const char * const *words, int n)
+{
+	size_t len = arg_len(p);
+
+	for (int i = 0; i < n; i++) {
+		if (words[i] && strlen(words[i]) == len &&
+		    !memcmp(p->pos, words[i], len)) {
+			p->pos += len;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Consume a run of hex digit pairs, with sep between the bytes if it is
+ * not NUL, and return how many bytes it holds.  hex_decode() turns the
+ * same text into bytes.
+ */
+static size_t
+hex_span(struct dp_parser *p, char sep)
+{
+	const uint8_t *s = (const uint8_t *)p->pos;
+	size_t n = 0;
+
+	while (guid_hex_values[s[0]] && guid_hex_values[s[1]]) {
+		s += 2;
+		n++;
+		if (!sep)
+			continue;
+		if (s[0] != sep || !guid_hex_values[s[1]])
+			break;
+		s++;
+	}
+	p->pos = (const char *)s;
+	return n;
+}
+
+static void
+hex_decode(const char *text, uint8_t *out, size_t n, char sep)
+{
+	const uint8_t *s = (const uint8_t *)text;
+
+	for (size_t i = 0; i < n; i++) {
+		out[i] = (uint8_t)((guid_hex_values[s[0]] & 0xf) << 4 |
+				   (guid_hex_values[s[1]] & 0xf));
+		s += sep ? 3 : 2;
+	}
+}
+
+static int
+parse_hex_bytes(struct dp_parser *p, uint8_t *out, size_t n, char sep)
+{
+	const char *text = p->pos;
+
+	if (hex_span(p, sep) != n) {
+		p->pos = text;
+		return parse_error(p, "hex bytes");
+	}
+	hex_decode(text, out, n, sep);
+	return 0;
+}
+
+static int
+parse_guid(struct dp_parser *p, efi_guid_t *guid)
+{
+	if (guid_from_text(p->pos, guid) < 0)
+		return parse_error(p, "a GUID");
+	p->pos += GUID_STR_LENGTH;
+	return 0;
+}
+
+/*
+ * Count the characters in len bytes of UTF-8, or return -1 if they
+ * aren't valid or don't fit in UCS-2.
+ */
+static ssize_t
+utf8_chars(const char *text, size_t len)
+{
+	const uint8_t *s = (const uint8_t *)text;
+	ssize_t n = 0;
+	size_t i = 0;
+
+	while (i < len) {
+		size_t width;
+
+		if (s[i] < 0x80)
+			width = 1;
+		else if ((s[i] & 0xe0) == 0xc0 && s[i] >= 0xc2)
+			width = 2;
+		else if ((s[i] & 0xf0) == 0xe0)
+			width = 3;
+		else
+			return -1;
+
+		if (width > len - i)
+			return -1;
+		for (size_t j = 1; j < width; j++)
+			if ((s[i + j] & 0xc0) != 0x80)
+				return -1;
+		i += width;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Write len bytes of UTF-8, which utf8_chars() has checked, to out as
+ * little endian UCS-2, followed by a NUL.
+ */
+static void
+utf8_to_ucs2_le(const char *text, size_t len, uint8_t *out)
+{
+	const uint8_t *s = (const uint8_t *)text;
+	const uint8_t *end = s + len;
+
+	while (s < end) {
+		uint16_t c;
+
+		if (s[0] < 0x80) {
+			c = s[0];
+			s += 1;
+		} else if (s[0] < 0xe0) {
+			c = (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+			s += 2;
+		} else {
+			c = (s[0] & 0x0f) << 12 | (s[1] & 0x3f) << 6 |
+			    (s[2] & 0x3f);
+			s += 3;
+		}
+		*out++ = c & 0xff;
+		*out++ = c >> 8;
+	}
+	out[0] = out[1] = 0;
+}
+
+/*
+ * Lay out a node of len bytes, with a zeroed body, if there's room for
+ * it.  This returns the node size the way efidp_make_generic() does, and
+ * the caller fills in the body only when size is nonzero.
+ */
+static ssize_t
+new_node(struct dp_parser *p, uint8_t *out, ssize_t size, uint8_t type,
+	 uint8_t subtype, size_t len)
+{
+	ssize_t sz;
+
+	if (len > UINT16_MAX) {
+		errno = EINVAL;
+		efi_error("%.*s() node is too long", (int)p->namelen, p->name);
+		return -1;
+	}
+
+	sz = efidp_make_generic(out, size, type, subtype, len);
+	if (sz < 0) {
+		efi_error("efidp_make_generic failed");
+		return -1;
+	}
+	if (size)
+		memset(out + sizeof(efidp_header), 0,
+		       len - sizeof(efidp_header));
+	return sz;
+}
+
+/*
+ * Write out the fixed size node the parser has assembled in p->node.
+ */
+static ssize_t
+emit_node(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size, size_t len)
+{
+	ssize_t sz;
+
+	sz = new_node(p, out, size, nt->type, nt->subtype, len);
+	if (sz > 0 && size)
+		memcpy(out + sizeof(efidp_header),
+		       (uint8_t *)&p->node + sizeof(efidp_header),
+		       len - sizeof(efidp_header));
+	return sz;
+}
+
+/*
+ * Path(type,subtype,hex), and HardwarePath(), AcpiPath(), Msg(),
+ * MediaPath(), and BbsPath(), which take the type from their name.
+ */
+static ssize_t
+parse_raw(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	uint8_t type = nt->type;
+	uint8_t subtype;
+	const char *data;
+	size_t n;
+	ssize_t sz;
+
+	if (!type) {
+		parse_field(p, 0, type);
+		if (type == EFIDP_END_TYPE) {
+			errno = EINVAL;
+			efi_error("Path() can not be used for end nodes");
+			return -1;
+		}
+		need(p, ',');
+	}
+	parse_field(p, 0, subtype);
+	need(p, ',');
+	data = p->pos;
+	n = hex_span(p, 0);
+	need(p, ')');
+
+	sz = new_node(p, out, size, type, subtype, sizeof(efidp_header) + n);
+	if (sz > 0 && size)
+		hex_decode(data, out + sizeof(efidp_header), n, 0);
+	return sz;
+}
+
+/*
+ * VenHw(), VenMsg(), and VenMedia(), and the messaging vendor nodes the
+ * formatter names after their GUID, which only list the data.
+ */
+static ssize_t
+parse_vendor(struct dp_parser *p, const struct dp_node_type *nt,
+	     uint8_t *out, ssize_t size)
+{
+	efi_guid_t guid;
+	const char *data;
+	size_t n = 0;
+	ssize_t sz;
+
+	if (nt->guid) {
+		guid = *nt->guid;
+		data = p->pos;
+		n = hex_span(p, 0);
+	} else {
+		if (parse_guid(p, &guid) < 0)
+			return -1;
+		if (*p->pos == ',')
+			p->pos++;
+		data = p->pos;
+		n = hex_span(p, 0);
+	}
+	need(p, ')');
+
+	sz = new_node(p, out, size, nt->type, nt->subtype,
+		      sizeof(efidp_hw_vendor) + n);
+	if (sz > 0 && size) {
+		efidp_hw_vendor *vendor = (efidp_hw_vendor *)out;
+
+		memcpy(&vendor->vendor_guid, &guid, sizeof(guid));
+		hex_decode(data, out + sizeof(efidp_hw_vendor), n, 0);
+	}
+	return sz;
+}
+
+/* Pci(device,function) */
+static ssize_t
+parse_pci(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	parse_field(p, 0, p->node.pci.device);
+	need(p, ',');
+	parse_field(p, 0, p->node.pci.function);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.pci));
+}
+
+/* PcCard(function) */
+static ssize_t
+parse_pccard(struct dp_parser *p, const struct dp_node_type *nt,
+	     uint8_t *out, ssize_t size)
+{
+	parse_field(p, 0, p->node.pccard.function);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.pccard));
+}
+
+/* MemoryMapped(type,start,end) */
+static ssize_t
+parse_mmio(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.mmio.memory_type);
+	need(p, ',');
+	parse_field(p, 0, p->node.mmio.starting_address);
+	need(p, ',');
+	parse_field(p, 0, p->node.mmio.ending_address);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.mmio));
+}
+
+/* EDD10(device) */
+static ssize_t
+parse_edd10(struct dp_parser *p, const struct dp_node_type *nt,
+	    uint8_t *out, ssize_t size)
+{
+	efidp_edd10 *edd10 = (efidp_edd10 *)&p->node;
+
+	edd10->vendor_guid = *nt->guid;
+	parse_field(p, 0, edd10->hardware_device);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(*edd10));
+}
+
+/* Ctrl(controller) */
+static ssize_t
+parse_controller(struct dp_parser *p, const struct dp_node_type *nt,
+		 uint8_t *out, ssize_t size)
+{
+	parse_field(p, 0, p->node.controller.controller);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.controller));
+}
+
+/* BMC(type,address) */
+static ssize_t
+parse_bmc(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	parse_field(p, 0, p->node.bmc.interface_type);
+	need(p, ',');
+	parse_field(p, 0, p->node.bmc.base_addr);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.bmc));
+}
+
+/*
+ * An ACPI _HID/_UID/_CID node with strings, which are given as text and
+ * length, and may be empty.
+ */
+static ssize_t
+write_acpi_hid_ex(struct dp_parser *p, uint8_t *out, ssize_t size,
+		  uint32_t hid, uint32_t uid, uint32_t cid,
+		  const char *strs[3], const size_t lens[3])
+{
+	size_t len = offsetof(efidp_acpi_hid_ex, hidstr) + 3;
+	ssize_t sz;
+
+	len += lens[0] + lens[1] + lens[2];
+	sz = new_node(p, out, size, EFIDP_ACPI_TYPE, EFIDP_ACPI_HID_EX, len);
+	if (sz > 0 && size) {
+		efidp_acpi_hid_ex *acpi = (efidp_acpi_hid_ex *)out;
+		char *next = (char *)out + offsetof(efidp_acpi_hid_ex, hidstr);
+
+		acpi->hid = hid;
+		acpi->uid = uid;
+		acpi->cid = cid;
+		for (int i = 0; i < 3; i++) {
+			memcpy(next, strs[i], lens[i]);
+			next += lens[i] + 1;
+		}
+	}
+	return sz;
+}
+
+/*
+ * PciRoot(uid), PcieRoot(uid), Floppy(uid), Keyboard(uid), Serial(uid),
+ * AcpiContainer(), and EmbeddedController().  A numeric or missing _UID
+ * makes an ACPI HID node, and a string one an ACPI HID EX node.
+ */
+static ssize_t
+parse_acpi_hid(struct dp_parser *p, const struct dp_node_type *nt,
+	       uint8_t *out, ssize_t size)
+{
+	const char *strs[3] = { "", p->pos, "" };
+	size_t lens[3] = { 0, arg_len(p), 0 };
+
+	if (!lens[1] || arg_is_number(p)) {
+		p->node.acpi_hid.hid = nt->arg;
+		if (lens[1])
+			parse_field(p, 0, p->node.acpi_hid.uid);
+		need(p, ')');
+		return emit_node(p, nt, out, size, sizeof(p->node.acpi_hid));
+	}
+
+	p->pos += lens[1];
+	need(p, ')');
+	return write_acpi_hid_ex(p, out, size, nt->arg, 0, 0, strs, lens);
+}
+
+/* Acpi(hid,uid) */
+static ssize_t
+parse_acpi(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.acpi_hid.hid);
+	need(p, ',');
+	parse_field(p, 0, p->node.acpi_hid.uid);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.acpi_hid));
+}
+
+/*
+ * AcpiEx(hid,cid,uid) and AcpiExp(hid,cid,uid), where each one is either
+ * a number or a string.
+ */
+static ssize_t
+parse_acpi_ex(struct dp_parser *p,
+	      const struct dp_node_type *nt UNUSED,
+	      uint8_t *out, ssize_t size)
+{
+	/* in the order the node stores them: hid, uid, cid */
+	static const int order[3] = { 0, 2, 1 };
+	const char *strs[3] = { "", "", "" };
+	size_t lens[3] = { 0, 0, 0 };
+	uint32_t ids[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 3; i++) {
+		int field = order[i];
+
+		if (i)
+			need(p, ',');
+		if (arg_is_number(p)) {
+			parse_field(p, 0, ids[field]);
+		} else {
+			strs[field] = p->pos;
+			lens[field] = arg_len(p);
+			p->pos += lens[field];
+		}
+	}
+	need(p, ')');
+	return write_acpi_hid_ex(p, out, size, ids[0], ids[1], ids[2],
+				 strs, lens);
+}
+
+/* AcpiAdr(adr[,adr...]) */
+static ssize_t
+parse_acpi_adr(struct dp_parser *p, const struct dp_node_type *nt,
+	       uint8_t *out, ssize_t size)
+{
+	const char *start = p->pos;
+	const char *end;
+	uint64_t adr;
+	size_t n = 0;
+	ssize_t sz;
+
+	do {
+		if (parse_uint(p, 0, UINT32_MAX, &adr) < 0)
+			return -1;
+		n++;
+	} while (*p->pos == ',' && p->pos++);
+	need(p, ')');
+
+	sz = new_node(p, out, size, nt->type, nt->subtype,
+		      sizeof(efidp_header) + n * sizeof(uint32_t));
+	if (sz <= 0 || !size)
+		return sz;
+
+	end = p->pos;
+	p->pos = start;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t adr32;
+
+		parse_uint(p, 0, UINT32_MAX, &adr);
+		adr32 = adr;
+		memcpy(out + sizeof(efidp_header) + i * sizeof(adr32), &adr32,
+		       sizeof(adr32));
+		p->pos++;
+	}
+	p->pos = end;
+	return sz;
+}
+
+/* Ata(primary,slave,lun) */
+static ssize_t
+parse_atapi(struct dp_parser *p, const struct dp_node_type *nt,
+	    uint8_t *out, ssize_t size)
+{
+	parse_field(p, 0, p->node.atapi.primary);
+	need(p, ',');
+	parse_field(p, 0, p->node.atapi.slave);
+	need(p, ',');
+	parse_field(p, 0, p->node.atapi.lun);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.atapi));
+}
+
+/* SCSI(target,lun) */
+static ssize_t
+parse_scsi(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.scsi.target);
+	need(p, ',');
+	parse_field(p, 0, p->node.scsi.lun);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.scsi));
+}
+
+/* Fibre(wwn,lun), in hex without a prefix */
+static ssize_t
+parse_fibre(struct dp_parser *p, const struct dp_node_type *nt,
+	    uint8_t *out, ssize_t size)
+{
+	uint64_t wwn, lun;
+
+	parse_field(p, 16, wwn);
+	need(p, ',');
+	parse_field(p, 16, lun);
+	need(p, ')');
+	p->node.fc.wwn = cpu_to_le64(wwn);
+	p->node.fc.lun = cpu_to_le64(lun);
+	return emit_node(p, nt, out, size, sizeof(p->node.fc));
+}
+
+/* I1394(guid) */
+static ssize_t
+parse_1394(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.firewire.guid);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.firewire));
+}
+
+/* USB(port,interface) */
+static ssize_t
+parse_usb(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	parse_field(p, 0, p->node.usb.parent_port);
+	need(p, ',');
+	parse_field(p, 0, p->node.usb.interface);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.usb));
+}
+
+/* I2O(target) */
+static ssize_t
+parse_i2o(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	parse_field(p, 0, p->node.i2o.target);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.i2o));
+}
+
+/* MAC(address,type), with up to 32 bytes of address */
+static ssize_t
+parse_mac_addr(struct dp_parser *p, const struct dp_node_type *nt,
+	       uint8_t *out, ssize_t size)
+{
+	const char *text = p->pos;
+	size_t n = hex_span(p, 0);
+
+	if (!n || n > sizeof(p->node.mac_addr.mac_addr)) {
+		p->pos = text;
+		return parse_error(p, "a MAC address");
+	}
+	hex_decode(text, p->node.mac_addr.mac_addr, n, 0);
+	need(p, ',');
+	parse_field(p, 0, p->node.mac_addr.if_type);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.mac_addr));
+}
+
+/*
+ * A dotted quad, and a port after a colon if port is not NULL.
+ */
+static int
+parse_ipv4_addr(struct dp_parser *p, uint8_t addr[4], uint16_t *port)
+{
+	uint64_t v;
+
+	for (int i = 0; i < 4; i++) {
+		if (i && expect(p, '.') < 0)
+			return -1;
+		if (parse_uint(p, 10, UINT8_MAX, &v) < 0)
+			return -1;
+		addr[i] = v;
+	}
+	if (port && *p->pos == ':') {
+		p->pos++;
+		if (parse_uint(p, 10, UINT16_MAX, &v) < 0)
+			return -1;
+		*port = v;
+	}
+	return 0;
+}
+
+static const char * const ip_protocols[] = {
+	[6] = "TCP",
+	[17] = "UDP",
+};
+
+/* IPv4(remote[:port],protocol,Static|DHCP,local[:port],gateway,netmask) */
+static ssize_t
+parse_ipv4(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	static const char * const origins[] = { "DHCP", "Static" };
+	efidp_ipv4_addr *ipv4 = &p->node.ipv4_addr;
+	uint16_t local_port = 0, remote_port = 0;
+	int kw;
+
+	if (parse_ipv4_addr(p, ipv4->remote_ipv4_addr, &remote_port) < 0)
+		return -1;
+	need(p, ',');
+	kw = parse_keyword(p, ip_protocols,
+			   sizeof(ip_protocols) / sizeof(ip_protocols[0]));
+	if (kw >= 0)
+		ipv4->protocol = kw;
+	else
+		parse_field(p, 0, ipv4->protocol);
+	need(p, ',');
+	kw = parse_keyword(p, origins, 2);
+	if (kw < 0)
+		return parse_error(p, "Static or DHCP");
+	ipv4->static_ip_addr = kw;
+	need(p, ',');
+	if (parse_ipv4_addr(p, ipv4->local_ipv4_addr, &local_port) < 0)
+		return -1;
+	need(p, ',');
+	if (parse_ipv4_addr(p, ipv4->gateway, NULL) < 0)
+		return -1;
+	need(p, ',');
+	if (parse_ipv4_addr(p, ipv4->netmask, NULL) < 0)
+		return -1;
+	need(p, ')');
+
+	ipv4->local_port = local_port;
+	ipv4->remote_port = remote_port;
+	return emit_node(p, nt, out, size, sizeof(*ipv4));
+}
+
+/* Uart(baud,data bits,parity,stop bits) */
+static ssize_t
+parse_uart(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	static const char * const parities[] = {
+		"D", "N", "E", "O", "M", "S"
+	};
+	static const char * const stop_bits[] = { "D", "1", "1.5", "2" };
+	int kw;
+
+	parse_field(p, 10, p->node.uart.baud_rate);
+	need(p, ',');
+	parse_field(p, 10, p->node.uart.data_bits);
+	need(p, ',');
+	kw = parse_keyword(p, parities, 6);
+	if (kw >= 0)
+		p->node.uart.parity = kw;
+	else
+		parse_field(p, 10, p->node.uart.parity);
+	need(p, ',');
+	kw = parse_keyword(p, stop_bits, 4);
+	if (kw >= 0)
+		p->node.uart.stop_bits = kw;
+	else
+		parse_field(p, 10, p->node.uart.stop_bits);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.uart));
+}
+
+/* UartFlowControl(None|Hardware|XonXoff|map) */
+static ssize_t
+parse_uart_flow_control(struct dp_parser *p, const struct dp_node_type *nt,
+			uint8_t *out, ssize_t size)
+{
+	static const char * const maps[] = { "None", "Hardware", "XonXoff" };
+	efidp_uart_flow_control *ufc = &p->node.uart_flow_control;
+	int kw;
+
+	ufc->vendor_guid = *nt->guid;
+	kw = parse_keyword(p, maps, 3);
+	if (kw >= 0)
+		ufc->flow_control_map = kw;
+	else
+		parse_field(p, 10, ufc->flow_control_map);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(*ufc));
+}
+
+/*
+ * UsbAudio(vendor,product,subclass,protocol) and the rest of the USB
+ * class nodes, whose class is in the low byte of nt->arg.  Class 254
+ * nodes also have their subclass in the next byte, and don't list it.
+ */
+static ssize_t
+parse_usb_class(struct dp_parser *p, const struct dp_node_type *nt,
+		uint8_t *out, ssize_t size)
+{
+	efidp_usb_class *usb = &p->node.usb_class;
+
+	usb->device_class = nt->arg & 0xff;
+	parse_field(p, 0, usb->vendor_id);
+	need(p, ',');
+	parse_field(p, 0, usb->product_id);
+	need(p, ',');
+	if (usb->device_class == EFIDP_USB_CLASS_254) {
+		usb->device_subclass = nt->arg >> 8;
+	} else {
+		parse_field(p, 10, usb->device_subclass);
+		need(p, ',');
+	}
+	parse_field(p, 10, usb->device_protocol);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(*usb));
+}
+
+/* UsbWwid(vendor,product,interface,serial), with the ids in bare hex */
+static ssize_t
+parse_usb_wwid(struct dp_parser *p, const struct dp_node_type *nt,
+	       uint8_t *out, ssize_t size)
+{
+	efidp_usb_wwid *wwid = &p->node.usb_wwid;
+	const char *serial;
+	size_t len;
+	ssize_t chars;
+	ssize_t sz;
+
+	parse_field(p, 16, wwid->vendor_id);
+	need(p, ',');
+	parse_field(p, 16, wwid->product_id);
+	need(p, ',');
+	parse_field(p, 10, wwid->interface);
+	need(p, ',');
+	serial = p->pos;
+	len = strcspn(serial, ")");
+	chars = utf8_chars(serial, len);
+	if (chars < 0)
+		return parse_error(p, "a UTF-8 serial number");
+	p->pos += len;
+	need(p, ')');
+
+	sz = emit_node(p, nt, out, size,
+		       sizeof(*wwid) + (chars + 1) * sizeof(uint16_t));
+	if (sz > 0 && size)
+		utf8_to_ucs2_le(serial, len, out + sizeof(*wwid));
+	return sz;
+}
+
+/* Unit(lun) */
+static ssize_t
+parse_lun(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	parse_field(p, 0, p->node.lun.lun);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.lun));
+}
+
+/* Sata(hba port,port multiplier port,lun) */
+static ssize_t
+parse_sata(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.sata.hba_port);
+	need(p, ',');
+	parse_field(p, 0, p->node.sata.port_multiplier_port);
+	need(p, ',');
+	parse_field(p, 0, p->node.sata.lun);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.sata));
+}
+
+/* Vlan(id) */
+static ssize_t
+parse_vlan(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.vlan.vlan_id);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.vlan));
+}
+
+/* NVMe(namespace,EUI-64), with the EUI-64 bytes separated by dashes */
+static ssize_t
+parse_nvme(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.nvme.namespace_id);
+	need(p, ',');
+	if (parse_hex_bytes(p, p->node.nvme.ieee_eui_64,
+			    sizeof(p->node.nvme.ieee_eui_64), '-') < 0)
+		return -1;
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.nvme));
+}
+
+/*
+ * Uri(uri).  A URI can hold most anything, so this takes everything up to
+ * the parenthesis that balances the node's opening one.
+ */
+static ssize_t
+parse_uri(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	const char *uri = p->pos;
+	unsigned int depth = 0;
+	ssize_t sz;
+	size_t len;
+
+	for (; *p->pos; p->pos++) {
+		if (*p->pos == '(')
+			depth++;
+		else if (*p->pos == ')' && depth-- == 0)
+			break;
+	}
+	len = p->pos - uri;
+	need(p, ')');
+
+	sz = new_node(p, out, size, nt->type, nt->subtype,
+		      sizeof(efidp_uri) + len);
+	if (sz > 0 && size)
+		memcpy(out + sizeof(efidp_uri), uri, len);
+	return sz;
+}
+
+/* UFS(target,lun) */
+static ssize_t
+parse_ufs(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	  ssize_t size)
+{
+	parse_field(p, 0, p->node.ufs.target_id);
+	need(p, ',');
+	parse_field(p, 0, p->node.ufs.lun);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.ufs));
+}
+
+/* SD(slot) */
+static ssize_t
+parse_sd(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	 ssize_t size)
+{
+	parse_field(p, 0, p->node.sd.slot_number);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.sd));
+}
+
+/* eMMC(slot) */
+static ssize_t
+parse_emmc(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	parse_field(p, 0, p->node.emmc.slot);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.emmc));
+}
+
+/* Bluetooth(address) */
+static ssize_t
+parse_bt(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	 ssize_t size)
+{
+	if (parse_hex_bytes(p, p->node.bt.addr, sizeof(p->node.bt.addr),
+			    ':') < 0)
+		return -1;
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.bt));
+}
+
+/* BluetoothLE(address,type) */
+static ssize_t
+parse_btle(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	if (parse_hex_bytes(p, p->node.btle.addr, sizeof(p->node.btle.addr),
+			    ':') < 0)
+		return -1;
+	need(p, ',');
+	parse_field(p, 0, p->node.btle.addr_type);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.btle));
+}
+
+/* Wi-Fi(ssid) */
+static ssize_t
+parse_wifi(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	   ssize_t size)
+{
+	if (parse_hex_bytes(p, p->node.wifi.ssid, sizeof(p->node.wifi.ssid),
+			    ':') < 0)
+		return -1;
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.wifi));
+}
+
+/*
+ * NVDIMM(uuid), Media(guid), FvFile(guid), and FvVol(guid): a node that
+ * is just a GUID.
+ */
+static ssize_t
+parse_guid_node(struct dp_parser *p, const struct dp_node_type *nt,
+		uint8_t *out, ssize_t size)
+{
+	efi_guid_t guid;
+
+	if (parse_guid(p, &guid) < 0)
+		return -1;
+	need(p, ')');
+	p->node.protocol.protocol_guid = guid;
+	return emit_node(p, nt, out, size, sizeof(p->node.protocol));
+}
+
+/* HD(partition,MBR|GPT|type,signature,start,size) */
+static ssize_t
+parse_hd(struct dp_parser *p, const struct dp_node_type *nt, uint8_t *out,
+	 ssize_t size)
+{
+	static const char * const sig_types[] = {
+		[EFIDP_HD_SIGNATURE_MBR] = "MBR",
+		[EFIDP_HD_SIGNATURE_GUID] = "GPT",
+	};
+	efidp_hd *hd = &p->node.hd;
+	uint32_t mbr;
+	int kw;
+
+	parse_field(p, 10, hd->partition_number);
+	need(p, ',');
+	kw = parse_keyword(p, sig_types, 3);
+	if (kw < 0)
+		parse_field(p, 10, hd->signature_type);
+	need(p, ',');
+	switch (kw) {
+	case EFIDP_HD_SIGNATURE_MBR:
+		hd->format = EFIDP_HD_FORMAT_PCAT;
+		hd->signature_type = EFIDP_HD_SIGNATURE_MBR;
+		parse_field(p, 0, mbr);
+		mbr = cpu_to_le32(mbr);
+		memcpy(hd->signature, &mbr, sizeof(mbr));
+		break;
+	case EFIDP_HD_SIGNATURE_GUID: {
+		efi_guid_t guid;
+
+		hd->format = EFIDP_HD_FORMAT_GPT;
+		hd->signature_type = EFIDP_HD_SIGNATURE_GUID;
+		if (parse_guid(p, &guid) < 0)
+			return -1;
+		memcpy(hd->signature, &guid, sizeof(guid));
+		break;
+				      }
+	default:
+		if (parse_hex_bytes(p, hd->signature, sizeof(hd->signature),
+				    0) < 0)
+			return -1;
+		break;
+	}
+	need(p, ',');
+	parse_field(p, 0, hd->start);
+	need(p, ',');
+	parse_field(p, 0, hd->size);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(*hd));
+}
+
+/* CDROM(entry,start,sectors) */
+static ssize_t
+parse_cdrom(struct dp_parser *p, const struct dp_node_type *nt,
+	    uint8_t *out, ssize_t size)
+{
+	parse_field(p, 0, p->node.cdrom.boot_catalog_entry);
+	need(p, ',');
+	parse_field(p, 0, p->node.cdrom.partition_rba);
+	need(p, ',');
+	parse_field(p, 0, p->node.cdrom.sectors);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.cdrom));
+}
+
+/* Offset(first,last) */
+static ssize_t
+parse_relative_offset(struct dp_parser *p, const struct dp_node_type *nt,
+		      uint8_t *out, ssize_t size)
+{
+	parse_field(p, 0, p->node.relative_offset.first_byte);
+	need(p, ',');
+	parse_field(p, 0, p->node.relative_offset.last_byte);
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(p->node.relative_offset));
+}
+
+/*
+ * Ramdisk(start,end,instance,type), and VirtualDisk(start,end,instance)
+ * and its siblings, which take the type from their name.
+ */
+static ssize_t
+parse_ramdisk(struct dp_parser *p, const struct dp_node_type *nt,
+	      uint8_t *out, ssize_t size)
+{
+	efidp_ramdisk *ramdisk = &p->node.ramdisk;
+
+	parse_field(p, 0, ramdisk->start_addr);
+	need(p, ',');
+	parse_field(p, 0, ramdisk->end_addr);
+	need(p, ',');
+	parse_field(p, 10, ramdisk->instance_number);
+	if (nt->guid) {
+		ramdisk->disk_type_guid = *nt->guid;
+	} else {
+		efi_guid_t guid;
+
+		need(p, ',');
+		if (parse_guid(p, &guid) < 0)
+			return -1;
+		ramdisk->disk_type_guid = guid;
+	}
+	need(p, ')');
+	return emit_node(p, nt, out, size, sizeof(*ramdisk));
+}
+
+/*
+ * Anything that isn't "Name(...)" is a file path, up to the next node or
+ * instance separator.
+ */
+static ssize_t
+parse_file(struct dp_parser *p, uint8_t *out, ssize_t size)
+{
+	const char *name = p->pos;
+	size_t len = strcspn(name, "/,");
+	ssize_t chars;
+	ssize_t sz;
+
+	p->name = "File";
+	p->namelen = strlen(p->name);
+	if (!len)
+		return parse_error(p, "a device path node");
+	chars = utf8_chars(name, len);
+	if (chars < 0)
+		return parse_error(p, "a UTF-8 file name");
+	p->pos += len;
+
+	sz = new_node(p, out, size, EFIDP_MEDIA_TYPE, EFIDP_MEDIA_FILE,
+		      sizeof(efidp_file) + (chars + 1) * sizeof(uint16_t));
+	if (sz > 0 && size)
+		utf8_to_ucs2_le(name, len, out + sizeof(efidp_file));
+	return sz;
+}
+
+#define EFIDP_PATH_TYPE 0
+
+static const efi_guid_t edd10_guid = EDD10_HARDWARE_VENDOR_PATH_GUID;
+static const efi_guid_t pc_ansi_guid = EFIDP_PC_ANSI_GUID;
+static const efi_guid_t vt_100_guid = EFIDP_VT_100_GUID;
+static const efi_guid_t vt_100_plus_guid = EFIDP_VT_100_PLUS_GUID;
+static const efi_guid_t vt_utf8_guid = EFIDP_VT_UTF8_GUID;
+static const efi_guid_t debugport_guid = EFIDP_MSG_DEBUGPORT_GUID;
+static const efi_guid_t uart_guid = EFIDP_MSG_UART_GUID;
+static const efi_guid_t virtual_disk_guid = EFIDP_VIRTUAL_DISK_GUID;
+static const efi_guid_t virtual_cd_guid = EFIDP_VIRTUAL_CD_GUID;
+static const efi_guid_t persistent_virtual_disk_guid =
+	EFIDP_PERSISTENT_VIRTUAL_DISK_GUID;
+static const efi_guid_t persistent_virtual_cd_guid =
+	EFIDP_PERSISTENT_VIRTUAL_CD_GUID;
+
+#define HW(name_, subtype_, parse_, args...)				\
+	{ .name = name_, .type = EFIDP_HARDWARE_TYPE,			\
+	  .subtype = EFIDP_HW_ ## subtype_, .parse = parse_, ## args }
+#define ACPI(name_, subtype_, parse_, args...)				\
+	{ .name = name_, .type = EFIDP_ACPI_TYPE,			\
+	  .subtype = EFIDP_ACPI_ ## subtype_, .parse = parse_, ## args }
+#define MSG(name_, subtype_, parse_, args...)				\
+	{ .name = name_, .type = EFIDP_MESSAGE_TYPE,			\
+	  .subtype = EFIDP_MSG_ ## subtype_, .parse = parse_, ## args }
+#define MEDIA(name_, subtype_, parse_, args...)				\
+	{ .name = name_, .type = EFIDP_MEDIA_TYPE,			\
+	  .subtype = EFIDP_MEDIA_ ## subtype_, .parse = parse_, ## args }
+#define USB_CLASS(name_, class_)					\
+	MSG(name_, USB_CLASS, parse_usb_class,				\
+	    .arg = EFIDP_USB_CLASS_ ## class_)
+#define USB_CLASS_254(name_, subclass_)					\
+	MSG(name_, USB_CLASS, parse_usb_class,				\
+	    .arg = EFIDP_USB_CLASS_254 |				\
+		   EFIDP_USB_SUBCLASS_ ## subclass_ << 8)
+
+/*
+ * Every node name the parser knows, sorted by name so that it can be
+ * searched with bsearch().
+ */
+static const struct dp_node_type dp_node_types[] = {
+	ACPI("Acpi", HID, parse_acpi),
+	ACPI("AcpiAdr", ADR, parse_acpi_adr),
+	ACPI("AcpiContainer", HID, parse_acpi_hid,
+	     .arg = EFIDP_ACPI_CONTAINER_0A05_HID),
+	ACPI("AcpiEx", HID_EX, parse_acpi_ex),
+	ACPI("AcpiExp", HID_EX, parse_acpi_ex),
+	{ .name = "AcpiPath", .type = EFIDP_ACPI_TYPE, .parse = parse_raw },
+	MSG("Ata", ATAPI, parse_atapi),
+	HW("BMC", BMC, parse_bmc),
+	{ .name = "BbsPath", .type = EFIDP_BIOS_BOOT_TYPE,
+	  .parse = parse_raw },
+	MSG("Bluetooth", BT, parse_bt),
+	MSG("BluetoothLE", BTLE, parse_btle),
+	MEDIA("CDROM", CDROM, parse_cdrom),
+	HW("Ctrl", CONTROLLER, parse_controller),
+	MSG("DebugPort", VENDOR, parse_vendor, .guid = &debugport_guid),
+	HW("EDD10", VENDOR, parse_edd10, .guid = &edd10_guid),
+	ACPI("EmbeddedController", HID, parse_acpi_hid,
+	     .arg = EFIDP_ACPI_EC_HID),
+	MSG("Fibre", FIBRECHANNEL, parse_fibre),
+	ACPI("Floppy", HID, parse_acpi_hid, .arg = EFIDP_ACPI_FLOPPY_HID),
+	MEDIA("FvFile", FIRMWARE_FILE, parse_guid_node),
+	MEDIA("FvVol", FIRMWARE_VOLUME, parse_guid_node),
+	MEDIA("HD", HD, parse_hd),
+	{ .name = "HardwarePath", .type = EFIDP_HARDWARE_TYPE,
+	  .parse = parse_raw },
+	MSG("I1394", 1394, parse_1394),
+	MSG("I2O", I2O, parse_i2o),
+	MSG("IPv4", IPv4, parse_ipv4),
+	ACPI("Keyboard", HID, parse_acpi_hid,
+	     .arg = EFIDP_ACPI_KEYBOARD_HID),
+	MSG("MAC", MAC_ADDR, parse_mac_addr),
+	MEDIA("Media", PROTOCOL, parse_guid_node),
+	{ .name = "MediaPath", .type = EFIDP_MEDIA_TYPE, .parse = parse_raw },
+	HW("MemoryMapped", MMIO, parse_mmio),
+	{ .name = "Msg", .type = EFIDP_MESSAGE_TYPE, .parse = parse_raw },
+	MSG("NVDIMM", NVDIMM, parse_guid_node),
+	MSG("NVMe", NVME, parse_nvme),
+	MEDIA("Offset", RELATIVE_OFFSET, parse_relative_offset),
+	{ .name = "Path", .type = EFIDP_PATH_TYPE, .parse = parse_raw },
+	HW("PcCard", PCCARD, parse_pccard),
+	HW("Pci", PCI, parse_pci),
+	ACPI("PciRoot", HID, parse_acpi_hid, .arg = EFIDP_ACPI_PCI_ROOT_HID),
+	ACPI("PcieRoot", HID, parse_acpi_hid,
+	     .arg = EFIDP_ACPI_PCIE_ROOT_HID),
+	MEDIA("PersistentVirtualCD", RAMDISK, parse_ramdisk,
+	      .guid = &persistent_virtual_cd_guid),
+	MEDIA("PersistentVirtualDisk", RAMDISK, parse_ramdisk,
+	      .guid = &persistent_virtual_disk_guid),
+	MEDIA("Ramdisk", RAMDISK, parse_ramdisk),
+	MSG("SCSI", SCSI, parse_scsi),
+	MSG("SD", SD, parse_sd),
+	MSG("Sata", SATA, parse_sata),
+	ACPI("Serial", HID, parse_acpi_hid, .arg = EFIDP_ACPI_SERIAL_HID),
+	MSG("UFS", UFS, parse_ufs),
+	MSG("USB", USB, parse_usb),
+	MSG("Uart", UART, parse_uart),
+	MSG("UartFlowControl", VENDOR, parse_uart_flow_control,
+	    .guid = &uart_guid),
+	MSG("Unit", LUN, parse_lun),
+	MSG("Uri", URI, parse_uri),
+	USB_CLASS("UsbAudio", AUDIO),
+	USB_CLASS("UsbCDCControl", CDC_CONTROL),
+	USB_CLASS("UsbCDCData", CDC_DATA),
+	USB_CLASS_254("UsbDeviceFirmwareUpdate", FW_UPDATE),
+	USB_CLASS("UsbDiagnostic", DIAGNOSTIC),
+	USB_CLASS("UsbHID", HID),
+	USB_CLASS("UsbHub", HUB),
+	USB_CLASS("UsbImage", IMAGE),
+	USB_CLASS_254("UsbIrdaBridge", IRDA_BRIDGE),
+	USB_CLASS("UsbMassStorage", MASS_STORAGE),
+	USB_CLASS("UsbPrinter", PRINTER),
+	USB_CLASS("UsbSmartCard", SMARTCARD),
+	USB_CLASS_254("UsbTestAndMeasurement", TEST_AND_MEASURE),
+	USB_CLASS("UsbVideo", VIDEO),
+	USB_CLASS("UsbWireless", WIRELESS),
+	MSG("UsbWwid", USB_WWID, parse_usb_wwid),
+	HW("VenHw", VENDOR, parse_vendor),
+	MEDIA("VenMedia", VENDOR, parse_vendor),
+	MSG("VenMsg", VENDOR, parse_vendor),
+	MSG("VenPcAnsi", VENDOR, parse_vendor, .guid = &pc_ansi_guid),
+	MSG("VenUtf8", VENDOR, parse_vendor, .guid = &vt_utf8_guid),
+	MSG("VenVt100", VENDOR, parse_vendor, .guid = &vt_100_guid),
+	MSG("VenVt100Plus", VENDOR, parse_vendor, .guid = &vt_100_plus_guid),
+	MEDIA("VirtualCD", RAMDISK, parse_ramdisk, .guid = &virtual_cd_guid),
+	MEDIA("VirtualDisk", RAMDISK, parse_ramdisk,
+	      .guid = &virtual_disk_guid),
+	MSG("Vlan", VLAN, parse_vlan),
+	MSG("Wi-Fi", WIFI, parse_wifi),
+	MSG("eMMC", EMMC, parse_emmc),
+};
+
+#undef HW
+#undef ACPI
+#undef MSG
+#undef MEDIA
+#undef USB_CLASS
+#undef USB_CLASS_254
+
+struct dp_node_key {
+	const char *name;
+	size_t len;
+};
+
+static int
+cmp_node_type(const void *k, const void *e)
+{
+	const struct dp_node_key *key = k;
+	const char *name = ((const struct dp_node_type *)e)->name;
+	int rc;
+
+	rc = strncmp(key->name, name, key->len);
+	if (rc)
+		return rc;
+	return name[key->len] ? -1 : 0;
+}
+
+static inline bool
+is_name_char(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	       (c >= '0' && c <= '9') || c == '-';
+}
+
+static ssize_t
+parse_node(struct dp_parser *p, uint8_t *out, ssize_t size)
+{
+	const struct dp_node_type *nt;
+	struct dp_node_key key;
+	const char *s = p->pos;
+
+	while (is_name_char(*s))
+		s++;
+	if (*s != '(' || s == p->pos)
+		return parse_file(p, out, size);
+
+	key.name = p->pos;
+	key.len = s - p->pos;
+	nt = bsearch(&key, dp_node_types,
+		     sizeof(dp_node_types) / sizeof(dp_node_types[0]),
+		     sizeof(dp_node_types[0]), cmp_node_type);
+	if (!nt) {
+		errno = EINVAL;
+		efi_error("unknown device path node \"%.*s\"",
+			  (int)key.len, key.name);
+		return -1;
+	}
+
+	p->name = key.name;
+	p->namelen = key.len;
+	p->pos = s + 1;
+	memset(&p->node, 0, sizeof(p->node));
+	return nt->parse(p, nt, out, size);
+}
+
+/*
+ * Where the next node goes, given that used bytes of out are taken.  A
+ * full buffer has to be reported here, since passing a size of 0 on to
+ * the node parsers would ask them to measure instead.
+ */
+static int
+next_out(uint8_t *out, size_t size, size_t used, uint8_t **next,
+	 ssize_t *left)
+{
+	if (!size) {
+		*next = NULL;
+		*left = 0;
+		return 0;
+	}
+	if (used >= size) {
+		errno = ENOSPC;
+		efi_error("device path is bigger than size limit");
+		return -1;
+	}
+	*next = out ? out + used : NULL;
+	*left = size - used;
+	return 0;
+}
+
+ssize_t PUBLIC
+efidp_parse_device_node(unsigned char *path, efidp out, size_t size)
+{
+	struct dp_parser p = {
+		.text = (const char *)path,
+		.pos = (const char *)path,
+	};
+	ssize_t sz;
+
+	if (!path) {
+		errno = EINVAL;
+		efi_error("invalid parameter 'path'");
+		return -1;
+	}
+	if (size > SSIZE_MAX)
+		size = SSIZE_MAX;
+
+	sz = parse_node(&p, (uint8_t *)out, size);
+	if (sz < 0) {
+		efi_error("could not parse device path node");
+		return -1;
+	}
+	if (*p.pos) {
+		parse_error(&p, "the end of the node");
+		return -1;
+	}
+	return sz;
+}
+
+ssize_t PUBLIC
+efidp_parse_device_path(unsigned char *path, efidp out, size_t size)
+{
+	struct dp_parser p = {
+		.text = (const char *)path,
+		.pos = (const char *)path,
+	};
+	uint8_t *buf = (uint8_t *)out;
+	size_t used = 0;
+	uint8_t *next;
+	ssize_t left;
+	ssize_t sz;
+
+	if (!path) {
+		errno = EINVAL;
+		efi_error("invalid parameter 'path'");
+		return -1;
+	}
+	if (size > SSIZE_MAX)
+		size = SSIZE_MAX;
+
+	while (*p.pos) {
+		if (next_out(buf, size, used, &next, &left) < 0)
+			return -1;
+		sz = parse_node(&p, next, left);
+		if (sz < 0) {
+			efi_error("could not parse device path");
+			return -1;
+		}
+		used += sz;
+
+		if (*p.pos == '/') {
+			p.pos++;
+		} else if (*p.pos == ',') {
+			p.pos++;
+			if (next_out(buf, size, used, &next, &left) < 0)
+				return -1;
+			sz = efidp_make_end_instance(next, left);
+			if (sz < 0)
+				return -1;
+			used += sz;
+		} else if (*p.pos) {
+			parse_error(&p, "'/', ',', or the end of the path");
+			return -1;
+		}
+	}
+
+	if (next_out(buf, size, used, &next, &left) < 0)
+		return -1;
+	sz = efidp_make_end_entire(next, left);
+	if (sz < 0)
+		return -1;
+	return used + sz;
+}
+
+// vim:fenc=utf-8:tw=75:noet
@@ -288,18 +288,275 @@ efidp_append_instance(const_efidp dp, const_efidp dpi, efidp *out)
 
 }
 
-ssize_t PUBLIC
-efidp_format_device_path(unsigned char *buf, size_t size, const_efidp dp,
-			 ssize_t limit)
+void HIDDEN
+dp_buf_append_slow(struct dp_buf *buf, const void *data, size_t len)
 {
-	ssize_t off = 0;
-	int first = 1;
+	size_t need;
 
-	if (!dp)
+	if (ADD(buf->len, len, &need) || ADD(need, 1, &need)) {
+		errno = EOVERFLOW;
+		buf->failed = true;
+		return;
+	}
+
+	if (buf->growable && !buf->failed) {
+		size_t size = buf->size ? buf->size : 128;
+		char *new;
+
+		while (size < need) {
+			if (MUL(size, 2, &size)) {
+				size = need;
+				break;
+			}
+		}
+		new = realloc(buf->buf, size);
+		if (new) {
+			buf->buf = new;
+			buf->size = size;
+			memcpy(buf->buf + buf->len, data, len);
+			buf->len += len;
+			return;
+		}
+		buf->failed = true;
+	}
+
+	/*
+	 * Take what fits, leaving room for the NUL, and count the rest.
+	 */
+	if (buf->len + 1 < buf->size) {
+		size_t avail = buf->size - buf->len - 1;
+
+		memcpy(buf->buf + buf->len, data, len < avail ? len : avail);
+	}
+	buf->len += len;
+}
+
+static void
+dp_buf_number(struct dp_buf *buf, unsigned long long val, bool negative,
+	      unsigned int base, bool upper, unsigned int width, bool zero)
+{
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char out[64];
+	char *pos = out + sizeof(out);
+	unsigned int n;
+
+	do {
+		*--pos = digits[val % base];
+		val /= base;
+	} while (val);
+	if (negative && !zero)
+		*--pos = '-';
+	if (width > sizeof(out) - 1)
+		width = sizeof(out) - 1;
+	n = out + sizeof(out) - pos + (negative && zero);
+	while (n < width) {
+		*--pos = zero ? '0' : ' ';
+		n++;
+	}
+	if (negative && zero)
+		*--pos = '-';
+	dp_buf_append(buf, pos, out + sizeof(out) - pos);
+}
+
+/*
+ * A printf() for the conversions the device path formatters use: flags
+ * '0', a field width, lengths 'hh', 'h', 'l', and 'll', and 'd', 'u',
+ * 'x', 'X', 'c', and 's'.
+ */
+void HIDDEN
+dp_buf_printf(struct dp_buf *buf, const char *fmt, ...)
+{
+	const char *start = fmt;
+	va_list ap;
+
+	va_start(ap, fmt);
+	while (*fmt) {
+		const char *pct = strchrnul(fmt, '%');
+		unsigned long long uval;
+		long long sval;
+		unsigned int width = 0;
+		bool zero = false;
+		int hs = 0, ls = 0;
+		const char *s;
+		char c;
+
+		if (pct != fmt)
+			dp_buf_append(buf, fmt, pct - fmt);
+		if (!*pct)
+			break;
+		fmt = pct + 1;
+
+		if (*fmt == '0') {
+			zero = true;
+			fmt++;
+		}
+		while (*fmt >= '0' && *fmt <= '9')
+			width = width * 10 + *fmt++ - '0';
+		while (*fmt == 'h') {
+			hs++;
+			fmt++;
+		}
+		while (*fmt == 'l') {
+			ls++;
+			fmt++;
+		}
+
+		switch (*fmt++) {
+		case '%':
+			dp_buf_append(buf, "%", 1);
+			break;
+		case 'c':
+			c = (char)va_arg(ap, int);
+			dp_buf_append(buf, &c, 1);
+			break;
+		case 's':
+			s = va_arg(ap, const char *);
+			if (!s)
+				s = "(null)";
+			for (size_t n = strlen(s); n < width; n++)
+				dp_buf_append(buf, " ", 1);
+			dp_buf_append(buf, s, strlen(s));
+			break;
+		case 'd':
+			if (ls > 1)
+				sval = va_arg(ap, long long);
+			else if (ls)
+				sval = va_arg(ap, long);
+			else if (hs > 1)
+				sval = (signed char)va_arg(ap, int);
+			else if (hs)
+				sval = (short)va_arg(ap, int);
+			else
+				sval = va_arg(ap, int);
+			uval = sval < 0 ? -(unsigned long long)sval
+					: (unsigned long long)sval;
+			dp_buf_number(buf, uval, sval < 0, 10, false, width,
+				      zero);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+			if (ls > 1)
+				uval = va_arg(ap, unsigned long long);
+			else if (ls)
+				uval = va_arg(ap, unsigned long);
+			else if (hs > 1)
+				uval = (unsigned char)va_arg(ap, unsigned int);
+			else if (hs)
+				uval = (unsigned short)va_arg(ap, unsigned int);
+			else
+				uval = va_arg(ap, unsigned int);
+			dp_buf_number(buf, uval, false, fmt[-1] == 'u' ? 10 : 16,
+				      fmt[-1] == 'X', width, zero);
+			break;
+		default:
+			errno = EINVAL;
+			efi_error("unsupported conversion in \"%s\"", start);
+			buf->failed = true;
+			va_end(ap);
+			return;
+		}
+	}
+	va_end(ap);
+}
+
+void HIDDEN
+dp_buf_hex(struct dp_buf *buf, const void *data, size_t len,
+	   const char *separator, int stride)
+{
+	static const char hex[] = "0123456789abcdef";
+	const uint8_t *bytes = data;
+	size_t seplen = separator ? strlen(separator) : 0;
+	char out[128];
+	size_t n = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		if (n + seplen + 2 > sizeof(out)) {
+			dp_buf_append(buf, out, n);
+			n = 0;
+		}
+		if (i && seplen && stride > 0 && i % stride == 0) {
+			memcpy(out + n, separator, seplen);
+			n += seplen;
+		}
+		out[n++] = hex[bytes[i] >> 4];
+		out[n++] = hex[bytes[i] & 0xf];
+	}
+	dp_buf_append(buf, out, n);
+}
+
+void HIDDEN
+dp_buf_guid(struct dp_buf *buf, const void *guid)
+{
+	char str[GUID_STR_LENGTH + 1];
+	efi_guid_t g;
+
+	memcpy(&g, guid, sizeof(g));
+	guid_to_text(&g, str);
+	dp_buf_append(buf, str, GUID_STR_LENGTH);
+}
+
+/*
+ * Append at most limit characters of a UCS-2 string, stopping at a NUL,
+ * as UTF-8.  The string needn't be aligned.
+ */
+void HIDDEN
+dp_buf_ucs2(struct dp_buf *buf, const void *str, ssize_t limit)
+{
+	const uint8_t *chars = str;
+	uint8_t out[128];
+	size_t n = 0;
+
+	for (ssize_t i = 0; i < limit; i++) {
+		uint16_t c;
+
+		memcpy(&c, chars + i * sizeof(c), sizeof(c));
+		if (!c)
+			break;
+		if (n + 3 > sizeof(out)) {
+			dp_buf_append(buf, out, n);
+			n = 0;
+		}
+		if (c <= 0x7f) {
+			out[n++] = c;
+		} else if (c <= 0x7ff) {
+			out[n++] = 0xc0 | ev_bits(c, 0x1f, 6);
+			out[n++] = 0x80 | ev_bits(c, 0x3f, 0);
+		} else {
+			out[n++] = 0xe0 | ev_bits(c, 0xf, 12);
+			out[n++] = 0x80 | ev_bits(c, 0x3f, 6);
+			out[n++] = 0x80 | ev_bits(c, 0x3f, 0);
+		}
+	}
+	dp_buf_append(buf, out, n);
+}
+
+/*
+ * NUL-terminate the string, and report whether building it failed.
+ */
+int HIDDEN
+dp_buf_finish(struct dp_buf *buf)
+{
+	if (buf->len < buf->size) {
+		buf->buf[buf->len] = '\0';
+	} else if (buf->growable) {
+		dp_buf_append_slow(buf, "", 1);
+		buf->len -= 1;
+	} else if (buf->size) {
+		buf->buf[buf->size - 1] = '\0';
+	}
+
+	if (buf->failed) {
+		efi_error("could not build DP string");
 		return -1;
+	}
+	return 0;
+}
 
-	if (buf && size)
-		memset(buf, 0, size);
+static ssize_t
+format_device_path(struct dp_buf *buf, const_efidp dp, ssize_t limit)
+{
+	int first = 1;
 
 	while (limit) {
 		ssize_t sz = efidp_node_size(dp);
@@ -309,8 +566,8 @@ efidp_format_device_path(unsigned char *buf, size_t size, const_efidp dp,
 			return -1;
 		}
 		if (limit >= 0 && (limit < 4 || efidp_node_size(dp) > limit)) {
-			if (off)
-				return off;
+			if (buf->len)
+				return buf->len;
 			else
 				return -1;
 		}
@@ -320,52 +577,48 @@ efidp_format_device_path(unsigned char *buf, size_t size, const_efidp dp,
 		} else {
 			if (dp->type == EFIDP_END_TYPE) {
 				if (dp->subtype == EFIDP_END_INSTANCE) {
-					format(buf, size, off, "\b", ",");
+					format(buf, ",");
 				} else {
-					return off+1;
+					return buf->len + 1;
 				}
 			} else {
-				format(buf, size, off, "\b", "/");
+				format(buf, "/");
 			}
 		}
 
 		switch (dp->type) {
 		case EFIDP_HARDWARE_TYPE:
-			format_hw_dn(buf, size, off, dp);
+			format_hw_dn(buf, dp);
 			break;
 		case EFIDP_ACPI_TYPE:
-			format_acpi_dn(buf, size, off, dp);
+			format_acpi_dn(buf, dp);
 			break;
 		case EFIDP_MESSAGE_TYPE:
-			format_message_dn(buf, size, off, dp);
+			format_message_dn(buf, dp);
 			break;
 		case EFIDP_MEDIA_TYPE:
-			format_media_dn(buf, size, off, dp);
+			format_media_dn(buf, dp);
 			break;
 		case EFIDP_BIOS_BOOT_TYPE: {
 			char *types[] = {"", "Floppy", "HD", "CDROM", "PCMCIA",
 					 "USB", "Network", "" };
 
 			if (dp->subtype != EFIDP_BIOS_BOOT) {
-				format(buf, size, off, "BbsPath",
-				       "BbsPath(%d,", dp->subtype);
+				format(buf, "BbsPath(%d,", dp->subtype);
 				if (sz > 0)
-					format_hex(buf, size, off, "BbsPath",
-						   (uint8_t *)dp+4, sz);
-				format(buf, size, off, "BbsPath", ")");
+					format_hex(buf, (uint8_t *)dp+4, sz);
+				format(buf, ")");
 				break;
 			}
 
 			if (dp->bios_boot.device_type > 0 &&
 					dp->bios_boot.device_type < 7) {
-				format(buf, size, off, "BBS",
-				       "BBS(%s,%s,0x%"PRIx32")",
+				format(buf, "BBS(%s,%s,0x%"PRIx32")",
 				       types[dp->bios_boot.device_type],
 				       dp->bios_boot.description,
 				       dp->bios_boot.status);
 			} else {
-				format(buf, size, off, "BBS",
-				       "BBS(%d,%s,0x%"PRIx32")",
+				format(buf, "BBS(%d,%s,0x%"PRIx32")",
 				       dp->bios_boot.device_type,
 				       dp->bios_boot.description,
 				       dp->bios_boot.status);
@@ -373,18 +626,18 @@ efidp_format_device_path(unsigned char *buf, size_t size, const_efidp dp,
 			break;
 					   }
 		case EFIDP_END_TYPE:
-			if (dp->subtype == EFIDP_END_INSTANCE) {
-				format(buf, size, off, "End", ",");
-				break;
-			}
+			/*
+			 * The "," is the separator above; the next instance
+			 * starts without one.
+			 */
+			if (dp->subtype == EFIDP_END_INSTANCE)
+				first = 1;
 			break;
 		default:
-			format(buf, size, off, "Path",
-				    "Path(%d,%d,", dp->type, dp->subtype);
+			format(buf, "Path(%d,%d,", dp->type, dp->subtype);
 			if (sz > 0)
-			format_hex(buf, size, off, "Path", (uint8_t *)dp + 4,
-				   sz);
-			format(buf, size, off, "Path", ")");
+				format_hex(buf, (uint8_t *)dp + 4, sz);
+			format(buf, ")");
 			break;
 		}
 
@@ -397,25 +650,75 @@ efidp_format_device_path(unsigned char *buf, size_t size, const_efidp dp,
 			return rc;
 		}
 	}
-	return off+1;
+	return buf->len + 1;
 }
 
 ssize_t PUBLIC
-efidp_parse_device_node(unsigned char *path UNUSED,
-			efidp out UNUSED, size_t size UNUSED)
+efidp_format_device_path(unsigned char *buf, size_t size, const_efidp dp,
+			 ssize_t limit)
 {
-	efi_error("not implented");
-	errno = -ENOSYS;
-	return -1;
+	struct dp_buf out = {
+		.buf = (char *)buf,
+		.size = buf ? size : 0,
+	};
+	ssize_t rc;
+
+	if (!dp)
+		return -1;
+
+	if (buf && size)
+		memset(buf, 0, size);
+
+	rc = format_device_path(&out, dp, limit);
+	if (rc >= 0 && dp_buf_finish(&out) < 0)
+		return -1;
+	return rc;
+}
+
+struct efidp_formatter {
+	struct dp_buf buf;
+};
+
+int PUBLIC
+efidp_formatter_new(efidp_formatter_t **formatter)
+{
+	efidp_formatter_t *new;
+
+	new = calloc(1, sizeof(*new));
+	if (!new) {
+		efi_error("allocation failed");
+		return -1;
+	}
+	new->buf.growable = true;
+
+	*formatter = new;
+	return 0;
 }
 
 ssize_t PUBLIC
-efidp_parse_device_path(unsigned char *path UNUSED, efidp out UNUSED,
-			size_t size UNUSED)
+efidp_formatter_format(efidp_formatter_t *formatter, const_efidp dp,
+		       ssize_t limit, const char **str)
+{
+	struct dp_buf *buf = &formatter->buf;
+
+	buf->len = 0;
+	buf->failed = false;
+
+	if (format_device_path(buf, dp, limit) < 0 ||
+	    dp_buf_finish(buf) < 0)
+		return -1;
+
+	*str = buf->buf;
+	return buf->len;
+}
+
+void PUBLIC
+efidp_formatter_free(efidp_formatter_t *formatter)
 {
-	efi_error("not implented");
-	errno = -ENOSYS;
-	return -1;
+	if (!formatter)
+		return;
+	free(formatter->buf.buf);
+	free(formatter);
 }
 
 ssize_t PUBLIC
@@ -0,0 +1,874 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * efiboot-test.c - check libefiboot's caches and device path generation
+ */
+
+#include "fix_coverity.h" // IWYU pragma: keep
+
+#include <efiboot.h>
+#include <endian.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <linux/loop.h>
+#include <sys/ioctl.h>
+
+#include "crc32.h"
+#include "gpt.h"
+#include "test-main.h"
+
+#define SYSFS_TEST_IFNAME "lo"
+#define SYSFS_TEST_BOGUS_IFNAME "efiboot-test0"
+
+/*
+ * Generating an IPv4 device path starts with a readlink() of
+ * /sys/class/net/<ifname>, which goes through the sysfs cache; the
+ * ioctl()s after it don't, so whatever happens there doesn't matter.
+ */
+static int
+sysfs_lookup(const char *ifname, int *error)
+{
+	ssize_t sz;
+
+	errno = 0;
+	sz = efi_generate_ipv4_device_path(NULL, 0, ifname, "10.0.0.2",
+					   "10.0.0.1", "10.0.0.254",
+					   "255.255.255.0", 0, 0, 0, 0);
+	*error = sz < 0 ? errno : 0;
+	efi_error_clear();
+	return sz < 0 ? -1 : 0;
+}
+
+static bool
+sysfs_stats_check(const char *what, const efi_sysfs_cache_stats_t *before,
+		  uint64_t hits, uint64_t misses, uint64_t invalidations,
+		  uint64_t syscalls_saved)
+{
+	efi_sysfs_cache_stats_t after;
+
+	efi_get_sysfs_cache_stats(&after);
+	if (after.hits - before->hits == hits &&
+	    after.misses - before->misses == misses &&
+	    after.invalidations - before->invalidations == invalidations &&
+	    after.syscalls_saved - before->syscalls_saved == syscalls_saved)
+		return true;
+
+	warnx("%s: got %"PRIu64" hits, %"PRIu64" misses, %"PRIu64
+	      " invalidations, %"PRIu64" syscalls saved; expected %"PRIu64
+	      ", %"PRIu64", %"PRIu64", %"PRIu64, what,
+	      after.hits - before->hits, after.misses - before->misses,
+	      after.invalidations - before->invalidations,
+	      after.syscalls_saved - before->syscalls_saved,
+	      hits, misses, invalidations, syscalls_saved);
+	return false;
+}
+
+/*
+ * Look ifname up and check that the cache counted it as expected and
+ * that the result matches what it was without the cache.
+ */
+static int
+sysfs_lookup_check(const char *what, const char *ifname, int rc0, int error0,
+		   uint64_t hits, uint64_t misses)
+{
+	efi_sysfs_cache_stats_t before;
+	int rc, error;
+
+	efi_get_sysfs_cache_stats(&before);
+	rc = sysfs_lookup(ifname, &error);
+	if (rc != rc0 || error != error0) {
+		warnx("%s: %s gave %d (%s), expected %d (%s)", what, ifname,
+		      rc, strerror(error), rc0, strerror(error0));
+		return -1;
+	}
+	if (!sysfs_stats_check(what, &before, hits, misses, 0, hits))
+		return -1;
+	if (verbosity >= 1)
+		printf("%-24s %s: %d (%s)\n", what, ifname, rc,
+		       strerror(error));
+	return 0;
+}
+
+static int
+sysfs_cache_test(void)
+{
+	efi_sysfs_cache_stats_t before;
+	const char *ifnames[] = { SYSFS_TEST_IFNAME, SYSFS_TEST_BOGUS_IFNAME };
+	int rcs[2], errors[2];
+	const size_t n = sizeof(ifnames) / sizeof(ifnames[0]);
+
+	/* with the cache off, nothing is counted */
+	efi_get_sysfs_cache_stats(&before);
+	for (size_t i = 0; i < n; i++)
+		rcs[i] = sysfs_lookup(ifnames[i], &errors[i]);
+	if (!sysfs_stats_check("disabled", &before, 0, 0, 0, 0))
+		return -1;
+	if (rcs[1] >= 0 || errors[1] != ENOENT) {
+		warnx("%s: expected ENOENT, got %d (%s)", ifnames[1], rcs[1],
+		      strerror(errors[1]));
+		return -1;
+	}
+
+	if (efi_sysfs_cache_enable() < 0) {
+		warn("efi_sysfs_cache_enable() failed");
+		return -1;
+	}
+
+	/*
+	 * The first lookup of each misses and fills the cache, the link for
+	 * the real interface and ENOENT for the bogus one; the second hits,
+	 * saving one readlink() each.
+	 */
+	for (size_t i = 0; i < n; i++) {
+		if (sysfs_lookup_check("first lookup", ifnames[i], rcs[i],
+				       errors[i], 0, 1) < 0 ||
+		    sysfs_lookup_check("cached lookup", ifnames[i], rcs[i],
+				       errors[i], 1, 0) < 0)
+			return -1;
+	}
+
+	efi_get_sysfs_cache_stats(&before);
+	efi_sysfs_cache_flush();
+	if (!sysfs_stats_check("flush", &before, 0, 0, n, 0))
+		return -1;
+
+	for (size_t i = 0; i < n; i++) {
+		if (sysfs_lookup_check("lookup after flush", ifnames[i],
+				       rcs[i], errors[i], 0, 1) < 0 ||
+		    sysfs_lookup_check("cached lookup", ifnames[i], rcs[i],
+				       errors[i], 1, 0) < 0)
+			return -1;
+	}
+
+	efi_get_sysfs_cache_stats(&before);
+	efi_sysfs_cache_disable();
+	if (!sysfs_stats_check("disable", &before, 0, 0, n, 0))
+		return -1;
+
+	for (size_t i = 0; i < n; i++) {
+		if (sysfs_lookup_check("lookup after disable", ifnames[i],
+				       rcs[i], errors[i], 0, 0) < 0)
+			return -1;
+	}
+
+	/* flushing a disabled cache does nothing */
+	efi_get_sysfs_cache_stats(&before);
+	efi_sysfs_cache_flush();
+	if (!sysfs_stats_check("flush while disabled", &before, 0, 0, 0, 0))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Disk images for the tests below, made in a scratch directory and each
+ * attached to a loop device, so libefiboot sees a whole disk.  Images are
+ * written through their loop devices, so what libefiboot reads back is
+ * never stale.  Without access to loop devices, which usually means not
+ * running as root, the tests that need them are skipped.
+ */
+#define IMAGE_SECTOR_SIZE	512
+#define IMAGE_SECTORS		32768
+#define IMAGE_LAST_LBA		(IMAGE_SECTORS - 1)
+#define IMAGE_NPTES		128
+#define IMAGE_PTES_LBAS		(IMAGE_NPTES * sizeof(gpt_entry) / \
+				 IMAGE_SECTOR_SIZE)
+
+#define IMAGE_PRIMARY		0x1
+#define IMAGE_ALTERNATE		0x2
+#define IMAGE_GPT		(IMAGE_PRIMARY|IMAGE_ALTERNATE)
+
+struct image_part {
+	efi_guid_t type;
+	efi_guid_t uuid;
+	uint64_t first_lba;
+	uint64_t last_lba;
+};
+
+struct image {
+	char name[32];
+	char devpath[32];
+	int fd;
+};
+
+static char image_dir[PATH_MAX];
+static struct image images[4];
+static size_t n_images;
+
+static const efi_guid_t image_disk_guid =
+	EFI_GUID(0x6c0fdb5e, 0x3a3c, 0x4c5d, 0x9b1f,
+		 0x2e, 0x7d, 0x55, 0x01, 0xa4, 0x10);
+
+static char *
+image_path(const char *name)
+{
+	static char path[PATH_MAX];
+
+	if (snprintf(path, sizeof(path), "%s/%s", image_dir, name)
+	    >= (int)sizeof(path))
+		errx(EXIT_FAILURE, "image path is too long");
+	return path;
+}
+
+/*
+ * The device libefiboot should look at for an image: its loop device once
+ * it's been written, and otherwise a path that doesn't exist.
+ */
+static const char *
+image_device(const char *name)
+{
+	for (size_t i = 0; i < n_images; i++) {
+		if (!strcmp(images[i].name, name))
+			return images[i].devpath;
+	}
+	return image_path(name);
+}
+
+/*
+ * Returns 1 if the caller should skip its test.
+ */
+static int
+image_dir_init(void)
+{
+	const char *tmpdir = getenv("TMPDIR");
+
+	if (access("/dev/loop-control", R_OK|W_OK) < 0) {
+		warn("skipping: cannot use loop devices");
+		return 1;
+	}
+
+	snprintf(image_dir, sizeof(image_dir), "%s/efiboot-test.XXXXXX",
+		 tmpdir ? tmpdir : "/tmp");
+	if (!mkdtemp(image_dir)) {
+		warn("could not make a directory for disk images");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Closing a loop device is enough to detach it, since image_attach()
+ * sets LO_FLAGS_AUTOCLEAR.
+ */
+static void
+image_dir_fini(void)
+{
+	for (size_t i = 0; i < n_images; i++) {
+		close(images[i].fd);
+		unlink(image_path(images[i].name));
+	}
+	n_images = 0;
+	rmdir(image_dir);
+}
+
+/*
+ * Create an image named name and attach it to a free loop device, or if
+ * that's already been done, just return the loop device's fd.
+ */
+static int
+image_attach(const char *name)
+{
+	const char *path = image_path(name);
+	struct image *image = &images[n_images];
+	struct loop_info64 info;
+	int backing, ctl = -1, fd = -1;
+
+	for (size_t i = 0; i < n_images; i++) {
+		if (!strcmp(images[i].name, name))
+			return images[i].fd;
+	}
+	if (n_images == sizeof(images) / sizeof(images[0]) ||
+	    strlen(name) >= sizeof(image->name))
+		errx(EXIT_FAILURE, "cannot attach image \"%s\"", name);
+
+	backing = open(path, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+	if (backing < 0) {
+		warn("could not create \"%s\"", path);
+		return -1;
+	}
+	if (ftruncate(backing, (off_t)IMAGE_SECTORS * IMAGE_SECTOR_SIZE) < 0) {
+		warn("could not size \"%s\"", path);
+		goto err;
+	}
+
+	ctl = open("/dev/loop-control", O_RDWR|O_CLOEXEC);
+	if (ctl < 0) {
+		warn("could not open /dev/loop-control");
+		goto err;
+	}
+
+	/* someone else can take the free device first, so try again */
+	for (int tries = 0; fd < 0 && tries < 16; tries++) {
+		int nr = ioctl(ctl, LOOP_CTL_GET_FREE);
+
+		if (nr < 0) {
+			warn("could not get a free loop device");
+			goto err;
+		}
+		snprintf(image->devpath, sizeof(image->devpath),
+			 "/dev/loop%d", nr);
+		fd = open(image->devpath, O_RDWR|O_CLOEXEC);
+		if (fd < 0) {
+			warn("could not open %s", image->devpath);
+			goto err;
+		}
+		if (ioctl(fd, LOOP_SET_FD, backing) < 0) {
+			if (errno != EBUSY) {
+				warn("could not attach \"%s\" to %s", path,
+				     image->devpath);
+				goto err;
+			}
+			close(fd);
+			fd = -1;
+		}
+	}
+	if (fd < 0) {
+		warnx("could not find a free loop device for \"%s\"", path);
+		goto err;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.lo_flags = LO_FLAGS_AUTOCLEAR;
+	if (ioctl(fd, LOOP_SET_STATUS64, &info) < 0) {
+		warn("could not set up %s", image->devpath);
+		ioctl(fd, LOOP_CLR_FD, 0);
+		goto err;
+	}
+
+	strcpy(image->name, name);
+	image->fd = fd;
+	n_images += 1;
+	close(ctl);
+	close(backing);
+	return fd;
+err:
+	if (fd >= 0)
+		close(fd);
+	if (ctl >= 0)
+		close(ctl);
+	close(backing);
+	unlink(path);
+	return -1;
+}
+
+static int
+write_gpt(int fd, uint64_t my_lba, uint64_t alternate_lba,
+	  uint64_t entries_lba, const gpt_entry *ptes)
+{
+	size_t ptes_size = IMAGE_NPTES * sizeof(gpt_entry);
+	gpt_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = htole64(GPT_HEADER_MAGIC);
+	hdr.revision = htole32(GPT_HEADER_REVISION_V1_00);
+	hdr.header_size = htole32(offsetof(gpt_header, reserved2));
+	hdr.my_lba = htole64(my_lba);
+	hdr.alternate_lba = htole64(alternate_lba);
+	hdr.first_usable_lba = htole64(2 + IMAGE_PTES_LBAS);
+	hdr.last_usable_lba = htole64(IMAGE_LAST_LBA - 1 - IMAGE_PTES_LBAS);
+	memcpy(&hdr.disk_guid, &image_disk_guid, sizeof(hdr.disk_guid));
+	hdr.partition_entry_lba = htole64(entries_lba);
+	hdr.num_partition_entries = htole32(IMAGE_NPTES);
+	hdr.sizeof_partition_entry = htole32(sizeof(gpt_entry));
+	hdr.partition_entry_array_crc32 = htole32(efi_crc32(ptes, ptes_size));
+	hdr.header_crc32 = htole32(efi_crc32(&hdr,
+					     offsetof(gpt_header, reserved2)));
+
+	if (pwrite(fd, ptes, ptes_size, entries_lba * IMAGE_SECTOR_SIZE)
+	    != (ssize_t)ptes_size ||
+	    pwrite(fd, &hdr, sizeof(hdr), my_lba * IMAGE_SECTOR_SIZE)
+	    != (ssize_t)sizeof(hdr))
+		return -1;
+	return 0;
+}
+
+/*
+ * Write an image holding parts, in a GPT with the copies flags asks for
+ * and a protective MBR, or with no GPT flags, in a plain MBR.  Anything
+ * already in the image is replaced.
+ */
+static int
+write_image(const char *name, const struct image_part *parts, size_t nparts,
+	    unsigned int flags)
+{
+	static const uint8_t zeroes[(2 + IMAGE_PTES_LBAS) * IMAGE_SECTOR_SIZE];
+	gpt_entry ptes[IMAGE_NPTES];
+	legacy_mbr mbr;
+	int fd;
+
+	fd = image_attach(name);
+	if (fd < 0)
+		return -1;
+
+	/* clear out the tables the image had before, at both ends */
+	if (pwrite(fd, zeroes, sizeof(zeroes), 0) != (ssize_t)sizeof(zeroes) ||
+	    pwrite(fd, zeroes, sizeof(zeroes) - IMAGE_SECTOR_SIZE,
+		   (IMAGE_LAST_LBA - IMAGE_PTES_LBAS) * IMAGE_SECTOR_SIZE)
+	    != (ssize_t)(sizeof(zeroes) - IMAGE_SECTOR_SIZE))
+		goto err;
+
+	memset(&mbr, 0, sizeof(mbr));
+	mbr.magic = htole16(MSDOS_MBR_MAGIC);
+	if (flags & IMAGE_GPT) {
+		mbr.partition[0].os_type = EFI_PMBR_OSTYPE_EFI_GPT;
+		mbr.partition[0].starting_lba = htole32(1);
+		mbr.partition[0].size_in_lba = htole32(IMAGE_LAST_LBA);
+	} else {
+		mbr.unique_mbr_signature = htole32(0x1badd15c);
+		for (size_t i = 0; i < nparts && i < 4; i++) {
+			partition_record *pr = &mbr.partition[i];
+
+			pr->os_type = EFI_PMBR_OSTYPE_EFI;
+			pr->starting_lba = htole32(parts[i].first_lba);
+			pr->size_in_lba = htole32(parts[i].last_lba -
+						  parts[i].first_lba + 1);
+		}
+	}
+	if (pwrite(fd, &mbr, sizeof(mbr), 0) != (ssize_t)sizeof(mbr))
+		goto err;
+
+	memset(ptes, 0, sizeof(ptes));
+	for (size_t i = 0; i < nparts; i++) {
+		memcpy(&ptes[i].partition_type_guid, &parts[i].type,
+		       sizeof(efi_guid_t));
+		memcpy(&ptes[i].unique_partition_guid, &parts[i].uuid,
+		       sizeof(efi_guid_t));
+		ptes[i].starting_lba = htole64(parts[i].first_lba);
+		ptes[i].ending_lba = htole64(parts[i].last_lba);
+	}
+
+	if ((flags & IMAGE_PRIMARY) &&
+	    write_gpt(fd, 1, IMAGE_LAST_LBA, 2, ptes) < 0)
+		goto err;
+	if ((flags & IMAGE_ALTERNATE) &&
+	    write_gpt(fd, IMAGE_LAST_LBA, 1, IMAGE_LAST_LBA - IMAGE_PTES_LBAS,
+		      ptes) < 0)
+		goto err;
+
+	if (fsync(fd) < 0)
+		goto err;
+	return 0;
+err:
+	warn("could not write \"%s\"", name);
+	return -1;
+}
+
+static int
+format_dp(uint8_t *dp, ssize_t size, char *buf, size_t bufsize)
+{
+	ssize_t sz;
+
+	sz = efidp_format_device_path((unsigned char *)buf, bufsize,
+				      (const_efidp)dp, size);
+	if (sz < 0 || (size_t)sz >= bufsize) {
+		warnx("could not format device path");
+		return -1;
+	}
+	return 0;
+}
+
+#define ESP_GUID(n)	EFI_GUID(0xe5900000 + (n), 0x7a2b, 0x4d3c, 0x8e4f, \
+				 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 + (n))
+
+static const struct image_part batch_parts_a[] = {
+	{ PARTITION_SYSTEM_GUID, ESP_GUID(1), 2048, 4095 },
+	{ PARTITION_BASIC_DATA_GUID, ESP_GUID(2), 4096, 8191 },
+	{ PARTITION_SYSTEM_GUID, ESP_GUID(3), 8192, 10239 },
+};
+
+static const struct image_part batch_parts_b[] = {
+	{ PARTITION_SYSTEM_GUID, ESP_GUID(4), 2048, 6143 },
+};
+
+static const char * const batch_images[] = {
+	"a.img",
+	"b.img",
+	"missing.img",
+};
+
+#define BATCH_FILE "\\EFI\\test\\shimx64.efi"
+
+/*
+ * Requests on the two images are interleaved, so they only come out
+ * right if each is grouped with the other requests on its own image.
+ */
+static const struct {
+	unsigned int image;
+	int partition;
+	bool relpath;
+	uint32_t options;
+	const char *expected;
+	int error;
+} batch_cases[] = {
+	{ 0, 1, true, EFIBOOT_ABBREV_HD,
+	  "HD(1,GPT,e5900001-7a2b-4d3c-8e4f-102030405061,0x800,0x800)/"
+	  BATCH_FILE, 0 },
+	{ 1, 1, true, EFIBOOT_ABBREV_HD,
+	  "HD(1,GPT,e5900004-7a2b-4d3c-8e4f-102030405064,0x800,0x1000)/"
+	  BATCH_FILE, 0 },
+	{ 0, 3, true, EFIBOOT_ABBREV_HD,
+	  "HD(3,GPT,e5900003-7a2b-4d3c-8e4f-102030405063,0x2000,0x800)/"
+	  BATCH_FILE, 0 },
+	{ 2, 1, true, EFIBOOT_ABBREV_HD, NULL, ENOENT },
+	{ 0, 2, false, EFIBOOT_ABBREV_HD, NULL, EINVAL },
+	{ 1, IMAGE_NPTES + 1, true, EFIBOOT_ABBREV_HD, NULL, ENOSYS },
+	{ 0, 1, true, 0, NULL, EINVAL },
+	{ 1, -1, true, EFIBOOT_ABBREV_HD,
+	  "HD(1,GPT,e5900004-7a2b-4d3c-8e4f-102030405064,0x800,0x1000)/"
+	  BATCH_FILE, 0 },
+	{ 0, 2, true, EFIBOOT_ABBREV_FILE, BATCH_FILE, 0 },
+};
+
+#define N_BATCH_CASES (sizeof(batch_cases) / sizeof(batch_cases[0]))
+
+static int
+esp_batch_check(unsigned int max_threads)
+{
+	efi_file_dp_request_t reqs[N_BATCH_CASES];
+	uint8_t bufs[N_BATCH_CASES][1024];
+	char devpaths[N_BATCH_CASES][PATH_MAX];
+	ssize_t n_expected = 0, failed;
+	char str[1024];
+
+	memset(reqs, 0, sizeof(reqs));
+	for (size_t i = 0; i < N_BATCH_CASES; i++) {
+		strcpy(devpaths[i],
+		       image_device(batch_images[batch_cases[i].image]));
+		reqs[i].devpath = devpaths[i];
+		reqs[i].partition = batch_cases[i].partition;
+		reqs[i].relpath = batch_cases[i].relpath
+				  ? "/EFI/test/shimx64.efi" : NULL;
+		reqs[i].options = batch_cases[i].options;
+		reqs[i].buf = bufs[i];
+		reqs[i].size = sizeof(bufs[i]);
+		if (!batch_cases[i].expected)
+			n_expected += 1;
+	}
+
+	failed = efi_generate_file_device_paths(reqs, N_BATCH_CASES,
+						max_threads);
+	if (failed != n_expected) {
+		warnx("%u threads: %zd requests failed, expected %zd",
+		      max_threads, failed, n_expected);
+		return -1;
+	}
+
+	for (size_t i = 0; i < N_BATCH_CASES; i++) {
+		efi_file_dp_request_t *req = &reqs[i];
+		uint8_t single[1024];
+		ssize_t sz;
+		int error;
+
+		if (!batch_cases[i].expected) {
+			if (req->ret >= 0 || req->error != batch_cases[i].error) {
+				warnx("%u threads: request %zd gave %zd (%s), expected %s",
+				      max_threads, i, req->ret,
+				      strerror(req->error),
+				      strerror(batch_cases[i].error));
+				return -1;
+			}
+		} else {
+			if (req->ret < 0) {
+				warnx("%u threads: request %zd failed: %s",
+				      max_threads, i, strerror(req->error));
+				return -1;
+			}
+			if (format_dp(req->buf, req->ret, str, sizeof(str)) < 0)
+				return -1;
+			if (strcmp(str, batch_cases[i].expected)) {
+				warnx("%u threads: request %zd gave \"%s\", expected \"%s\"",
+				      max_threads, i, str,
+				      batch_cases[i].expected);
+				return -1;
+			}
+			if (verbosity >= 1)
+				printf("%u threads: %zd: %s\n", max_threads,
+				       i, str);
+		}
+
+		/* and each matches what the one-at-a-time call says */
+		if (!req->relpath)
+			continue;
+		efi_error_clear();
+		errno = 0;
+		sz = efi_generate_file_device_path_from_esp(single,
+				sizeof(single), req->devpath, req->partition,
+				req->relpath, req->options);
+		error = sz < 0 ? errno : 0;
+		efi_error_clear();
+		if (sz != req->ret || error != req->error ||
+		    (sz > 0 && memcmp(single, req->buf, sz))) {
+			warnx("%u threads: request %zd gave %zd (%s), but one at a time gave %zd (%s)",
+			      max_threads, i, req->ret, strerror(req->error),
+			      sz, strerror(error));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+esp_batch_test(void)
+{
+	const unsigned int threads[] = { 1, 2, 0 };
+	int rc = -1;
+
+	rc = image_dir_init();
+	if (rc != 0)
+		return rc < 0 ? -1 : 0;
+	rc = -1;
+
+	if (write_image(batch_images[0], batch_parts_a,
+			sizeof(batch_parts_a) / sizeof(batch_parts_a[0]),
+			IMAGE_GPT) < 0 ||
+	    write_image(batch_images[1], batch_parts_b,
+			sizeof(batch_parts_b) / sizeof(batch_parts_b[0]),
+			IMAGE_GPT) < 0)
+		goto out;
+
+	for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		if (esp_batch_check(threads[i]) < 0)
+			goto out;
+	}
+	rc = 0;
+out:
+	efi_error_clear();
+	image_dir_fini();
+	return rc;
+}
+
+/*
+ * Look guid up on an image with efi_find_gpt_partition() and check that
+ * it's partition expected, or with expected < 0, that the lookup fails
+ * with error.
+ */
+static int
+find_check(const char *what, const char *name, const efi_guid_t *guid,
+	   uint32_t options, int after, int expected, int error)
+{
+	int rc, rc_error;
+
+	errno = 0;
+	rc = efi_find_gpt_partition(image_device(name), guid, options, after);
+	rc_error = rc < 0 ? errno : 0;
+	efi_error_clear();
+
+	if (rc != expected || (expected < 0 && rc_error != error)) {
+		warnx("%s: %s gave %d (%s), expected %d (%s)", what, name,
+		      rc, strerror(rc_error), expected,
+		      strerror(expected < 0 ? error : 0));
+		return -1;
+	}
+	if (verbosity >= 1)
+		printf("%-32s %s: %d\n", what, name, rc);
+	return 0;
+}
+
+/*
+ * The GPT cache only answers if the blocks it worked its answer out from
+ * still read the same, so every lookup here, including the ones after an
+ * image is rewritten in place, has to match what's on the image now.
+ */
+static const struct image_part gpt_cache_parts[] = {
+	{ PARTITION_SYSTEM_GUID, ESP_GUID(5), 2048, 4095 },
+	{ PARTITION_BASIC_DATA_GUID, ESP_GUID(6), 4096, 8191 },
+};
+
+static const struct image_part gpt_cache_parts_moved[] = {
+	{ PARTITION_BASIC_DATA_GUID, ESP_GUID(6), 2048, 4095 },
+	{ PARTITION_SYSTEM_GUID, ESP_GUID(5), 4096, 8191 },
+	{ PARTITION_SYSTEM_GUID, ESP_GUID(7), 8192, 10239 },
+};
+
+static const char * const gpt_cache_images[] = {
+	"primary.img",
+	"alternate.img",
+	"mbr.img",
+};
+
+#define N_GPT_CACHE_PARTS \
+	(sizeof(gpt_cache_parts) / sizeof(gpt_cache_parts[0]))
+#define N_GPT_CACHE_PARTS_MOVED \
+	(sizeof(gpt_cache_parts_moved) / sizeof(gpt_cache_parts_moved[0]))
+
+static int
+gpt_cache_test(void)
+{
+	const efi_guid_t esp = PARTITION_SYSTEM_GUID;
+	const efi_guid_t guid5 = ESP_GUID(5);
+	const efi_guid_t guid6 = ESP_GUID(6);
+	const efi_guid_t guid7 = ESP_GUID(7);
+	const uint32_t by_type = EFIBOOT_OPTIONS_MATCH_TYPE_GUID;
+	int mbr_error;
+	int rc = -1;
+
+	rc = image_dir_init();
+	if (rc != 0)
+		return rc < 0 ? -1 : 0;
+	rc = -1;
+
+	if (write_image("primary.img", gpt_cache_parts, N_GPT_CACHE_PARTS,
+			IMAGE_PRIMARY) < 0 ||
+	    write_image("alternate.img", gpt_cache_parts, N_GPT_CACHE_PARTS,
+			IMAGE_ALTERNATE) < 0 ||
+	    write_image("mbr.img", gpt_cache_parts, N_GPT_CACHE_PARTS, 0) < 0)
+		goto out;
+
+	/* a primary GPT with no alternate, looked up cold and cached */
+	for (int i = 0; i < 2; i++) {
+		if (find_check("primary only", "primary.img", &guid6, 0, 0,
+			       2, 0) < 0 ||
+		    find_check("primary only, by type", "primary.img", &esp,
+			       by_type, 0, 1, 0) < 0)
+			goto out;
+	}
+
+	/* only the alternate GPT, which the cache checks the tail for */
+	for (int i = 0; i < 2; i++) {
+		if (find_check("alternate only", "alternate.img", &guid5, 0, 0,
+			       1, 0) < 0 ||
+		    find_check("alternate only, by type", "alternate.img",
+			       &esp, by_type, 0, 1, 0) < 0)
+			goto out;
+	}
+
+	/*
+	 * No GPT at all is cached too; the second lookup must fail the
+	 * same way the first did, and writing a GPT must be noticed.
+	 */
+	errno = 0;
+	if (efi_find_gpt_partition(image_device("mbr.img"), &guid5, 0, 0) >= 0) {
+		warnx("found a GPT partition on an MBR disk");
+		goto out;
+	}
+	mbr_error = errno;
+	efi_error_clear();
+	if (find_check("MBR", "mbr.img", &guid5, 0, 0, -1, mbr_error) < 0)
+		goto out;
+	if (write_image("mbr.img", gpt_cache_parts, N_GPT_CACHE_PARTS,
+			IMAGE_GPT) < 0 ||
+	    find_check("MBR rewritten as GPT", "mbr.img", &guid5, 0, 0,
+		       1, 0) < 0)
+		goto out;
+
+	/*
+	 * Rewrite each image's table in place, moving partitions and
+	 * adding one, and then make the primary one alternate only and
+	 * the alternate one primary only.
+	 */
+	if (write_image("primary.img", gpt_cache_parts_moved,
+			N_GPT_CACHE_PARTS_MOVED, IMAGE_PRIMARY) < 0 ||
+	    write_image("alternate.img", gpt_cache_parts_moved,
+			N_GPT_CACHE_PARTS_MOVED, IMAGE_ALTERNATE) < 0)
+		goto out;
+	for (unsigned int i = 0; i < 2; i++) {
+		if (find_check("rewritten", gpt_cache_images[i], &guid5, 0, 0,
+			       2, 0) < 0 ||
+		    find_check("rewritten, new partition",
+			       gpt_cache_images[i], &guid7, 0, 0, 3, 0) < 0 ||
+		    find_check("rewritten, moved partition",
+			       gpt_cache_images[i], &guid6, 0, 0, 1, 0) < 0)
+			goto out;
+	}
+
+	if (write_image("primary.img", gpt_cache_parts, N_GPT_CACHE_PARTS,
+			IMAGE_ALTERNATE) < 0 ||
+	    write_image("alternate.img", gpt_cache_parts, N_GPT_CACHE_PARTS,
+			IMAGE_PRIMARY) < 0)
+		goto out;
+	for (unsigned int i = 0; i < 2; i++) {
+		if (find_check("swapped", gpt_cache_images[i], &guid5, 0, 0,
+			       1, 0) < 0 ||
+		    find_check("swapped, removed partition",
+			       gpt_cache_images[i], &guid7, 0, 0,
+			       -1, ENOENT) < 0)
+			goto out;
+	}
+	rc = 0;
+out:
+	image_dir_fini();
+	return rc;
+}
+
+/*
+ * batch_parts_a has ESPs as partitions 1 and 3, with a data partition
+ * between them.
+ */
+static const char * const gpt_find_images[] = {
+	"a.img",
+};
+
+static int
+gpt_find_test(void)
+{
+	const efi_guid_t esp = PARTITION_SYSTEM_GUID;
+	const efi_guid_t data = PARTITION_BASIC_DATA_GUID;
+	const efi_guid_t guid1 = ESP_GUID(1);
+	const efi_guid_t guid3 = ESP_GUID(3);
+	const efi_guid_t zero = EFI_GUID(0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	const uint32_t by_type = EFIBOOT_OPTIONS_MATCH_TYPE_GUID;
+	const char *img = gpt_find_images[0];
+	int rc = -1;
+
+	rc = image_dir_init();
+	if (rc != 0)
+		return rc < 0 ? -1 : 0;
+	rc = -1;
+
+	if (write_image(img, batch_parts_a,
+			sizeof(batch_parts_a) / sizeof(batch_parts_a[0]),
+			IMAGE_GPT) < 0)
+		goto out;
+
+	/* walk both ESPs with after, as a caller looking for all of them */
+	if (find_check("first ESP", img, &esp, by_type, 0, 1, 0) < 0 ||
+	    find_check("ESP after 1", img, &esp, by_type, 1, 3, 0) < 0 ||
+	    find_check("ESP after 2", img, &esp, by_type, 2, 3, 0) < 0 ||
+	    find_check("ESP after 3", img, &esp, by_type, 3, -1, ENOENT) < 0 ||
+	    find_check("ESP after -1", img, &esp, by_type, -1, 1, 0) < 0 ||
+	    find_check("ESP after the table", img, &esp, by_type,
+		       IMAGE_NPTES, -1, ENOENT) < 0 ||
+	    find_check("data", img, &data, by_type, 0, 2, 0) < 0)
+		goto out;
+
+	/* unique GUIDs, and each kind of GUID only matches its own field */
+	if (find_check("unique 1", img, &guid1, 0, 0, 1, 0) < 0 ||
+	    find_check("unique 3", img, &guid3, 0, 0, 3, 0) < 0 ||
+	    find_check("unique 3 after 3", img, &guid3, 0, 3,
+		       -1, ENOENT) < 0 ||
+	    find_check("type as unique", img, &esp, 0, 0, -1, ENOENT) < 0 ||
+	    find_check("unique as type", img, &guid1, by_type, 0,
+		       -1, ENOENT) < 0)
+		goto out;
+
+	if (find_check("zero type", img, &zero, by_type, 0, -1, EINVAL) < 0 ||
+	    find_check("zero unique", img, &zero, 0, 0, -1, EINVAL) < 0)
+		goto out;
+	rc = 0;
+out:
+	image_dir_fini();
+	return rc;
+}
+
+static const struct test tests[] = {
+	{ "sysfs-cache", sysfs_cache_test },
+	{ "esp-batch", esp_batch_test },
+	{ "gpt-cache", gpt_cache_test },
+	{ "gpt-find", gpt_find_test },
+};
+
+const struct test_program test_program = {
+	.description = "Check libefiboot's results for each TEST.",
+	.verbose_help = "Report what each check saw",
+	.tests = tests,
+	.ntests = sizeof(tests) / sizeof(tests[0]),
+};
+
+// vim:fenc=utf-8:tw=75:noet
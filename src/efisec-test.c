@@ -0,0 +1,406 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * efisec-test.c - check libefisec's handling of security databases
+ */
+
+#include "fix_coverity.h" // IWYU pragma: keep
+
+#include <efivar.h>
+#include <efisec.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "test-main.h"
+
+#define TEST_OWNER \
+	EFI_GUID(0x0223eddb,0x9079,0x4388,0xaf77,0x2d,0x65,0xb1,0xc3,0x5d,0x3b)
+
+#define OTHER_TEST_OWNER \
+	EFI_GUID(0x5ba3ee6b,0x2b51,0x4e06,0x8b59,0x0d,0x1c,0x3f,0x6e,0x92,0x47)
+
+/*
+ * fill in sha256 data whose first byte is key and whose other bytes are
+ * all 0x5a
+ */
+static void
+key_data(efi_secdb_data_t *data, uint8_t key)
+{
+	memset(&data->sha256, 0x5a, sizeof(data->sha256));
+	data->raw[0] = key;
+}
+
+/*
+ * add the sha256 entry for key
+ */
+static int
+add_key(efi_secdb_t *secdb, efi_guid_t owner, uint8_t key)
+{
+	efi_secdb_data_t data;
+
+	key_data(&data, key);
+	if (efi_secdb_add_entry(secdb, &owner, EFI_SECDB_TYPE_SHA256, &data,
+				sizeof(data.sha256)) < 0) {
+		warn("could not add entry 0x%02hhx", key);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * check that efi_secdb_contains() says want about the sha256 entry for
+ * key; a NULL owner matches any owner
+ */
+static int
+contains_check(const char *what, efi_secdb_t *secdb, const efi_guid_t *owner,
+	       uint8_t key, int want)
+{
+	efi_secdb_data_t data;
+	int rc;
+
+	key_data(&data, key);
+	rc = efi_secdb_contains(secdb, owner, EFI_SECDB_TYPE_SHA256, &data,
+				sizeof(data.sha256));
+	if (verbosity > 0)
+		printf("%s: contains 0x%02hhx: %d\n", what, key, rc);
+	if (rc != want) {
+		warnx("%s: contains 0x%02hhx returned %d, expected %d",
+		      what, key, rc, want);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * realize secdb and check that its one list holds entries with the
+ * first bytes in keys, in that order
+ */
+static int
+keys_check(const char *what, efi_secdb_t *secdb, const uint8_t *keys,
+	   size_t nkeys)
+{
+	const size_t esl_hdrsz = sizeof(efi_guid_t) + 3 * sizeof(uint32_t);
+	const size_t sigsz = sizeof(efi_guid_t) + sizeof(efi_sha256_hash_t);
+	uint8_t *esl = NULL;
+	size_t eslsz = 0;
+	int rc = -1;
+
+	if (efi_secdb_realize(secdb, (void **)&esl, &eslsz) < 0) {
+		warn("%s: could not realize secdb", what);
+		return -1;
+	}
+	if (eslsz != esl_hdrsz + nkeys * sigsz) {
+		warnx("%s: got %zd bytes, expected %zd", what, eslsz,
+		      esl_hdrsz + nkeys * sigsz);
+		goto out;
+	}
+
+	for (size_t i = 0; i < nkeys; i++) {
+		uint8_t key = esl[esl_hdrsz + i * sigsz + sizeof(efi_guid_t)];
+
+		if (verbosity > 0)
+			printf("%s: entry %zd is 0x%02hhx\n", what, i, key);
+		if (key != keys[i]) {
+			warnx("%s: entry %zd is 0x%02hhx, expected 0x%02hhx",
+			      what, i, key, keys[i]);
+			goto out;
+		}
+	}
+	rc = 0;
+out:
+	free(esl);
+	return rc;
+}
+
+/*
+ * Turning on data sorting, or changing its direction, after entries are
+ * already in a list has to sort the whole list on the next addition, not
+ * just slot the new entry into place.
+ */
+static int
+sort_data_test(void)
+{
+	const uint8_t unsorted[] = { 0x87, 0x02, 0xa3, 0x8d };
+	const uint8_t ascending[] = { 0x02, 0x50, 0x87, 0x8d, 0xa3 };
+	const uint8_t descending[] = { 0xa3, 0x8d, 0x87, 0x50, 0x10, 0x02 };
+	efi_guid_t owner = TEST_OWNER;
+	efi_secdb_t *secdb;
+	int rc = -1;
+
+	secdb = efi_secdb_new();
+	if (!secdb)
+		err(1, "could not allocate secdb");
+
+	for (size_t i = 0; i < sizeof(unsorted); i++) {
+		if (add_key(secdb, owner, unsorted[i]) < 0)
+			goto out;
+	}
+	if (keys_check("unsorted", secdb, unsorted, sizeof(unsorted)) < 0)
+		goto out;
+
+	efi_secdb_set_bool(secdb, EFI_SECDB_SORT_DATA, true);
+	if (add_key(secdb, owner, 0x50) < 0 ||
+	    keys_check("ascending", secdb, ascending, sizeof(ascending)) < 0)
+		goto out;
+
+	efi_secdb_set_bool(secdb, EFI_SECDB_SORT_DESCENDING, true);
+	if (add_key(secdb, owner, 0x10) < 0 ||
+	    keys_check("descending", secdb, descending,
+		       sizeof(descending)) < 0)
+		goto out;
+
+	rc = 0;
+out:
+	efi_secdb_free(secdb);
+	return rc;
+}
+
+/*
+ * efi_secdb_contains() finds entries by data, with or without an owner,
+ * and adding data that's already there, even with another owner, leaves
+ * the database as it was.
+ */
+static int
+contains_test(void)
+{
+	const uint8_t keys[] = { 0x11, 0x22, 0x33, 0x44 };
+	efi_guid_t owner = TEST_OWNER;
+	efi_guid_t other = OTHER_TEST_OWNER;
+	efi_secdb_data_t data;
+	efi_secdb_t *secdb;
+	int rc = -1;
+
+	secdb = efi_secdb_new();
+	if (!secdb)
+		err(1, "could not allocate secdb");
+
+	for (size_t i = 0; i < sizeof(keys); i++) {
+		if (add_key(secdb, owner, keys[i]) < 0)
+			goto out;
+	}
+
+	if (contains_check("present", secdb, &owner, 0x33, 1) < 0 ||
+	    contains_check("any owner", secdb, NULL, 0x33, 1) < 0 ||
+	    contains_check("other owner", secdb, &other, 0x33, 0) < 0 ||
+	    contains_check("absent", secdb, &owner, 0x55, 0) < 0)
+		goto out;
+
+	key_data(&data, 0x33);
+	if (efi_secdb_contains(secdb, &owner, EFI_SECDB_TYPE_SHA1, &data,
+			       sizeof(data.sha1)) != 0) {
+		warnx("found a sha1 entry in a sha256-only secdb");
+		goto out;
+	}
+
+	errno = 0;
+	if (efi_secdb_contains(secdb, &owner, EFI_SECDB_TYPE_SHA256, NULL,
+			       sizeof(data.sha256)) != -1 || errno != EINVAL) {
+		warnx("contains with no data did not fail with EINVAL");
+		goto out;
+	}
+	errno = 0;
+	if (efi_secdb_contains(secdb, &owner, EFI_SECDB_TYPE_MAX, &data,
+			       sizeof(data.sha256)) != -1 || errno != EINVAL) {
+		warnx("contains with an invalid type did not fail with EINVAL");
+		goto out;
+	}
+
+	if (add_key(secdb, other, 0x33) < 0 ||
+	    keys_check("duplicate", secdb, keys, sizeof(keys)) < 0 ||
+	    contains_check("duplicate", secdb, &owner, 0x33, 1) < 0 ||
+	    contains_check("duplicate", secdb, &other, 0x33, 0) < 0)
+		goto out;
+
+	rc = 0;
+out:
+	efi_secdb_free(secdb);
+	return rc;
+}
+
+/*
+ * Deleting entries has to take them out of the hash index, both before
+ * and after enough deletions compact the list, and leave everything else
+ * findable and in order.
+ */
+static int
+delete_test(void)
+{
+	uint8_t keys[16];
+	size_t nkeys = sizeof(keys);
+	efi_guid_t owner = TEST_OWNER;
+	efi_secdb_data_t data;
+	efi_secdb_t *secdb;
+	int rc = -1;
+
+	secdb = efi_secdb_new();
+	if (!secdb)
+		err(1, "could not allocate secdb");
+
+	for (size_t i = 0; i < nkeys; i++) {
+		keys[i] = 0x10 + i;
+		if (add_key(secdb, owner, keys[i]) < 0)
+			goto out;
+	}
+
+	/*
+	 * The list compacts once deleted slots outnumber live ones, which
+	 * is after the ninth of these twelve deletions.
+	 */
+	for (size_t i = 0; i < 12; i++) {
+		uint8_t key = keys[0];
+
+		key_data(&data, key);
+		if (efi_secdb_del_entry(secdb, &owner, EFI_SECDB_TYPE_SHA256,
+					&data, sizeof(data.sha256)) < 0) {
+			warn("could not delete entry 0x%02hhx", key);
+			goto out;
+		}
+		memmove(keys, keys + 1, --nkeys);
+
+		if (contains_check("deleted", secdb, &owner, key, 0) < 0)
+			goto out;
+		for (size_t j = 0; j < nkeys; j++) {
+			if (contains_check("kept", secdb, &owner, keys[j],
+					   1) < 0)
+				goto out;
+		}
+		if (keys_check("after delete", secdb, keys, nkeys) < 0)
+			goto out;
+	}
+
+	key_data(&data, 0x10);
+	if (efi_secdb_del_entry(secdb, &owner, EFI_SECDB_TYPE_SHA256, &data,
+				sizeof(data.sha256)) < 0) {
+		warn("deleting an absent entry failed");
+		goto out;
+	}
+
+	keys[nkeys++] = 0x10;
+	if (add_key(secdb, owner, 0x10) < 0 ||
+	    contains_check("re-added", secdb, &owner, 0x10, 1) < 0 ||
+	    keys_check("re-added", secdb, keys, nkeys) < 0)
+		goto out;
+
+	rc = 0;
+out:
+	efi_secdb_free(secdb);
+	return rc;
+}
+
+/*
+ * efi_secdb_realize_buf() and efi_secdb_realize_fd() have to produce the
+ * same bytes as efi_secdb_realize(), including for a list with more
+ * entries than one writev() can take.
+ */
+static int
+realize_test(void)
+{
+	efi_guid_t owner = TEST_OWNER;
+	efi_secdb_data_t data;
+	efi_secdb_t *secdb;
+	uint8_t *esl = NULL, *buf = NULL, *fdbuf = NULL;
+	size_t eslsz = 0;
+	ssize_t sz;
+	FILE *f = NULL;
+	int rc = -1;
+
+	secdb = efi_secdb_new();
+	if (!secdb)
+		err(1, "could not allocate secdb");
+
+	for (unsigned int i = 0; i < 1500; i++) {
+		key_data(&data, i & 0xff);
+		memcpy(&data.raw[1], &i, sizeof(i));
+		if (efi_secdb_add_entry(secdb, &owner, EFI_SECDB_TYPE_SHA256,
+					&data, sizeof(data.sha256)) < 0) {
+			warn("could not add sha256 entry %u", i);
+			goto out;
+		}
+	}
+	memset(&data.sha1, 0xa5, sizeof(data.sha1));
+	if (efi_secdb_add_entry(secdb, &owner, EFI_SECDB_TYPE_SHA1, &data,
+				sizeof(data.sha1)) < 0) {
+		warn("could not add sha1 entry");
+		goto out;
+	}
+
+	if (efi_secdb_realize(secdb, (void **)&esl, &eslsz) < 0) {
+		warn("could not realize secdb");
+		goto out;
+	}
+
+	sz = efi_secdb_realize_buf(secdb, NULL, 0);
+	if (sz < 0 || (size_t)sz != eslsz) {
+		warnx("realize_buf size query returned %zd, expected %zd",
+		      sz, eslsz);
+		goto out;
+	}
+
+	buf = malloc(eslsz);
+	if (!buf)
+		err(1, "could not allocate %zd bytes", eslsz);
+
+	errno = 0;
+	sz = efi_secdb_realize_buf(secdb, buf, eslsz - 1);
+	if (sz != -1 || errno != ENOSPC) {
+		warnx("realize_buf into a short buffer did not fail with ENOSPC");
+		goto out;
+	}
+
+	sz = efi_secdb_realize_buf(secdb, buf, eslsz);
+	if (sz < 0 || (size_t)sz != eslsz || memcmp(buf, esl, eslsz)) {
+		warnx("realize_buf output does not match realize");
+		goto out;
+	}
+
+	f = tmpfile();
+	if (!f)
+		err(1, "could not create temporary file");
+	if (efi_secdb_realize_fd(secdb, fileno(f)) < 0) {
+		warn("could not realize secdb to a file");
+		goto out;
+	}
+	fdbuf = calloc(1, eslsz + 1);
+	if (!fdbuf)
+		err(1, "could not allocate %zd bytes", eslsz + 1);
+	rewind(f);
+	sz = fread(fdbuf, 1, eslsz + 1, f);
+	if ((size_t)sz != eslsz || memcmp(fdbuf, esl, eslsz)) {
+		warnx("realize_fd wrote %zd bytes that do not match realize",
+		      sz);
+		goto out;
+	}
+
+	if (verbosity > 0)
+		printf("realized %zd identical bytes three ways\n", eslsz);
+	rc = 0;
+out:
+	if (f)
+		fclose(f);
+	free(fdbuf);
+	free(buf);
+	free(esl);
+	efi_secdb_free(secdb);
+	return rc;
+}
+
+static const struct test tests[] = {
+	{ "sort-data", sort_data_test },
+	{ "contains", contains_test },
+	{ "delete", delete_test },
+	{ "realize", realize_test },
+};
+
+const struct test_program test_program = {
+	.description = "Check libefisec's results for each TEST.",
+	.verbose_help = "Report what each check saw",
+	.tests = tests,
+	.ntests = sizeof(tests) / sizeof(tests[0]),
+};
+
+// vim:fenc=utf-8:tw=75:noet
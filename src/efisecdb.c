@@ -577,22 +577,13 @@ sort_err:
 		err(1, "could not truncate output file \"%s\"", outfile);
 	}
 
-	void *output;
-	size_t size = 0;
-	rc = efi_secdb_realize(secdb, &output, &size);
+	rc = efi_secdb_realize_fd(secdb, outfd);
 	if (rc < 0) {
 		unlink(outfile);
-		secdb_err(1, "could not realize signature list");
-	}
-
-	rc = write(outfd, output, size);
-	if (rc < 0) {
-		unlink(outfile);
-		err(1, "could not write signature list");
+		secdb_err(1, "could not write signature list");
 	}
 
 	close(outfd);
-	xfree(output);
 
 	return 0;
 }
@@ -0,0 +1,933 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * efivar-test.c - check and time libefivar's GUID, CRC32, and device
+ *		   path code
+ */
+
+#include "fix_coverity.h" // IWYU pragma: keep
+
+#include <efivar.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "crc32.h"
+#include "test-main.h"
+
+/*
+ * Call fn(arg) iterations times, stopping at the first failure, and with
+ * -v, report the rate; each call handles ops of whatever unit names.
+ */
+static int
+timed(const char *label, double ops, const char *unit,
+      int (*fn)(void *arg), void *arg)
+{
+	struct timespec start, end;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned long i = 0; i < iterations; i++) {
+		if (fn(arg) < 0)
+			return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (verbosity >= 1) {
+		secs = (end.tv_sec - start.tv_sec) +
+		       (end.tv_nsec - start.tv_nsec) / 1e9;
+		ops *= iterations;
+		printf("%-24s %.0f %s in %.3fs (%.0f/s)\n", label, ops, unit,
+		       secs, ops / secs);
+	}
+	return 0;
+}
+
+/*
+ * Map each well-known GUID to its name and the name back to the GUID.
+ */
+static int
+guids_one(void *arg __attribute__((__unused__)))
+{
+	for (uint64_t j = 0; j < efi_n_well_known_guids; j++) {
+		const struct efivar_guidname *gn;
+		efi_guid_t guid;
+		char *name = NULL;
+		int result;
+
+		gn = &efi_well_known_guids[j];
+		result = efi_guid_to_name((efi_guid_t *)&gn->guid, &name);
+		if (result < 0 || strcmp(name, gn->name)) {
+			warnx("efi_guid_to_name(%s) = \"%s\"", gn->name,
+			      result < 0 ? "" : name);
+			free(name);
+			return -1;
+		}
+		free(name);
+
+		result = efi_name_to_guid(gn->name, &guid);
+		if (result < 0 || efi_guid_cmp(&guid, &gn->guid)) {
+			warnx("efi_name_to_guid(%s) failed", gn->name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+guids_test(void)
+{
+	return timed("guids", 2.0 * efi_n_well_known_guids, "lookups",
+		     guids_one, NULL);
+}
+
+/*
+ * Resolve each well-known GUID's "{name}" form, each followed by an
+ * alias or a name that doesn't exist.
+ */
+static int
+names_one(void *arg __attribute__((__unused__)))
+{
+	static const struct {
+		const char *name;
+		const efi_guid_t *guid;
+	} others[] = {
+		{ "empty", &efi_guid_zero },
+		{ "efivar-test-no-such-guid", NULL },
+		{ "{redhat_2}", &efi_guid_redhat },
+		{ "{efivar-test-no-such-guid}", NULL },
+	};
+
+	for (uint64_t j = 0; j < efi_n_well_known_guids; j++) {
+		const struct efivar_guidname *gn;
+		char name[sizeof(gn->name) + 2];
+		const char *other;
+		efi_guid_t guid;
+		int result;
+
+		gn = &efi_well_known_guids[j];
+		snprintf(name, sizeof(name), "{%s}", gn->name);
+		result = efi_name_to_guid(name, &guid);
+		if (result < 0 || efi_guid_cmp(&guid, &gn->guid)) {
+			warnx("efi_name_to_guid(%s) failed", name);
+			return -1;
+		}
+
+		other = others[j % 4].name;
+		result = efi_name_to_guid(other, &guid);
+		if (others[j % 4].guid == NULL) {
+			if (result >= 0 || errno != ENOENT) {
+				warnx("efi_name_to_guid(%s) = %d", other,
+				      result);
+				return -1;
+			}
+			efi_error_clear();
+		} else if (result < 0 ||
+			   efi_guid_cmp(&guid, others[j % 4].guid)) {
+			warnx("efi_name_to_guid(%s) failed", other);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+names_test(void)
+{
+	return timed("names", 2.0 * efi_n_well_known_guids, "lookups",
+		     names_one, NULL);
+}
+
+enum guidstr_test {
+	GUIDSTR_TO_STR,
+	GUIDSTR_TO_STR_R,
+	GUIDSTR_FROM_STR,
+	GUIDSTR_FROM_STR_FAST,
+};
+
+static const char * const guidstr_test_names[] = {
+	[GUIDSTR_TO_STR] = "efi_guid_to_str",
+	[GUIDSTR_TO_STR_R] = "efi_guid_to_str_r",
+	[GUIDSTR_FROM_STR] = "efi_str_to_guid",
+	[GUIDSTR_FROM_STR_FAST] = "efi_str_to_guid_fast",
+};
+
+static char (*guidstrs)[37];
+
+/*
+ * Convert each well-known GUID to or from its string form with the
+ * functions *arg picks.
+ */
+static int
+guidstr_one(void *arg)
+{
+	enum guidstr_test test = *(enum guidstr_test *)arg;
+
+	for (uint64_t j = 0; j < efi_n_well_known_guids; j++) {
+		const efi_guid_t *expected = &efi_well_known_guids[j].guid;
+		char buf[37], *str = NULL;
+		efi_guid_t guid;
+		int result = -1;
+
+		switch (test) {
+		case GUIDSTR_TO_STR:
+			result = efi_guid_to_str(expected, &str);
+			if (result == 36 && strcmp(str, guidstrs[j]))
+				result = -1;
+			free(str);
+			break;
+		case GUIDSTR_TO_STR_R:
+			result = efi_guid_to_str_r(expected, buf);
+			if (result == 36 && strcmp(buf, guidstrs[j]))
+				result = -1;
+			break;
+		case GUIDSTR_FROM_STR:
+			result = efi_str_to_guid(guidstrs[j], &guid);
+			if (result == 0 && efi_guid_cmp(&guid, expected))
+				result = -1;
+			break;
+		case GUIDSTR_FROM_STR_FAST:
+			result = efi_str_to_guid_fast(guidstrs[j], &guid);
+			if (result == 0 && efi_guid_cmp(&guid, expected))
+				result = -1;
+			break;
+		}
+		if (result < 0) {
+			warnx("%s(%s) failed", guidstr_test_names[test],
+			      guidstrs[j]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int
+guidstr_test(void)
+{
+	int rc = 0;
+
+	guidstrs = calloc(efi_n_well_known_guids, sizeof(*guidstrs));
+	if (!guidstrs) {
+		warn("could not allocate memory");
+		return -1;
+	}
+	for (uint64_t j = 0; j < efi_n_well_known_guids; j++)
+		efi_guid_to_str_r(&efi_well_known_guids[j].guid, guidstrs[j]);
+
+	for (enum guidstr_test test = GUIDSTR_TO_STR;
+	     rc == 0 && test <= GUIDSTR_FROM_STR_FAST; test++)
+		rc = timed(guidstr_test_names[test], efi_n_well_known_guids,
+			   "calls", guidstr_one, &test);
+
+	free(guidstrs);
+	guidstrs = NULL;
+	return rc;
+}
+
+static const struct {
+	const char *data;
+	unsigned long len;
+	uint32_t crc;
+} crc32_vectors[] = {
+	{ "", 0, 0x00000000 },
+	{ "a", 1, 0xe8b7be43 },
+	{ "abc", 3, 0x352441c2 },
+	{ "123456789", 9, 0xcbf43926 },
+	{ "message digest", 14, 0x20159d7f },
+	{ "abcdefghijklmnopqrstuvwxyz", 26, 0x4c2750bd },
+	{ "The quick brown fox jumps over the lazy dog", 43, 0x414fa339 },
+	{ "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+	  "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 32, 0x190a55ad },
+	{ "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"
+	  "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff",
+	  32, 0xff6cab0b },
+	{ "\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+	  "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+	  32, 0x91267e8a },
+};
+
+/*
+ * crc32_pattern[i] is (i * 7 + 3) & 0xff, and these are the EFI CRCs of
+ * its first 1000 and 16384 bytes.
+ */
+#define CRC32_PATTERN_SIZE 16384
+static uint8_t crc32_pattern[CRC32_PATTERN_SIZE + 64];
+#define CRC32_PATTERN_1000 0x17bc2a46
+#define CRC32_PATTERN_16384 0x72a4967a
+
+/* How far the exhaustive comparison goes, per offset. */
+#define CRC32_CHECK_LEN 640
+
+static uint32_t
+crc32_bitwise(const uint8_t *buf, unsigned long len, uint32_t val)
+{
+	for (unsigned long i = 0; i < len; i++) {
+		val ^= buf[i];
+		for (unsigned int j = 0; j < 8; j++)
+			val = (val >> 1) ^ (0xedb88320 & -(val & 1));
+	}
+	return val;
+}
+
+/*
+ * Check an implementation against the test vectors, and against a
+ * bitwise CRC of every length up to CRC32_CHECK_LEN at every offset in a
+ * 16 byte window, both in one call and split in two with the first CRC
+ * as the second's seed.
+ */
+static int
+crc32_check(const struct crc32_impl *impl)
+{
+	crc32_fn_t fn = impl->crc32;
+
+	for (size_t j = 0; j < sizeof(crc32_vectors) / sizeof(crc32_vectors[0]); j++) {
+		uint32_t crc = fn(crc32_vectors[j].data,
+				  crc32_vectors[j].len, ~0U) ^ ~0U;
+
+		if (crc != crc32_vectors[j].crc) {
+			warnx("%s vector %zu: 0x%08"PRIx32" != 0x%08"PRIx32,
+			      impl->name, j, crc, crc32_vectors[j].crc);
+			return -1;
+		}
+	}
+	if ((fn(crc32_pattern, 1000, ~0U) ^ ~0U) != CRC32_PATTERN_1000 ||
+	    (fn(crc32_pattern, CRC32_PATTERN_SIZE, ~0U) ^ ~0U) != CRC32_PATTERN_16384) {
+		warnx("%s pattern CRCs are wrong", impl->name);
+		return -1;
+	}
+
+	for (unsigned int off = 0; off < 16; off++) {
+		const uint8_t *buf = crc32_pattern + off;
+		uint32_t expected = ~0U;
+
+		for (unsigned long len = 0; len <= CRC32_CHECK_LEN; len++) {
+			unsigned long split = len * 3 / 7;
+			uint32_t crc;
+
+			if (len)
+				expected = crc32_bitwise(buf + len - 1, 1, expected);
+			crc = fn(buf, len, ~0U);
+			if (crc != expected) {
+				warnx("%s offset %u length %lu is wrong",
+				      impl->name, off, len);
+				return -1;
+			}
+			crc = fn(buf + split, len - split,
+				 fn(buf, split, ~0U));
+			if (crc != expected) {
+				warnx("%s offset %u length %lu split at %lu is wrong",
+				      impl->name, off, len, split);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+#define CRC32_TIMED_BYTES (1ul << 20)
+
+struct crc32_timing {
+	crc32_fn_t fn;
+	unsigned long size;
+};
+
+static int
+crc32_one(void *arg)
+{
+	struct crc32_timing *t = arg;
+	volatile uint32_t crc = 0;
+
+	for (unsigned long i = 0; i < CRC32_TIMED_BYTES / t->size; i++)
+		crc = t->fn(crc32_pattern, t->size, crc);
+	return 0;
+}
+
+/*
+ * Check each implementation, and time it on the sizes GPT validation
+ * sees: a 92 byte header and a 128 entry partition table.
+ */
+static int
+crc32_test(void)
+{
+	static const unsigned long sizes[] = { 92, CRC32_PATTERN_SIZE };
+	const struct crc32_impl *impls;
+	size_t n_impls = crc32_get_impls(&impls);
+
+	for (size_t i = 0; i < sizeof(crc32_pattern); i++)
+		crc32_pattern[i] = (i * 7 + 3) & 0xff;
+
+	for (size_t i = 0; i < n_impls; i++) {
+		if (crc32_check(&impls[i]) < 0)
+			return -1;
+
+		for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			struct crc32_timing t = { impls[i].crc32, sizes[j] };
+			char label[32];
+
+			snprintf(label, sizeof(label), "crc32 %s %lu",
+				 impls[i].name, sizes[j]);
+			timed(label,
+			      (double)(CRC32_TIMED_BYTES / sizes[j]) * sizes[j],
+			      "bytes", crc32_one, &t);
+		}
+	}
+	return 0;
+}
+
+#define DP_PATHS 3
+
+static uint8_t dp_paths[DP_PATHS][512];
+static ssize_t dp_path_sizes[DP_PATHS];
+
+/*
+ * Build the kinds of paths Boot#### entries hold: a file on a GPT
+ * partition of an NVMe disk and of a SATA disk, and a PXE boot.
+ */
+static int
+build_dp_paths(void)
+{
+	uint8_t eui[8] = { 0x00, 0x25, 0x38, 0x5b, 0x71, 0xb0, 0x4e, 0x1a };
+	uint8_t mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+	efi_guid_t part = EFI_GUID(0x5d4ba1f0,0x2c8e,0x4b9a,0x9f3e,
+				   0x1c,0x61,0x27,0xe0,0x88,0xd2);
+	ssize_t sz, off;
+	uint8_t *buf;
+
+#define add(fn, args...) ({						\
+		sz = fn(buf + off, sizeof(dp_paths[0]) - off, ## args);	\
+		if (sz < 0)						\
+			return -1;					\
+		off += sz;						\
+	})
+	buf = dp_paths[0];
+	off = 0;
+	add(efidp_make_acpi_hid, EFIDP_ACPI_PCI_ROOT_HID, 0);
+	add(efidp_make_pci, 0x1d, 0);
+	add(efidp_make_pci, 0, 0);
+	add(efidp_make_nvme, 1, eui);
+	add(efidp_make_hd, 1, 0x800, 0x100000, (uint8_t *)&part,
+	    EFIDP_HD_FORMAT_GPT, EFIDP_HD_SIGNATURE_GUID);
+	add(efidp_make_file, "\\EFI\\fedora\\shimx64.efi");
+	add(efidp_make_end_entire);
+	dp_path_sizes[0] = off;
+
+	buf = dp_paths[1];
+	off = 0;
+	add(efidp_make_acpi_hid, EFIDP_ACPI_PCI_ROOT_HID, 0);
+	add(efidp_make_pci, 0x17, 0);
+	add(efidp_make_sata, 2, -1, 0);
+	add(efidp_make_hd, 2, 0x100800, 0x3a000000, (uint8_t *)&part,
+	    EFIDP_HD_FORMAT_GPT, EFIDP_HD_SIGNATURE_GUID);
+	add(efidp_make_file, "\\EFI\\BOOT\\BOOTX64.EFI");
+	add(efidp_make_end_entire);
+	dp_path_sizes[1] = off;
+
+	buf = dp_paths[2];
+	off = 0;
+	add(efidp_make_acpi_hid, EFIDP_ACPI_PCI_ROOT_HID, 0);
+	add(efidp_make_pci, 0x1c, 4);
+	add(efidp_make_pci, 0, 0);
+	add(efidp_make_mac_addr, 1, mac, sizeof(mac));
+	add(efidp_make_ipv4, 0xc0a80a14, 0xc0a80a01, 0xc0a80a01, 0xffffff00,
+	    68, 67, 17, 0);
+	add(efidp_make_end_entire);
+	dp_path_sizes[2] = off;
+#undef add
+	return 0;
+}
+
+static const char * const dp_path_strs[DP_PATHS] = {
+	"PciRoot(0x0)/Pci(0x1d,0x0)/Pci(0x0,0x0)/"
+	"NVMe(0x1,00-25-38-5B-71-B0-4E-1A)/"
+	"HD(1,GPT,5d4ba1f0-2c8e-4b9a-9f3e-1c6127e088d2,0x800,0x100000)/"
+	"\\EFI\\fedora\\shimx64.efi",
+	"PciRoot(0x0)/Pci(0x17,0x0)/Sata(2,65535,0)/"
+	"HD(2,GPT,5d4ba1f0-2c8e-4b9a-9f3e-1c6127e088d2,0x100800,0x3a000000)/"
+	"\\EFI\\BOOT\\BOOTX64.EFI",
+	"PciRoot(0x0)/Pci(0x1c,0x4)/Pci(0x0,0x0)/MAC(525400123456,1)/"
+	"IPv4(192.168.10.1:17152,4352,DHCP,192.168.10.20:17408,"
+	"192.168.10.1,255.255.255.0)",
+};
+
+enum dp_test {
+	DP_FORMAT_TWICE,
+	DP_FORMATTER,
+	DP_PARSE,
+};
+
+static const char * const dp_test_names[] = {
+	[DP_FORMAT_TWICE] = "efidp_format_device_path",
+	[DP_FORMATTER] = "efidp_formatter_format",
+	[DP_PARSE] = "efidp_parse_device_path",
+};
+
+struct dp_timing {
+	enum dp_test test;
+	efidp_formatter_t *formatter;
+};
+
+/*
+ * Format each path, either by sizing and then filling a buffer with
+ * efidp_format_device_path(), or with one reused efidp_formatter_t, or
+ * parse its text form back.
+ */
+static int
+dp_one(void *arg)
+{
+	struct dp_timing *t = arg;
+
+	for (unsigned j = 0; j < DP_PATHS; j++) {
+		const_efidp dp = (const_efidp)dp_paths[j];
+		ssize_t limit = dp_path_sizes[j];
+		const char *str = NULL;
+		ssize_t result = -1;
+		char buf[512];
+
+		switch (t->test) {
+		case DP_FORMAT_TWICE:
+			result = efidp_format_device_path(NULL, 0, dp, limit);
+			if (result <= 0 || result > (ssize_t)sizeof(buf))
+				break;
+			result = efidp_format_device_path((unsigned char *)buf,
+							  result, dp, limit);
+			str = buf;
+			break;
+		case DP_FORMATTER:
+			result = efidp_formatter_format(t->formatter, dp,
+							limit, &str);
+			break;
+		case DP_PARSE:
+			result = efidp_parse_device_path(
+					(unsigned char *)dp_path_strs[j],
+					(efidp)buf, sizeof(buf));
+			if (result == limit && !memcmp(buf, dp, limit))
+				str = dp_path_strs[j];
+			break;
+		}
+		if (result < 0 || !str || strcmp(str, dp_path_strs[j])) {
+			warnx("%s(%s) failed", dp_test_names[t->test],
+			      dp_path_strs[j]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+#define DP_FUZZ_PATHS 20000
+
+static uint64_t dp_fuzz_state = 0x9e3779b97f4a7c15ull;
+
+static uint32_t
+dp_fuzz_rand(void)
+{
+	dp_fuzz_state ^= dp_fuzz_state << 13;
+	dp_fuzz_state ^= dp_fuzz_state >> 7;
+	dp_fuzz_state ^= dp_fuzz_state << 17;
+	return dp_fuzz_state >> 32;
+}
+
+static void
+dp_fuzz_bytes(void *buf, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		((uint8_t *)buf)[i] = dp_fuzz_rand();
+}
+
+/*
+ * A random string from chars, which starts with a letter, so that it
+ * can't be taken for a number.
+ */
+static size_t
+dp_fuzz_str(char *buf, size_t max, const char *chars)
+{
+	size_t nchars = strlen(chars);
+	size_t n = 1 + dp_fuzz_rand() % max;
+
+	buf[0] = 'A' + dp_fuzz_rand() % 26;
+	for (size_t i = 1; i < n; i++)
+		buf[i] = chars[dp_fuzz_rand() % nchars];
+	buf[n] = '\0';
+	return n;
+}
+
+/*
+ * Write one random node to buf, in the form the formatter prints back
+ * unchanged: fields the text leaves out are zero, and numbers are only
+ * used where the text doesn't say something else.
+ */
+static ssize_t
+dp_fuzz_node(uint8_t *buf, size_t size)
+{
+	static const uint32_t named_hids[] = {
+		EFIDP_ACPI_PCI_ROOT_HID, EFIDP_ACPI_PCIE_ROOT_HID,
+		EFIDP_ACPI_FLOPPY_HID, EFIDP_ACPI_KEYBOARD_HID,
+		EFIDP_ACPI_SERIAL_HID,
+	};
+	static const uint16_t file_chars[] = {
+		'a', 'Z', '0', '.', '_', '-', ' ', '\\', 0xe9, 0x3a9, 0x4e2d,
+	};
+	static const char alnum[] = "abcdefghijklmnopqrstuvwxyz"
+				    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	efidp_data *dp = (efidp_data *)buf;
+	uint8_t type = 0, subtype = 0;
+	size_t len = 0;
+	char str[3][16];
+	size_t n;
+
+	memset(buf, 0, size);
+	switch (dp_fuzz_rand() % 24) {
+	case 0:
+		type = EFIDP_HARDWARE_TYPE;
+		subtype = EFIDP_HW_PCI;
+		len = sizeof(dp->pci);
+		dp->pci.device = dp_fuzz_rand();
+		dp->pci.function = dp_fuzz_rand();
+		break;
+	case 1:
+		type = EFIDP_HARDWARE_TYPE;
+		subtype = EFIDP_HW_MMIO;
+		len = sizeof(dp->mmio);
+		dp_fuzz_bytes(&dp->mmio.memory_type,
+			      len - sizeof(dp->header));
+		break;
+	case 2:
+		type = EFIDP_HARDWARE_TYPE;
+		subtype = EFIDP_HW_VENDOR;
+		n = dp_fuzz_rand() % 9;
+		len = sizeof(dp->hw_vendor) + n;
+		dp_fuzz_bytes(&dp->hw_vendor.vendor_guid,
+			      sizeof(efi_guid_t) + n);
+		break;
+	case 3:
+		type = EFIDP_ACPI_TYPE;
+		subtype = EFIDP_ACPI_HID;
+		len = sizeof(dp->acpi_hid);
+		dp->acpi_hid.uid = dp_fuzz_rand();
+		n = dp_fuzz_rand() % 6;
+		if (n < 5)
+			dp->acpi_hid.hid = named_hids[n];
+		else
+			dp->acpi_hid.hid = 0x5a5a0000 | (dp_fuzz_rand() & 0xffff);
+		break;
+	case 4: {
+		/* AcpiEx(), or PciRoot() with a string _UID */
+		char *next = (char *)buf + offsetof(efidp_acpi_hid_ex, hidstr);
+		bool named = !(dp_fuzz_rand() % 4);
+		uint32_t ids[3] = { 0, 0, 0 };
+
+		type = EFIDP_ACPI_TYPE;
+		subtype = EFIDP_ACPI_HID_EX;
+		for (int i = 0; i < 3; i++) {
+			str[i][0] = '\0';
+			if (named ? i == 1 : dp_fuzz_rand() % 2)
+				dp_fuzz_str(str[i], 8, alnum);
+			else if (!named)
+				ids[i] = dp_fuzz_rand();
+			strcpy(next, str[i]);
+			next += strlen(str[i]) + 1;
+		}
+		if (named)
+			ids[0] = EFIDP_ACPI_PCI_ROOT_HID;
+		else if (!str[0][0])
+			ids[0] = 0x5a5a0000 | (dp_fuzz_rand() & 0xffff);
+		dp->acpi_hid_ex.hid = ids[0];
+		dp->acpi_hid_ex.uid = ids[1];
+		dp->acpi_hid_ex.cid = ids[2];
+		len = next - (char *)buf;
+		break;
+		}
+	case 5:
+		type = EFIDP_ACPI_TYPE;
+		subtype = EFIDP_ACPI_ADR;
+		n = 1 + dp_fuzz_rand() % 4;
+		len = sizeof(dp->header) + n * sizeof(uint32_t);
+		dp_fuzz_bytes(dp->acpi_adr.adr, n * sizeof(uint32_t));
+		break;
+	case 6:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_NVME;
+		len = sizeof(dp->nvme);
+		dp_fuzz_bytes(&dp->nvme.namespace_id, len - sizeof(dp->header));
+		break;
+	case 7:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_SATA;
+		len = sizeof(dp->sata);
+		dp_fuzz_bytes(&dp->sata.hba_port, len - sizeof(dp->header));
+		break;
+	case 8:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_SCSI;
+		len = sizeof(dp->scsi);
+		dp_fuzz_bytes(&dp->scsi.target, len - sizeof(dp->header));
+		break;
+	case 9:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_MAC_ADDR;
+		len = sizeof(dp->mac_addr);
+		dp->mac_addr.if_type = dp_fuzz_rand() % 3;
+		dp_fuzz_bytes(dp->mac_addr.mac_addr,
+			      dp->mac_addr.if_type < 2 ? 6
+				: sizeof(dp->mac_addr.mac_addr));
+		break;
+	case 10:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_IPv4;
+		len = sizeof(dp->ipv4_addr);
+		dp_fuzz_bytes(dp->ipv4_addr.local_ipv4_addr,
+			      len - sizeof(dp->header));
+		dp->ipv4_addr.static_ip_addr &= 1;
+		break;
+	case 11:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_USB_CLASS;
+		len = sizeof(dp->usb_class);
+		dp_fuzz_bytes(&dp->usb_class.vendor_id,
+			      len - sizeof(dp->header));
+		n = dp_fuzz_rand() % 4;
+		if (n < 3) {
+			dp->usb_class.device_class = EFIDP_USB_CLASS_254;
+			dp->usb_class.device_subclass = n + 1;
+		} else {
+			dp->usb_class.device_class = EFIDP_USB_CLASS_AUDIO +
+						     dp_fuzz_rand() % 2;
+		}
+		break;
+	case 12:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_UART;
+		len = sizeof(dp->uart);
+		dp_fuzz_bytes(&dp->uart.reserved, len - sizeof(dp->header));
+		dp->uart.reserved = 0;
+		dp->uart.baud_rate |= 1;
+		dp->uart.data_bits |= 1;
+		break;
+	case 13:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_USB_WWID;
+		n = dp_fuzz_str(str[0], 12, alnum);
+		len = sizeof(dp->usb_wwid) + (n + 1) * sizeof(uint16_t);
+		dp_fuzz_bytes(&dp->usb_wwid.interface, 6);
+		for (size_t i = 0; i < n; i++)
+			dp->usb_wwid.serial_number[i] = str[0][i];
+		break;
+	case 14:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_URI;
+		n = dp_fuzz_str(str[0], 15, "abc:/.?=&,-");
+		len = sizeof(dp->uri) + n;
+		memcpy(dp->uri.uri, str[0], n);
+		break;
+	case 15:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_BTLE;
+		len = sizeof(dp->btle);
+		dp_fuzz_bytes(dp->btle.addr, len - sizeof(dp->header));
+		break;
+	case 16:
+		type = EFIDP_MESSAGE_TYPE;
+		subtype = EFIDP_MSG_FIBRECHANNEL;
+		len = sizeof(dp->fc);
+		dp_fuzz_bytes(&dp->fc.wwn, 16);
+		break;
+	case 17:
+		type = EFIDP_MEDIA_TYPE;
+		subtype = EFIDP_MEDIA_HD;
+		len = sizeof(dp->hd);
+		dp_fuzz_bytes(&dp->hd.partition_number,
+			      len - sizeof(dp->header));
+		switch (dp_fuzz_rand() % 3) {
+		case 0:
+			dp->hd.format = EFIDP_HD_FORMAT_PCAT;
+			dp->hd.signature_type = EFIDP_HD_SIGNATURE_MBR;
+			memset(&dp->hd.signature[4], 0, 12);
+			break;
+		case 1:
+			dp->hd.format = EFIDP_HD_FORMAT_GPT;
+			dp->hd.signature_type = EFIDP_HD_SIGNATURE_GUID;
+			break;
+		default:
+			dp->hd.format = 0;
+			dp->hd.signature_type = 3 + dp_fuzz_rand() % 250;
+			break;
+		}
+		break;
+	case 18:
+		type = EFIDP_MEDIA_TYPE;
+		subtype = EFIDP_MEDIA_FILE;
+		n = 1 + dp_fuzz_rand() % 20;
+		len = sizeof(dp->file) + (n + 1) * sizeof(uint16_t);
+		for (size_t i = 0; i < n; i++)
+			dp->file.name[i] = file_chars[dp_fuzz_rand() %
+				(sizeof(file_chars) / sizeof(file_chars[0]))];
+		break;
+	case 19:
+		type = EFIDP_MEDIA_TYPE;
+		subtype = EFIDP_MEDIA_RAMDISK;
+		len = sizeof(dp->ramdisk);
+		dp_fuzz_bytes(&dp->ramdisk.start_addr,
+			      len - sizeof(dp->header));
+		break;
+	case 20:
+		type = EFIDP_MEDIA_TYPE;
+		subtype = EFIDP_MEDIA_FIRMWARE_FILE + dp_fuzz_rand() % 2;
+		len = sizeof(dp->protocol);
+		dp_fuzz_bytes(&dp->protocol.protocol_guid,
+			      sizeof(efi_guid_t));
+		break;
+	case 21:
+		type = EFIDP_MEDIA_TYPE;
+		subtype = EFIDP_MEDIA_CDROM;
+		len = sizeof(dp->cdrom);
+		dp_fuzz_bytes(&dp->cdrom.boot_catalog_entry,
+			      len - sizeof(dp->header));
+		break;
+	case 22:
+		/* HardwarePath(), AcpiPath(), Msg(), and MediaPath() */
+		type = EFIDP_HARDWARE_TYPE + dp_fuzz_rand() % 4;
+		subtype = 0x70 + dp_fuzz_rand() % 16;
+		n = dp_fuzz_rand() % 12;
+		len = sizeof(dp->header) + n;
+		dp_fuzz_bytes(buf + sizeof(dp->header), n);
+		break;
+	default:
+		type = 0x10 + dp_fuzz_rand() % 0x60;
+		subtype = dp_fuzz_rand();
+		n = dp_fuzz_rand() % 12;
+		len = sizeof(dp->header) + n;
+		dp_fuzz_bytes(buf + sizeof(dp->header), n);
+		break;
+	}
+
+	dp->type = type;
+	dp->subtype = subtype;
+	dp->length = len;
+	return len;
+}
+
+/*
+ * Build random paths, with more than one instance now and then, and
+ * check that formatting each one and parsing the text gives back the
+ * same bytes, and that those format to the same text.
+ */
+static int
+dp_round_trip_test(void)
+{
+	static uint8_t dp[1024], parsed[1024];
+	static char text[8192], text2[8192];
+
+	for (unsigned i = 0; i < DP_FUZZ_PATHS; i++) {
+		unsigned nodes = 1 + dp_fuzz_rand() % 6;
+		ssize_t size = 0, sz;
+
+		for (unsigned j = 0; j < nodes; j++) {
+			size += dp_fuzz_node(dp + size, 128);
+			if (j + 1 < nodes && !(dp_fuzz_rand() % 8))
+				size += efidp_make_end_instance(dp + size, 4);
+		}
+		size += efidp_make_end_entire(dp + size, 4);
+
+		sz = efidp_format_device_path((unsigned char *)text,
+					      sizeof(text), (const_efidp)dp,
+					      size);
+		if (sz < 0) {
+			warn("path %u: efidp_format_device_path() failed", i);
+			return -1;
+		}
+		sz = efidp_parse_device_path((unsigned char *)text,
+					     (efidp)parsed, sizeof(parsed));
+		if (sz != size || memcmp(dp, parsed, size)) {
+			warnx("path %u: efidp_parse_device_path(%s) = %zd, expected %zd",
+			      i, text, sz, size);
+			return -1;
+		}
+		sz = efidp_format_device_path((unsigned char *)text2,
+					      sizeof(text2),
+					      (const_efidp)parsed, sz);
+		if (sz < 0 || strcmp(text, text2)) {
+			warnx("path %u: \"%s\" formats as \"%s\"",
+			      i, text, text2);
+			return -1;
+		}
+
+		/*
+		 * One byte short has to fail cleanly, and so may a cut off
+		 * copy of the text.
+		 */
+		if (efidp_parse_device_path((unsigned char *)text,
+					    (efidp)parsed, size - 1) >= 0 ||
+		    errno != ENOSPC) {
+			warnx("path %u: efidp_parse_device_path(%s) fit in %zd bytes",
+			      i, text, size - 1);
+			return -1;
+		}
+		text[dp_fuzz_rand() % strlen(text)] = '\0';
+		efidp_parse_device_path((unsigned char *)text, (efidp)parsed,
+					sizeof(parsed));
+		efi_error_clear();
+	}
+	return 0;
+}
+
+static int
+dp_test(void)
+{
+	struct dp_timing t = { 0, };
+	int rc = 0;
+
+	if (build_dp_paths() < 0) {
+		warn("could not build device paths");
+		return -1;
+	}
+	if (efidp_formatter_new(&t.formatter) < 0) {
+		warn("efidp_formatter_new() failed");
+		return -1;
+	}
+
+	for (t.test = DP_FORMAT_TWICE; rc == 0 && t.test <= DP_FORMATTER;
+	     t.test++)
+		rc = timed(dp_test_names[t.test], DP_PATHS, "paths", dp_one, &t);
+	efidp_formatter_free(t.formatter);
+	return rc;
+}
+
+static int
+dp_parse_test(void)
+{
+	struct dp_timing t = { .test = DP_PARSE, };
+
+	if (build_dp_paths() < 0) {
+		warn("could not build device paths");
+		return -1;
+	}
+	if (timed(dp_test_names[t.test], DP_PATHS, "paths", dp_one, &t) < 0)
+		return -1;
+
+	return dp_round_trip_test();
+}
+
+static const struct test tests[] = {
+	{ "guids", guids_test },
+	{ "names", names_test },
+	{ "guidstr", guidstr_test },
+	{ "crc32", crc32_test },
+	{ "dp", dp_test },
+	{ "dp-parse", dp_parse_test },
+};
+
+const struct test_program test_program = {
+	.description = "Check libefivar's results for each TEST, and with -v, report\n"
+		       "how fast it got them.",
+	.verbose_help = "Report timings",
+	.timed = true,
+	.tests = tests,
+	.ntests = sizeof(tests) / sizeof(tests[0]),
+};
+
+// vim:fenc=utf-8:tw=75:noet
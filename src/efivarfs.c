@@ -6,6 +6,7 @@
 
 #include "fix_coverity.h" // IWYU pragma: keep
 
+#include <dirent.h>
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -18,6 +19,7 @@
 #include <sys/stat.h>
 #include <sys/uio.h>
 #include <sys/vfs.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "efivar.h"
@@ -353,25 +355,94 @@ err:
 	return ret;
 }
 
+/*
+ * Open the variable and read just its 4-byte attribute header, without
+ * reading (or allocating room for) the data behind it.  If statbuf isn't
+ * NULL, it's filled in from the same fd.
+ */
+static int
+efivarfs_read_header(efi_guid_t guid, const char *name, uint32_t *attributes,
+		     struct stat *statbuf)
+{
+	__typeof__(errno) errno_value;
+	char *path = NULL;
+	int fd = -1;
+	int ret = -1;
+	ssize_t rc;
+
+	rc = make_efivarfs_path(&path, guid, name);
+	if (rc < 0) {
+		efi_error("make_efivarfs_path failed");
+		goto err;
+	}
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0) {
+		efi_error("open(%s)", path);
+		goto err;
+	}
+
+	if (statbuf && fstat(fd, statbuf) < 0) {
+		efi_error("fstat(%s) failed", path);
+		goto err;
+	}
+
+	efi_ratelimit_acquire(1);
+	do {
+		rc = pread(fd, attributes, sizeof(*attributes), 0);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0) {
+		efi_error("pread(%s) failed", path);
+		goto err;
+	}
+	if (rc != sizeof(*attributes)) {
+		errno = EIO;
+		efi_error("short read of %s (%zd of %zd)", path, rc,
+			  sizeof(*attributes));
+		goto err;
+	}
+
+	ret = 0;
+err:
+	errno_value = errno;
+
+	if (fd >= 0)
+		close(fd);
+
+	if (path)
+		free(path);
+
+	errno = errno_value;
+	return ret;
+}
+
 static int
 efivarfs_get_variable_attributes(efi_guid_t guid, const char *name,
 			    uint32_t *attributes)
 {
-	int ret = -1;
+	int ret;
+
+	ret = efivarfs_read_header(guid, name, attributes, NULL);
+	if (ret < 0)
+		efi_error("efivarfs_read_header failed");
+	return ret;
+}
 
-	uint8_t *data;
-	size_t data_size;
-	uint32_t attribs;
+static int
+efivarfs_stat_variable(efi_guid_t guid, const char *name, size_t *size,
+		       uint32_t *attributes)
+{
+	struct stat statbuf = { 0, };
+	int ret;
 
-	ret = efi_get_variable(guid, name, &data, &data_size, &attribs);
+	ret = efivarfs_read_header(guid, name, attributes, &statbuf);
 	if (ret < 0) {
-		efi_error("efi_get_variable failed");
+		efi_error("efivarfs_read_header failed");
 		return ret;
 	}
 
-	*attributes = attribs;
-	if (data)
-		free(data);
+	/* Compensate for the size of the Attributes field. */
+	*size = statbuf.st_size - sizeof (uint32_t);
 	return ret;
 }
 
@@ -387,16 +458,6 @@ efivarfs_get_variable(efi_guid_t guid, const char *name, uint8_t **data,
 	int fd = -1;
 	char *path = NULL;
 	int rc;
-	int ratelimit;
-
-	/*
-	 * The kernel rate limiter hits us if we go faster than 100 efi
-	 * variable reads per second as non-root.  So if we're not root, just
-	 * delay this long after each read.  The user is not going to notice.
-	 *
-	 * 1s / 100 = 10000us.
-	 */
-	ratelimit = geteuid() == 0 ? 0 : 10000;
 
 	rc = make_efivarfs_path(&path, guid, name);
 	if (rc < 0) {
@@ -410,14 +471,19 @@ efivarfs_get_variable(efi_guid_t guid, const char *name, uint8_t **data,
 		goto err;
 	}
 
-	usleep(ratelimit);
+	/*
+	 * The kernel rate limiter hits us if we go faster than 100 efi
+	 * variable reads per second as non-root, so account for each read()
+	 * we're about to do: the header, the data, and the EOF.
+	 */
+	efi_ratelimit_acquire(1);
 	rc = read(fd, &ret_attributes, sizeof (ret_attributes));
 	if (rc < 0) {
 		efi_error("read failed");
 		goto err;
 	}
 
-	usleep(ratelimit);
+	efi_ratelimit_acquire(2);
 	rc = read_file(fd, &ret_data, &size);
 	if (rc < 0) {
 		efi_error("read_file failed");
@@ -466,9 +532,48 @@ efivarfs_del_variable(efi_guid_t guid, const char *name)
 	return rc;
 }
 
+/*
+ * Check that the variable open on rfd (or not, if rfd is -1) holds
+ * expected_data, which is NULL if it should not exist.
+ */
 static int
-efivarfs_set_variable(efi_guid_t guid, const char *name, const uint8_t *data,
-		      size_t data_size, uint32_t attributes, mode_t mode)
+efivarfs_check_contents(int rfd, const uint8_t *expected_data,
+			size_t expected_size)
+{
+	uint8_t *cur = NULL;
+	size_t cur_size = 0;
+	bool matches;
+	int rc;
+
+	if (rfd < 0 || !expected_data) {
+		matches = rfd < 0 && !expected_data;
+	} else {
+		efi_ratelimit_acquire(2);
+		rc = read_file(rfd, &cur, &cur_size);
+		if (rc < 0) {
+			efi_error("read_file failed");
+			return -1;
+		}
+		/* read_file pads out 1 extra byte to NUL it */
+		matches = cur_size == sizeof (uint32_t) + expected_size + 1 &&
+			  !memcmp(cur + sizeof (uint32_t), expected_data,
+				  expected_size);
+		free(cur);
+	}
+
+	if (!matches) {
+		errno = ESTALE;
+		efi_error("variable does not have the expected contents");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+efivarfs_write_variable(efi_guid_t guid, const char *name, const uint8_t *data,
+			size_t data_size, uint32_t attributes, mode_t mode,
+			bool check, const uint8_t *expected_data,
+			size_t expected_size)
 {
 	char *path;
 	size_t alloc_size;
@@ -515,6 +620,15 @@ efivarfs_set_variable(efi_guid_t guid, const char *name, const uint8_t *data,
 	 * either.
 	 */
 	rfd = open(path, O_RDONLY);
+	if (rfd == -1 && check && errno != ENOENT) {
+		efi_error("failed to open %s for reading", path);
+		goto err;
+	}
+	if (check && efivarfs_check_contents(rfd, expected_data,
+					     expected_size) < 0) {
+		efi_error("efivarfs_check_contents failed");
+		goto err;
+	}
 	if (rfd != -1) {
 		/* save the containing device and the inode number for later */
 		if (fstat(rfd, &rfd_stat) == -1) {
@@ -615,6 +729,35 @@ err:
 	return ret;
 }
 
+static int
+efivarfs_set_variable(efi_guid_t guid, const char *name, const uint8_t *data,
+		      size_t data_size, uint32_t attributes, mode_t mode)
+{
+	return efivarfs_write_variable(guid, name, data, data_size,
+				       attributes, mode, false, NULL, 0);
+}
+
+/*
+ * The variable is checked through the same descriptor whose inode
+ * efivarfs_write_variable() later compares against the one it writes
+ * to, so a variable that is deleted and recreated in between is caught.
+ */
+static int
+efivarfs_update_variable_if(efi_guid_t guid, const char *name,
+			    const uint8_t *expected_data, size_t expected_size,
+			    const uint8_t *data, size_t data_size,
+			    uint32_t attributes, mode_t mode)
+{
+	int rc;
+
+	rc = efivarfs_write_variable(guid, name, data, data_size,
+				     attributes, mode, true, expected_data,
+				     expected_size);
+	if (rc < 0)
+		efi_error("efivarfs_write_variable failed");
+	return rc;
+}
+
 static int
 efivarfs_append_variable(efi_guid_t guid, const char *name, const uint8_t *data,
 	size_t data_size, uint32_t attributes)
@@ -637,6 +780,142 @@ efivarfs_get_next_variable_name(efi_guid_t **guid, char **name)
 	return rc;
 }
 
+static int
+efivarfs_variable_iter_new(efi_variable_iter_t **iter)
+{
+	int rc;
+	rc = generic_variable_iter_new(get_efivarfs_path(), iter);
+	if (rc < 0)
+		efi_error("generic_variable_iter_new failed");
+	return rc;
+}
+
+static int
+efivarfs_get_variable_snapshot(efi_variable_snapshot_entry_t **entries,
+			       size_t *n_entries)
+{
+	struct var_snapshot vs = { 0, };
+	const char *path = get_efivarfs_path();
+	size_t guidlen = strlen("8be4df61-93ca-11d2-aa0d-00e098032b8c");
+	struct dirent *de;
+	DIR *dir = NULL;
+	int dfd;
+	int fd = -1;
+	int ret = -1;
+	__typeof__(errno) errno_value;
+
+	dir = opendir(path);
+	if (!dir) {
+		efi_error("opendir(%s) failed", path);
+		goto err;
+	}
+
+	dfd = dirfd(dir);
+	if (dfd < 0) {
+		efi_error("dirfd failed");
+		goto err;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		size_t namelen = strlen(de->d_name);
+		efi_guid_t guid;
+		struct stat statbuf;
+		uint32_t attributes;
+		size_t size, filled = 0;
+		uint8_t *buf;
+
+		if (namelen < guidlen + 2)
+			continue;
+
+		if (text_to_guid(de->d_name + namelen - guidlen, &guid) < 0) {
+			errno = EINVAL;
+			efi_error("text_to_guid(%s) failed", de->d_name);
+			goto err;
+		}
+
+		fd = openat(dfd, de->d_name, O_RDONLY|O_CLOEXEC);
+		if (fd < 0) {
+			/* deleted since readdir(); it's not in the snapshot */
+			if (errno == ENOENT)
+				continue;
+			efi_error("openat(%s%s) failed", path, de->d_name);
+			goto err;
+		}
+
+		if (fstat(fd, &statbuf) < 0) {
+			efi_error("fstat(%s%s) failed", path, de->d_name);
+			goto err;
+		}
+
+		/*
+		 * efivarfs keeps i_size up to date, so this is normally
+		 * exact; the extra byte lets the EOF read land without
+		 * growing the arena.
+		 */
+		size = statbuf.st_size > 0 ? (size_t)statbuf.st_size + 1
+					   : 4096;
+		buf = var_snapshot_reserve(&vs, sizeof(attributes), size);
+		if (!buf)
+			goto err;
+
+		/* the header and data come in one read(), then the EOF */
+		efi_ratelimit_acquire(2);
+		while (1) {
+			ssize_t rc = read(fd, buf + filled, size - filled);
+			if (rc < 0 && (errno == EAGAIN || errno == EINTR)) {
+				struct timespec ts = { 0, 10000000 };
+				nanosleep(&ts, NULL);
+				continue;
+			} else if (rc < 0) {
+				efi_error("read(%s%s) failed", path,
+					  de->d_name);
+				goto err;
+			}
+			if (rc == 0)
+				break;
+			filled += rc;
+			if (filled == size) {
+				size += 4096;
+				buf = var_snapshot_reserve(&vs,
+							   sizeof(attributes),
+							   size);
+				if (!buf)
+					goto err;
+			}
+		}
+		close(fd);
+		fd = -1;
+
+		if (filled < sizeof(attributes)) {
+			var_snapshot_discard(&vs);
+			continue;
+		}
+
+		memcpy(&attributes, buf, sizeof(attributes));
+		if (var_snapshot_commit(&vs, &guid, de->d_name,
+					namelen - guidlen - 1, attributes,
+					sizeof(attributes),
+					filled - sizeof(attributes)) < 0)
+			goto err;
+	}
+
+	if (var_snapshot_finish(&vs, entries, n_entries) < 0)
+		goto err;
+
+	ret = 0;
+err:
+	errno_value = errno;
+
+	if (fd >= 0)
+		close(fd);
+	if (dir)
+		closedir(dir);
+	var_snapshot_free(&vs);
+
+	errno = errno_value;
+	return ret;
+}
+
 static int
 efivarfs_chmod_variable(efi_guid_t guid, const char *name, mode_t mode)
 {
@@ -661,12 +940,17 @@ struct efi_var_operations efivarfs_ops = {
 	.probe = efivarfs_probe,
 	.set_variable = efivarfs_set_variable,
 	.append_variable = efivarfs_append_variable,
+	.update_variable_if = efivarfs_update_variable_if,
 	.del_variable = efivarfs_del_variable,
 	.get_variable = efivarfs_get_variable,
 	.get_variable_attributes = efivarfs_get_variable_attributes,
 	.get_variable_size = efivarfs_get_variable_size,
+	.stat_variable = efivarfs_stat_variable,
 	.get_next_variable_name = efivarfs_get_next_variable_name,
+	.variable_iter_new = efivarfs_variable_iter_new,
+	.get_variable_snapshot = efivarfs_get_variable_snapshot,
 	.chmod_variable = efivarfs_chmod_variable,
+	.get_path = get_efivarfs_path,
 };
 
 // vim:fenc=utf-8:tw=75:noet
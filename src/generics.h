@@ -15,67 +15,80 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-static DIR *dir;
-
 static inline int UNUSED
-generic_get_next_variable_name(const char *path, efi_guid_t **guid, char **name)
+generic_variable_iter_new(const char *path, efi_variable_iter_t **iterp)
 {
-	static char ret_name[NAME_MAX+1];
-	static efi_guid_t ret_guid;
+	efi_variable_iter_t *iter;
 
-	if (!guid || !name) {
+	if (!iterp) {
 		errno = EINVAL;
 		efi_error("invalid arguments");
 		return -1;
 	}
 
-	/* if only one of guid and name are null, there's no "next" variable,
-	 * because the current variable is invalid. */
-	if ((*guid == NULL && *name != NULL) ||
-			(*guid != NULL && *name == NULL)) {
-		errno = EINVAL;
-		efi_error("invalid arguments");
+	iter = calloc(1, sizeof(*iter));
+	if (!iter) {
+		efi_error("could not allocate memory");
 		return -1;
 	}
 
-	/* if dir is NULL, we're also starting over */
-	if (!dir) {
-		dir = opendir(path);
-		if (!dir) {
-			efi_error("opendir(%s) failed", path);
-			return -1;
-		}
-
-		int fd = dirfd(dir);
-		if (fd < 0) {
-			__typeof__(errno) errno_value = errno;
-			efi_error("dirfd failed");
-			closedir(dir);
-			errno = errno_value;
-			return -1;
-		}
-		int flags = fcntl(fd, F_GETFD);
-		if (flags < 0) {
-			efi_error("fcntl(fd, F_GETFD) failed");
-		} else {
-			flags |= FD_CLOEXEC;
-			if (fcntl(fd, F_SETFD, flags) < 0)
-				efi_error("fcntl(fd, F_SETFD, flags | FD_CLOEXEC) failed");
-		}
+	iter->dir = opendir(path);
+	if (!iter->dir) {
+		__typeof__(errno) errno_value = errno;
+		efi_error("opendir(%s) failed", path);
+		free(iter);
+		errno = errno_value;
+		return -1;
+	}
 
-		*guid = NULL;
-		*name = NULL;
+	int fd = dirfd(iter->dir);
+	if (fd < 0) {
+		__typeof__(errno) errno_value = errno;
+		efi_error("dirfd failed");
+		closedir(iter->dir);
+		free(iter);
+		errno = errno_value;
+		return -1;
 	}
+	int flags = fcntl(fd, F_GETFD);
+	if (flags < 0) {
+		efi_error("fcntl(fd, F_GETFD) failed");
+	} else {
+		flags |= FD_CLOEXEC;
+		if (fcntl(fd, F_SETFD, flags) < 0)
+			efi_error("fcntl(fd, F_SETFD, flags | FD_CLOEXEC) failed");
+	}
+
+	*iterp = iter;
+	return 0;
+}
 
+/*
+ * The name we hand back is copied out of the directory entry into the
+ * iterator, so it's valid until the next call on this iterator.
+ */
+static inline int UNUSED
+generic_variable_iter_next(efi_variable_iter_t *iter, efi_guid_t **guid,
+			   char **name)
+{
 	struct dirent *de = NULL;
 	char *guidtext = "8be4df61-93ca-11d2-aa0d-00e098032b8c";
 	size_t guidlen = strlen(guidtext);
 
+	if (!iter || !guid || !name) {
+		errno = EINVAL;
+		efi_error("invalid arguments");
+		return -1;
+	}
+
+	if (!iter->dir)
+		return 0;
+
 	while (1) {
-		de = readdir(dir);
+		de = readdir(iter->dir);
 		if (de == NULL) {
-			closedir(dir);
-			dir = NULL;
+			closedir(iter->dir);
+			iter->dir = NULL;
 			return 0;
 		}
 		/* a proper entry must have space for a guid, a dash, and
@@ -84,58 +97,124 @@ generic_get_next_variable_name(const char *path, efi_guid_t **guid, char **name)
 		if (namelen < guidlen + 2)
 			continue;
 
-		int rc = text_to_guid(de->d_name +namelen -guidlen, &ret_guid);
+		int rc = text_to_guid(de->d_name +namelen -guidlen, &iter->guid);
 		if (rc < 0) {
-			closedir(dir);
-			dir = NULL;
+			closedir(iter->dir);
+			iter->dir = NULL;
 			errno = EINVAL;
 			efi_error("text_to_guid failed");
 			return -1;
 		}
 
-		strncpy(ret_name, de->d_name, sizeof(ret_name));
-		ret_name[namelen - guidlen - 1] = '\0';
+		memcpy(iter->name, de->d_name, namelen - guidlen - 1);
+		iter->name[namelen - guidlen - 1] = '\0';
 
-		*guid = &ret_guid;
-		*name = ret_name;
+		*guid = &iter->guid;
+		*name = iter->name;
 		break;
 	}
 
 	return 1;
 }
 
+static inline void UNUSED
+generic_variable_iter_free(efi_variable_iter_t *iter)
+{
+	if (!iter)
+		return;
+	if (iter->dir)
+		closedir(iter->dir);
+	free(iter);
+}
+
+static efi_variable_iter_t *generic_iter;
+
+static inline int UNUSED
+generic_get_next_variable_name(const char *path, efi_guid_t **guid, char **name)
+{
+	int rc;
+
+	if (!guid || !name) {
+		errno = EINVAL;
+		efi_error("invalid arguments");
+		return -1;
+	}
+
+	/* if only one of guid and name are null, there's no "next" variable,
+	 * because the current variable is invalid. */
+	if ((*guid == NULL && *name != NULL) ||
+			(*guid != NULL && *name == NULL)) {
+		errno = EINVAL;
+		efi_error("invalid arguments");
+		return -1;
+	}
+
+	/* if we don't have an iterator, we're also starting over */
+	if (!generic_iter) {
+		rc = generic_variable_iter_new(path, &generic_iter);
+		if (rc < 0)
+			return rc;
+
+		*guid = NULL;
+		*name = NULL;
+	}
+
+	rc = generic_variable_iter_next(generic_iter, guid, name);
+	if (rc <= 0) {
+		generic_variable_iter_free(generic_iter);
+		generic_iter = NULL;
+	}
+	return rc;
+}
+
 static void DESTRUCTOR close_dir(void);
 static void DESTRUCTOR
 close_dir(void)
 {
-	if (dir != NULL) {
-		closedir(dir);
-		dir = NULL;
+	if (generic_iter != NULL) {
+		generic_variable_iter_free(generic_iter);
+		generic_iter = NULL;
 	}
 }
 
 /* this is a simple read/delete/write implementation of "update".  Good luck.
- * -- pjones */
+ * -- pjones
+ *
+ * The variable lock keeps concurrent appends and efi_update_variable_if()
+ * calls from losing each other's updates, and if the rewrite fails we put
+ * the old contents back.
+ */
 static int UNUSED FLATTEN
 generic_append_variable(efi_guid_t guid, const char *name,
 		       const uint8_t *new_data, size_t new_data_size,
 		       uint32_t new_attributes)
 {
 	int rc;
+	int lockfd;
 	uint8_t *data = NULL;
 	size_t data_size = 0;
 	uint32_t attributes = 0;
 
+	/* best effort; see efi_append_variable() */
+	lockfd = efi_variable_lock(guid, name);
+
 	rc = efi_get_variable(guid, name, &data, &data_size, &attributes);
 	if (rc >= 0) {
 		if ((attributes | EFI_VARIABLE_APPEND_WRITE) !=
 				(new_attributes | EFI_VARIABLE_APPEND_WRITE)) {
 			free(data);
+			efi_variable_unlock(guid, name, lockfd);
 			errno = EINVAL;
 			return -1;
 		}
 		uint8_t *d = malloc(data_size + new_data_size);
 		size_t ds = data_size + new_data_size;
+		if (!d) {
+			efi_error("could not allocate memory");
+			free(data);
+			efi_variable_unlock(guid, name, lockfd);
+			return -1;
+		}
 		memcpy(d, data, data_size);
 		memcpy(d + data_size, new_data, new_data_size);
 		attributes &= ~EFI_VARIABLE_APPEND_WRITE;
@@ -144,15 +223,19 @@ generic_append_variable(efi_guid_t guid, const char *name,
 			efi_error("efi_del_variable failed");
 			free(data);
 			free(d);
+			efi_variable_unlock(guid, name, lockfd);
 			return rc;
 		}
-		/* if this doesn't work, we accidentally deleted.  There's
-		 * really not much to do about it, so return the error and
-		 * let our caller attempt to clean up :/
-		 */
 		rc = efi_set_variable(guid, name, d, ds, attributes, 0600);
-		if (rc < 0)
+		if (rc < 0) {
+			int saved_errno = errno;
+
 			efi_error("efi_set_variable failed");
+			if (efi_set_variable(guid, name, data, data_size,
+					     attributes, 0600) < 0)
+				efi_error("could not restore variable");
+			errno = saved_errno;
+		}
 		free(d);
 		free(data);
 	} else if (rc < 0 && errno == ENOENT) {
@@ -160,6 +243,7 @@ generic_append_variable(efi_guid_t guid, const char *name,
 		rc = efi_set_variable(guid, name, new_data, new_data_size,
 				      attributes, 0600);
 	}
+	efi_variable_unlock(guid, name, lockfd);
 	if (rc < 0)
 		efi_error("efi_set_variable failed");
 	return rc;
@@ -13,6 +13,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +31,12 @@
 
 #include "efivar.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #ifndef BLKGETLASTSECT
 #define BLKGETLASTSECT _IO(0x12,108) /* get last sector of block device */
 #endif
@@ -203,16 +212,145 @@ read_lastoddsector(int fd, void *buffer, size_t count)
 	return !rc;
 }
 
+/*
+ * One disk we're looking for a GPT on.  The protective MBR, the primary
+ * header, and a default-sized primary entry array are read with a single
+ * pread() up front, and the same span at the end of the disk, which holds
+ * the alternate entries and header, with one more the first time anything
+ * there is asked for.  Anything else, such as entries somewhere unusual,
+ * is read from the disk as it's asked for.
+ */
+struct gpt_disk {
+	int fd;
+	struct stat stat;
+	uint32_t sector_size;
+	uint64_t last_lba;
+
+	uint8_t *head;
+	size_t head_size;
+
+	bool tail_read;
+	uint64_t tail_lba;
+	uint8_t *tail;
+	size_t tail_size;
+
+	unsigned int direct_reads;
+};
+
+/*
+ * How many blocks the header and a default-sized entry array take at
+ * either end of the disk.
+ */
+static inline uint64_t
+gpt_area_lbas(uint32_t sector_size)
+{
+	return 1 + (GPT_DEFAULT_RESERVED_PARTITION_ENTRY_ARRAY_SIZE
+		    + sector_size - 1) / sector_size;
+}
+
+static ssize_t
+gpt_disk_pread(struct gpt_disk *disk, uint64_t lba, uint64_t nlbas,
+	       uint8_t **bufp)
+{
+	size_t size = nlbas * disk->sector_size;
+	ssize_t bytesread;
+	void *buf;
+	int rc;
+
+	*bufp = NULL;
+	rc = posix_memalign(&buf, disk->sector_size, size);
+	if (rc) {
+		errno = rc;
+		efi_error("posix_memalign failed");
+		return -1;
+	}
+	memset(buf, 0, size);
+
+	bytesread = pread(disk->fd, buf, size, lba * disk->sector_size);
+	if (bytesread <= 0) {
+		free(buf);
+		return bytesread;
+	}
+
+	*bufp = buf;
+	return bytesread;
+}
+
+static int
+gpt_disk_init(struct gpt_disk *disk, int fd, uint32_t logical_block_size)
+{
+	ssize_t sz;
+	int rc;
+
+	memset(disk, 0, sizeof(*disk));
+	disk->fd = fd;
+	disk->sector_size = logical_block_size;
+
+	rc = fstat(fd, &disk->stat);
+	if (rc < 0) {
+		efi_error("could not stat disk");
+		return rc;
+	}
+	disk->last_lba = last_lba(fd);
+
+	sz = gpt_disk_pread(disk, 0, 1 + gpt_area_lbas(disk->sector_size),
+			    &disk->head);
+	disk->head_size = sz > 0 ? sz : 0;
+
+	disk->tail_lba = disk->last_lba + 1 > gpt_area_lbas(disk->sector_size)
+			 ? disk->last_lba + 1 - gpt_area_lbas(disk->sector_size)
+			 : 0;
+	return 0;
+}
+
+static void
+gpt_disk_read_tail(struct gpt_disk *disk)
+{
+	ssize_t sz;
+
+	if (disk->tail_read)
+		return;
+
+	disk->tail_read = true;
+	sz = gpt_disk_pread(disk, disk->tail_lba,
+			    disk->last_lba + 1 - disk->tail_lba, &disk->tail);
+	disk->tail_size = sz > 0 ? sz : 0;
+}
+
+static void
+gpt_disk_fini(struct gpt_disk *disk)
+{
+	free(disk->head);
+	free(disk->tail);
+	memset(disk, 0, sizeof(*disk));
+}
+
 static ssize_t
-read_lba(int fd, uint64_t lba, void *buffer, size_t bytes)
+read_lba(struct gpt_disk *disk, uint64_t lba, void *buffer, size_t bytes)
 {
-	int sector_size = get_sector_size(fd);
+	int sector_size = disk->sector_size;
 	off_t offset = lba * sector_size;
 	ssize_t bytesread;
 	void *iobuf;
 	size_t iobuf_size;
 	int rc;
-	off_t new_offset;
+
+	if ((uint64_t)offset + bytes <= disk->head_size) {
+		memcpy(buffer, disk->head + offset, bytes);
+		return bytes;
+	}
+
+	if (lba >= disk->tail_lba && lba <= disk->last_lba) {
+		size_t tail_offset = (lba - disk->tail_lba) * sector_size;
+
+		gpt_disk_read_tail(disk);
+		if (tail_offset + bytes <= disk->tail_size) {
+			memcpy(buffer, disk->tail + tail_offset, bytes);
+			return bytes;
+		}
+	}
+
+	disk->direct_reads += 1;
 
 	iobuf_size = lcm(bytes, sector_size);
 	rc = posix_memalign(&iobuf, sector_size, iobuf_size);
@@ -220,12 +358,11 @@ read_lba(int fd, uint64_t lba, void *buffer, size_t bytes)
 		return rc;
 	memset(iobuf, 0, bytes);
 
-	new_offset = lseek(fd, offset, SEEK_SET);
-	if (new_offset == (off_t)-1) {
+	bytesread = pread(disk->fd, iobuf, iobuf_size, offset);
+	if (bytesread < 0) {
 		free(iobuf);
 		return 0;
 	}
-	bytesread = read(fd, iobuf, iobuf_size);
 	memcpy(buffer, iobuf, bytes);
 	free(iobuf);
 
@@ -234,22 +371,23 @@ read_lba(int fd, uint64_t lba, void *buffer, size_t bytes)
 	   This is only used by gpt.c, and only to read
 	   one sector, so we don't have to be fancy.
 	*/
-	if (!bytesread && !(last_lba(fd) & 1) && lba == last_lba(fd)) {
-		bytesread = read_lastoddsector(fd, buffer, bytes);
+	if (!bytesread && !(disk->last_lba & 1) && lba == disk->last_lba) {
+		bytesread = read_lastoddsector(disk->fd, buffer, bytes);
 	}
 	return bytesread;
 }
 
 /**
  * alloc_read_gpt_entries(): reads partition entries from disk
- * @fd  is an open file descriptor to the whole disk
+ * @disk is the disk being read
  * @gpt is a buffer into which the GPT will be put
  * Description: Returns ptes on success,  NULL on error.
  * Allocates space for PTEs based on information found in @gpt.
  * Notes: remember to free pte when you're done!
  */
 static gpt_entry *
-alloc_read_gpt_entries(int fd, uint32_t nptes, uint32_t ptesz, uint64_t ptelba)
+alloc_read_gpt_entries(struct gpt_disk *disk, uint32_t nptes, uint32_t ptesz,
+		       uint64_t ptelba)
 {
 	gpt_entry *pte;
 	size_t count = nptes * ptesz;
@@ -262,7 +400,7 @@ alloc_read_gpt_entries(int fd, uint32_t nptes, uint32_t ptesz, uint64_t ptelba)
 		return NULL;
 
 	memset(pte, 0, count);
-	if (!read_lba(fd, ptelba, pte, count)) {
+	if (!read_lba(disk, ptelba, pte, count)) {
 		free(pte);
 		return NULL;
 	}
@@ -271,7 +409,7 @@ alloc_read_gpt_entries(int fd, uint32_t nptes, uint32_t ptesz, uint64_t ptelba)
 
 /**
  * alloc_read_gpt_header(): Allocates GPT header, reads into it from disk
- * @fd  is an open file descriptor to the whole disk
+ * @disk is the disk being read
  * @lba is the Logical Block Address of the partition table
  *
  * Description: returns GPT header on success, NULL on error.   Allocates
@@ -279,7 +417,7 @@ alloc_read_gpt_entries(int fd, uint32_t nptes, uint32_t ptesz, uint64_t ptelba)
  * Note: remember to free gpt when finished with it.
  */
 static gpt_header *
-alloc_read_gpt_header(int fd, uint64_t lba)
+alloc_read_gpt_header(struct gpt_disk *disk, uint64_t lba)
 {
 	gpt_header *gpt;
 
@@ -289,7 +427,7 @@ alloc_read_gpt_header(int fd, uint64_t lba)
 		return NULL;
 
 	memset(gpt, 0, sizeof (*gpt));
-	if (!read_lba(fd, lba, gpt, sizeof (gpt_header))) {
+	if (!read_lba(disk, lba, gpt, sizeof (gpt_header))) {
 		free(gpt);
 		return NULL;
 	}
@@ -356,7 +494,7 @@ check_lba(uint64_t lba, uint64_t lastlba, char *name)
 
 /**
  * is_gpt_valid() - tests one GPT header and PTEs for validity
- * @fd  is an open file descriptor to the whole disk
+ * @disk is the disk being read
  * @lba is the logical block address of the GPT header to test
  * @gpt is a GPT header ptr, filled on return.
  * @ptes is a PTEs ptr, filled on return.
@@ -365,17 +503,17 @@ check_lba(uint64_t lba, uint64_t lastlba, char *name)
  * If valid, returns pointers to newly allocated GPT header and PTEs.
  */
 static int
-is_gpt_valid(int fd, uint64_t lba,
-	     gpt_header ** gpt, gpt_entry ** ptes,
-	     uint32_t logical_block_size)
+is_gpt_valid(struct gpt_disk *disk, uint64_t lba,
+	     gpt_header ** gpt, gpt_entry ** ptes)
 {
 	int rc = 0;		/* default to not valid */
 	uint32_t crc, origcrc;
-	uint64_t max_device_lba = last_lba(fd);
+	uint64_t max_device_lba = disk->last_lba;
+	uint32_t logical_block_size = disk->sector_size;
 
 	if (!gpt || !ptes)
 		return 0;
-	if (!(*gpt = alloc_read_gpt_header(fd, lba)))
+	if (!(*gpt = alloc_read_gpt_header(disk, lba)))
 		return 0;
 
 	/* Check the GUID Partition Table magic */
@@ -486,7 +624,7 @@ err:
 		goto err;
 	}
 
-	if (!(*ptes = alloc_read_gpt_entries(fd, nptes, ptesz, ptelba))) {
+	if (!(*ptes = alloc_read_gpt_entries(disk, nptes, ptesz, ptelba))) {
 		free(*gpt);
 		*gpt = NULL;
 		return 0;
@@ -599,17 +737,18 @@ compare_gpts(gpt_header *pgpt, gpt_header *agpt, uint64_t lastlba)
 
 /**
  * find_valid_gpt() - Search disk for valid GPT headers and PTEs
- * @fd  is an open file descriptor to the whole disk
+ * @disk is the disk being read
  * @gpt is a GPT header ptr, filled on return.
  * @ptes is a PTEs ptr, filled on return.
+ * @used_primary is set if the primary GPT header and PTEs were used.
  * Description: Returns 1 if valid, 0 on error.
  * If valid, returns pointers to newly allocated GPT header and PTEs.
  * Validity depends on finding either the Primary GPT header and PTEs valid,
  * or the Alternate GPT header and PTEs valid, and the PMBR valid.
  */
 static int
-find_valid_gpt(int fd, gpt_header ** gpt, gpt_entry ** ptes,
-	       int ignore_pmbr_err, int logical_block_size)
+find_valid_gpt(struct gpt_disk *disk, gpt_header ** gpt, gpt_entry ** ptes,
+	       int ignore_pmbr_err, bool *used_primary)
 {
 	int good_pgpt = 0, good_agpt = 0, good_pmbr = 0;
 	gpt_header *pgpt = NULL, *agpt = NULL;
@@ -623,20 +762,18 @@ find_valid_gpt(int fd, gpt_header ** gpt, gpt_entry ** ptes,
 	if (!gpt || !ptes)
 		return -1;
 
-	lastlba = last_lba(fd);
-	good_pgpt = is_gpt_valid(fd, GPT_PRIMARY_PARTITION_TABLE_LBA,
-				 &pgpt, &pptes, logical_block_size);
+	lastlba = disk->last_lba;
+	good_pgpt = is_gpt_valid(disk, GPT_PRIMARY_PARTITION_TABLE_LBA,
+				 &pgpt, &pptes);
 	if (good_pgpt) {
-		good_agpt = is_gpt_valid(fd,
+		good_agpt = is_gpt_valid(disk,
 					 le64_to_cpu(pgpt->alternate_lba),
-					 &agpt, &aptes, logical_block_size);
+					 &agpt, &aptes);
 		if (!good_agpt) {
-			good_agpt = is_gpt_valid(fd, lastlba, &agpt, &aptes,
-						 logical_block_size);
+			good_agpt = is_gpt_valid(disk, lastlba, &agpt, &aptes);
 		}
 	} else {
-		good_agpt = is_gpt_valid(fd, lastlba, &agpt, &aptes,
-					 logical_block_size);
+		good_agpt = is_gpt_valid(disk, lastlba, &agpt, &aptes);
 	}
 
 	/* The obviously unsuccessful case */
@@ -648,7 +785,7 @@ find_valid_gpt(int fd, gpt_header ** gpt, gpt_entry ** ptes,
 	legacymbr = malloc(sizeof (*legacymbr));
 	if (legacymbr) {
 		memset(legacymbr, 0, sizeof (*legacymbr));
-		read_lba(fd, 0, (uint8_t *) legacymbr, sizeof (*legacymbr));
+		read_lba(disk, 0, (uint8_t *) legacymbr, sizeof (*legacymbr));
 		good_pmbr = is_pmbr_valid(legacymbr);
 		free(legacymbr);
 		legacymbr=NULL;
@@ -673,6 +810,7 @@ find_valid_gpt(int fd, gpt_header ** gpt, gpt_entry ** ptes,
 	if (good_pgpt && (good_pmbr || ignore_pmbr_err)) {
 		*gpt  = pgpt;
 		*ptes = pptes;
+		*used_primary = true;
 	} else if (good_agpt && (good_pmbr || ignore_pmbr_err)) {
 		*gpt  = agpt;
 		*ptes = aptes;
@@ -705,6 +843,396 @@ find_valid_gpt(int fd, gpt_header ** gpt, gpt_entry ** ptes,
 }
 
 
+/*
+ * Validated GPTs, keyed by the disk's device number and size, so that
+ * looking up several partitions on the same disk doesn't validate both
+ * copies of its GPT every time.  An entry keeps the blocks its answer was
+ * worked out from, and is only used if the same blocks read from the disk
+ * now are still the same: the head of the disk, in one read, when the
+ * primary GPT was good, and the tail as well when it wasn't.  Disks whose
+ * GPT needed any other reads aren't cached.
+ */
+#define GPT_CACHE_MAX_ENTRIES 16
+
+struct gpt_cache_entry {
+	list_t list;
+	dev_t rdev;
+	uint64_t last_lba;
+	uint32_t sector_size;
+	int ignore_pmbr_err;
+
+	int error;
+	gpt_header *gpt;
+	gpt_entry *ptes;
+	size_t ptes_size;
+
+	uint8_t *head;
+	size_t head_size;
+	bool need_tail;
+	uint8_t *tail;
+	size_t tail_size;
+};
+
+static pthread_mutex_t gpt_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(gpt_cache);
+static size_t gpt_cache_nentries;
+
+static void
+gpt_cache_entry_free(struct gpt_cache_entry *entry)
+{
+	free(entry->gpt);
+	free(entry->ptes);
+	free(entry->head);
+	free(entry->tail);
+	free(entry);
+}
+
+static void DESTRUCTOR
+gpt_cache_fini(void)
+{
+	list_t *pos, *tmp;
+
+	pthread_mutex_lock(&gpt_cache_lock);
+	list_for_each_safe(pos, tmp, &gpt_cache) {
+		struct gpt_cache_entry *entry;
+
+		entry = list_entry(pos, struct gpt_cache_entry, list);
+		list_del(&entry->list);
+		gpt_cache_entry_free(entry);
+	}
+	gpt_cache_nentries = 0;
+	pthread_mutex_unlock(&gpt_cache_lock);
+}
+
+static struct gpt_cache_entry *
+gpt_cache_find(struct gpt_disk *disk, int ignore_pmbr_err)
+{
+	list_t *pos;
+
+	list_for_each(pos, &gpt_cache) {
+		struct gpt_cache_entry *entry;
+
+		entry = list_entry(pos, struct gpt_cache_entry, list);
+		if (entry->rdev == disk->stat.st_rdev &&
+		    entry->last_lba == disk->last_lba &&
+		    entry->sector_size == disk->sector_size &&
+		    entry->ignore_pmbr_err == ignore_pmbr_err)
+			return entry;
+	}
+	return NULL;
+}
+
+static bool
+gpt_cache_entry_matches(struct gpt_cache_entry *entry, struct gpt_disk *disk)
+{
+	if (entry->head_size != disk->head_size ||
+	    memcmp(entry->head, disk->head, disk->head_size))
+		return false;
+
+	if (entry->need_tail &&
+	    (entry->tail_size != disk->tail_size ||
+	     memcmp(entry->tail, disk->tail, disk->tail_size)))
+		return false;
+
+	return true;
+}
+
+/*
+ * Returns true with *rc set to what find_valid_gpt() would have returned
+ * if the cache has the answer for this disk.
+ */
+static bool
+gpt_cache_lookup(struct gpt_disk *disk, gpt_header **gpt, gpt_entry **ptes,
+		 int ignore_pmbr_err, int *rc)
+{
+	struct gpt_cache_entry *entry;
+	bool need_tail = false;
+
+	if (!S_ISBLK(disk->stat.st_mode) || !disk->head_size)
+		return false;
+
+	pthread_mutex_lock(&gpt_cache_lock);
+	entry = gpt_cache_find(disk, ignore_pmbr_err);
+	if (entry && entry->need_tail && !disk->tail_read)
+		need_tail = true;
+	pthread_mutex_unlock(&gpt_cache_lock);
+
+	if (!entry)
+		return false;
+
+	/* don't do I/O with the lock held */
+	if (need_tail)
+		gpt_disk_read_tail(disk);
+
+	pthread_mutex_lock(&gpt_cache_lock);
+	entry = gpt_cache_find(disk, ignore_pmbr_err);
+	if (!entry || !gpt_cache_entry_matches(entry, disk) ||
+	    (entry->need_tail && !disk->tail_read)) {
+		if (entry) {
+			list_del(&entry->list);
+			gpt_cache_entry_free(entry);
+			gpt_cache_nentries -= 1;
+		}
+		pthread_mutex_unlock(&gpt_cache_lock);
+		return false;
+	}
+
+	if (entry->error) {
+		*rc = -1;
+		errno = entry->error;
+		efi_error("no valid GPT on disk");
+		goto out;
+	}
+
+	*gpt = malloc(sizeof(**gpt));
+	*ptes = malloc(entry->ptes_size);
+	if (!*gpt || !*ptes) {
+		free(*gpt);
+		free(*ptes);
+		*gpt = NULL;
+		*ptes = NULL;
+		pthread_mutex_unlock(&gpt_cache_lock);
+		return false;
+	}
+	memcpy(*gpt, entry->gpt, sizeof(**gpt));
+	memcpy(*ptes, entry->ptes, entry->ptes_size);
+	*rc = 0;
+	errno = 0;
+out:
+	list_del(&entry->list);
+	list_add(&entry->list, &gpt_cache);
+	pthread_mutex_unlock(&gpt_cache_lock);
+	return true;
+}
+
+static void
+gpt_cache_store(struct gpt_disk *disk, int ignore_pmbr_err, int rc,
+		int error, gpt_header *gpt, gpt_entry *ptes, bool used_primary)
+{
+	struct gpt_cache_entry *entry, *old;
+
+	if (!S_ISBLK(disk->stat.st_mode) || !disk->head_size ||
+	    disk->direct_reads)
+		return;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return;
+
+	entry->rdev = disk->stat.st_rdev;
+	entry->last_lba = disk->last_lba;
+	entry->sector_size = disk->sector_size;
+	entry->ignore_pmbr_err = ignore_pmbr_err;
+	entry->error = rc < 0 ? (error ? error : EINVAL) : 0;
+	entry->need_tail = rc < 0 || !used_primary;
+
+	if (entry->need_tail && !disk->tail_read)
+		goto err;
+
+	entry->head = malloc(disk->head_size);
+	if (!entry->head)
+		goto err;
+	memcpy(entry->head, disk->head, disk->head_size);
+	entry->head_size = disk->head_size;
+
+	if (entry->need_tail && disk->tail_size) {
+		entry->tail = malloc(disk->tail_size);
+		if (!entry->tail)
+			goto err;
+		memcpy(entry->tail, disk->tail, disk->tail_size);
+		entry->tail_size = disk->tail_size;
+	}
+
+	if (rc >= 0) {
+		entry->ptes_size =
+			(size_t)le32_to_cpu(gpt->num_partition_entries) *
+			le32_to_cpu(gpt->sizeof_partition_entry);
+		entry->gpt = malloc(sizeof(*gpt));
+		entry->ptes = malloc(entry->ptes_size);
+		if (!entry->gpt || !entry->ptes)
+			goto err;
+		memcpy(entry->gpt, gpt, sizeof(*gpt));
+		memcpy(entry->ptes, ptes, entry->ptes_size);
+	}
+
+	pthread_mutex_lock(&gpt_cache_lock);
+	old = gpt_cache_find(disk, ignore_pmbr_err);
+	if (old) {
+		list_del(&old->list);
+		gpt_cache_entry_free(old);
+		gpt_cache_nentries -= 1;
+	}
+	if (gpt_cache_nentries >= GPT_CACHE_MAX_ENTRIES) {
+		old = list_last_entry(&gpt_cache, struct gpt_cache_entry, list);
+		list_del(&old->list);
+		gpt_cache_entry_free(old);
+		gpt_cache_nentries -= 1;
+	}
+	list_add(&entry->list, &gpt_cache);
+	gpt_cache_nentries += 1;
+	pthread_mutex_unlock(&gpt_cache_lock);
+	return;
+err:
+	gpt_cache_entry_free(entry);
+}
+
+/************************************************************
+ * gpt_disk_read_table()
+ * Requires:
+ *  - open file descriptor fd
+ *  - gpt, ptes
+ * Modifies: gpt, ptes; both must be freed by the caller
+ * Returns:
+ *  0 on success
+ *  non-zero on failure
+ *
+ ************************************************************/
+int NONNULL(2, 3) HIDDEN
+gpt_disk_read_table(int fd, gpt_header **gpt, gpt_entry **ptes,
+		    int ignore_pmbr_error, int logical_block_size)
+{
+	struct gpt_disk disk;
+	bool used_primary = false;
+	int saved_errno;
+	int rc;
+
+	*gpt = NULL;
+	*ptes = NULL;
+
+	rc = gpt_disk_init(&disk, fd, logical_block_size);
+	if (rc < 0)
+		goto out;
+
+	if (gpt_cache_lookup(&disk, gpt, ptes, ignore_pmbr_error, &rc))
+		goto out;
+
+	rc = find_valid_gpt(&disk, gpt, ptes, ignore_pmbr_error,
+			    &used_primary);
+	gpt_cache_store(&disk, ignore_pmbr_error, rc, errno, *gpt, *ptes,
+			used_primary);
+out:
+	saved_errno = errno;
+	gpt_disk_fini(&disk);
+	errno = saved_errno;
+	return rc;
+}
+
+static inline gpt_entry *
+gpt_entry_at(gpt_header *gpt, gpt_entry *ptes, uint32_t i)
+{
+	return (gpt_entry *)((uint8_t *)ptes +
+			     (size_t)i * le32_to_cpu(gpt->sizeof_partition_entry));
+}
+
+/************************************************************
+ * gpt_table_get_partition_info()
+ * Requires:
+ *  - gpt and ptes from gpt_disk_read_table()
+ *  - start, size, signature, mbr_type, signature_type
+ * Modifies: all these
+ * Returns:
+ *  0 on success
+ *  non-zero on failure
+ *
+ ************************************************************/
+int NONNULL(1, 2, 4, 5, 6, 7, 8) HIDDEN
+gpt_table_get_partition_info(gpt_header *gpt, gpt_entry *ptes,
+			     uint32_t num, uint64_t *start, uint64_t *size,
+			     efi_guid_t *signature, uint8_t *mbr_type,
+			     uint8_t *signature_type)
+{
+	gpt_entry *p;
+
+	*mbr_type = 0x02;
+	*signature_type = 0x02;
+
+	if (num == 0 || num > le32_to_cpu(gpt->num_partition_entries)) {
+		efi_error("partition %d is not valid", num);
+		errno = EINVAL;
+		return -1;
+	}
+
+	p = gpt_entry_at(gpt, ptes, num - 1);
+	*start = le64_to_cpu(p->starting_lba);
+	*size = le64_to_cpu(p->ending_lba) -
+		le64_to_cpu(p->starting_lba) + 1;
+	memcpy(signature, &p->unique_partition_guid,
+	       sizeof (p->unique_partition_guid));
+	return 0;
+}
+
+static inline bool
+guid_bytes_equal(const void *a, const void *b)
+{
+#if defined(__SSE2__)
+	__m128i x = _mm_loadu_si128((const __m128i *)a);
+	__m128i y = _mm_loadu_si128((const __m128i *)b);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xffff;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	uint8x16_t x = vld1q_u8(a);
+	uint8x16_t y = vld1q_u8(b);
+
+	return vminvq_u8(vceqq_u8(x, y)) == 0xff;
+#else
+	uint64_t x[2], y[2];
+
+	memcpy(x, a, sizeof(x));
+	memcpy(y, b, sizeof(y));
+	return x[0] == y[0] && x[1] == y[1];
+#endif
+}
+
+/************************************************************
+ * gpt_table_find_partition()
+ * Requires:
+ *  - gpt and ptes from gpt_disk_read_table()
+ *  - guid, which must not be all zeros
+ *  - by_type, to match partition_type_guid rather than
+ *    unique_partition_guid
+ *  - after, the partition number to start searching after
+ * Modifies: nothing
+ * Returns:
+ *  the number of the first matching partition after "after"
+ *  -1 with errno set to ENOENT if there isn't one
+ *
+ ************************************************************/
+int NONNULL(1, 2, 3) HIDDEN
+gpt_table_find_partition(gpt_header *gpt, gpt_entry *ptes,
+			 const efi_guid_t *guid, bool by_type,
+			 uint32_t after)
+{
+	uint32_t nptes = le32_to_cpu(gpt->num_partition_entries);
+	size_t ptesz = le32_to_cpu(gpt->sizeof_partition_entry);
+	size_t offset = by_type ? offsetof(gpt_entry, partition_type_guid)
+				: offsetof(gpt_entry, unique_partition_guid);
+	const uint8_t *p;
+
+	if (efi_guid_is_empty(guid)) {
+		errno = EINVAL;
+		efi_error("can't search for the empty GUID");
+		return -1;
+	}
+
+	if (after >= nptes) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	/*
+	 * Both GUIDs are stored in the entries as raw bytes, so comparing
+	 * each one is a single 16 byte compare; just stride through them.
+	 */
+	p = (const uint8_t *)ptes + (size_t)after * ptesz + offset;
+	for (uint32_t i = after; i < nptes; i++, p += ptesz) {
+		if (guid_bytes_equal(p, guid))
+			return i + 1;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
 /************************************************************
  * gpt_disk_get_partition_info()
  * Requires:
@@ -723,29 +1251,17 @@ gpt_disk_get_partition_info(int fd, uint32_t num, uint64_t * start,
 			    int ignore_pmbr_error, int logical_block_size)
 {
 	gpt_header *gpt = NULL;
-	gpt_entry *ptes = NULL, *p;
+	gpt_entry *ptes = NULL;
 	int rc = 0;
 
-	rc = find_valid_gpt(fd, &gpt, &ptes, ignore_pmbr_error,
-			    logical_block_size);
+	rc = gpt_disk_read_table(fd, &gpt, &ptes, ignore_pmbr_error,
+				 logical_block_size);
 	if (rc < 0)
 		return rc;
 
-	*mbr_type = 0x02;
-	*signature_type = 0x02;
-
-	if (num > 0 && num <= le32_to_cpu(gpt->num_partition_entries)) {
-		p = &ptes[num - 1];
-		*start = le64_to_cpu(p->starting_lba);
-		*size = le64_to_cpu(p->ending_lba) -
-			le64_to_cpu(p->starting_lba) + 1;
-		memcpy(signature, &p->unique_partition_guid,
-		       sizeof (p->unique_partition_guid));
-	} else {
-		efi_error("partition %d is not valid", num);
-		errno = EINVAL;
-		rc = -1;
-	}
+	rc = gpt_table_get_partition_info(gpt, ptes, num, start, size,
+					  signature, mbr_type,
+					  signature_type);
 	free(ptes);
 	free(gpt);
 
@@ -143,6 +143,21 @@ typedef union {
 } partition_signature_t;
 
 /* Functions */
+extern int NONNULL(2, 3) HIDDEN
+gpt_disk_read_table (int fd, gpt_header **gpt, gpt_entry **ptes,
+		     int ignore_pmbr_error, int logical_sector_size);
+
+extern int NONNULL(1, 2, 4, 5, 6, 7, 8) HIDDEN
+gpt_table_get_partition_info (gpt_header *gpt, gpt_entry *ptes,
+			      uint32_t num, uint64_t *start, uint64_t *size,
+			      efi_guid_t *signature, uint8_t *mbr_type,
+			      uint8_t *signature_type);
+
+extern int NONNULL(1, 2, 3) HIDDEN
+gpt_table_find_partition (gpt_header *gpt, gpt_entry *ptes,
+			  const efi_guid_t *guid, bool by_type,
+			  uint32_t after);
+
 extern int NONNULL(3, 4, 5, 6, 7) HIDDEN
 gpt_disk_get_partition_info (int fd, uint32_t num, uint64_t *start,
 			     uint64_t *size, efi_guid_t *signature,
@@ -8,6 +8,7 @@
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <link.h>
 #include <stdio.h>
 
 #include "efivar.h"
@@ -42,72 +43,92 @@ int NONNULL(1) PUBLIC
 efi_guid_to_str(const efi_guid_t *guid, char **sp)
 {
 	char *ret = NULL;
-	int rc = -1;
-
-	if (!sp) {
-		rc = snprintf(NULL, 0, GUID_FORMAT, GUID_FORMAT_ARGS(guid));
-	} else if (sp && *sp) {
-		rc = snprintf(*sp, GUID_LENGTH_WITH_NUL, GUID_FORMAT,
-			      GUID_FORMAT_ARGS(guid));
-	} else {
-		rc = asprintf(&ret, GUID_FORMAT, GUID_FORMAT_ARGS(guid));
-		if (rc >= 0)
-			*sp = ret;
+
+	if (!sp)
+		return GUID_STR_LENGTH;
+
+	if (!*sp) {
+		ret = malloc(GUID_LENGTH_WITH_NUL);
+		if (!ret) {
+			efi_error("Could not format guid");
+			return -1;
+		}
+		*sp = ret;
 	}
-	if (rc < 0)
-		efi_error("Could not format guid");
-	return rc;
+	guid_to_text(guid, *sp);
+	return GUID_STR_LENGTH;
 }
 
-static int NONNULL(1, 2)
-cmpguidp(const void *p1, const void *p2)
+int NONNULL(1, 2) PUBLIC
+efi_guid_to_str_r(const efi_guid_t *guid, char *buf)
 {
-	struct efivar_guidname *gn1 = (struct efivar_guidname *)p1;
-	struct efivar_guidname *gn2 = (struct efivar_guidname *)p2;
-
-	return efi_guid_cmp_(&gn1->guid, &gn2->guid);
+	guid_to_text(guid, buf);
+	return GUID_STR_LENGTH;
 }
 
-static int NONNULL(1, 2)
-cmpnamep(const void *p1, const void *p2)
+int NONNULL(1, 2) PUBLIC
+efi_str_to_guid_fast(const char *s, efi_guid_t *guid)
 {
-	struct efivar_guidname *gn1 = (struct efivar_guidname *)p1;
-	struct efivar_guidname *gn2 = (struct efivar_guidname *)p2;
+	efi_guid_t tmp;
+	int rc;
 
-	return strncmp(gn1->name, gn2->name, sizeof(gn1->name));
+	rc = guid_from_text(s, &tmp);
+	if (rc >= 0)
+		memcpy(guid, &tmp, sizeof(tmp));
+	return rc;
 }
 
+static const struct efivar_guid_table * const guid_table = &efi_well_known_guid_table_;
+
 static int NONNULL(1, 2)
-_get_common_guidname(const efi_guid_t *guid, const struct efivar_guidname **result)
-{
-	struct efivar_guidname key;
-	memset(&key, '\0', sizeof(key));
-	memcpy(&key.guid, guid, sizeof(*guid));
-
-	const struct efivar_guidname *tmp;
-	tmp = bsearch(&key,
-		      &efi_well_known_guids[0],
-		      efi_n_well_known_guids,
-		      sizeof(efi_well_known_guids[0]),
-		      cmpguidp);
-	if (!tmp) {
-		*result = NULL;
+_get_common_guidname(const efi_guid_t *guid, const char **symbol)
+{
+	const struct efivar_guid_phash *ph = &guid_table->by_guid;
+	uint32_t seed, slot, idx;
+
+	seed = ph->seeds[efi_guid_phash_(guid, 0) % ph->nbuckets];
+	slot = efi_guid_phash_(guid, seed) & ph->mask;
+	idx = ph->slots[slot];
+	if (idx == EFI_GUID_PHASH_EMPTY ||
+	    efi_guid_cmp_(guid, &guid_table->guids[idx])) {
+		*symbol = NULL;
 		errno = ENOENT;
-		efi_error("GUID is not in common GUID list");
 		return -1;
 	}
 
-	*result = tmp;
+	*symbol = &guid_table->strtab[guid_table->symoffs[idx]];
 	return 0;
 }
 
+static int NONNULL(1)
+_get_common_guid_by_name(const char *name, size_t namelen)
+{
+	const struct efivar_guid_phash *ph = &guid_table->by_name;
+	uint32_t seed, slot, idx;
+	const char *symbol;
+
+	seed = ph->seeds[efi_name_phash_(name, namelen, 0) % ph->nbuckets];
+	slot = efi_name_phash_(name, namelen, seed) & ph->mask;
+	idx = ph->slots[slot];
+	if (idx == EFI_GUID_PHASH_EMPTY)
+		return -1;
+
+	symbol = &guid_table->strtab[guid_table->symoffs[idx]];
+	symbol += strlen("efi_guid_");
+	if (strncmp(symbol, name, namelen) || symbol[namelen] != '\0')
+		return -1;
+	if (idx >= guid_table->nguids)
+		idx = guid_table->aliases[idx - guid_table->nguids];
+	return idx;
+}
+
 int NONNULL(1, 2) PUBLIC
 efi_guid_to_name(efi_guid_t *guid, char **name)
 {
-	const struct efivar_guidname *result;
-	int rc = _get_common_guidname(guid, &result);
+	const char *symbol;
+	int rc = _get_common_guidname(guid, &symbol);
 	if (rc >= 0) {
-		*name = strndup(result->name, sizeof(result->name) -1);
+		*name = strdup(symbol + strlen("efi_guid_"));
 		return *name ? (int)strlen(*name) : -1;
 	}
 	rc = efi_guid_to_str(guid, name);
@@ -119,10 +140,10 @@ efi_guid_to_name(efi_guid_t *guid, char **name)
 int NONNULL(1, 2) PUBLIC
 efi_guid_to_symbol(efi_guid_t *guid, char **symbol)
 {
-	const struct efivar_guidname *result;
+	const char *result;
 	int rc = _get_common_guidname(guid, &result);
 	if (rc >= 0) {
-		*symbol = strndup(result->symbol, sizeof(result->symbol) -1);
+		*symbol = strdup(result);
 		return *symbol ? (int)strlen(*symbol) : -1;
 	}
 	efi_error_clear();
@@ -133,7 +154,7 @@ efi_guid_to_symbol(efi_guid_t *guid, char **symbol)
 int NONNULL(1) PUBLIC
 efi_guid_to_id_guid(const efi_guid_t *guid, char **sp)
 {
-	const struct efivar_guidname *result = NULL;
+	const char *result = NULL;
 	char *ret = NULL;
 	int rc;
 
@@ -141,40 +162,134 @@ efi_guid_to_id_guid(const efi_guid_t *guid, char **sp)
 	if (rc >= 0) {
 		if (!sp) {
 			return snprintf(NULL, 0, "{%s}",
-					result->symbol + strlen("efi_guid_"));
+					result + strlen("efi_guid_"));
 		} else if (sp && *sp) {
 			return snprintf(*sp, GUID_LENGTH_WITH_NUL + 2, "{%s}",
-					result->symbol + strlen("efi_guid_"));
+					result + strlen("efi_guid_"));
 		}
 
 		rc = asprintf(&ret, "{%s}",
-				result->symbol + strlen("efi_guid_"));
+				result + strlen("efi_guid_"));
 		if (rc >= 0)
 			*sp = ret;
 		return rc;
 	}
-	if (!sp) {
-		return snprintf(NULL, 0, "{"GUID_FORMAT"}",
-				GUID_FORMAT_ARGS(guid));
-	} else if (sp && *sp) {
-		return snprintf(*sp, GUID_LENGTH_WITH_NUL+2, "{"GUID_FORMAT"}",
-				GUID_FORMAT_ARGS(guid));
-	}
-	rc = asprintf(&ret, "{"GUID_FORMAT"}", GUID_FORMAT_ARGS(guid));
-	if (rc >= 0)
+	if (!sp)
+		return GUID_STR_LENGTH + 2;
+
+	if (!*sp) {
+		ret = malloc(GUID_LENGTH_WITH_NUL + 2);
+		if (!ret) {
+			efi_error("Could not format guid");
+			return -1;
+		}
 		*sp = ret;
-	return rc;
+	}
+	(*sp)[0] = '{';
+	guid_to_text(guid, *sp + 1);
+	(*sp)[GUID_STR_LENGTH + 1] = '}';
+	(*sp)[GUID_STR_LENGTH + 2] = '\0';
+	return GUID_STR_LENGTH + 2;
 }
 
-int NONNULL(1, 2) PUBLIC
-efi_symbol_to_guid(const char *symbol, efi_guid_t *guid)
+/*
+ * Symbols that aren't in the well-known table are looked up with dlsym(),
+ * and the results are remembered here.  Each entry is published once
+ * with a compare-and-swap and then never changes until the library is
+ * unloaded, so readers don't need a lock.  A miss is only believed while
+ * no other object has been loaded since it was recorded.
+ */
+#define SYMBOL_CACHE_SIZE 64
+#define SYMBOL_CACHE_PROBES 4
+
+struct symbol_cache_entry {
+	unsigned long long generation;
+	bool found;
+	efi_guid_t guid;
+	char symbol[];
+};
+
+static struct symbol_cache_entry *symbol_cache[SYMBOL_CACHE_SIZE];
+
+static void DESTRUCTOR
+symbol_cache_fini(void)
+{
+	for (unsigned int i = 0; i < SYMBOL_CACHE_SIZE; i++) {
+		free(symbol_cache[i]);
+		symbol_cache[i] = NULL;
+	}
+}
+
+static int
+dl_generation_cb(struct dl_phdr_info *info, size_t size, void *data)
+{
+	if (size >= offsetof(struct dl_phdr_info, dlpi_subs))
+		*(unsigned long long *)data = info->dlpi_adds;
+	return 1;
+}
+
+static unsigned long long
+dl_generation(void)
+{
+	unsigned long long adds = ULLONG_MAX;
+
+	dl_iterate_phdr(dl_generation_cb, &adds);
+	return adds;
+}
+
+static int NONNULL(1, 3)
+dlsym_guid(const char *symbol, size_t len, efi_guid_t *guid)
 {
+	uint32_t hash = efi_name_phash_(symbol, len, 0);
+	unsigned long long generation = dl_generation();
+	struct symbol_cache_entry *entry;
+	unsigned int i;
+
+	for (i = 0; i < SYMBOL_CACHE_PROBES; i++) {
+		entry = __atomic_load_n(&symbol_cache[(hash + i) % SYMBOL_CACHE_SIZE],
+					__ATOMIC_ACQUIRE);
+		if (!entry)
+			break;
+		if (strcmp(entry->symbol, symbol))
+			continue;
+		if (entry->found) {
+			memcpy(guid, &entry->guid, sizeof(*guid));
+			return 0;
+		}
+		if (entry->generation == generation &&
+		    generation != ULLONG_MAX)
+			return -1;
+	}
+
 	void *dlh = dlopen(NULL, RTLD_LAZY);
 	if (!dlh)
 		return -1;
 
 	void *sym = dlsym(dlh, symbol);
 	dlclose(dlh);
+
+	entry = malloc(sizeof(*entry) + len + 1);
+	if (entry) {
+		entry->generation = generation;
+		entry->found = sym != NULL;
+		if (sym)
+			memcpy(&entry->guid, sym, sizeof(entry->guid));
+		memcpy(entry->symbol, symbol, len + 1);
+
+		for (i = 0; i < SYMBOL_CACHE_PROBES; i++) {
+			struct symbol_cache_entry *expected = NULL;
+
+			if (__atomic_compare_exchange_n(
+					&symbol_cache[(hash + i) % SYMBOL_CACHE_SIZE],
+					&expected, entry, false,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+				entry = NULL;
+				break;
+			}
+		}
+		free(entry);
+	}
+
 	if (!sym)
 		return -1;
 
@@ -183,48 +298,63 @@ efi_symbol_to_guid(const char *symbol, efi_guid_t *guid)
 }
 
 int NONNULL(1, 2) PUBLIC
-efi_name_to_guid(const char *name, efi_guid_t *guid)
+efi_symbol_to_guid(const char *symbol, efi_guid_t *guid)
 {
-	size_t namelen;
-	struct efivar_guidname key;
+	size_t prefixlen = strlen("efi_guid_");
+	size_t len = strlen(symbol);
+	int idx;
+
+	if (len > prefixlen && !strncmp(symbol, "efi_guid_", prefixlen)) {
+		idx = _get_common_guid_by_name(symbol + prefixlen,
+					       len - prefixlen);
+		if (idx >= 0) {
+			memcpy(guid, &guid_table->guids[idx], sizeof(*guid));
+			return 0;
+		}
+	}
 
-	namelen = strnlen(name, 39);
+	return dlsym_guid(symbol, len, guid);
+}
 
-	memset(&key, '\0', sizeof(key));
-	memcpy(key.name, name, namelen);
+int NONNULL(1, 2) PUBLIC
+efi_name_to_guid(const char *name, efi_guid_t *guid)
+{
+	size_t namelen;
+	char key[40];
+	int idx;
 
+	namelen = strnlen(name, sizeof(key) - 1);
 	if (namelen > 2 && name[0] == '{' && name[namelen - 1] == '}') {
+		name += 1;
 		namelen -= 2;
-		memcpy(key.name, name + 1, namelen);
-		key.name[namelen] = 0;
 	}
+	memcpy(key, name, namelen);
+	key[namelen] = '\0';
 
-	key.name[sizeof(key.name) - 1] = '\0';
-
-	const struct efivar_guidname *result;
-	result = bsearch(&key,
-			 &efi_well_known_names[0],
-			 efi_n_well_known_names,
-			 sizeof(efi_well_known_names[0]),
-			 cmpnamep);
-	if (result != NULL) {
-		memcpy(guid, &result->guid, sizeof(*guid));
+	idx = _get_common_guid_by_name(key, namelen);
+	if (idx >= 0) {
+		memcpy(guid, &guid_table->guids[idx], sizeof(*guid));
 		return 0;
 	}
 
-	int rc = efi_str_to_guid(key.name, guid);
+	/*
+	 * Most names that get this far aren't GUID strings, so don't leave
+	 * an error behind for each one of them that fails to parse.
+	 */
+	int rc = text_to_guid(key, guid);
 	if (rc >= 0)
 		return 0;
 
-	char tmpname[sizeof(key.name) + 9];
+	char tmpname[sizeof(key) + 9];
 	strcpy(tmpname, "efi_guid_");
-	memmove(tmpname+9, key.name, sizeof(key.name) - 9);
+	strcpy(tmpname + 9, key);
 
 	rc = efi_symbol_to_guid(tmpname, guid);
 	if (rc >= 0)
 		return rc;
 
 	errno = ENOENT;
+	efi_error("\"%s\" is not a GUID or a known GUID name", key);
 	return -1;
 }
 
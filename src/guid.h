@@ -12,6 +12,7 @@
 #include <string.h>
 #include "efivar_endian.h"
 #include "compiler.h"
+#include "util.h"
 #include "include/efivar/efivar-types.h"
 #include "include/efivar/efivar.h"
 
@@ -31,56 +32,99 @@ real_isspace(char c)
 	return 0;
 }
 
-static inline int
-check_sanity(const char *text, size_t len)
+#define GUID_STR_LENGTH 36
+
+/*
+ * Where each byte of a GUID, in the order the canonical string spells
+ * them, starts in that string.
+ */
+static const uint8_t guid_str_offsets[16] UNUSED = {
+	0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34
+};
+
+/*
+ * 0x10 | the value of each hex digit, and 0 for everything else.
+ */
+static const uint8_t guid_hex_values[256] UNUSED = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13,
+	['4'] = 0x14, ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17,
+	['8'] = 0x18, ['9'] = 0x19,
+	['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c,
+	['d'] = 0x1d, ['e'] = 0x1e, ['f'] = 0x1f,
+	['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c,
+	['D'] = 0x1d, ['E'] = 0x1e, ['F'] = 0x1f,
+};
+
+/*
+ * Write the 36 character canonical form of guid, and a NUL, to buf.
+ */
+static inline void NONNULL(1, 2) UNUSED
+guid_to_text(const efi_guid_t *guid, char *buf)
 {
-	size_t sl = strlen("84be9c3e-8a32-42c0-891c-4cd3b072becc");
+	static const char hex[] = "0123456789abcdef";
+	uint32_t a = le32_to_cpu(guid->a);
+	uint16_t b = le16_to_cpu(guid->b);
+	uint16_t c = le16_to_cpu(guid->c);
+	uint8_t bytes[16] = {
+		a >> 24, a >> 16, a >> 8, a, b >> 8, b, c >> 8, c,
+	};
 
-	errno = EINVAL;
-	if (len < sl)
-		return -1;
-	else if (len > sl && !real_isspace(text[sl]))
-		return -1;
+	memcpy(&bytes[8], &guid->d, sizeof(guid->d));
+	memcpy(&bytes[10], guid->e, sizeof(guid->e));
 
-	if (text[8] != '-' || text[13] != '-' || text[18] != '-' ||
-			text[23] != '-')
-		return -1;
+	for (unsigned int i = 0; i < 16; i++) {
+		char *pos = &buf[guid_str_offsets[i]];
 
-	errno = 0;
-	return 0;
+		pos[0] = hex[bytes[i] >> 4];
+		pos[1] = hex[bytes[i] & 0xf];
+	}
+	buf[8] = buf[13] = buf[18] = buf[23] = '-';
+	buf[GUID_STR_LENGTH] = '\0';
 }
 
-static inline int
-check_segment_sanity(const char *text, size_t len)
+/*
+ * Parse the first 36 characters of text as a canonical GUID.  This reads
+ * them in order and stops at the first one that's wrong, so it never
+ * reads past the end of a shorter string.
+ */
+static inline int NONNULL(1, 2) UNUSED
+guid_from_text(const char *text, efi_guid_t *guid)
 {
-	for(unsigned int i = 0; i < len; i++) {
-		if (text[i] >= '0' && text[i] <= '9')
-			continue;
-		/* "| 0x20" is tolower() without having to worry about
-		 * locale concerns, since we know everything here must
-		 * be within traditional ascii space. */
-		if ((text[i] | 0x20) >= 'a' && (text[i] | 0x20) <= 'f')
-			continue;
-		errno = EINVAL;
-		return -1;
+	uint8_t bytes[16];
+
+	for (unsigned int i = 0; i < 16; i++) {
+		const uint8_t *pos = (const uint8_t *)&text[guid_str_offsets[i]];
+		uint8_t hi, lo;
+
+		if ((i == 4 || i == 6 || i == 8 || i == 10) && pos[-1] != '-')
+			goto err;
+		hi = guid_hex_values[pos[0]];
+		if (!hi)
+			goto err;
+		lo = guid_hex_values[pos[1]];
+		if (!lo)
+			goto err;
+		bytes[i] = (uint8_t)(hi << 4) | (lo & 0xf);
 	}
+
+	guid->a = cpu_to_le32((uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 |
+			      (uint32_t)bytes[2] << 8 | bytes[3]);
+	guid->b = cpu_to_le16((uint16_t)(bytes[4] << 8 | bytes[5]));
+	guid->c = cpu_to_le16((uint16_t)(bytes[6] << 8 | bytes[7]));
+	memcpy(&guid->d, &bytes[8], sizeof(guid->d));
+	memcpy(guid->e, &bytes[10], sizeof(guid->e));
 	return 0;
+err:
+	errno = EINVAL;
+	return -1;
 }
 
 static inline int UNUSED
 text_to_guid(const char *text, efi_guid_t *guid)
 {
-	/* these variables represent the length of the /string/ they hold,
-	 * not the interpreted length of the value from them.  Mostly the
-	 * names make it more obvious to verify that my bounds checking is
-	 * correct. */
-	char eightbytes[9] = "";
-	char fourbytes[5] = "";
-	char twobytes[3] = "";
 	size_t textlen = strlen(text);
-	size_t guidlen = strlen("84be9c3e-8a32-42c0-891c-4cd3b072becc");
 
-	if (textlen == guidlen + 2) {
+	if (textlen == GUID_STR_LENGTH + 2) {
 		if (text[0] != '{' || text[textlen - 1] != '}') {
 			errno = EINVAL;
 			return -1;
@@ -89,94 +133,99 @@ text_to_guid(const char *text, efi_guid_t *guid)
 		textlen -= 2;
 	}
 
-	if (check_sanity(text, textlen) < 0)
-		return -1;
-
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 * ^ */
-	memcpy(eightbytes, text, 8);
-	if (check_segment_sanity(eightbytes, 8) < 0)
+	if (textlen < GUID_STR_LENGTH ||
+	    (textlen > GUID_STR_LENGTH && !real_isspace(text[GUID_STR_LENGTH]))) {
+		errno = EINVAL;
 		return -1;
-	guid->a = (uint32_t)strtoul(eightbytes, NULL, 16);
-	guid->a = cpu_to_le32(guid->a);
+	}
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *	  ^ */
-	memcpy(fourbytes, text+9, 4);
-	if (check_segment_sanity(fourbytes, 4) < 0)
-		return -1;
-	guid->b = (uint16_t)strtoul(fourbytes, NULL, 16);
-	guid->b = cpu_to_le16(guid->b);
+	return guid_from_text(text, guid);
+}
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *	       ^ */
-	memcpy(fourbytes, text+14, 4);
-	if (check_segment_sanity(fourbytes, 4) < 0)
-		return -1;
-	guid->c = (uint16_t)strtoul(fourbytes, NULL, 16);
-	guid->c = cpu_to_le16(guid->c);
+#ifndef EFIVAR_GUIDS_H
+struct efivar_guidname {
+	efi_guid_t guid;
+	char symbol[256];
+	char name[256];
+	char description[256];
+} __attribute__((__aligned__(16)));
+#endif /* EFIVAR_GUIDS_H */
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *		    ^ */
-	memcpy(fourbytes, text+19, 4);
-	if (check_segment_sanity(fourbytes, 4) < 0)
-		return -1;
-	guid->d = (uint16_t)strtoul(fourbytes, NULL, 16);
-	guid->d = cpu_to_be16(guid->d);
+/*
+ * The packed well-known GUID table makeguids generates for lookups.  The
+ * GUIDs are sorted in their own array, and symbols live in one string
+ * table; a name is its symbol without the "efi_guid_" prefix.  Alias
+ * symbols follow the GUIDs' entries in symoffs, and aliases[] holds the
+ * index of the GUID each of them names.  Each key type has a perfect
+ * hash: the key's bucket supplies the seed that hashes it to its slot,
+ * and the slot holds the index of its entry.  Slots that hold no entry
+ * are set to EFI_GUID_PHASH_EMPTY, and since any other key can also hash
+ * to an occupied slot, lookups have to compare the entry.
+ */
+#define EFI_GUID_PHASH_EMPTY 0xffff
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *			 ^ */
-	memcpy(twobytes, text+24, 2);
-	if (check_segment_sanity(twobytes, 2) < 0)
-		return -1;
-	guid->e[0] = (uint8_t)strtoul(twobytes, NULL, 16);
+struct efivar_guid_phash {
+	const uint16_t *seeds;
+	uint32_t nbuckets;
+	const uint16_t *slots;
+	uint32_t mask;
+};
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *			   ^ */
-	memcpy(twobytes, text+26, 2);
-	if (check_segment_sanity(twobytes, 2) < 0)
-		return -1;
-	guid->e[1] = (uint8_t)strtoul(twobytes, NULL, 16);
+struct efivar_guid_table {
+	const efi_guid_t *guids;
+	const uint16_t *symoffs;
+	const char *strtab;
+	uint32_t nguids;
+	const uint16_t *aliases;
+	uint32_t naliases;
+	struct efivar_guid_phash by_guid;
+	struct efivar_guid_phash by_name;
+};
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *			     ^ */
-	memcpy(twobytes, text+28, 2);
-	if (check_segment_sanity(twobytes, 2) < 0)
-		return -1;
-	guid->e[2] = (uint8_t)strtoul(twobytes, NULL, 16);
+extern const struct efivar_guid_table efi_well_known_guid_table_ HIDDEN;
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *			       ^ */
-	memcpy(twobytes, text+30, 2);
-	if (check_segment_sanity(twobytes, 2) < 0)
-		return -1;
-	guid->e[3] = (uint8_t)strtoul(twobytes, NULL, 16);
+static inline uint64_t
+efi_guid_phash_mix_(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *				 ^ */
-	memcpy(twobytes, text+32, 2);
-	if (check_segment_sanity(twobytes, 2) < 0)
-		return -1;
-	guid->e[4] = (uint8_t)strtoul(twobytes, NULL, 16);
+/*
+ * These hash the field values rather than the bytes in memory, so that
+ * makeguids computes the same hashes on the build host as the library
+ * does on the target.
+ */
+static inline uint32_t NONNULL(1) UNUSED
+efi_guid_phash_(const efi_guid_t *guid, uint32_t seed)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ull * (seed + 1ull);
+	uint64_t lo, hi;
 
-	/* 84be9c3e-8a32-42c0-891c-4cd3b072becc
-	 *				   ^ */
-	memcpy(twobytes, text+34, 2);
-	if (check_segment_sanity(twobytes, 2) < 0)
-		return -1;
-	guid->e[5] = (uint8_t)strtoul(twobytes, NULL, 16);
+	lo = (uint64_t)le32_to_cpu(guid->a) << 32
+	     | (uint64_t)le16_to_cpu(guid->b) << 16
+	     | le16_to_cpu(guid->c);
+	hi = (uint64_t)be16_to_cpu(guid->d) << 48;
+	for (unsigned int i = 0; i < 6; i++)
+		hi |= (uint64_t)guid->e[i] << (40 - 8 * i);
 
-	return 0;
+	h = efi_guid_phash_mix_(h ^ lo);
+	h = efi_guid_phash_mix_(h ^ hi);
+	return (uint32_t)h;
 }
 
-#ifndef EFIVAR_GUIDS_H
-struct efivar_guidname {
-	efi_guid_t guid;
-	char symbol[256];
-	char name[256];
-	char description[256];
-} __attribute__((__aligned__(16)));
-#endif /* EFIVAR_GUIDS_H */
+static inline uint32_t NONNULL(1) UNUSED
+efi_name_phash_(const char *name, size_t len, uint32_t seed)
+{
+	uint64_t h = FNV1A_64_INIT ^ (0x9e3779b97f4a7c15ull * seed);
+
+	h = fnv1a_64(h, name, len);
+	return (uint32_t)efi_guid_phash_mix_(h);
+}
 
 static inline int
 efi_int_cmp_(uint64_t a, uint64_t b)
@@ -18,6 +18,7 @@ extern "C" {
 #define EFIBOOT_OPTIONS_IGNORE_FS_ERROR	0x00000010
 #define EFIBOOT_OPTIONS_WRITE_SIGNATURE	0x00000020
 #define EFIBOOT_OPTIONS_IGNORE_PMBR_ERR	0x00000040
+#define EFIBOOT_OPTIONS_MATCH_TYPE_GUID	0x00000080
 
 extern ssize_t efi_generate_file_device_path(uint8_t *buf, ssize_t size,
 					     const char * const filepath,
@@ -33,6 +34,54 @@ extern ssize_t efi_generate_file_device_path_from_esp(uint8_t *buf,
 	__attribute__((__nonnull__ (3, 5)))
 	__attribute__((__visibility__ ("default")));
 
+/*
+ * Find the GPT partition on the disk at devpath whose unique partition
+ * GUID, or with EFIBOOT_OPTIONS_MATCH_TYPE_GUID its partition type GUID,
+ * is guid.  Returns the number of the first match numbered above after
+ * (pass 0 to start at the beginning), or -1 with errno set to ENOENT if
+ * there isn't one.  The disk's GPT is validated once and cached, so asking
+ * repeatedly about the same disk is cheap.
+ */
+extern int efi_find_gpt_partition(const char *devpath, const efi_guid_t *guid,
+				  uint32_t options, int after)
+	__attribute__((__nonnull__ (1, 2)))
+	__attribute__((__visibility__ ("default")));
+
+/*
+ * One request for efi_generate_file_device_paths().  devpath, partition,
+ * relpath, options, buf, and size mean the same as the arguments to
+ * efi_generate_file_device_path_from_esp(), and edd10_devicenum is the
+ * value it takes as a variadic argument with EFIBOOT_ABBREV_EDD10.  On
+ * return, ret holds what that call would have returned, and error holds
+ * its errno when ret is negative, or 0.
+ */
+typedef struct {
+	const char *devpath;
+	int partition;
+	const char *relpath;
+	uint32_t options;
+	uint32_t edd10_devicenum;
+	uint8_t *buf;
+	ssize_t size;
+
+	ssize_t ret;
+	int error;
+} efi_file_dp_request_t;
+
+/*
+ * Make the File() device paths for many requests at once.  Requests are
+ * grouped by the disk they're on; each disk is probed and has its
+ * partition table read once, and separate disks are handled in parallel
+ * on up to max_threads threads (0 picks a small default).  Returns the
+ * number of requests that failed, or -1 if the batch couldn't be set up
+ * at all.  Errors from requests handled on other threads are only
+ * reported through their error member, not efi_error_get().
+ */
+extern ssize_t efi_generate_file_device_paths(efi_file_dp_request_t *reqs,
+					      size_t n_reqs,
+					      unsigned int max_threads)
+	__attribute__((__nonnull__ (1)))
+	__attribute__((__visibility__ ("default")));
 
 extern ssize_t efi_generate_ipv4_device_path(uint8_t *buf, ssize_t size,
 					     const char * const ifname,
@@ -47,6 +96,30 @@ extern ssize_t efi_generate_ipv4_device_path(uint8_t *buf, ssize_t size,
 	__attribute__((__nonnull__ (3,4,5,6,7)))
 	__attribute__((__visibility__ ("default")));
 
+/*
+ * Opt-in, process-wide cache of the sysfs links, attributes, and
+ * existence checks that generating device paths looks up.  Nothing
+ * tells the library when sysfs changes, so callers should flush it after
+ * devices come or go.  syscalls_saved counts the readlink(), stat(), and
+ * open()/fstat()/read()/close() calls that hits stood in for.
+ */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations;
+	uint64_t syscalls_saved;
+} efi_sysfs_cache_stats_t;
+
+extern int efi_sysfs_cache_enable(void)
+	__attribute__((__visibility__ ("default")));
+extern void efi_sysfs_cache_disable(void)
+	__attribute__((__visibility__ ("default")));
+extern void efi_sysfs_cache_flush(void)
+	__attribute__((__visibility__ ("default")));
+extern void efi_get_sysfs_cache_stats(efi_sysfs_cache_stats_t *stats)
+	__attribute__((__nonnull__ (1)))
+	__attribute__((__visibility__ ("default")));
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -67,10 +67,20 @@ extern int efi_secdb_del_entry(efi_secdb_t *secdb,
 			       efi_secdb_type_t algorithm,
 			       efi_secdb_data_t *data,
 			       size_t datasz);
+extern int efi_secdb_contains(efi_secdb_t *secdb,
+			      const efi_guid_t *owner,
+			      efi_secdb_type_t algorithm,
+			      efi_secdb_data_t *data,
+			      size_t datasz);
 extern int efi_secdb_realize(efi_secdb_t *secdb,
 			     /* caller owns out */
 			     void **out,
 			     size_t *outsize);
+extern ssize_t efi_secdb_realize_buf(efi_secdb_t *secdb,
+				     void *buf,
+				     size_t bufsize);
+extern int efi_secdb_realize_fd(efi_secdb_t *secdb,
+				int fd);
 extern void efi_secdb_free(efi_secdb_t *secdb);
 
 typedef enum {
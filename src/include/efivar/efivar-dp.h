@@ -1203,6 +1203,24 @@ extern ssize_t efidp_parse_device_path(unsigned char *path,
 				       efidp out, size_t size);
 extern ssize_t efidp_format_device_path(unsigned char *buf, size_t size,
 					const_efidp dp, ssize_t limit);
+
+/*
+ * A device path formatter that can be reused for many paths.  Each call
+ * to efidp_formatter_format() formats dp in a single pass into a buffer
+ * the formatter owns, growing it as needed, and points *str at it; the
+ * string stays valid until the next call or efidp_formatter_free().  It
+ * returns the length of the string, or -1 on error.
+ */
+typedef struct efidp_formatter efidp_formatter_t;
+
+extern int efidp_formatter_new(efidp_formatter_t **formatter)
+	__attribute__((__nonnull__ (1)));
+extern ssize_t efidp_formatter_format(efidp_formatter_t *formatter,
+				      const_efidp dp, ssize_t limit,
+				      const char **str)
+	__attribute__((__nonnull__ (1, 2, 4)));
+extern void efidp_formatter_free(efidp_formatter_t *formatter);
+
 extern ssize_t efidp_make_vendor(uint8_t *buf, ssize_t size, uint8_t type,
 				 uint8_t subtype,  efi_guid_t vendor_guid,
 				 void *data, size_t data_size);
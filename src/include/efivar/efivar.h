@@ -39,6 +39,9 @@ extern int efi_get_variable_attributes(efi_guid_t, const char *name,
 				__attribute__((__nonnull__ (2, 3)));
 extern int efi_get_variable_exists(efi_guid_t, const char *name)
 				__attribute__((__nonnull__ (2)));
+extern int efi_stat_variable(efi_guid_t guid, const char *name, size_t *size,
+			     uint32_t *attributes)
+				__attribute__((__nonnull__ (2, 3, 4)));
 extern int efi_get_variable(efi_guid_t guid, const char *name, uint8_t **data,
 			    size_t *data_size, uint32_t *attributes)
 				__attribute__((__nonnull__ (2, 3, 4, 5)));
@@ -52,8 +55,87 @@ extern int efi_append_variable(efi_guid_t guid, const char *name,
 			       const uint8_t *data, size_t data_size,
 			       uint32_t attributes)
 			      __attribute__((__nonnull__ (2, 3)));
+
+/*
+ * Set a variable only if its current contents are expected_data, or only
+ * if it does not exist when expected_data is NULL.  Fails with ESTALE if
+ * the variable has changed, in which case the caller should re-read it
+ * and try again.  Updates made this way, and with efi_append_variable(),
+ * are serialized against each other with an advisory lock.
+ */
+extern int efi_update_variable_if(efi_guid_t guid, const char *name,
+				  const uint8_t *expected_data,
+				  size_t expected_size,
+				  const uint8_t *data, size_t data_size,
+				  uint32_t attributes, mode_t mode)
+			      __attribute__((__nonnull__ (2, 5)));
+
 extern int efi_get_next_variable_name(efi_guid_t **guid, char **name)
 			      __attribute__((__nonnull__ (1, 2)));
+
+/*
+ * Variable name iterators are independent of each other and of
+ * efi_get_next_variable_name(), so they may be used concurrently and
+ * nested.  The guid and name passed back by efi_variable_iter_next() are
+ * owned by the iterator and valid until its next call.
+ */
+typedef struct efi_variable_iter efi_variable_iter_t;
+
+extern int efi_variable_iter_new(efi_variable_iter_t **iter)
+			      __attribute__((__nonnull__ (1)));
+extern int efi_variable_iter_next(efi_variable_iter_t *iter, efi_guid_t **guid,
+				  char **name)
+			      __attribute__((__nonnull__ (1, 2, 3)));
+extern void efi_variable_iter_free(efi_variable_iter_t *iter);
+
+/*
+ * One entry of a variable store snapshot.  All entries, names and data
+ * returned by efi_get_variable_snapshot() live in a single allocation,
+ * which is released with efi_free_variable_snapshot().
+ */
+typedef struct {
+	efi_guid_t guid;
+	const char *name;
+	uint32_t attributes;
+	const uint8_t *data;
+	size_t data_size;
+} efi_variable_snapshot_entry_t;
+
+extern int efi_get_variable_snapshot(efi_variable_snapshot_entry_t **entries,
+				     size_t *n_entries)
+			      __attribute__((__nonnull__ (1, 2)));
+extern void efi_free_variable_snapshot(efi_variable_snapshot_entry_t *entries);
+
+/*
+ * Accounting for the unprivileged efivarfs read rate limit.  Reads are
+ * only counted, and only ever delayed, when not running as root.
+ */
+typedef struct {
+	uint64_t reads;
+	uint64_t throttled_reads;
+	uint64_t throttled_ns;
+} efi_ratelimit_stats_t;
+
+extern void efi_get_ratelimit_stats(efi_ratelimit_stats_t *stats)
+			      __attribute__((__nonnull__ (1)));
+
+/*
+ * Opt-in, process-wide cache of efi_get_variable(),
+ * efi_get_variable_size(), and efi_get_variable_attributes() results.
+ * Entries are invalidated by inotify events on the variable store and by
+ * this library's own writes.  Only available with efivarfs.
+ */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations;
+} efi_variable_cache_stats_t;
+
+extern int efi_variable_cache_enable(void);
+extern void efi_variable_cache_disable(void);
+extern void efi_get_variable_cache_stats(efi_variable_cache_stats_t *stats)
+			      __attribute__((__nonnull__ (1)));
+
 extern int efi_chmod_variable(efi_guid_t guid, const char *name, mode_t mode)
 			      __attribute__((__nonnull__ (2)));
 
@@ -61,6 +143,19 @@ extern int efi_str_to_guid(const char *s, efi_guid_t *guid)
 			  __attribute__((__nonnull__ (1, 2)));
 extern int efi_guid_to_str(const efi_guid_t *guid, char **sp)
 			  __attribute__((__nonnull__ (1)));
+
+/*
+ * Allocation-free conversions of the canonical 36 character GUID form.
+ * efi_guid_to_str_r() writes it and a NUL to buf, which must have room
+ * for 37 bytes, and returns 36.  efi_str_to_guid_fast() parses the first
+ * 36 characters of s, without braces, and unlike efi_str_to_guid() only
+ * sets errno when they are not a GUID.
+ */
+extern int efi_guid_to_str_r(const efi_guid_t *guid, char *buf)
+			    __attribute__((__nonnull__ (1, 2)));
+extern int efi_str_to_guid_fast(const char *s, efi_guid_t *guid)
+			       __attribute__((__nonnull__ (1, 2)));
+
 extern int efi_guid_to_id_guid(const efi_guid_t *guid, char **sp)
 			      __attribute__((__nonnull__ (1)));
 extern int efi_guid_to_symbol(efi_guid_t *guid, char **symbol)
@@ -8,10 +8,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "efivar.h"
@@ -28,6 +32,363 @@ struct efi_var_operations default_ops = {
 
 struct efi_var_operations *ops = NULL;
 
+/*
+ * Opt-in read-through cache for long lived processes.  Lookups are
+ * memoized per (guid, name), including "doesn't exist".  Entries are
+ * dropped when inotify tells us the backing file changed, which we check
+ * for (without blocking) at the start of every lookup, and when we
+ * change a variable ourselves.  Backend I/O is done without the lock
+ * held; a generation count keeps a lookup that raced with an
+ * invalidation from inserting stale data.
+ */
+#define VAR_CACHE_BUCKETS	256
+#define VAR_CACHE_MAX_ENTRIES	1024
+
+#define VAR_CACHE_DATA		0x1
+#define VAR_CACHE_SIZE		0x2
+#define VAR_CACHE_ATTRS		0x4
+
+struct var_cache_entry {
+	list_t list;
+	efi_guid_t guid;
+	int error;
+	unsigned int valid;
+	uint32_t attributes;
+	size_t size;
+	uint8_t *data;
+	char name[];
+};
+
+static pthread_mutex_t var_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool var_cache_on;
+static int var_cache_fd = -1;
+static uint64_t var_cache_generation;
+static list_t var_cache_buckets[VAR_CACHE_BUCKETS];
+static size_t var_cache_nentries;
+static efi_variable_cache_stats_t var_cache_stats;
+
+static unsigned int
+var_cache_hash(const efi_guid_t *guid, const char *name, size_t namelen)
+{
+	uint64_t hash;
+
+	hash = fnv1a_64(FNV1A_64_INIT, guid, sizeof(*guid));
+	hash = fnv1a_64(hash, name, namelen);
+	return hash % VAR_CACHE_BUCKETS;
+}
+
+static struct var_cache_entry *
+var_cache_find(const efi_guid_t *guid, const char *name, size_t namelen)
+{
+	list_t *bucket = &var_cache_buckets[var_cache_hash(guid, name, namelen)];
+	list_t *pos;
+
+	list_for_each(pos, bucket) {
+		struct var_cache_entry *entry;
+
+		entry = list_entry(pos, struct var_cache_entry, list);
+		if (!memcmp(&entry->guid, guid, sizeof(*guid)) &&
+		    !strncmp(entry->name, name, namelen) &&
+		    entry->name[namelen] == '\0')
+			return entry;
+	}
+	return NULL;
+}
+
+static void
+var_cache_drop(struct var_cache_entry *entry)
+{
+	list_del(&entry->list);
+	free(entry->data);
+	free(entry);
+	var_cache_nentries -= 1;
+	var_cache_stats.invalidations += 1;
+}
+
+static void
+var_cache_flush(void)
+{
+	for (unsigned int i = 0; i < VAR_CACHE_BUCKETS; i++) {
+		list_t *pos, *tmp;
+
+		list_for_each_safe(pos, tmp, &var_cache_buckets[i])
+			var_cache_drop(list_entry(pos, struct var_cache_entry,
+						  list));
+	}
+	var_cache_generation += 1;
+}
+
+static void
+var_cache_invalidate_locked(const efi_guid_t *guid, const char *name,
+			    size_t namelen)
+{
+	struct var_cache_entry *entry;
+
+	entry = var_cache_find(guid, name, namelen);
+	if (entry)
+		var_cache_drop(entry);
+	var_cache_generation += 1;
+}
+
+static void
+var_cache_stop(void)
+{
+	if (var_cache_fd >= 0) {
+		close(var_cache_fd);
+		var_cache_fd = -1;
+	}
+	var_cache_flush();
+	var_cache_on = false;
+}
+
+static void
+var_cache_drain_events(void)
+{
+	char buf[4096] ALIGNED(__alignof__(struct inotify_event));
+	size_t guidlen = strlen("8be4df61-93ca-11d2-aa0d-00e098032b8c");
+
+	while (var_cache_on) {
+		ssize_t len = read(var_cache_fd, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+
+		for (char *p = buf; p < buf + len; ) {
+			struct inotify_event *ev = (struct inotify_event *)p;
+			size_t namelen;
+			efi_guid_t guid;
+
+			p += sizeof(*ev) + ev->len;
+
+			/*
+			 * If the directory itself went away, nothing will
+			 * ever tell us about changes again.
+			 */
+			if (ev->mask & (IN_IGNORED | IN_DELETE_SELF |
+					IN_MOVE_SELF | IN_UNMOUNT)) {
+				var_cache_stop();
+				return;
+			}
+			if (ev->mask & IN_Q_OVERFLOW) {
+				var_cache_flush();
+				continue;
+			}
+			if (!ev->len)
+				continue;
+
+			namelen = strlen(ev->name);
+			if (namelen < guidlen + 2 ||
+			    text_to_guid(ev->name + namelen - guidlen,
+					 &guid) < 0)
+				continue;
+			var_cache_invalidate_locked(&guid, ev->name,
+						    namelen - guidlen - 1);
+		}
+	}
+}
+
+static void
+var_cache_invalidate(efi_guid_t guid, const char *name)
+{
+	pthread_mutex_lock(&var_cache_lock);
+	if (var_cache_on)
+		var_cache_invalidate_locked(&guid, name, strlen(name));
+	pthread_mutex_unlock(&var_cache_lock);
+}
+
+static struct var_cache_entry *
+var_cache_get_entry(const efi_guid_t *guid, const char *name)
+{
+	size_t namelen = strlen(name);
+	struct var_cache_entry *entry;
+
+	entry = var_cache_find(guid, name, namelen);
+	if (entry)
+		return entry;
+
+	if (var_cache_nentries >= VAR_CACHE_MAX_ENTRIES)
+		var_cache_flush();
+
+	entry = calloc(1, sizeof(*entry) + namelen + 1);
+	if (!entry)
+		return NULL;
+	memcpy(&entry->guid, guid, sizeof(*guid));
+	memcpy(entry->name, name, namelen + 1);
+	list_add(&entry->list,
+		 &var_cache_buckets[var_cache_hash(guid, name, namelen)]);
+	var_cache_nentries += 1;
+	return entry;
+}
+
+static int
+var_cache_fetch(efi_guid_t guid, const char *name, unsigned int what,
+		uint8_t **data, size_t *size, uint32_t *attributes)
+{
+	switch (what) {
+	case VAR_CACHE_DATA:
+		return ops->get_variable(guid, name, data, size, attributes);
+	case VAR_CACHE_SIZE:
+		return ops->get_variable_size(guid, name, size);
+	case VAR_CACHE_ATTRS:
+		return ops->get_variable_attributes(guid, name, attributes);
+	default:
+		return ops->stat_variable(guid, name, size, attributes);
+	}
+}
+
+/*
+ * Look up whichever of the data, size, or attributes "what" asks for,
+ * going to the backend on a miss.  Returns the backend's result.
+ */
+static int
+var_cache_lookup(efi_guid_t guid, const char *name, unsigned int what,
+		 uint8_t **data, size_t *size, uint32_t *attributes)
+{
+	struct var_cache_entry *entry;
+	uint64_t generation;
+	int rc;
+
+	pthread_mutex_lock(&var_cache_lock);
+	var_cache_drain_events();
+	if (!var_cache_on) {
+		pthread_mutex_unlock(&var_cache_lock);
+		goto uncached;
+	}
+
+	entry = var_cache_find(&guid, name, strlen(name));
+	if (entry && entry->error) {
+		int error = entry->error;
+
+		var_cache_stats.hits += 1;
+		pthread_mutex_unlock(&var_cache_lock);
+		errno = error;
+		return -1;
+	}
+	if (entry && (entry->valid & what) == what) {
+		if (what == VAR_CACHE_DATA) {
+			*data = malloc(entry->size ? entry->size : 1);
+			if (!*data) {
+				pthread_mutex_unlock(&var_cache_lock);
+				efi_error("could not allocate memory");
+				return -1;
+			}
+			memcpy(*data, entry->data, entry->size);
+		}
+		if (size)
+			*size = entry->size;
+		if (attributes)
+			*attributes = entry->attributes;
+		var_cache_stats.hits += 1;
+		pthread_mutex_unlock(&var_cache_lock);
+		return 0;
+	}
+	var_cache_stats.misses += 1;
+	generation = var_cache_generation;
+	pthread_mutex_unlock(&var_cache_lock);
+
+	rc = var_cache_fetch(guid, name, what, data, size, attributes);
+	if (rc < 0 && errno != ENOENT)
+		return rc;
+
+	__typeof__(errno) errno_value = errno;
+	pthread_mutex_lock(&var_cache_lock);
+	if (var_cache_on && generation == var_cache_generation &&
+	    (entry = var_cache_get_entry(&guid, name)) != NULL) {
+		if (rc < 0) {
+			entry->error = ENOENT;
+		} else if (what == VAR_CACHE_DATA) {
+			uint8_t *copy = malloc(*size ? *size : 1);
+			if (copy) {
+				memcpy(copy, *data, *size);
+				free(entry->data);
+				entry->data = copy;
+				entry->size = *size;
+				entry->attributes = *attributes;
+				entry->valid = VAR_CACHE_DATA |
+					       VAR_CACHE_SIZE |
+					       VAR_CACHE_ATTRS;
+			}
+		} else {
+			if (what & VAR_CACHE_SIZE)
+				entry->size = *size;
+			if (what & VAR_CACHE_ATTRS)
+				entry->attributes = *attributes;
+			entry->valid |= what;
+		}
+	}
+	pthread_mutex_unlock(&var_cache_lock);
+	errno = errno_value;
+	return rc;
+
+uncached:
+	return var_cache_fetch(guid, name, what, data, size, attributes);
+}
+
+int PUBLIC
+efi_variable_cache_enable(void)
+{
+	const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB |
+			      IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+			      IN_DELETE_SELF | IN_MOVE_SELF;
+	const char *path;
+	int ret = -1;
+
+	pthread_mutex_lock(&var_cache_lock);
+	if (var_cache_on) {
+		ret = 0;
+		goto out;
+	}
+
+	/* without a directory to watch, we'd never know to invalidate */
+	if (!ops->get_path || !(path = ops->get_path())) {
+		errno = ENOTSUP;
+		efi_error("variable cache is not supported with %s", ops->name);
+		goto out;
+	}
+
+	var_cache_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (var_cache_fd < 0) {
+		efi_error("inotify_init1() failed");
+		goto out;
+	}
+
+	if (inotify_add_watch(var_cache_fd, path, mask) < 0) {
+		__typeof__(errno) errno_value = errno;
+		efi_error("inotify_add_watch(%s) failed", path);
+		close(var_cache_fd);
+		var_cache_fd = -1;
+		errno = errno_value;
+		goto out;
+	}
+
+	if (!var_cache_buckets[0].next)
+		for (unsigned int i = 0; i < VAR_CACHE_BUCKETS; i++)
+			INIT_LIST_HEAD(&var_cache_buckets[i]);
+
+	var_cache_on = true;
+	efi_error_clear();
+	ret = 0;
+out:
+	pthread_mutex_unlock(&var_cache_lock);
+	return ret;
+}
+
+void PUBLIC
+efi_variable_cache_disable(void)
+{
+	pthread_mutex_lock(&var_cache_lock);
+	if (var_cache_on)
+		var_cache_stop();
+	pthread_mutex_unlock(&var_cache_lock);
+}
+
+void NONNULL(1) PUBLIC
+efi_get_variable_cache_stats(efi_variable_cache_stats_t *stats)
+{
+	pthread_mutex_lock(&var_cache_lock);
+	memcpy(stats, &var_cache_stats, sizeof(*stats));
+	pthread_mutex_unlock(&var_cache_lock);
+}
+
 VERSION(_efi_set_variable, _efi_set_variable@libefivar.so.0)
 int NONNULL(2, 3) PUBLIC
 _efi_set_variable(efi_guid_t guid, const char *name, const uint8_t *data,
@@ -40,6 +401,7 @@ _efi_set_variable(efi_guid_t guid, const char *name, const uint8_t *data,
 		return -1;
 	}
 	rc = ops->set_variable(guid, name, data, data_size, attributes, 0600);
+	var_cache_invalidate(guid, name);
 	if (rc < 0)
 		efi_error("ops->set_variable() failed");
 	return rc;
@@ -57,6 +419,7 @@ _efi_set_variable_variadic(efi_guid_t guid, const char *name, const uint8_t *dat
 		return -1;
 	}
 	rc = ops->set_variable(guid, name, data, data_size, attributes, 0600);
+	var_cache_invalidate(guid, name);
 	if (rc < 0)
 		efi_error("ops->set_variable() failed");
 	return rc;
@@ -74,6 +437,7 @@ _efi_set_variable_mode(efi_guid_t guid, const char *name, const uint8_t *data,
 		return -1;
 	}
 	rc = ops->set_variable(guid, name, data, data_size, attributes, mode);
+	var_cache_invalidate(guid, name);
 	if (rc < 0)
 		efi_error("ops->set_variable() failed");
 	else
@@ -90,6 +454,7 @@ int NONNULL(2, 3) PUBLIC
 efi_append_variable(efi_guid_t guid, const char *name, const uint8_t *data,
 			size_t data_size, uint32_t attributes)
 {
+	int lockfd;
 	int rc;
 	if (!ops->append_variable) {
 		rc = generic_append_variable(guid, name, data, data_size,
@@ -100,7 +465,13 @@ efi_append_variable(efi_guid_t guid, const char *name, const uint8_t *data,
 			efi_error_clear();
 		return rc;
 	}
+	/* so that an append can't land between the check and the write
+	 * of an efi_update_variable_if(); without a lock directory we just
+	 * append unserialized, as we always have. */
+	lockfd = efi_variable_lock(guid, name);
 	rc = ops->append_variable(guid, name, data, data_size, attributes);
+	var_cache_invalidate(guid, name);
+	efi_variable_unlock(guid, name, lockfd);
 	if (rc < 0)
 		efi_error("ops->append_variable() failed");
 	else
@@ -108,6 +479,271 @@ efi_append_variable(efi_guid_t guid, const char *name, const uint8_t *data,
 	return rc;
 }
 
+/*
+ * Advisory per-variable locks, so that read-modify-write cycles made by
+ * cooperating processes (and threads) don't interleave.  They live
+ * outside the variable store, since creating a file there creates a
+ * variable; EFIVAR_LOCK_PATH overrides the location.
+ *
+ * Anybody can make directories in /run/lock, so root's locks go directly
+ * under /run instead; otherwise any user could create /run/lock/efivar
+ * first, and since root won't use a directory it doesn't own, every
+ * efi_update_variable_if() would fail until the next reboot.
+ */
+static const char *
+get_variable_lock_path(void)
+{
+	static const char *lock_path;
+
+	if (!lock_path) {
+		lock_path = secure_getenv("EFIVAR_LOCK_PATH");
+		if (!lock_path)
+			lock_path = geteuid() == 0 ? "/run/efivar/"
+						   : "/run/lock/efivar/";
+	}
+	return lock_path;
+}
+
+/*
+ * Create the lock directory and any missing parents, and make sure the
+ * directory itself belongs to us and nobody else can write to it, since
+ * anybody who can would be able to hold or replace our lock files.
+ */
+static int
+open_variable_lock_dir(void)
+{
+	const char *dir = get_variable_lock_path();
+	char *path = strdupa(dir);
+	size_t len = strlen(path);
+	struct stat sb;
+	int dfd;
+	int rc;
+
+	while (len > 1 && path[len - 1] == '/')
+		path[--len] = '\0';
+	for (char *p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		rc = mkdir(path, 0755);
+		if (rc < 0 && errno != EEXIST) {
+			efi_error("could not create \"%s\"", path);
+			return -1;
+		}
+		*p = '/';
+	}
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		efi_error("could not create lock directory \"%s\"", dir);
+		return -1;
+	}
+
+	dfd = open(dir, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+	if (dfd < 0) {
+		efi_error("could not open lock directory \"%s\"", dir);
+		return -1;
+	}
+	if (fstat(dfd, &sb) < 0) {
+		int saved_errno = errno;
+		close(dfd);
+		errno = saved_errno;
+		efi_error("could not stat lock directory \"%s\"", dir);
+		return -1;
+	}
+	if (sb.st_uid != geteuid() || (sb.st_mode & (S_IWGRP|S_IWOTH))) {
+		close(dfd);
+		errno = EPERM;
+		efi_error("lock directory \"%s\" is not private to uid %u",
+			  dir, geteuid());
+		return -1;
+	}
+	return dfd;
+}
+
+static char *
+variable_lock_name(efi_guid_t guid, const char *name)
+{
+	char *lockname = NULL;
+
+	if (asprintf(&lockname, "%s-" GUID_FORMAT ".lock", name,
+		     GUID_FORMAT_ARGS(&guid)) < 0) {
+		efi_error("asprintf failed");
+		return NULL;
+	}
+	return lockname;
+}
+
+/*
+ * The lock file is removed again by efi_variable_unlock(), while it's
+ * still held.  Anybody who was waiting on it has then locked a file that
+ * is no longer in the directory, so after taking the lock we check that
+ * the file we hold is the one the name refers to, and start over if not.
+ */
+int HIDDEN
+efi_variable_lock(efi_guid_t guid, const char *name)
+{
+	char *lockname;
+	int dfd;
+	int fd = -1;
+	int rc;
+
+	if (strchr(name, '/')) {
+		errno = EINVAL;
+		efi_error("invalid variable name \"%s\"", name);
+		return -1;
+	}
+
+	dfd = open_variable_lock_dir();
+	if (dfd < 0)
+		return -1;
+
+	lockname = variable_lock_name(guid, name);
+	if (!lockname) {
+		close(dfd);
+		return -1;
+	}
+
+	while (1) {
+		struct stat held, named;
+
+		fd = openat(dfd, lockname,
+			    O_RDWR|O_CREAT|O_NOFOLLOW|O_CLOEXEC, 0600);
+		if (fd < 0) {
+			efi_error("could not open lock file \"%s\"",
+				  lockname);
+			break;
+		}
+
+		do {
+			rc = flock(fd, LOCK_EX);
+		} while (rc < 0 && errno == EINTR);
+		if (rc < 0) {
+			int saved_errno = errno;
+			close(fd);
+			fd = -1;
+			errno = saved_errno;
+			efi_error("flock() failed");
+			break;
+		}
+
+		if (fstat(fd, &held) == 0 &&
+		    fstatat(dfd, lockname, &named, AT_SYMLINK_NOFOLLOW) == 0 &&
+		    held.st_dev == named.st_dev && held.st_ino == named.st_ino)
+			break;
+		close(fd);
+		fd = -1;
+	}
+
+	free(lockname);
+	close(dfd);
+	return fd;
+}
+
+void HIDDEN
+efi_variable_unlock(efi_guid_t guid, const char *name, int fd)
+{
+	int saved_errno = errno;
+
+	if (fd >= 0) {
+		const char *dir = get_variable_lock_path();
+		char *lockname = variable_lock_name(guid, name);
+
+		if (lockname) {
+			char *path = NULL;
+
+			if (asprintf(&path, "%s/%s", dir, lockname) >= 0) {
+				unlink(path);
+				free(path);
+			}
+			free(lockname);
+		}
+		close(fd);
+	}
+	errno = saved_errno;
+}
+
+static int
+generic_update_variable_if(efi_guid_t guid, const char *name,
+			   const uint8_t *expected_data, size_t expected_size,
+			   const uint8_t *data, size_t data_size,
+			   uint32_t attributes, mode_t mode)
+{
+	uint8_t *cur_data = NULL;
+	size_t cur_size = 0;
+	uint32_t cur_attributes = 0;
+	bool matches;
+	int rc;
+
+	if (!ops->get_variable || !ops->set_variable) {
+		efi_error("get_variable() or set_variable() is not implemented");
+		errno = ENOSYS;
+		return -1;
+	}
+
+	rc = ops->get_variable(guid, name, &cur_data, &cur_size,
+			       &cur_attributes);
+	if (rc < 0 && errno != ENOENT) {
+		efi_error("ops->get_variable() failed");
+		return -1;
+	}
+
+	if (rc < 0)
+		matches = expected_data == NULL;
+	else
+		matches = expected_data != NULL &&
+			  cur_size == expected_size &&
+			  !memcmp(cur_data, expected_data, cur_size);
+	free(cur_data);
+
+	if (!matches) {
+		errno = ESTALE;
+		efi_error("variable does not have the expected contents");
+		return -1;
+	}
+
+	rc = ops->set_variable(guid, name, data, data_size, attributes, mode);
+	if (rc < 0)
+		efi_error("ops->set_variable() failed");
+	return rc;
+}
+
+int NONNULL(2, 5) PUBLIC
+efi_update_variable_if(efi_guid_t guid, const char *name,
+		       const uint8_t *expected_data, size_t expected_size,
+		       const uint8_t *data, size_t data_size,
+		       uint32_t attributes, mode_t mode)
+{
+	int lockfd;
+	int rc;
+
+	lockfd = efi_variable_lock(guid, name);
+	if (lockfd < 0) {
+		efi_error("efi_variable_lock() failed");
+		return -1;
+	}
+
+	if (ops->update_variable_if) {
+		rc = ops->update_variable_if(guid, name,
+					     expected_data, expected_size,
+					     data, data_size, attributes,
+					     mode);
+		if (rc < 0)
+			efi_error("ops->update_variable_if() failed");
+	} else {
+		rc = generic_update_variable_if(guid, name,
+						expected_data, expected_size,
+						data, data_size, attributes,
+						mode);
+		if (rc < 0)
+			efi_error("generic_update_variable_if() failed");
+	}
+	var_cache_invalidate(guid, name);
+	efi_variable_unlock(guid, name, lockfd);
+
+	if (rc >= 0)
+		efi_error_clear();
+	return rc;
+}
+
 int NONNULL(2) PUBLIC
 efi_del_variable(efi_guid_t guid, const char *name)
 {
@@ -118,6 +754,7 @@ efi_del_variable(efi_guid_t guid, const char *name)
 		return -1;
 	}
 	rc = ops->del_variable(guid, name);
+	var_cache_invalidate(guid, name);
 	if (rc < 0)
 		efi_error("ops->del_variable() failed");
 	else
@@ -135,7 +772,8 @@ efi_get_variable(efi_guid_t guid, const char *name, uint8_t **data,
 		errno = ENOSYS;
 		return -1;
 	}
-	rc = ops->get_variable(guid, name, data, data_size, attributes);
+	rc = var_cache_lookup(guid, name, VAR_CACHE_DATA, data, data_size,
+			      attributes);
 	if (rc < 0)
 		efi_error("ops->get_variable failed");
 	else
@@ -153,7 +791,8 @@ efi_get_variable_attributes(efi_guid_t guid, const char *name,
 		errno = ENOSYS;
 		return -1;
 	}
-	rc = ops->get_variable_attributes(guid, name, attributes);
+	rc = var_cache_lookup(guid, name, VAR_CACHE_ATTRS, NULL, NULL,
+			      attributes);
 	if (rc < 0)
 		efi_error("ops->get_variable_attributes() failed");
 	else
@@ -177,7 +816,7 @@ efi_get_variable_size(efi_guid_t guid, const char *name, size_t *size)
 		errno = ENOSYS;
 		return -1;
 	}
-	rc = ops->get_variable_size(guid, name, size);
+	rc = var_cache_lookup(guid, name, VAR_CACHE_SIZE, NULL, size, NULL);
 	if (rc < 0)
 		efi_error("ops->get_variable_size() failed");
 	else
@@ -185,6 +824,27 @@ efi_get_variable_size(efi_guid_t guid, const char *name, size_t *size)
 	return rc;
 }
 
+int NONNULL(2, 3, 4) PUBLIC
+efi_stat_variable(efi_guid_t guid, const char *name, size_t *size,
+		  uint32_t *attributes)
+{
+	int rc;
+	if (!ops->stat_variable) {
+		rc = efi_get_variable_size(guid, name, size);
+		if (rc >= 0)
+			rc = efi_get_variable_attributes(guid, name,
+							 attributes);
+		return rc;
+	}
+	rc = var_cache_lookup(guid, name, VAR_CACHE_SIZE | VAR_CACHE_ATTRS,
+			      NULL, size, attributes);
+	if (rc < 0)
+		efi_error("ops->stat_variable() failed");
+	else
+		efi_error_clear();
+	return rc;
+}
+
 int NONNULL(1, 2) PUBLIC
 efi_get_next_variable_name(efi_guid_t **guid, char **name)
 {
@@ -202,6 +862,291 @@ efi_get_next_variable_name(efi_guid_t **guid, char **name)
 	return rc;
 }
 
+/*
+ * The kernel rate limits efivarfs reads by unprivileged users to 100 per
+ * second (per user), and makes readers sleep once that's exceeded.  We
+ * track the same budget across every thread in the process with a token
+ * bucket, kept as a single "theoretical arrival time" (GCRA), so reads go
+ * straight through while there's budget left and only wait once it's
+ * spent.
+ */
+#define RATELIMIT_BURST		100
+#define RATELIMIT_INTERVAL_NS	(1000000000ull / RATELIMIT_BURST)
+#define RATELIMIT_TOLERANCE_NS	((RATELIMIT_BURST - 1) * RATELIMIT_INTERVAL_NS)
+
+static uint64_t ratelimit_tat;
+static uint64_t ratelimit_reads;
+static uint64_t ratelimit_throttled_reads;
+static uint64_t ratelimit_throttled_ns;
+
+static uint64_t
+ratelimit_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void HIDDEN
+efi_ratelimit_acquire(unsigned int reads)
+{
+	uint64_t now, tat, start, new_tat, allowed;
+	struct timespec ts;
+
+	if (reads == 0 || geteuid() == 0)
+		return;
+
+	now = ratelimit_now();
+	tat = __atomic_load_n(&ratelimit_tat, __ATOMIC_RELAXED);
+	do {
+		start = tat > now ? tat : now;
+		new_tat = start + reads * RATELIMIT_INTERVAL_NS;
+	} while (!__atomic_compare_exchange_n(&ratelimit_tat, &tat, new_tat,
+					      true, __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+
+	__atomic_add_fetch(&ratelimit_reads, reads, __ATOMIC_RELAXED);
+
+	/*
+	 * Our slot is [start, new_tat); the last read in it conforms once
+	 * it's within the burst tolerance of now.
+	 */
+	allowed = new_tat - RATELIMIT_INTERVAL_NS;
+	if (allowed <= now + RATELIMIT_TOLERANCE_NS)
+		return;
+
+	allowed -= RATELIMIT_TOLERANCE_NS;
+	ts.tv_sec = allowed / 1000000000ull;
+	ts.tv_nsec = allowed % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+
+	__atomic_add_fetch(&ratelimit_throttled_reads, reads,
+			   __ATOMIC_RELAXED);
+	__atomic_add_fetch(&ratelimit_throttled_ns, ratelimit_now() - now,
+			   __ATOMIC_RELAXED);
+}
+
+void NONNULL(1) PUBLIC
+efi_get_ratelimit_stats(efi_ratelimit_stats_t *stats)
+{
+	stats->reads = __atomic_load_n(&ratelimit_reads, __ATOMIC_RELAXED);
+	stats->throttled_reads = __atomic_load_n(&ratelimit_throttled_reads,
+						 __ATOMIC_RELAXED);
+	stats->throttled_ns = __atomic_load_n(&ratelimit_throttled_ns,
+					      __ATOMIC_RELAXED);
+}
+
+uint8_t HIDDEN *
+var_snapshot_reserve(struct var_snapshot *vs, size_t hdrsz, size_t size)
+{
+	size_t need;
+
+	/*
+	 * Start each record so that the data following the backend's
+	 * header is 8-byte aligned, the same as it would be if it came back
+	 * from malloc() in efi_get_variable().
+	 */
+	if (!vs->in_record) {
+		vs->record = ALIGN(vs->arena_used + hdrsz, 8) - hdrsz;
+		vs->in_record = true;
+	}
+
+	if (checked_add(vs->record, size, &need)) {
+		errno = EOVERFLOW;
+		efi_error("snapshot record size overflows");
+		return NULL;
+	}
+
+	if (need > vs->arena_size) {
+		size_t newsize = vs->arena_size ? vs->arena_size : 65536;
+		uint8_t *newarena;
+
+		while (newsize < need) {
+			if (checked_mul(newsize, 2, &newsize)) {
+				errno = EOVERFLOW;
+				efi_error("snapshot arena size overflows");
+				return NULL;
+			}
+		}
+		newarena = realloc(vs->arena, newsize);
+		if (!newarena) {
+			efi_error("could not allocate %zd bytes", newsize);
+			return NULL;
+		}
+		vs->arena = newarena;
+		vs->arena_size = newsize;
+	}
+
+	return vs->arena + vs->record;
+}
+
+void HIDDEN
+var_snapshot_discard(struct var_snapshot *vs)
+{
+	vs->in_record = false;
+}
+
+int HIDDEN
+var_snapshot_commit(struct var_snapshot *vs, const efi_guid_t *guid,
+		    const char *name, size_t namelen, uint32_t attributes,
+		    size_t hdrsz, size_t data_size)
+{
+	struct var_snapshot_slot *slot;
+	size_t data_offset = vs->record + hdrsz;
+	uint8_t *namebuf;
+
+	if (!vs->in_record) {
+		errno = EINVAL;
+		efi_error("no snapshot record in progress");
+		return -1;
+	}
+
+	if (vs->nslots == vs->slots_size) {
+		size_t newsize = vs->slots_size ? vs->slots_size * 2 : 64;
+		struct var_snapshot_slot *newslots;
+
+		newslots = reallocarray(vs->slots, newsize, sizeof(*newslots));
+		if (!newslots) {
+			efi_error("could not allocate %zd snapshot slots",
+				  newsize);
+			return -1;
+		}
+		vs->slots = newslots;
+		vs->slots_size = newsize;
+	}
+
+	/* the name goes right behind the data, inside the same record */
+	namebuf = var_snapshot_reserve(vs, hdrsz,
+				       hdrsz + data_size + namelen + 1);
+	if (!namebuf)
+		return -1;
+	namebuf += hdrsz + data_size;
+	memcpy(namebuf, name, namelen);
+	namebuf[namelen] = '\0';
+
+	slot = &vs->slots[vs->nslots++];
+	memcpy(&slot->guid, guid, sizeof(slot->guid));
+	slot->data_offset = data_offset;
+	slot->data_size = data_size;
+	slot->name_offset = data_offset + data_size;
+	slot->attributes = attributes;
+
+	vs->arena_used = slot->name_offset + namelen + 1;
+	vs->in_record = false;
+	return 0;
+}
+
+int HIDDEN
+var_snapshot_finish(struct var_snapshot *vs,
+		    efi_variable_snapshot_entry_t **entries, size_t *n_entries)
+{
+	efi_variable_snapshot_entry_t *table;
+	size_t tablesz;
+	size_t allocsz;
+	uint8_t *arena;
+
+	if (checked_mul(vs->nslots, sizeof(*table), &tablesz) ||
+	    checked_add(ALIGN(tablesz, 8), vs->arena_used, &allocsz)) {
+		errno = EOVERFLOW;
+		efi_error("snapshot size overflows");
+		return -1;
+	}
+
+	table = malloc(allocsz ? allocsz : 1);
+	if (!table) {
+		efi_error("could not allocate %zd bytes", allocsz);
+		return -1;
+	}
+	arena = (uint8_t *)table + ALIGN(tablesz, 8);
+	if (vs->arena_used)
+		memcpy(arena, vs->arena, vs->arena_used);
+
+	for (size_t i = 0; i < vs->nslots; i++) {
+		struct var_snapshot_slot *slot = &vs->slots[i];
+
+		memcpy(&table[i].guid, &slot->guid, sizeof(table[i].guid));
+		table[i].name = (char *)arena + slot->name_offset;
+		table[i].attributes = slot->attributes;
+		table[i].data = arena + slot->data_offset;
+		table[i].data_size = slot->data_size;
+	}
+
+	*entries = table;
+	*n_entries = vs->nslots;
+	var_snapshot_free(vs);
+	return 0;
+}
+
+void HIDDEN
+var_snapshot_free(struct var_snapshot *vs)
+{
+	xfree(vs->slots);
+	xfree(vs->arena);
+	memset(vs, 0, sizeof(*vs));
+}
+
+int NONNULL(1, 2) PUBLIC
+efi_get_variable_snapshot(efi_variable_snapshot_entry_t **entries,
+			  size_t *n_entries)
+{
+	int rc;
+	if (!ops->get_variable_snapshot) {
+		efi_error("get_variable_snapshot() is not implemented");
+		errno = ENOSYS;
+		return -1;
+	}
+	rc = ops->get_variable_snapshot(entries, n_entries);
+	if (rc < 0)
+		efi_error("ops->get_variable_snapshot() failed");
+	else
+		efi_error_clear();
+	return rc;
+}
+
+void PUBLIC
+efi_free_variable_snapshot(efi_variable_snapshot_entry_t *entries)
+{
+	free(entries);
+}
+
+int NONNULL(1) PUBLIC
+efi_variable_iter_new(efi_variable_iter_t **iter)
+{
+	int rc;
+	if (!ops->variable_iter_new) {
+		efi_error("variable_iter_new() is not implemented");
+		errno = ENOSYS;
+		return -1;
+	}
+	rc = ops->variable_iter_new(iter);
+	if (rc < 0)
+		efi_error("ops->variable_iter_new() failed");
+	else
+		efi_error_clear();
+	return rc;
+}
+
+int NONNULL(1, 2, 3) PUBLIC
+efi_variable_iter_next(efi_variable_iter_t *iter, efi_guid_t **guid,
+		       char **name)
+{
+	int rc;
+	rc = generic_variable_iter_next(iter, guid, name);
+	if (rc < 0)
+		efi_error("generic_variable_iter_next() failed");
+	else
+		efi_error_clear();
+	return rc;
+}
+
+void PUBLIC
+efi_variable_iter_free(efi_variable_iter_t *iter)
+{
+	generic_variable_iter_free(iter);
+}
+
 int NONNULL(2) PUBLIC
 efi_chmod_variable(efi_guid_t guid, const char *name, mode_t mode)
 {
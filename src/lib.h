@@ -9,6 +9,7 @@
 #include <limits.h>
 #include <sys/types.h>
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #include <efivar/efivar-types.h>
@@ -21,6 +22,12 @@ struct efi_variable {
 	size_t data_size;
 };
 
+struct efi_variable_iter {
+	DIR *dir;
+	efi_guid_t guid;
+	char name[NAME_MAX + 1];
+};
+
 struct efi_var_operations {
 	char name[NAME_MAX];
 	int (*probe)(void);
@@ -33,15 +40,72 @@ struct efi_var_operations {
 				       uint32_t *attributes);
 	int (*get_variable_size)(efi_guid_t guid, const char *name,
 				 size_t *size);
+	int (*stat_variable)(efi_guid_t guid, const char *name, size_t *size,
+			     uint32_t *attributes);
 	int (*get_next_variable_name)(efi_guid_t **guid, char **name);
+	int (*variable_iter_new)(efi_variable_iter_t **iter);
+	int (*get_variable_snapshot)(efi_variable_snapshot_entry_t **entries,
+				     size_t *n_entries);
 	int (*append_variable)(efi_guid_t guid, const char *name,
 			       const uint8_t *data, size_t data_size,
 			       uint32_t attributes);
+	int (*update_variable_if)(efi_guid_t guid, const char *name,
+				  const uint8_t *expected_data,
+				  size_t expected_size, const uint8_t *data,
+				  size_t data_size, uint32_t attributes,
+				  mode_t mode);
 	int (*chmod_variable)(efi_guid_t guid, const char *name, mode_t mode);
+	const char *(*get_path)(void);
 };
 
 typedef unsigned long efi_status_t;
 
+extern void HIDDEN efi_ratelimit_acquire(unsigned int reads);
+
+extern int HIDDEN efi_variable_lock(efi_guid_t guid, const char *name);
+extern void HIDDEN efi_variable_unlock(efi_guid_t guid, const char *name,
+				       int fd);
+
+/*
+ * Builder for efi_get_variable_snapshot() tables.  Backends reserve space
+ * for one record at a time at the tail of a shared arena, read the
+ * variable directly into it, and commit it; var_snapshot_finish() then
+ * packs the entry table and the arena into one allocation.
+ */
+struct var_snapshot_slot {
+	efi_guid_t guid;
+	size_t name_offset;
+	size_t data_offset;
+	size_t data_size;
+	uint32_t attributes;
+};
+
+struct var_snapshot {
+	struct var_snapshot_slot *slots;
+	size_t nslots;
+	size_t slots_size;
+
+	uint8_t *arena;
+	size_t arena_used;
+	size_t arena_size;
+
+	bool in_record;
+	size_t record;
+};
+
+extern uint8_t HIDDEN *var_snapshot_reserve(struct var_snapshot *vs,
+					    size_t hdrsz, size_t size);
+extern void HIDDEN var_snapshot_discard(struct var_snapshot *vs);
+extern int HIDDEN var_snapshot_commit(struct var_snapshot *vs,
+				      const efi_guid_t *guid,
+				      const char *name, size_t namelen,
+				      uint32_t attributes, size_t hdrsz,
+				      size_t data_size);
+extern int HIDDEN var_snapshot_finish(struct var_snapshot *vs,
+				      efi_variable_snapshot_entry_t **entries,
+				      size_t *n_entries);
+extern void HIDDEN var_snapshot_free(struct var_snapshot *vs);
+
 extern struct efi_var_operations vars_ops;
 extern struct efi_var_operations efivarfs_ops;
 
@@ -16,6 +16,7 @@
 #include <linux/version.h>
 #include <linux/sockios.h>
 #include <net/if.h>
+#include <pthread.h>
 #include <scsi/scsi.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -33,6 +34,448 @@
 
 #include "efiboot.h"
 
+/*
+ * Scratch space for read_sysfs_file(), which copies what it needs out of
+ * it straight away; keeping it around means building a device path
+ * doesn't malloc and free a buffer for every sysfs attribute it reads.
+ * Each thread's buffer is registered with a pthread key the first time
+ * it's used, so it's freed when that thread exits; the destructor below
+ * handles the thread that exits the process, for which key destructors
+ * never run.
+ */
+static __thread uint8_t *sysfs_buf;
+static __thread size_t sysfs_bufalloc;
+static __thread bool sysfs_buf_tracked;
+
+static pthread_once_t sysfs_buf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sysfs_buf_key;
+static bool sysfs_buf_key_valid;
+
+static void
+free_thread_sysfs_buf(void *arg UNUSED)
+{
+	xfree(sysfs_buf);
+	sysfs_bufalloc = 0;
+	sysfs_buf_tracked = false;
+}
+
+static void
+make_sysfs_buf_key(void)
+{
+	if (pthread_key_create(&sysfs_buf_key, free_thread_sysfs_buf) == 0)
+		sysfs_buf_key_valid = true;
+}
+
+static void
+track_sysfs_buf(void)
+{
+	if (sysfs_buf_tracked)
+		return;
+
+	pthread_once(&sysfs_buf_once, make_sysfs_buf_key);
+	if (sysfs_buf_key_valid)
+		pthread_setspecific(sysfs_buf_key, &sysfs_buf);
+	sysfs_buf_tracked = true;
+}
+
+static void DESTRUCTOR
+free_sysfs_buf(void)
+{
+	free_thread_sysfs_buf(NULL);
+	if (sysfs_buf_key_valid) {
+		pthread_key_delete(sysfs_buf_key);
+		sysfs_buf_key_valid = false;
+	}
+}
+
+/*
+ * Opt-in cache of sysfs lookups for processes that generate many device
+ * paths.  Attribute contents, link targets, and stat() results are
+ * memoized per path, as are the errors that mean a path isn't there.
+ * Nothing tells us when sysfs changes, so the cache is only dropped by
+ * efi_sysfs_cache_flush() and efi_sysfs_cache_disable().  As with the
+ * variable cache, I/O is done without the lock held, and a generation
+ * count keeps a lookup that raced with a flush from inserting stale data.
+ */
+#define SYSFS_CACHE_BUCKETS	256
+#define SYSFS_CACHE_MAX_ENTRIES	4096
+
+#define SYSFS_CACHE_FILE	0x1
+#define SYSFS_CACHE_LINK	0x2
+#define SYSFS_CACHE_STAT	0x4
+
+struct sysfs_cache_entry {
+	list_t list;
+	unsigned int valid;
+	int file_error;
+	int link_error;
+	int stat_error;
+	uint8_t *data;
+	ssize_t size;
+	char *link;
+	struct stat stat;
+	char path[];
+};
+
+static pthread_mutex_t sysfs_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool sysfs_cache_on;
+static uint64_t sysfs_cache_generation;
+static list_t sysfs_cache_buckets[SYSFS_CACHE_BUCKETS];
+static size_t sysfs_cache_nentries;
+static efi_sysfs_cache_stats_t sysfs_cache_stats;
+
+static unsigned int
+sysfs_cache_hash(const char *path)
+{
+	return fnv1a_64(FNV1A_64_INIT, path, strlen(path)) %
+	       SYSFS_CACHE_BUCKETS;
+}
+
+static struct sysfs_cache_entry *
+sysfs_cache_find(const char *path)
+{
+	list_t *bucket = &sysfs_cache_buckets[sysfs_cache_hash(path)];
+	list_t *pos;
+
+	list_for_each(pos, bucket) {
+		struct sysfs_cache_entry *entry;
+
+		entry = list_entry(pos, struct sysfs_cache_entry, list);
+		if (!strcmp(entry->path, path))
+			return entry;
+	}
+	return NULL;
+}
+
+static void
+sysfs_cache_flush_locked(void)
+{
+	for (unsigned int i = 0; i < SYSFS_CACHE_BUCKETS; i++) {
+		list_t *pos, *tmp;
+
+		list_for_each_safe(pos, tmp, &sysfs_cache_buckets[i]) {
+			struct sysfs_cache_entry *entry;
+
+			entry = list_entry(pos, struct sysfs_cache_entry, list);
+			list_del(&entry->list);
+			free(entry->data);
+			free(entry->link);
+			free(entry);
+			sysfs_cache_stats.invalidations += 1;
+		}
+	}
+	sysfs_cache_nentries = 0;
+	sysfs_cache_generation += 1;
+}
+
+static struct sysfs_cache_entry *
+sysfs_cache_get_entry(const char *path)
+{
+	struct sysfs_cache_entry *entry;
+	size_t pathlen;
+
+	entry = sysfs_cache_find(path);
+	if (entry)
+		return entry;
+
+	/* sysfs paths don't change much; starting over is good enough */
+	if (sysfs_cache_nentries >= SYSFS_CACHE_MAX_ENTRIES)
+		sysfs_cache_flush_locked();
+
+	pathlen = strlen(path);
+	entry = calloc(1, sizeof(*entry) + pathlen + 1);
+	if (!entry)
+		return NULL;
+	memcpy(entry->path, path, pathlen + 1);
+	list_add(&entry->list, &sysfs_cache_buckets[sysfs_cache_hash(path)]);
+	sysfs_cache_nentries += 1;
+	return entry;
+}
+
+/*
+ * If what is cached for path, return its entry with the lock held.
+ * Otherwise return NULL, with the lock released, and the generation to
+ * pass to sysfs_cache_store() once the caller has looked it up.
+ */
+static struct sysfs_cache_entry *
+sysfs_cache_lookup(const char *path, unsigned int what, uint64_t *generation)
+{
+	struct sysfs_cache_entry *entry;
+
+	*generation = UINT64_MAX;
+	if (!__atomic_load_n(&sysfs_cache_on, __ATOMIC_RELAXED))
+		return NULL;
+
+	pthread_mutex_lock(&sysfs_cache_lock);
+	if (sysfs_cache_on) {
+		entry = sysfs_cache_find(path);
+		if (entry && (entry->valid & what)) {
+			sysfs_cache_stats.hits += 1;
+			sysfs_cache_stats.syscalls_saved +=
+				what == SYSFS_CACHE_FILE ? 4 : 1;
+			return entry;
+		}
+		sysfs_cache_stats.misses += 1;
+	}
+	*generation = sysfs_cache_generation;
+	pthread_mutex_unlock(&sysfs_cache_lock);
+	return NULL;
+}
+
+/*
+ * The errors that mean a path isn't there, which will still hold next
+ * time; for readlink(), EINVAL means it isn't a link.
+ */
+static const int sysfs_missing_errors[] = { ENOENT, ENOTDIR, 0 };
+static const int sysfs_link_missing_errors[] = { ENOENT, ENOTDIR, EINVAL, 0 };
+
+/*
+ * Return the entry to store a lookup's result in, with the lock held, or
+ * NULL, with it released, if the result should not be kept: the cache
+ * has been flushed since, or the lookup failed with an error that isn't
+ * in cacheable.
+ */
+static struct sysfs_cache_entry *
+sysfs_cache_store(const char *path, uint64_t generation, int rc, int error,
+		  const int *cacheable)
+{
+	struct sysfs_cache_entry *entry;
+
+	if (generation == UINT64_MAX)
+		return NULL;
+	if (rc < 0) {
+		while (*cacheable && *cacheable != error)
+			cacheable++;
+		if (!*cacheable)
+			return NULL;
+	}
+
+	pthread_mutex_lock(&sysfs_cache_lock);
+	if (sysfs_cache_on && generation == sysfs_cache_generation) {
+		entry = sysfs_cache_get_entry(path);
+		if (entry)
+			return entry;
+	}
+	pthread_mutex_unlock(&sysfs_cache_lock);
+	return NULL;
+}
+
+ssize_t HIDDEN
+get_sysfs_file(uint8_t **result, const char * const fmt, ...)
+{
+	struct sysfs_cache_entry *entry;
+	uint64_t generation;
+	va_list ap;
+	char *path;
+	ssize_t rc;
+	int error;
+
+	*result = NULL;
+	va_start(ap, fmt);
+	rc = vasprintfa(&path, fmt, ap);
+	va_end(ap);
+	if (rc < 0) {
+		efi_error("could not allocate memory");
+		return -1;
+	}
+
+	track_sysfs_buf();
+	entry = sysfs_cache_lookup(path, SYSFS_CACHE_FILE, &generation);
+	if (entry) {
+		rc = entry->size;
+		error = entry->file_error;
+		if (!error && sysfs_bufalloc < (size_t)rc) {
+			uint8_t *newbuf = realloc(sysfs_buf, rc);
+
+			if (newbuf) {
+				sysfs_buf = newbuf;
+				sysfs_bufalloc = rc;
+			} else {
+				error = errno;
+			}
+		}
+		if (!error && rc > 0)
+			memcpy(sysfs_buf, entry->data, rc);
+		pthread_mutex_unlock(&sysfs_cache_lock);
+		if (error) {
+			errno = error;
+			efi_error("could not read file \"%s\"", path);
+			return -1;
+		}
+		*result = rc > 0 ? sysfs_buf : NULL;
+		return rc;
+	}
+
+	rc = get_file_buf(&sysfs_buf, &sysfs_bufalloc, "%s", path);
+	error = errno;
+
+	entry = sysfs_cache_store(path, generation, rc, error,
+				  sysfs_missing_errors);
+	if (entry) {
+		uint8_t *data = NULL;
+
+		if (rc > 0)
+			data = malloc(rc);
+		if (rc < 0 || data) {
+			if (data)
+				memcpy(data, sysfs_buf, rc);
+			free(entry->data);
+			entry->data = data;
+			entry->size = rc;
+			entry->file_error = rc < 0 ? error : 0;
+			entry->valid |= SYSFS_CACHE_FILE;
+		}
+		pthread_mutex_unlock(&sysfs_cache_lock);
+	}
+
+	errno = error;
+	*result = rc > 0 ? sysfs_buf : NULL;
+	return rc;
+}
+
+ssize_t HIDDEN
+sysfs_cached_readlink(const char *path, char *buf, size_t bufsize)
+{
+	struct sysfs_cache_entry *entry;
+	uint64_t generation;
+	ssize_t rc;
+	int error;
+
+	entry = sysfs_cache_lookup(path, SYSFS_CACHE_LINK, &generation);
+	if (entry) {
+		error = entry->link_error;
+		if (!error) {
+			rc = strnlen(entry->link, bufsize);
+			memcpy(buf, entry->link, rc);
+		}
+		pthread_mutex_unlock(&sysfs_cache_lock);
+		if (error) {
+			errno = error;
+			return -1;
+		}
+		return rc;
+	}
+
+	rc = readlink(path, buf, bufsize);
+	error = errno;
+
+	/* a link that filled the buffer may have been cut short */
+	entry = sysfs_cache_store(path, generation,
+				  (size_t)rc == bufsize ? -1 : rc, error,
+				  sysfs_link_missing_errors);
+	if (entry) {
+		char *link = NULL;
+
+		if (rc >= 0)
+			link = strndup(buf, rc);
+		if (rc < 0 || link) {
+			free(entry->link);
+			entry->link = link;
+			entry->link_error = rc < 0 ? error : 0;
+			entry->valid |= SYSFS_CACHE_LINK;
+		}
+		pthread_mutex_unlock(&sysfs_cache_lock);
+	}
+
+	errno = error;
+	return rc;
+}
+
+int HIDDEN
+sysfs_cached_stat(const char *path, struct stat *statbuf)
+{
+	struct sysfs_cache_entry *entry;
+	uint64_t generation;
+	int rc;
+	int error;
+
+	entry = sysfs_cache_lookup(path, SYSFS_CACHE_STAT, &generation);
+	if (entry) {
+		error = entry->stat_error;
+		if (!error)
+			memcpy(statbuf, &entry->stat, sizeof(*statbuf));
+		pthread_mutex_unlock(&sysfs_cache_lock);
+		if (error) {
+			errno = error;
+			return -1;
+		}
+		return 0;
+	}
+
+	rc = stat(path, statbuf);
+	error = errno;
+
+	entry = sysfs_cache_store(path, generation, rc, error,
+				  sysfs_missing_errors);
+	if (entry) {
+		if (rc == 0)
+			memcpy(&entry->stat, statbuf, sizeof(*statbuf));
+		entry->stat_error = rc < 0 ? error : 0;
+		entry->valid |= SYSFS_CACHE_STAT;
+		pthread_mutex_unlock(&sysfs_cache_lock);
+	}
+
+	errno = error;
+	return rc;
+}
+
+/*
+ * Whether a path exists is what find_device_file() and the probes ask
+ * most; that comes from the cached stat() result.
+ */
+int HIDDEN
+sysfs_cached_access(const char *path, int mode)
+{
+	struct stat statbuf;
+
+	if (mode != F_OK || !__atomic_load_n(&sysfs_cache_on, __ATOMIC_RELAXED))
+		return access(path, mode);
+	return sysfs_cached_stat(path, &statbuf);
+}
+
+int PUBLIC
+efi_sysfs_cache_enable(void)
+{
+	pthread_mutex_lock(&sysfs_cache_lock);
+	if (!sysfs_cache_buckets[0].next)
+		for (unsigned int i = 0; i < SYSFS_CACHE_BUCKETS; i++)
+			INIT_LIST_HEAD(&sysfs_cache_buckets[i]);
+	if (!sysfs_cache_on) {
+		sysfs_cache_generation += 1;
+		__atomic_store_n(&sysfs_cache_on, true, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&sysfs_cache_lock);
+	return 0;
+}
+
+void PUBLIC
+efi_sysfs_cache_disable(void)
+{
+	pthread_mutex_lock(&sysfs_cache_lock);
+	if (sysfs_cache_on) {
+		__atomic_store_n(&sysfs_cache_on, false, __ATOMIC_RELAXED);
+		sysfs_cache_flush_locked();
+	}
+	pthread_mutex_unlock(&sysfs_cache_lock);
+}
+
+void PUBLIC
+efi_sysfs_cache_flush(void)
+{
+	pthread_mutex_lock(&sysfs_cache_lock);
+	if (sysfs_cache_on)
+		sysfs_cache_flush_locked();
+	pthread_mutex_unlock(&sysfs_cache_lock);
+}
+
+void NONNULL(1) PUBLIC
+efi_get_sysfs_cache_stats(efi_sysfs_cache_stats_t *stats)
+{
+	pthread_mutex_lock(&sysfs_cache_lock);
+	memcpy(stats, &sysfs_cache_stats, sizeof(*stats));
+	pthread_mutex_unlock(&sysfs_cache_lock);
+}
+
 int HIDDEN
 find_parent_devpath(char * const child, char **parent)
 {
@@ -331,8 +774,8 @@ print_dev_dp_node(struct device *dev, struct dev_probe *probe)
 {
 	ssize_t dpsz;
 	uint8_t *dp;
-	ssize_t bufsz;
-	uint8_t *buf;
+	efidp_formatter_t *formatter;
+	const char *str;
 	ssize_t sz;
 
 	dpsz = probe->create(dev, NULL, 0, 0);
@@ -351,21 +794,13 @@ print_dev_dp_node(struct device *dev, struct dev_probe *probe)
 	if (sz < 0)
 		return;
 	dpsz += sz;
-	bufsz = efidp_format_device_path(NULL, 0,
-					 (const_efidp)dp, dpsz);
-	if (bufsz <= 0)
-		return;
-
-	buf = alloca(bufsz);
-	if (!buf)
-		return;
 
-	bufsz = efidp_format_device_path(buf, bufsz,
-			(const_efidp)dp, dpsz);
-	if (bufsz <= 0)
+	if (efidp_formatter_new(&formatter) < 0)
 		return;
-
-	debug("Device path node is %s", buf);
+	sz = efidp_formatter_format(formatter, (const_efidp)dp, dpsz, &str);
+	if (sz > 0)
+		debug("Device path node is %s", str);
+	efidp_formatter_free(formatter);
 }
 
 struct device HIDDEN
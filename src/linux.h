@@ -166,26 +166,33 @@ extern int HIDDEN find_parent_devpath(char * const child,
 extern ssize_t HIDDEN make_mac_path(uint8_t *buf, ssize_t size,
 				    const char * const ifname);
 
+extern ssize_t HIDDEN get_sysfs_file(uint8_t **result,
+				      const char * const fmt, ...)
+	__attribute__((__format__(printf, 2, 3)));
+
+/*
+ * readlink(), stat(), and access() for sysfs paths, which go through
+ * the sysfs cache when it's enabled.
+ */
+extern ssize_t HIDDEN sysfs_cached_readlink(const char *path, char *buf,
+					    size_t bufsize);
+extern int HIDDEN sysfs_cached_stat(const char *path, struct stat *statbuf);
+extern int HIDDEN sysfs_cached_access(const char *path, int mode);
+
 #define read_sysfs_file(buf, fmt, args...)				\
 	({								\
 		uint8_t *buf_ = NULL;					\
 		ssize_t bufsize_ = -1;					\
 		int error_;						\
 									\
-		bufsize_ = get_file(&buf_, "/sys/" fmt, ## args);	\
+		bufsize_ = get_sysfs_file(&buf_, "/sys/" fmt, ## args);	\
 		if (bufsize_ > 0) {					\
 			uint8_t *buf2_ = alloca(bufsize_);		\
 			error_ = errno;					\
 			if (buf2_)					\
 				memcpy(buf2_, buf_, bufsize_);		\
-			free(buf_);					\
 			*(buf) = (__typeof__(*(buf)))buf2_;		\
 			errno = error_;					\
-		} else if (buf_) {					\
-			/* covscan is _sure_ we leak buf_ if bufsize_ */\
-			/* is <= 0, which is wrong, but appease it.   */\
-			free(buf_);					\
-			buf_ = NULL;					\
 		}							\
 		bufsize_;						\
 	})
@@ -200,7 +207,8 @@ extern ssize_t HIDDEN make_mac_path(uint8_t *buf, ssize_t size,
 		_rc = asprintfa(&_pn, "/sys/" fmt, ## args);		\
 		if (_rc >= 0) {						\
 			ssize_t _linksz;				\
-			_rc = _linksz = readlink(_pn, _lb, PATH_MAX);   \
+			_rc = _linksz = sysfs_cached_readlink(_pn, _lb,	\
+							      PATH_MAX);\
 			if (_linksz >= 0)				\
 				_lb[_linksz] = '\0';			\
 			else						\
@@ -219,7 +227,7 @@ extern ssize_t HIDDEN make_mac_path(uint8_t *buf, ssize_t size,
 									\
 		rc_ = asprintfa(&pn_, "/sys/" fmt, ## args);		\
 		if (rc_ >= 0) {						\
-			rc_ = access(pn_, mode);			\
+			rc_ = sysfs_cached_access(pn_, mode);		\
 			if (rc_ < 0)					\
 				efi_error("could not access %s", pn_);  \
 		} else {						\
@@ -235,7 +243,7 @@ extern ssize_t HIDDEN make_mac_path(uint8_t *buf, ssize_t size,
 									\
 		rc_ = asprintfa(&pn_, "/sys/" fmt, ## args);		\
 		if (rc_ >= 0) {						\
-			rc_ = stat(pn_, statbuf);			\
+			rc_ = sysfs_cached_stat(pn_, statbuf);		\
 			if (rc_ < 0)					\
 				efi_error("could not stat %s", pn_);    \
 		} else {						\
@@ -116,6 +116,296 @@ write_guidnames(FILE *out, const char *listname,
                         listname, listname, n - 1);
 }
 
+struct phash {
+	uint16_t *seeds;
+	uint32_t nbuckets;
+	uint16_t *slots;
+	uint32_t mask;
+};
+
+typedef uint32_t (*phash_fn)(struct efivar_guidname *gn, uint32_t seed);
+
+static uint32_t
+guid_phash(struct efivar_guidname *gn, uint32_t seed)
+{
+	return efi_guid_phash_(&gn->guid, seed);
+}
+
+static uint32_t
+name_phash(struct efivar_guidname *gn, uint32_t seed)
+{
+	return efi_name_phash_(gn->name, strlen(gn->name), seed);
+}
+
+static int
+cmpbucketsize(const void *p1, const void *p2)
+{
+	const uint32_t *b1 = p1, *b2 = p2;
+
+	if (b1[1] != b2[1])
+		return b1[1] < b2[1] ? 1 : -1;
+	return b1[0] < b2[0] ? -1 : b1[0] > b2[0];
+}
+
+/*
+ * Two equal keys always hash to the same slot, so build_phash() would
+ * never find a seed that separates them; refuse them up front.
+ */
+static void
+check_duplicates(struct efivar_guidname *guidnames, size_t n,
+		 int (*cmp)(const void *, const void *), const char *what)
+{
+	struct efivar_guidname *sorted;
+
+	sorted = calloc(n ? n : 1, sizeof(*sorted));
+	if (!sorted)
+		err(1, "could not allocate memory");
+	memcpy(sorted, guidnames, n * sizeof(*sorted));
+	qsort(sorted, n, sizeof(*sorted), cmp);
+
+	for (size_t i = 1; i < n; i++) {
+		if (!cmp(&sorted[i - 1], &sorted[i]))
+			errx(1, "\"%s\" and \"%s\" have the same %s",
+			     sorted[i - 1].symbol, sorted[i].symbol, what);
+	}
+	free(sorted);
+}
+
+/*
+ * Build a perfect hash over guidnames[0:n] with hash-and-displace: the
+ * keys are split into buckets with seed 0, and then, biggest bucket
+ * first, each bucket gets the first seed that puts all of its keys in
+ * free slots.  If some bucket can't be placed, try again with twice as
+ * many slots.
+ */
+static void
+build_phash(struct efivar_guidname *guidnames, size_t n, phash_fn hash,
+	    int (*cmp)(const void *, const void *), const char *what,
+	    struct phash *ph)
+{
+	uint32_t nslots = 1;
+	uint32_t (*order)[2];
+	uint32_t *buckets;
+	uint32_t *pos;
+
+	if (n >= EFI_GUID_PHASH_EMPTY)
+		errx(1, "too many guids (%zd)", n);
+	check_duplicates(guidnames, n, cmp, what);
+
+	while (nslots < n)
+		nslots <<= 1;
+	ph->nbuckets = n / 4 + 1;
+
+	buckets = calloc(n ? n : 1, sizeof(*buckets));
+	order = calloc(ph->nbuckets, sizeof(*order));
+	pos = calloc(n ? n : 1, sizeof(*pos));
+	ph->seeds = calloc(ph->nbuckets, sizeof(*ph->seeds));
+	if (!buckets || !order || !pos || !ph->seeds)
+		err(1, "could not allocate memory");
+
+	for (uint32_t b = 0; b < ph->nbuckets; b++)
+		order[b][0] = b;
+	for (size_t i = 0; i < n; i++) {
+		buckets[i] = hash(&guidnames[i], 0) % ph->nbuckets;
+		order[buckets[i]][1] += 1;
+	}
+	qsort(order, ph->nbuckets, sizeof(*order), cmpbucketsize);
+
+retry:
+	ph->mask = nslots - 1;
+	free(ph->slots);
+	ph->slots = malloc(nslots * sizeof(*ph->slots));
+	if (!ph->slots)
+		err(1, "could not allocate memory");
+	memset(ph->slots, 0xff, nslots * sizeof(*ph->slots));
+
+	for (uint32_t b = 0; b < ph->nbuckets && order[b][1] > 0; b++) {
+		uint32_t bucket = order[b][0];
+		uint32_t seed;
+
+		for (seed = 1; seed < 0x10000; seed++) {
+			size_t npos = 0;
+			size_t i;
+
+			for (i = 0; i < n; i++) {
+				if (buckets[i] != bucket)
+					continue;
+
+				uint32_t slot = hash(&guidnames[i], seed) & ph->mask;
+				if (ph->slots[slot] != EFI_GUID_PHASH_EMPTY)
+					break;
+
+				size_t j;
+				for (j = 0; j < npos; j++)
+					if ((hash(&guidnames[pos[j]], seed) & ph->mask) == slot)
+						break;
+				if (j < npos)
+					break;
+				pos[npos++] = i;
+			}
+			if (i < n)
+				continue;
+
+			for (size_t j = 0; j < npos; j++)
+				ph->slots[hash(&guidnames[pos[j]], seed) & ph->mask] = pos[j];
+			ph->seeds[bucket] = seed;
+			break;
+		}
+		if (seed == 0x10000) {
+			nslots <<= 1;
+			memset(ph->seeds, 0, ph->nbuckets * sizeof(*ph->seeds));
+			goto retry;
+		}
+	}
+
+	free(pos);
+	free(order);
+	free(buckets);
+}
+
+static void
+write_u16_array(FILE *out, const char *name, uint16_t *values, size_t n)
+{
+	fprintf(out, "static const uint16_t %s[%zd] = {", name, n);
+	for (size_t i = 0; i < n; i++)
+		fprintf(out, "%s%#x,", i % 8 ? " " : "\n\t", values[i]);
+	fprintf(out, "\n};\n\n");
+}
+
+static void
+write_phash(FILE *out, const char *prefix, struct phash *ph)
+{
+	char *name = NULL;
+
+	if (asprintf(&name, "%s_seeds", prefix) < 0)
+		err(1, "could not allocate memory");
+	write_u16_array(out, name, ph->seeds, ph->nbuckets);
+	free(name);
+
+	if (asprintf(&name, "%s_slots", prefix) < 0)
+		err(1, "could not allocate memory");
+	write_u16_array(out, name, ph->slots, ph->mask + 1);
+	free(name);
+}
+
+/*
+ * Emit the packed table efi_well_known_guid_table_ from guidnames[0:n],
+ * which must be sorted by guid, and guid_aliases.
+ */
+static void
+write_guid_table(FILE *out, struct efivar_guidname *guidnames, size_t n)
+{
+	struct phash by_guid = { 0, }, by_name = { 0, };
+	struct efivar_guidname *names;
+	uint16_t *symoffs, *aliases;
+	size_t naliases = 0;
+	size_t strsz = 0;
+	size_t prefixlen = strlen("efi_guid_");
+
+	while (guid_aliases[naliases].name != NULL)
+		naliases++;
+
+	names = calloc(n + naliases ? n + naliases : 1, sizeof(*names));
+	symoffs = calloc(n + naliases ? n + naliases : 1, sizeof(*symoffs));
+	aliases = calloc(naliases ? naliases : 1, sizeof(*aliases));
+	if (!names || !symoffs || !aliases)
+		err(1, "could not allocate memory");
+
+	memcpy(names, guidnames, n * sizeof(*names));
+	for (size_t i = 0; i < naliases; i++) {
+		struct efivar_guidname *gn = &names[n + i];
+		size_t j;
+
+		for (j = 0; j < n; j++)
+			if (!strcmp(guidnames[j].symbol, guid_aliases[i].alias))
+				break;
+		if (j == n)
+			errx(1, "alias \"%s\" is for unknown guid \"%s\"",
+			     guid_aliases[i].name, guid_aliases[i].alias);
+
+		aliases[i] = j;
+		gn->guid = guidnames[j].guid;
+		strcpy(gn->symbol, guid_aliases[i].name);
+		strcpy(gn->name, guid_aliases[i].name + prefixlen);
+	}
+
+	fprintf(out, "static const efi_guid_t efi_well_known_guid_keys[%zd] = {\n", n);
+	for (size_t i = 0; i < n; i++) {
+		efi_guid_t *guid = &guidnames[i].guid;
+
+		fprintf(out,
+			"\t{cpu_to_le32(0x%08x),cpu_to_le16(0x%04hx),"
+			"cpu_to_le16(0x%04hx),cpu_to_be16(0x%02hhx%02hhx),"
+			"{0x%02hhx,0x%02hhx,0x%02hhx,0x%02hhx,0x%02hhx,0x%02hhx}},\n",
+			guid->a, guid->b, guid->c,
+			(uint8_t)(guid->d & 0xff),
+			(uint8_t)((guid->d & 0xff00) >> 8),
+			guid->e[0], guid->e[1], guid->e[2],
+			guid->e[3], guid->e[4], guid->e[5]);
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static const char efi_well_known_guid_strtab[] =");
+	for (size_t i = 0; i < n + naliases; i++) {
+		struct efivar_guidname *gn = &names[i];
+
+		if (strncmp(gn->symbol, "efi_guid_", prefixlen) ||
+		    strcmp(gn->symbol + prefixlen, gn->name))
+			errx(1, "symbol \"%s\" does not match name \"%s\"",
+			     gn->symbol, gn->name);
+		if (strsz >= EFI_GUID_PHASH_EMPTY)
+			errx(1, "guid string table is too big");
+
+		symoffs[i] = strsz;
+		strsz += strlen(gn->symbol) + 1;
+		fprintf(out, "\n\t\"%s\\0\"", gn->symbol);
+	}
+	fprintf(out, ";\n\n");
+	write_u16_array(out, "efi_well_known_guid_symoffs", symoffs,
+			n + naliases);
+	write_u16_array(out, "efi_well_known_guid_aliases", aliases, naliases);
+
+	build_phash(guidnames, n, guid_phash, cmpguidp, "guid", &by_guid);
+	write_phash(out, "efi_well_known_guid_by_guid", &by_guid);
+	build_phash(names, n + naliases, name_phash, cmpnamep, "name",
+		    &by_name);
+	write_phash(out, "efi_well_known_guid_by_name", &by_name);
+
+	fprintf(out,
+		"const struct efivar_guid_table\n"
+		"\t__attribute__((__visibility__ (\"hidden\")))\n"
+		"\tefi_well_known_guid_table_ = {\n"
+		"\t\t.guids = efi_well_known_guid_keys,\n"
+		"\t\t.symoffs = efi_well_known_guid_symoffs,\n"
+		"\t\t.strtab = efi_well_known_guid_strtab,\n"
+		"\t\t.nguids = %zd,\n"
+		"\t\t.aliases = efi_well_known_guid_aliases,\n"
+		"\t\t.naliases = %zd,\n"
+		"\t\t.by_guid = {\n"
+		"\t\t\t.seeds = efi_well_known_guid_by_guid_seeds,\n"
+		"\t\t\t.nbuckets = %u,\n"
+		"\t\t\t.slots = efi_well_known_guid_by_guid_slots,\n"
+		"\t\t\t.mask = %#x,\n"
+		"\t\t},\n"
+		"\t\t.by_name = {\n"
+		"\t\t\t.seeds = efi_well_known_guid_by_name_seeds,\n"
+		"\t\t\t.nbuckets = %u,\n"
+		"\t\t\t.slots = efi_well_known_guid_by_name_slots,\n"
+		"\t\t\t.mask = %#x,\n"
+		"\t\t},\n"
+		"\t};\n\n",
+		n, naliases, by_guid.nbuckets, by_guid.mask,
+		by_name.nbuckets, by_name.mask);
+
+	free(by_guid.seeds);
+	free(by_guid.slots);
+	free(by_name.seeds);
+	free(by_name.slots);
+	free(aliases);
+	free(symoffs);
+	free(names);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -175,20 +465,7 @@ struct efivar_guidname {\n\
 	fprintf(symout, "#endif /* EFIVAR_BUILD_ENVIRONMENT */\n\n");
 	fprintf(symout, "#include \"fix_coverity.h\"\n");
 	fprintf(symout, "#include <efivar/efivar.h>\n");
-	fprintf(symout, "#include <endian.h>\n");
-	fprintf(symout, "\n\
-#if BYTE_ORDER == BIG_ENDIAN\n\
-#define cpu_to_be32(n) (n)\n\
-#define cpu_to_be16(n) (n)\n\
-#define cpu_to_le32(n) (__builtin_bswap32(n))\n\
-#define cpu_to_le16(n) (__builtin_bswap16(n))\n\
-#else\n\
-#define cpu_to_le32(n) (n)\n\
-#define cpu_to_le16(n) (n)\n\
-#define cpu_to_be32(n) (__builtin_bswap32(n))\n\
-#define cpu_to_be16(n) (__builtin_bswap16(n))\n\
-#endif\n\
-""");
+	fprintf(symout, "#include \"guid.h\"\n\n");
 
 	unsigned int i;
 	for (i = 0; i < line; i++) {
@@ -287,15 +564,8 @@ struct efivar_guidname {\n\
 	fprintf(header, "\n#endif /* EFIVAR_GUIDS_H */\n");
 	fclose(header);
 
-	fprintf(symout,
-		"struct efivar_guidname {\n"
-		"\tefi_guid_t guid;\n"
-		"\tchar symbol[256];\n"
-		"\tchar name[256];\n"
-		"\tchar description[256];\n"
-		"} __attribute__((__aligned__(16)));\n\n");
-
 	qsort(outbuf, line, sizeof(struct efivar_guidname), cmpguidp);
+	write_guid_table(symout, outbuf, i);
 	write_guidnames(symout, "efi_well_known_guids", outbuf, line, "libefivar.so.0");
 
 	qsort(outbuf, line, sizeof(struct efivar_guidname), cmpnamep);
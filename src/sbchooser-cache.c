@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-v3-or-later
+/*
+ * sbchooser-cache.c - on-disk cache of authenticode digests
+ */
+
+#include "sbchooser.h" // IWYU pragma: keep
+
+#include <openssl/evp.h>
+
+#define DIGEST_CACHE_MAGIC "sbcdgst1"
+
+/*
+ * One cache entry, stored as-is in a file named after the device and
+ * inode.  Everything is a multiple of 8 bytes, so there's no padding.
+ */
+struct digest_cache_entry {
+	char magic[8];
+
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+	uint8_t header_sha256[32];
+
+	uint8_t sha256[32];
+	uint8_t sha384[48];
+	uint8_t sha512[64];
+
+	uint8_t check[32];	// SHA-256 of everything above
+};
+
+static int
+checksum_cache_entry(struct digest_cache_entry *entry, uint8_t *check)
+{
+	if (!EVP_Digest(entry, offsetof(struct digest_cache_entry, check),
+			check, NULL, EVP_sha256(), NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+make_cache_key(pe_file_t *pe, struct digest_cache_entry *entry)
+{
+	size_t header_size = pe->ctx.size_of_headers;
+
+	memset(entry, 0, sizeof(*entry));
+	memcpy(entry->magic, DIGEST_CACHE_MAGIC, sizeof(entry->magic));
+	entry->dev = pe->statbuf.st_dev;
+	entry->ino = pe->statbuf.st_ino;
+	entry->size = pe->statbuf.st_size;
+	entry->mtime_sec = pe->statbuf.st_mtim.tv_sec;
+	entry->mtime_nsec = pe->statbuf.st_mtim.tv_nsec;
+	entry->ctime_sec = pe->statbuf.st_ctim.tv_sec;
+	entry->ctime_nsec = pe->statbuf.st_ctim.tv_nsec;
+
+	if (header_size > pe->mapsz)
+		header_size = pe->mapsz;
+	if (!EVP_Digest(pe->map, header_size, entry->header_sha256, NULL,
+			EVP_sha256(), NULL)) {
+		debug("couldn't hash headers of \"%s\"", pe->filename);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+cache_entry_path(const char * const cachedir, pe_file_t *pe, char **pathp)
+{
+	int rc;
+
+	rc = asprintf(pathp, "%s/%016"PRIx64"-%016"PRIx64, cachedir,
+		      (uint64_t)pe->statbuf.st_dev,
+		      (uint64_t)pe->statbuf.st_ino);
+	if (rc < 0) {
+		*pathp = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Like the entries, the directory they're in must be ours and writable
+ * by nobody else, or somebody else could swap entries in and out of it.
+ * When storing, create it and any missing parents first.
+ */
+static int
+check_cache_dir(const char * const cachedir, bool create)
+{
+	struct stat statbuf;
+	int rc;
+
+	if (create) {
+		char *path = strdupa(cachedir);
+
+		for (char *p = path + 1; *p; p++) {
+			if (*p != '/' || p[1] == '/' || p[1] == '\0')
+				continue;
+			*p = '\0';
+			rc = mkdir(path, 0700);
+			if (rc < 0 && errno != EEXIST) {
+				debug("couldn't create \"%s\": %m", path);
+				return rc;
+			}
+			*p = '/';
+		}
+		rc = mkdir(cachedir, 0700);
+		if (rc < 0 && errno != EEXIST) {
+			debug("couldn't create \"%s\": %m", cachedir);
+			return rc;
+		}
+	}
+
+	rc = lstat(cachedir, &statbuf);
+	if (rc < 0) {
+		debug("couldn't stat \"%s\": %m", cachedir);
+		return rc;
+	}
+	if (!S_ISDIR(statbuf.st_mode) || statbuf.st_uid != geteuid() ||
+	    (statbuf.st_mode & (S_IWGRP|S_IWOTH))) {
+		debug("ignoring untrusted cache directory \"%s\"", cachedir);
+		errno = EPERM;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+copy_digest(digest_data_t *dgst, const uint8_t *data, size_t datasz)
+{
+	dgst->data = malloc(datasz);
+	if (!dgst->data)
+		return -1;
+	memcpy(dgst->data, data, datasz);
+	dgst->datasz = datasz;
+	return 0;
+}
+
+int
+load_cached_digests(const char * const cachedir, pe_file_t *pe)
+{
+	struct digest_cache_entry key, entry;
+	uint8_t check[32];
+	struct stat statbuf;
+	char *path = NULL;
+	ssize_t sz;
+	int fd;
+	int rc;
+
+	rc = make_cache_key(pe, &key);
+	if (rc < 0)
+		return rc;
+
+	rc = check_cache_dir(cachedir, false);
+	if (rc < 0)
+		return rc;
+
+	rc = cache_entry_path(cachedir, pe, &path);
+	if (rc < 0)
+		return rc;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0) {
+		debug("no cache entry \"%s\" for \"%s\"", path, pe->filename);
+		free(path);
+		return -1;
+	}
+	free(path);
+
+	/*
+	 * These digests decide what we trust, so don't take them from an
+	 * entry that anybody else could have written.
+	 */
+	rc = fstat(fd, &statbuf);
+	if (rc < 0 || statbuf.st_uid != geteuid() ||
+	    (statbuf.st_mode & (S_IWGRP|S_IWOTH))) {
+		debug("ignoring untrusted cache entry for \"%s\"",
+		      pe->filename);
+		close(fd);
+		errno = EPERM;
+		return -1;
+	}
+
+	sz = read(fd, &entry, sizeof(entry));
+	close(fd);
+	if (sz != sizeof(entry) ||
+	    checksum_cache_entry(&entry, check) < 0 ||
+	    memcmp(check, entry.check, sizeof(check)) != 0) {
+		debug("corrupt cache entry for \"%s\"", pe->filename);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (memcmp(&entry, &key, offsetof(struct digest_cache_entry, sha256))) {
+		debug("stale cache entry for \"%s\"", pe->filename);
+		errno = ESTALE;
+		return -1;
+	}
+
+	if (copy_digest(&pe->sha256, entry.sha256, sizeof(entry.sha256)) < 0 ||
+	    copy_digest(&pe->sha384, entry.sha384, sizeof(entry.sha384)) < 0 ||
+	    copy_digest(&pe->sha512, entry.sha512, sizeof(entry.sha512)) < 0) {
+		free(pe->sha256.data);
+		free(pe->sha384.data);
+		free(pe->sha512.data);
+		memset(&pe->sha256, 0, sizeof(pe->sha256));
+		memset(&pe->sha384, 0, sizeof(pe->sha384));
+		memset(&pe->sha512, 0, sizeof(pe->sha512));
+		return -1;
+	}
+
+	debug("using cached digests for \"%s\"", pe->filename);
+	return 0;
+}
+
+int
+store_cached_digests(const char * const cachedir, pe_file_t *pe)
+{
+	struct digest_cache_entry entry;
+	char *path = NULL;
+	char *tmppath = NULL;
+	ssize_t sz;
+	int fd = -1;
+	int rc;
+
+	if (pe->sha256.datasz != sizeof(entry.sha256) ||
+	    pe->sha384.datasz != sizeof(entry.sha384) ||
+	    pe->sha512.datasz != sizeof(entry.sha512)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rc = make_cache_key(pe, &entry);
+	if (rc < 0)
+		return rc;
+	memcpy(entry.sha256, pe->sha256.data, sizeof(entry.sha256));
+	memcpy(entry.sha384, pe->sha384.data, sizeof(entry.sha384));
+	memcpy(entry.sha512, pe->sha512.data, sizeof(entry.sha512));
+	rc = checksum_cache_entry(&entry, entry.check);
+	if (rc < 0)
+		return rc;
+
+	rc = check_cache_dir(cachedir, true);
+	if (rc < 0)
+		return rc;
+
+	rc = cache_entry_path(cachedir, pe, &path);
+	if (rc < 0)
+		return rc;
+
+	rc = asprintf(&tmppath, "%s.XXXXXX", path);
+	if (rc < 0) {
+		tmppath = NULL;
+		goto err;
+	}
+
+	fd = mkostemp(tmppath, O_CLOEXEC);
+	if (fd < 0)
+		goto err;
+
+	sz = write(fd, &entry, sizeof(entry));
+	if (sz != sizeof(entry))
+		goto err;
+
+	rc = close(fd);
+	fd = -1;
+	if (rc < 0)
+		goto err;
+
+	rc = rename(tmppath, path);
+	if (rc < 0)
+		goto err;
+
+	free(tmppath);
+	free(path);
+	return 0;
+err:
+	debug("couldn't write cache entry for \"%s\": %m", pe->filename);
+	if (fd >= 0)
+		close(fd);
+	if (tmppath) {
+		unlink(tmppath);
+		free(tmppath);
+	}
+	free(path);
+	return -1;
+}
+
+// vim:fenc=utf-8:tw=75:noet
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-v3-or-later
+/*
+ * sbchooser-cache.h - on-disk cache of authenticode digests
+ */
+
+#pragma once
+
+#include "sbchooser.h" // IWYU pragma: keep
+
+/*
+ * Look up pe's authenticode digests in the cache directory.  An entry is
+ * only used if the file's device, inode, size, mtime, and ctime, and a
+ * SHA-256 of its headers, all match what was recorded, its checksum is
+ * intact, and it is owned by us and not writable by anyone else.
+ *
+ * returns 0 and fills in pe->sha256, pe->sha384, and pe->sha512 on a hit,
+ * negative on a miss or error
+ */
+int load_cached_digests(const char * const cachedir, pe_file_t *pe);
+
+/*
+ * Record pe's authenticode digests in the cache directory, creating it if
+ * need be.  Entries are written to a temporary file and renamed into
+ * place, so concurrent writers and readers never see a partial entry.
+ *
+ * returns 0 on success, negative on error
+ */
+int store_cached_digests(const char * const cachedir, pe_file_t *pe);
+
+// vim:fenc=utf-8:tw=75:noet
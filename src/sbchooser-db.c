@@ -116,6 +116,207 @@ add_digest(sbchooser_context_t *ctx, bool db,
 	return 0;
 }
 
+static digest_data_t **
+find_digest_slot(digest_set_t *set, const uint8_t * const data)
+{
+	size_t mask = set->n_slots - 1;
+	size_t i = fnv1a_64(FNV1A_64_INIT, data, set->datasz) & mask;
+
+	while (set->slots[i] &&
+	       memcmp(set->slots[i]->data, data, set->datasz) != 0)
+		i = (i + 1) & mask;
+
+	return &set->slots[i];
+}
+
+/*
+ * Build one digest set per digest length, with at least twice as many
+ * slots as entries so that probe sequences stay short.
+ */
+static int
+build_digest_sets(digest_data_t **digests, size_t n_digests,
+		  digest_set_t **setsp, size_t *n_setsp)
+{
+	digest_set_t *sets = NULL;
+	size_t n_sets = 0;
+
+	for (size_t i = 0; i < n_digests; i++) {
+		size_t datasz = digests[i]->datasz;
+		size_t n_entries = 0;
+		digest_set_t *new_sets;
+		digest_set_t *set;
+		size_t j;
+
+		for (j = 0; j < n_sets; j++)
+			if (sets[j].datasz == datasz)
+				break;
+		if (j < n_sets)
+			continue;
+
+		for (j = i; j < n_digests; j++)
+			if (digests[j]->datasz == datasz)
+				n_entries += 1;
+
+		new_sets = reallocarray(sets, n_sets + 1, sizeof(*sets));
+		if (!new_sets)
+			goto err;
+		sets = new_sets;
+
+		set = &sets[n_sets];
+		set->datasz = datasz;
+		set->n_slots = 8;
+		while (set->n_slots < n_entries * 2)
+			set->n_slots <<= 1;
+		set->slots = calloc(set->n_slots, sizeof(*set->slots));
+		if (!set->slots)
+			goto err;
+		n_sets += 1;
+
+		for (j = i; j < n_digests; j++) {
+			digest_data_t **slot;
+
+			if (digests[j]->datasz != datasz)
+				continue;
+
+			slot = find_digest_slot(set, digests[j]->data);
+			if (!*slot)
+				*slot = digests[j];
+		}
+	}
+
+	*setsp = sets;
+	*n_setsp = n_sets;
+	return 0;
+err:
+	for (size_t i = 0; i < n_sets; i++)
+		free(sets[i].slots);
+	free(sets);
+	return -1;
+}
+
+static void
+free_digest_sets(digest_set_t **setsp, size_t *n_setsp)
+{
+	for (size_t i = 0; i < *n_setsp; i++)
+		free((*setsp)[i].slots);
+	free(*setsp);
+	*setsp = NULL;
+	*n_setsp = 0;
+}
+
+digest_data_t *
+find_digest(digest_set_t *sets, size_t n_sets,
+	    const digest_data_t * const candidate)
+{
+	for (size_t i = 0; i < n_sets; i++) {
+		if (sets[i].datasz != candidate->datasz)
+			continue;
+
+		return *find_digest_slot(&sets[i], candidate->data);
+	}
+
+	return NULL;
+}
+
+static void
+add_cert_index_entry(struct cert_index_entry *entries, size_t mask,
+		     uint64_t hash, size_t n, cert_data_t *cert)
+{
+	size_t i = hash & mask;
+
+	while (entries[i].cert)
+		i = (i + 1) & mask;
+
+	entries[i].hash = hash;
+	entries[i].n = n;
+	entries[i].cert = cert;
+}
+
+static int
+build_cert_index(cert_data_t **certs, size_t n_certs, cert_index_t *index)
+{
+	size_t n_slots = 8;
+
+	while (n_slots < n_certs * 2)
+		n_slots <<= 1;
+
+	index->by_subject = calloc(n_slots, sizeof(*index->by_subject));
+	index->by_issuer_serial = calloc(n_slots,
+					 sizeof(*index->by_issuer_serial));
+	if (!index->by_subject || !index->by_issuer_serial) {
+		free(index->by_subject);
+		free(index->by_issuer_serial);
+		memset(index, 0, sizeof(*index));
+		return -1;
+	}
+	index->n_slots = n_slots;
+
+	for (size_t i = 0; i < n_certs; i++) {
+		add_cert_index_entry(index->by_subject, n_slots - 1,
+				     certs[i]->subject_hash, i, certs[i]);
+		add_cert_index_entry(index->by_issuer_serial, n_slots - 1,
+				     certs[i]->issuer_serial_hash, i, certs[i]);
+	}
+
+	return 0;
+}
+
+static void
+free_cert_index(cert_index_t *index)
+{
+	free(index->by_subject);
+	free(index->by_issuer_serial);
+	memset(index, 0, sizeof(*index));
+}
+
+/*
+ * Walk the probe sequence for hash and return the matching entry that
+ * came first in db or dbx, so that the result is the same one a linear
+ * scan would find.
+ */
+static struct cert_index_entry *
+find_cert_index_entry(struct cert_index_entry *entries, size_t mask,
+		      uint64_t hash, cert_data_t *sigcert,
+		      bool (*match)(cert_data_t *, cert_data_t *))
+{
+	struct cert_index_entry *found = NULL;
+
+	for (size_t i = hash & mask; entries[i].cert; i = (i + 1) & mask) {
+		if (entries[i].hash != hash)
+			continue;
+		if (found && found->n < entries[i].n)
+			continue;
+		if (!match(sigcert, entries[i].cert))
+			continue;
+		found = &entries[i];
+	}
+
+	return found;
+}
+
+cert_data_t *
+find_cert(cert_index_t *index, cert_data_t *sigcert)
+{
+	struct cert_index_entry *same, *issuer;
+
+	if (index->n_slots == 0)
+		return NULL;
+
+	same = find_cert_index_entry(index->by_issuer_serial,
+				     index->n_slots - 1,
+				     sigcert->issuer_serial_hash, sigcert,
+				     is_same_cert);
+	issuer = find_cert_index_entry(index->by_subject, index->n_slots - 1,
+				       sigcert->issuer_hash, sigcert,
+				       is_issuing_cert);
+
+	if (same && (!issuer || same->n <= issuer->n))
+		return same->cert;
+	if (issuer)
+		return issuer->cert;
+	return NULL;
+}
+
 static efi_secdb_visitor_status_t
 parse_one_secdb_cert(unsigned int listnum UNUSED,
 		     unsigned int signum UNUSED,
@@ -184,12 +385,37 @@ parse_secdb_info(sbchooser_context_t *ctx)
 		return rc;
 	}
 
+	rc = build_digest_sets(ctx->db_digests, ctx->n_db_digests,
+			       &ctx->db_digest_sets, &ctx->n_db_digest_sets);
+	if (rc < 0)
+		return rc;
+
+	rc = build_digest_sets(ctx->dbx_digests, ctx->n_dbx_digests,
+			       &ctx->dbx_digest_sets, &ctx->n_dbx_digest_sets);
+	if (rc < 0)
+		return rc;
+
+	rc = build_cert_index(ctx->db_certs, ctx->n_db_certs,
+			      &ctx->db_cert_index);
+	if (rc < 0)
+		return rc;
+
+	rc = build_cert_index(ctx->dbx_certs, ctx->n_dbx_certs,
+			      &ctx->dbx_cert_index);
+	if (rc < 0)
+		return rc;
+
 	return 0;
 }
 
 void
 free_secdb_info(sbchooser_context_t *ctx)
 {
+	free_digest_sets(&ctx->db_digest_sets, &ctx->n_db_digest_sets);
+	free_digest_sets(&ctx->dbx_digest_sets, &ctx->n_dbx_digest_sets);
+	free_cert_index(&ctx->db_cert_index);
+	free_cert_index(&ctx->dbx_cert_index);
+
 	for (size_t i = 0; i < ctx->n_db_digests; i++) {
 		digest_data_t *dgst = ctx->db_digests[i];
 
@@ -13,5 +13,13 @@ int load_secdb_from_var(const char * const name,
 			const efi_guid_t * const guidp, efi_secdb_t **secdbp);
 int parse_secdb_info(sbchooser_context_t *ctx);
 void free_secdb_info(sbchooser_context_t *ctx);
+digest_data_t *find_digest(digest_set_t *sets, size_t n_sets,
+			   const digest_data_t * const candidate);
+
+/*
+ * Find the first cert in db or dbx order that either is sigcert (the same
+ * issuer and serial) or is named as its issuer.
+ */
+cert_data_t *find_cert(cert_index_t *index, cert_data_t *sigcert);
 
 // vim:fenc=utf-8:tw=75:noet
@@ -116,30 +116,22 @@ image_is_64_bit(efi_image_optional_header_union_t *pehdr)
 static bool
 get_revocation(sbchooser_context_t *ctx, cert_data_t *sigcert)
 {
-	debug("looking for subject or issuer in %d dbx certs", ctx->n_dbx_certs);
-
-	for (size_t i = 0; i < ctx->n_dbx_certs; i++) {
-		cert_data_t *dbxcert = ctx->dbx_certs[i];
+	cert_data_t *dbxcert;
 
-		if (is_same_cert(sigcert, dbxcert)) {
-			if (!sigcert->revoked_cert)
-				sigcert->revoked_cert = dbxcert;
-			debug("found");
-			return true;
-		}
+	debug("looking for subject or issuer in %d dbx certs", ctx->n_dbx_certs);
 
-		if (is_issuing_cert(sigcert, dbxcert)) {
-			if (!sigcert->revoked_cert)
-				sigcert->revoked_cert = dbxcert;
-			debug("found");
-			return true;
-		}
-		/*
-		 * XXX PJFIX: right now we don't check cert revocations by
-		 * TBS hash.  I think we could solve this with
-		 * X509_digest() and looking them up, but I don't have any
-		 * dbx examples handy.
-		 */
+	/*
+	 * XXX PJFIX: right now we don't check cert revocations by
+	 * TBS hash.  I think we could solve this with
+	 * X509_digest() and looking them up, but I don't have any
+	 * dbx examples handy.
+	 */
+	dbxcert = find_cert(&ctx->dbx_cert_index, sigcert);
+	if (dbxcert) {
+		if (!sigcert->revoked_cert)
+			sigcert->revoked_cert = dbxcert;
+		debug("found");
+		return true;
 	}
 	debug("none found");
 	return false;
@@ -148,30 +140,22 @@ get_revocation(sbchooser_context_t *ctx, cert_data_t *sigcert)
 static bool
 get_authorization(sbchooser_context_t *ctx, cert_data_t *sigcert)
 {
-	debug("looking for subject or issuer in %d db certs", ctx->n_db_certs);
-
-	for (size_t i = 0; i < ctx->n_db_certs; i++) {
-		cert_data_t *dbcert = ctx->db_certs[i];
+	cert_data_t *dbcert;
 
-		if (is_same_cert(sigcert, dbcert)) {
-			if (!sigcert->trust_anchor_cert)
-				sigcert->trust_anchor_cert = dbcert;
-			debug("found");
-			return true;
-		}
+	debug("looking for subject or issuer in %d db certs", ctx->n_db_certs);
 
-		if (is_issuing_cert(sigcert, dbcert)) {
-			if (!sigcert->trust_anchor_cert)
-				sigcert->trust_anchor_cert = dbcert;
-			debug("found");
-			return true;
-		}
-		/*
-		 * XXX PJFIX: right now we don't check cert authorizations
-		 * by TBS hash.  I think we could solve this with
-		 * X509_digest() and looking them up, but I don't have any
-		 * db examples handy.
-		 */
+	/*
+	 * XXX PJFIX: right now we don't check cert authorizations
+	 * by TBS hash.  I think we could solve this with
+	 * X509_digest() and looking them up, but I don't have any
+	 * db examples handy.
+	 */
+	dbcert = find_cert(&ctx->db_cert_index, sigcert);
+	if (dbcert) {
+		if (!sigcert->trust_anchor_cert)
+			sigcert->trust_anchor_cert = dbcert;
+		debug("found");
+		return true;
 	}
 	debug("none found");
 	return false;
@@ -497,6 +481,7 @@ load_pe(sbchooser_context_t *ctx,
 		goto err;
 
 	pe_ctx = &pe->ctx;
+	pe->statbuf = statbuf;
 	pe->mapsz = statbuf.st_size;
 	pe->map = mmap(NULL, pe->mapsz, PROT_READ, MAP_SHARED, fd, 0);
 	if (pe->map == MAP_FAILED)
@@ -755,9 +740,19 @@ load_pe(sbchooser_context_t *ctx,
 	if (rc < 0)
 		goto err;
 
-	rc = generate_authenticode(pe);
-	if (rc < 0)
-		goto err;
+	if (!ctx->digest_cache ||
+	    load_cached_digests(ctx->digest_cache, pe) < 0) {
+		rc = generate_authenticode(pe);
+		if (rc < 0)
+			goto err;
+
+		/*
+		 * The cache only saves time; if we can't write to it we
+		 * just hash the file again next time.
+		 */
+		if (ctx->digest_cache)
+			store_cached_digests(ctx->digest_cache, pe);
+	}
 
 	*pe_p = pe;
 	return 0;
@@ -833,27 +828,32 @@ err:
 
 static void
 check_secdb_hash(char *dbname, digest_data_t **digests, size_t n_digests,
+		 digest_set_t *sets, size_t n_sets,
 		 char *dgstname, digest_data_t *candidate, bool *found)
 {
 	char buf[1024];
 
-	fmt_digest(candidate, buf, sizeof(buf));
-	debug("candidate:%s", buf);
-
-	for (size_t i = 0; i < n_digests; i++) {
-		digest_data_t *dgst = digests[i];
+	if (efi_get_verbose() >= DEBUG_LEVEL) {
+		fmt_digest(candidate, buf, sizeof(buf));
+		debug("candidate:%s", buf);
+	}
 
-		if (candidate->datasz != dgst->datasz)
-			continue;
+	if (efi_get_verbose() >= LOG_DEBUG_DUMPER) {
+		for (size_t i = 0; i < n_digests; i++) {
+			digest_data_t *dgst = digests[i];
 
-		fmt_digest(dgst, buf, sizeof(buf));
-		log(LOG_DEBUG_DUMPER, "%s:%s", dbname, buf);
+			if (candidate->datasz != dgst->datasz)
+				continue;
 
-		if (memcmp(dgst->data, candidate->data, dgst->datasz) == 0) {
-			debug("%s hash is in %s", dgstname, dbname);
-			*found = true;
+			fmt_digest(dgst, buf, sizeof(buf));
+			log(LOG_DEBUG_DUMPER, "%s:%s", dbname, buf);
 		}
 	}
+
+	if (find_digest(sets, n_sets, candidate)) {
+		debug("%s hash is in %s", dgstname, dbname);
+		*found = true;
+	}
 }
 
 static void
@@ -862,10 +862,13 @@ check_dbx_hashes(sbchooser_context_t *ctx, pe_file_t *pe)
 	debug("%zu digests in dbx\n", ctx->n_dbx_digests);
 
 	check_secdb_hash("dbx", ctx->dbx_digests, ctx->n_dbx_digests,
+			 ctx->dbx_digest_sets, ctx->n_dbx_digest_sets,
 			 "sha512", &pe->sha512, &pe->sha512_revoked);
 	check_secdb_hash("dbx", ctx->dbx_digests, ctx->n_dbx_digests,
+			 ctx->dbx_digest_sets, ctx->n_dbx_digest_sets,
 			 "sha384", &pe->sha384, &pe->sha384_revoked);
 	check_secdb_hash("dbx", ctx->dbx_digests, ctx->n_dbx_digests,
+			 ctx->dbx_digest_sets, ctx->n_dbx_digest_sets,
 			 "sha256", &pe->sha256, &pe->sha256_revoked);
 }
 
@@ -875,10 +878,13 @@ check_db_hashes(sbchooser_context_t *ctx, pe_file_t *pe)
 	debug("%zu digests in db\n", ctx->n_db_digests);
 
 	check_secdb_hash("db", ctx->db_digests, ctx->n_db_digests,
+			 ctx->db_digest_sets, ctx->n_db_digest_sets,
 			 "sha512", &pe->sha512, &pe->sha512_trusted);
 	check_secdb_hash("db", ctx->db_digests, ctx->n_db_digests,
+			 ctx->db_digest_sets, ctx->n_db_digest_sets,
 			 "sha384", &pe->sha384, &pe->sha384_trusted);
 	check_secdb_hash("db", ctx->db_digests, ctx->n_db_digests,
+			 ctx->db_digest_sets, ctx->n_db_digest_sets,
 			 "sha256", &pe->sha256, &pe->sha256_trusted);
 }
 
@@ -84,6 +84,7 @@ struct pe_file {
 	char *filename;		// for display later
 	void *map;		// where the file is mapped
 	size_t mapsz;		// how big the map is
+	struct stat statbuf;	// identity of the file, for the digest cache
 	pe_image_context_t ctx;	// context built from "loading" it.
 
 	/*
@@ -170,6 +171,20 @@ int get_section_vma (pe_file_t *pe, unsigned int section_num,
 void fmt_digest(digest_data_t *dgst, char *buf, size_t bufsz);
 int generate_authenticode(pe_file_t *pe);
 
+/*
+ * How generate_authenticode_ex() spreads the SHA-256, SHA-384, and
+ * SHA-512 digests of an image over threads.  generate_authenticode()
+ * uses AUTHENTICODE_THREADS_AUTO, which only uses threads for large
+ * images.
+ */
+typedef enum {
+	AUTHENTICODE_THREADS_AUTO = 0,
+	AUTHENTICODE_THREADS_NEVER,
+	AUTHENTICODE_THREADS_ALWAYS,
+} authenticode_threads_t;
+
+int generate_authenticode_ex(pe_file_t *pe, authenticode_threads_t threads);
+
 /*
  * evaluate the security posture of the PE file provided, in the context of
  * the security databases in ctx.
@@ -77,7 +77,7 @@ is_same_cert(cert_data_t *cert0, cert_data_t *cert1)
 	ASN1_INTEGER_get_uint64(&b, cert1->serial);
 	rc = ASN1_INTEGER_cmp(cert0->serial, cert1->serial);
 	debug("  serial cmp(0x%"PRIx64",0x%"PRIx64"):%d", a, b, rc);
-	if (!rc)
+	if (rc != 0)
 		return false;
 
 	return true;
@@ -102,6 +102,52 @@ is_issuing_cert(cert_data_t *subject, cert_data_t *candidate_issuer)
 	return false;
 }
 
+static int
+hash_x509_name(const X509_NAME *name, uint64_t *hash)
+{
+	int ok = 1;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	*hash = X509_NAME_hash_ex(name, NULL, NULL, &ok);
+#else
+	*hash = X509_NAME_hash((X509_NAME *)name);
+#endif
+	return ok ? 0 : -1;
+}
+
+/*
+ * The name hashes are over the same canonical encoding X509_NAME_cmp()
+ * compares, so any names it calls equal have equal hashes.
+ */
+static int
+hash_cert_names(cert_data_t *cert)
+{
+	const unsigned char *serial;
+	int serial_type;
+	int rc;
+
+	rc = hash_x509_name(cert->subject, &cert->subject_hash);
+	if (rc < 0)
+		return rc;
+
+	rc = hash_x509_name(cert->issuer, &cert->issuer_hash);
+	if (rc < 0)
+		return rc;
+
+	serial = ASN1_STRING_get0_data(cert->serial);
+	serial_type = ASN1_STRING_type(cert->serial);
+	cert->issuer_serial_hash =
+		fnv1a_64(FNV1A_64_INIT, &cert->issuer_hash,
+			 sizeof(cert->issuer_hash));
+	cert->issuer_serial_hash =
+		fnv1a_64(cert->issuer_serial_hash, &serial_type,
+			 sizeof(serial_type));
+	cert->issuer_serial_hash =
+		fnv1a_64(cert->issuer_serial_hash, serial,
+			 ASN1_STRING_length(cert->serial));
+	return 0;
+}
+
 void
 free_cert(cert_data_t *cert)
 {
@@ -146,6 +192,12 @@ elaborate_x509_info(cert_data_t *cert)
 		goto err;
 	}
 
+	rc = hash_cert_names(cert);
+	if (rc < 0) {
+		warnx("couldn't hash cert names");
+		goto err;
+	}
+
 	cert->not_before = X509_get0_notBefore(cert->x509);
 	if (cert->not_before == NULL) {
 		warnx("couldn't get not_before");
@@ -19,6 +19,14 @@ struct cert_data {
 	X509_NAME *subject;
 	ASN1_INTEGER *serial;
 
+	/*
+	 * Hashes of the canonical subject and issuer names, and of the
+	 * issuer and serial together, for looking certs up in db and dbx
+	 */
+	uint64_t subject_hash;
+	uint64_t issuer_hash;
+	uint64_t issuer_serial_hash;
+
 	const ASN1_TIME *not_before;
 	const ASN1_TIME *not_after;
 
@@ -16,6 +16,7 @@ usage(int status)
 	fprintf(status == 0 ? stdout : stderr,
 		"Usage: %s [OPTION...]\n"
 		"\nOptions:\n"
+		"  -c, --digest-cache=<dir>          Cache authenticode digests in <dir>\n"
 		"  -d, --db=<db file>                UEFI trusted key database\n"
 		"  -D, --no-system-db                Do not load the UEFI trusted key database\n"
 		"  -s, --system-db                   Load the UEFI trusted key database from\n"
@@ -27,6 +28,8 @@ usage(int status)
 		"  -S, --system-dbx                  Load the UEFI revoked key database from\n"
 		"                                    this system (default)\n"
 		"  -i, --input=<efi file>            EFI binary for sorting\n"
+		"  -j, --jobs=<n>                    Load and score inputs on <n> threads\n"
+		"                                    (0 for one per CPU)\n"
 		"Help options:\n"
 		"  -?, --help                        Show this help message\n"
 		"      --usage                       Display brief usage message\n",
@@ -69,12 +72,9 @@ add_file_to_ctx(sbchooser_context_t *ctxp, pe_file_t *pe)
 }
 
 static void
-add_one_pe_to_ctx(sbchooser_context_t *ctx, const char *filename)
+add_loaded_pe_to_ctx(sbchooser_context_t *ctx, const char *filename,
+		     pe_file_t *pe, int rc)
 {
-	int rc;
-	pe_file_t *pe = NULL;
-
-	rc = load_pe(ctx, filename, &pe);
 	if (rc < 0) {
 		if (filename[0] == '-') {
 			warnx("Unknown argument:\"%s\"", filename);
@@ -87,11 +87,144 @@ add_one_pe_to_ctx(sbchooser_context_t *ctx, const char *filename)
 		err(ERR_BAD_PE, "Could not add \"%s\" to context", filename);
 }
 
+/*
+ * With --jobs, inputs are only queued while we parse the command line,
+ * and are loaded and scored together once the db and dbx are ready.
+ */
+typedef struct {
+	char *filename;
+	bool first_sig_only;
+	pe_file_t *pe;
+	int rc;
+	int error;
+} pending_pe_t;
+
+static pending_pe_t *pending;
+static size_t n_pending;
+static long jobs = -1;
+
+static void
+add_one_pe_to_ctx(sbchooser_context_t *ctx, const char *filename)
+{
+	int rc;
+	pe_file_t *pe = NULL;
+
+	if (jobs >= 0) {
+		pending_pe_t *new_pending;
+
+		new_pending = reallocarray(pending, n_pending + 1,
+					   sizeof(*pending));
+		if (!new_pending)
+			err(ERR_BAD_PE, "Could not add \"%s\" to context",
+			    filename);
+		pending = new_pending;
+		memset(&pending[n_pending], 0, sizeof(pending[0]));
+		pending[n_pending].filename = strdup(filename);
+		if (!pending[n_pending].filename)
+			err(ERR_BAD_PE, "Could not add \"%s\" to context",
+			    filename);
+		pending[n_pending].first_sig_only = ctx->first_sig_only;
+		n_pending += 1;
+		return;
+	}
+
+	rc = load_pe(ctx, filename, &pe);
+	add_loaded_pe_to_ctx(ctx, filename, pe, rc);
+}
+
+struct pe_worker_state {
+	sbchooser_context_t *ctx;
+	size_t next;
+};
+
+/*
+ * Everything a worker touches in the context (the db and dbx digests and
+ * certs) is only read once parse_secdb_info() is done, and everything it
+ * writes belongs to its own pe_file_t.
+ */
+static void *
+pe_worker(void *arg)
+{
+	struct pe_worker_state *state = arg;
+	size_t i;
+
+	while ((i = __atomic_fetch_add(&state->next, 1, __ATOMIC_RELAXED))
+	       < n_pending) {
+		pending_pe_t *p = &pending[i];
+
+		p->rc = load_pe(state->ctx, p->filename, &p->pe);
+		p->error = errno;
+		if (p->rc < 0)
+			continue;
+
+		/* load_pe() took this from the context; use what it was
+		 * when this input was given, as the serial path would. */
+		p->pe->first_sig_only = p->first_sig_only;
+		update_pe_security(state->ctx, p->pe);
+	}
+
+	return NULL;
+}
+
+static void
+load_pending_pes(sbchooser_context_t *ctx)
+{
+	struct pe_worker_state state = { .ctx = ctx, .next = 0 };
+	pthread_t *threads = NULL;
+	size_t n_threads = 0;
+	size_t max_threads = jobs;
+	int rc;
+
+	if (max_threads == 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		max_threads = ncpus > 0 ? (size_t)ncpus : 1;
+	}
+	if (max_threads > n_pending)
+		max_threads = n_pending;
+
+	if (max_threads > 1) {
+		threads = calloc(max_threads - 1, sizeof(*threads));
+		if (!threads)
+			err(ERR_BAD_PE, "could not allocate memory");
+		for (n_threads = 0; n_threads < max_threads - 1; n_threads++) {
+			rc = pthread_create(&threads[n_threads], NULL,
+					    pe_worker, &state);
+			if (rc != 0) {
+				debug("pthread_create() failed: %s",
+				      strerror(rc));
+				break;
+			}
+		}
+	}
+
+	pe_worker(&state);
+
+	for (size_t i = 0; i < n_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	/*
+	 * Report failures and add the files in the order they were given,
+	 * so the sort sees exactly what the serial path would give it.
+	 */
+	for (size_t i = 0; i < n_pending; i++) {
+		errno = pending[i].error;
+		add_loaded_pe_to_ctx(ctx, pending[i].filename,
+				     pending[i].pe, pending[i].rc);
+		free(pending[i].filename);
+	}
+	free(pending);
+	pending = NULL;
+	n_pending = 0;
+}
+
 int
 main(int argc, char *argv[])
 {
-	const char sopts[] = ":d:Defi:sSx:Xvh";
+	const char sopts[] = ":c:d:Defi:j:sSx:Xvh";
 	const struct option lopts[] = {
+		{"digest-cache", required_argument, NULL, 'c' },
 		{"db", required_argument, NULL, 'd' },
 		{"no-system-db", no_argument, NULL, 'D' },
 		{"system-db", no_argument, NULL, 's' },
@@ -101,6 +234,7 @@ main(int argc, char *argv[])
 		{"first-sig-only", no_argument, NULL, 'f' },
 		{"explain", no_argument, NULL, 'e' },
 		{"in", required_argument, NULL, 'i' },
+		{"jobs", required_argument, NULL, 'j' },
 		{"verbose", no_argument, NULL, 'v' },
 		{"usage", no_argument, NULL, 'h' },
 		{"help", no_argument, NULL, 'h' },
@@ -143,6 +277,11 @@ main(int argc, char *argv[])
 		case ':':
 			errx(ERR_USAGE, "Error: '--%s' requires an argument", lopts[optind].name);
 			break;
+		case 'c':
+			if (ctx.n_files > 0)
+				errx(ERR_USAGE, "Error: '--digest-cache' must come before any inputs");
+			ctx.digest_cache = optarg;
+			break;
 		case 'D':
 			needs_db = false;
 			break;
@@ -191,6 +330,18 @@ main(int argc, char *argv[])
 			}
 			add_one_pe_to_ctx(&ctx, argv[optind-1]);
 			break;
+		case 'j': {
+			char *end = NULL;
+
+			if (ctx.n_files > 0)
+				errx(ERR_USAGE, "Error: '--jobs' must come before any inputs");
+			errno = 0;
+			jobs = strtol(optarg, &end, 10);
+			if (errno || !end || *end || jobs < 0)
+				errx(ERR_USAGE, "Error: invalid job count \"%s\"",
+				     optarg);
+			break;
+		}
 		case 'v':
 			verbose += 1;
 			efi_set_verbose(verbose, stderr);
@@ -242,7 +393,7 @@ main(int argc, char *argv[])
 		errx(ERR_SECDB, "couldn't parse secdb info");
 	}
 
-	if (ctx.n_files == 0 && !isatty(STDIN_FILENO)) {
+	if (ctx.n_files == 0 && n_pending == 0 && !isatty(STDIN_FILENO)) {
 		read_inputs_from_stdin = true;
 	}
 
@@ -272,13 +423,17 @@ main(int argc, char *argv[])
 		}
 	}
 
-	if (ctx.n_files == 0) {
+	if (ctx.n_files == 0 && n_pending == 0) {
 		warnx("no input files!");
 		exit(ERR_USAGE);
 	}
 
-	for (size_t i = 0; i < ctx.n_files; i++) {
-		update_pe_security(&ctx, ctx.files[i]);
+	if (jobs >= 0) {
+		load_pending_pes(&ctx);
+	} else {
+		for (size_t i = 0; i < ctx.n_files; i++) {
+			update_pe_security(&ctx, ctx.files[i]);
+		}
 	}
 
 	qsort(ctx.files, ctx.n_files, sizeof(ctx.files[0]), pe_cmp);
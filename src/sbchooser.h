@@ -14,12 +14,14 @@
 #include <errno.h> // IWYU pragma: keep
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h> // IWYU pragma: keep
 #include <stdlib.h> // IWYU pragma: keep
 #include <string.h> // IWYU pragma: keep
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -49,6 +51,35 @@ struct digest_data {
 };
 typedef struct digest_data digest_data_t;
 
+/*
+ * An open-addressed set of the db or dbx digests of one length; slots
+ * is a power of two, and NULL marks an empty slot.
+ */
+struct digest_set {
+	size_t datasz;
+	size_t n_slots;
+	digest_data_t **slots;
+};
+typedef struct digest_set digest_set_t;
+
+/*
+ * Open-addressed indices of the db or dbx certs by subject name and by
+ * issuer name and serial number.  Both tables have n_slots entries, and
+ * an entry with a NULL cert is empty.
+ */
+struct cert_index_entry {
+	uint64_t hash;
+	size_t n;		// the cert's position in db_certs/dbx_certs
+	cert_data_t *cert;
+};
+
+struct cert_index {
+	size_t n_slots;
+	struct cert_index_entry *by_subject;
+	struct cert_index_entry *by_issuer_serial;
+};
+typedef struct cert_index cert_index_t;
+
 typedef struct pe_file pe_file_t;
 
 #include "compiler.h" // IWYU pragma: export
@@ -56,6 +87,7 @@ typedef struct pe_file pe_file_t;
 #include "sbchooser-pe.h" // IWYU pragma: export
 #include "sbchooser-db.h" // IWYU pragma: export
 #include "sbchooser-x509.h" // IWYU pragma: export
+#include "sbchooser-cache.h" // IWYU pragma: export
 
 /*
  * sbchooser's main context
@@ -70,17 +102,25 @@ struct sbchooser_context {
 	efi_secdb_t *db;
 	size_t n_db_digests;
 	digest_data_t **db_digests;
+	size_t n_db_digest_sets;
+	digest_set_t *db_digest_sets;
 	size_t n_db_certs;
 	cert_data_t **db_certs;
+	cert_index_t db_cert_index;
 
 	efi_secdb_t *dbx;
 	size_t n_dbx_digests;
 	digest_data_t **dbx_digests;
+	size_t n_dbx_digest_sets;
+	digest_set_t *dbx_digest_sets;
 	size_t n_dbx_certs;
 	cert_data_t **dbx_certs;
+	cert_index_t dbx_cert_index;
 	// XXX PJFIX: support cert TBS hash revocations
 
 	bool first_sig_only;	// should only the first signature be scored?
+
+	char *digest_cache;	// directory of cached authenticode digests
 };
 
 // vim:fenc=utf-8:tw=75:noet
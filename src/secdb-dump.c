@@ -302,7 +302,7 @@ void
 secdb_dump(efi_secdb_t *secdb, bool annotations)
 {
 	int esln = 0;
-	list_t *pos0, *pos1;
+	list_t *pos0;
 	ssize_t offset = 0;
 
 	start = offset;
@@ -310,6 +310,7 @@ secdb_dump(efi_secdb_t *secdb, bool annotations)
 
 	for_each_secdb(pos0, &secdb->list) {
 		efi_secdb_t *esl;
+		secdb_entry_t *esd;
 		int esdn = 0;
 
 		esl = list_entry(pos0, efi_secdb_t, list);
@@ -319,8 +320,7 @@ secdb_dump(efi_secdb_t *secdb, bool annotations)
 		if (offset < 0)
 			break;
 
-		for_each_secdb_entry(pos1, &esl->entries) {
-			secdb_entry_t *esd;
+		for_each_secdb_entry(esd, esl) {
 			bool has_owner = true;
 			size_t datasz = esl->sigsz;
 			int rc;
@@ -337,7 +337,6 @@ secdb_dump(efi_secdb_t *secdb, bool annotations)
 			if (has_owner)
 				datasz -= sizeof(efi_guid_t);
 
-			esd = list_entry(pos1, secdb_entry_t, list);
 			debug("esl[%d].esd[%d]:%p owner:%p data:%p-%p datasz:%zd",
 			      esln, esdn, esd, &esd->owner,
 			      &esd->data, &esd->data+datasz, datasz);
@@ -6,6 +6,10 @@
  */
 
 #include "efisec.h" // IWYU pragma: keep
+
+#include <assert.h>
+#include <sys/uio.h>
+
 #include "efivar/efisec-secdb.h"
 
 /*
@@ -21,7 +25,6 @@ efi_secdb_new(void)
 		return NULL;
 	}
 	INIT_LIST_HEAD(&secdb->list);
-	INIT_LIST_HEAD(&secdb->entries);
 
 	efi_secdb_set_bool(secdb, EFI_SECDB_SORT, true);
 	efi_secdb_set_bool(secdb, EFI_SECDB_SORT_DATA, false);
@@ -30,6 +33,209 @@ efi_secdb_new(void)
 	return secdb;
 }
 
+/*
+ * Each signature list keeps a hash index of its entries' slots, so that
+ * duplicate checks, deletion, and lookups don't have to walk the lists.
+ * Entries with the same data but different owners share a hash; the
+ * lookup tells them apart.
+ */
+static uint64_t
+secdb_index_hash(const efi_secdb_data_t *data, size_t datasz)
+{
+	return fnv1a_64(FNV1A_64_INIT, data->raw, datasz);
+}
+
+/*
+ * rebuild a list's index from its entries, growing it to at least
+ * min_size buckets
+ */
+static int
+secdb_index_rebuild(efi_secdb_t *secdb, size_t min_size)
+{
+	size_t size = secdb->index_size ? secdb->index_size : 16;
+	size_t *index;
+
+	while (size < min_size)
+		size *= 2;
+
+	if (size != secdb->index_size) {
+		index = realloc(secdb->index, size * sizeof(*index));
+		if (!index) {
+			efi_error("could not allocate %zd bytes",
+				  size * sizeof(*index));
+			return -1;
+		}
+		secdb->index = index;
+		secdb->index_size = size;
+	}
+	memset(secdb->index, 0, size * sizeof(*secdb->index));
+
+	for (size_t slot = 0; slot < secdb->nslots; slot++) {
+		secdb_entry_t *entry = secdb_entry_at(secdb, slot);
+		size_t bucket = entry->hash & (size - 1);
+
+		if (entry->deleted)
+			continue;
+		entry->index_next = secdb->index[bucket];
+		secdb->index[bucket] = slot + 1;
+	}
+	return 0;
+}
+
+static void
+secdb_index_unlink(efi_secdb_t *secdb, size_t slot)
+{
+	secdb_entry_t *entry = secdb_entry_at(secdb, slot);
+	size_t *pos = &secdb->index[entry->hash & (secdb->index_size - 1)];
+
+	while (*pos) {
+		if (*pos == slot + 1) {
+			*pos = entry->index_next;
+			entry->index_next = 0;
+			return;
+		}
+		pos = &secdb_entry_at(secdb, *pos - 1)->index_next;
+	}
+}
+
+/*
+ * find an entry on one list with the given data, and the given owner if
+ * owner isn't NULL
+ */
+static secdb_entry_t *
+secdb_index_find(efi_secdb_t *secdb, const efi_guid_t *owner, uint64_t hash,
+		 const efi_secdb_data_t *data, size_t datasz, size_t *slotp)
+{
+	secdb_entry_t *entry;
+	size_t next;
+
+	if (!secdb->index_size || secdb->nsigs == 0 ||
+	    secdb->entry_datasz != datasz)
+		return NULL;
+
+	next = secdb->index[hash & (secdb->index_size - 1)];
+	for (; next; next = entry->index_next) {
+		entry = secdb_entry_at(secdb, next - 1);
+		if (entry->hash == hash &&
+		    (!owner || !efi_guid_cmp(owner, &entry->owner)) &&
+		    !memcmp(data, &entry->data, datasz)) {
+			if (slotp)
+				*slotp = next - 1;
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * find an entry with the given algorithm and data on any list
+ */
+static secdb_entry_t *
+secdb_find(efi_secdb_t *top, const efi_guid_t *owner,
+	   efi_secdb_type_t algorithm, const efi_secdb_data_t *data,
+	   size_t datasz, efi_secdb_t **secdbp, size_t *slotp)
+{
+	uint64_t hash = secdb_index_hash(data, datasz);
+	list_t *pos;
+
+	for_each_secdb(pos, &top->list) {
+		efi_secdb_t *secdb = list_entry(pos, efi_secdb_t, list);
+		secdb_entry_t *entry;
+
+		if (secdb->algorithm != algorithm)
+			continue;
+
+		entry = secdb_index_find(secdb, owner, hash, data, datasz,
+					 slotp);
+		if (entry) {
+			if (secdbp)
+				*secdbp = secdb;
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * squeeze deleted entries out of a list's arena, keeping the order of the
+ * rest
+ */
+static int
+secdb_compact_entries(efi_secdb_t *secdb)
+{
+	size_t live = 0;
+
+	for (size_t slot = 0; slot < secdb->nslots; slot++) {
+		secdb_entry_t *entry = secdb_entry_at(secdb, slot);
+
+		if (entry->deleted)
+			continue;
+		if (live != slot)
+			memcpy(secdb_entry_at(secdb, live), entry,
+			       secdb->entry_stride);
+		live++;
+	}
+	secdb->nslots = live;
+
+	return secdb_index_rebuild(secdb, live);
+}
+
+/*
+ * sort all of a list's entries by data
+ */
+static int
+secdb_sort_entries(efi_secdb_t *secdb, bool descending)
+{
+	size_t datasz = secdb->entry_datasz;
+
+	qsort_r(secdb->entries, secdb->nslots, secdb->entry_stride,
+		descending ? secdb_entry_cmp_descending : secdb_entry_cmp,
+		&datasz);
+
+	return secdb_index_rebuild(secdb, secdb->nslots);
+}
+
+/*
+ * move the entry just added at the end of a sorted list into place, which
+ * is cheaper than sorting the whole list again
+ */
+static int
+secdb_sort_new_entry(efi_secdb_t *secdb, bool descending)
+{
+	int (*cmp)(const void *, const void *, void *);
+	size_t datasz = secdb->entry_datasz;
+	size_t stride = secdb->entry_stride;
+	size_t last = secdb->nslots - 1;
+	size_t lo = 0, hi = last;
+	uint8_t *tmp;
+
+	cmp = descending ? secdb_entry_cmp_descending : secdb_entry_cmp;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (cmp(secdb_entry_at(secdb, mid),
+			secdb_entry_at(secdb, last), &datasz) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == last)
+		return 0;
+
+	tmp = malloc(stride);
+	if (!tmp) {
+		efi_error("could not allocate %zd bytes", stride);
+		return -1;
+	}
+	memcpy(tmp, secdb_entry_at(secdb, last), stride);
+	memmove(secdb_entry_at(secdb, lo + 1), secdb_entry_at(secdb, lo),
+		(last - lo) * stride);
+	memcpy(secdb_entry_at(secdb, lo), tmp, stride);
+	free(tmp);
+
+	return secdb_index_rebuild(secdb, secdb->nslots);
+}
+
 /*
  * find the secdb entry for a given size and algorithm, or return NULL and set
  * errno to ENOENT if there aren't any.
@@ -83,7 +289,6 @@ alloc_secdb_entry(efi_secdb_t *top,
 	if (!secdb)
 		return NULL;
 
-	INIT_LIST_HEAD(&secdb->entries);
 	INIT_LIST_HEAD(&secdb->list);
 	secdb->algorithm = algorithm;
 	secdb->hdrsz = secdb_header_size_from_type(algorithm);
@@ -135,68 +340,126 @@ efi_secdb_del_entry(efi_secdb_t *top,
 		    efi_secdb_data_t *data,
 		    size_t datasz)
 {
-	efi_secdb_t *secdb;
-	list_t *pos;
-	size_t sigsz = datasz;
+	efi_secdb_t *secdb = NULL;
+	secdb_entry_t *entry;
+	size_t slot = 0;
 	bool has_owner = false;
 
-	if (algorithm != EFI_SECDB_TYPE_X509_CERT)
-		sigsz = secdb_entry_size_from_type(algorithm);
-
 	if (secdb_entry_has_owner_from_type(algorithm, &has_owner) < 0)
 		return -1;
 
-	if (has_owner)
-		sigsz -= sizeof(efi_guid_t);
-
 	if (!top || (has_owner && !owner) || !data || !datasz) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	secdb = find_secdb_entry(top, algorithm, datasz);
-	if (!secdb)
-		return -1;
-
-	for_each_secdb_entry(pos, &secdb->entries) {
-		secdb_entry_t *entry = list_entry(pos, secdb_entry_t, list);
+	/*
+	 * As it always has, deleting an entry that isn't there only fails
+	 * (with ENOENT) when there's no list it could have been in.
+	 */
+	entry = secdb_find(top, has_owner ? owner : NULL, algorithm, data,
+			   datasz, &secdb, &slot);
+	if (!entry)
+		return find_secdb_entry(top, algorithm, datasz) ? 0 : -1;
+
+	debug("deleting entry at %p\n", entry);
+	secdb_index_unlink(secdb, slot);
+	entry->deleted = true;
+	secdb->nsigs -= 1;
+	secdb->listsz = secdb_entry_size(secdb);
 
-		if (!memcmp(data, &entry->data, sigsz) &&
-		    (!has_owner || !efi_guid_cmp(owner, &entry->owner))) {
-			debug("deleting entry at %p\n", &entry);
-			list_del(&entry->list);
-			free(entry);
-			break;
-		}
+	if (secdb->nsigs == 0) {
+		secdb->nslots = 0;
+		memset(secdb->index, 0,
+		       secdb->index_size * sizeof(*secdb->index));
+	} else if (secdb->nslots - secdb->nsigs > secdb->nsigs) {
+		if (secdb_compact_entries(secdb) < 0)
+			return -1;
 	}
 
 	return 0;
 }
 
+/*
+ * test if an entry is in our internal representation; if owner is NULL,
+ * any owner matches.
+ */
+PUBLIC int
+efi_secdb_contains(efi_secdb_t *top,
+		   const efi_guid_t *owner,
+		   efi_secdb_type_t algorithm,
+		   efi_secdb_data_t *data,
+		   size_t datasz)
+{
+	if (!top || !data || !datasz ||
+	    algorithm < 0 || algorithm >= EFI_SECDB_TYPE_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return secdb_find(top, owner, algorithm, data, datasz,
+			  NULL, NULL) != NULL;
+}
+
 static int
 secdb_add_entry_data(efi_secdb_t *secdb,
 		     const efi_guid_t * const owner,
-		     efi_secdb_data_t *data, uint32_t datasz)
+		     efi_secdb_data_t *data, uint32_t datasz,
+		     uint64_t hash)
 {
 	secdb_entry_t *new;
-	size_t allocsz;
+	size_t bucket;
 
 	if (!secdb || !owner || !data || !datasz) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	allocsz = offsetof(secdb_entry_t, data) + datasz;
-	new = calloc(1, allocsz);
-	if (!new)
+	if (secdb->nsigs == 0) {
+		/* a new list, or an emptied one being reused */
+		secdb->nslots = 0;
+		secdb->entry_datasz = datasz;
+		secdb->entry_stride = ALIGN_UP(offsetof(secdb_entry_t, data)
+					       + datasz, sizeof(uint64_t));
+	} else if (datasz != secdb->entry_datasz) {
+		errno = EINVAL;
+		efi_error("entry size %"PRIu32" does not match list entry size %zd",
+			  datasz, secdb->entry_datasz);
+		return -1;
+	}
+
+	if ((secdb->nslots + 1) * secdb->entry_stride > secdb->entries_size) {
+		size_t allocsz = secdb->entries_size ? secdb->entries_size * 2
+						     : 16 * secdb->entry_stride;
+		uint8_t *entries;
+
+		while (allocsz < (secdb->nslots + 1) * secdb->entry_stride)
+			allocsz *= 2;
+		entries = realloc(secdb->entries, allocsz);
+		if (!entries) {
+			efi_error("could not allocate %zd bytes", allocsz);
+			return -1;
+		}
+		secdb->entries = entries;
+		secdb->entries_size = allocsz;
+	}
+
+	if (secdb->nslots >= secdb->index_size &&
+	    secdb_index_rebuild(secdb, secdb->nslots + 1) < 0)
 		return -1;
 
-	INIT_LIST_HEAD(&new->list);
+	new = secdb_entry_at(secdb, secdb->nslots);
+	memset(new, 0, secdb->entry_stride);
 	memcpy(&new->data, data, datasz);
 	memcpy(&new->owner, owner, sizeof(efi_guid_t));
+	new->hash = hash;
+	bucket = hash & (secdb->index_size - 1);
+	new->index_next = secdb->index[bucket];
+	secdb->index[bucket] = secdb->nslots + 1;
+	secdb->nslots += 1;
+
 	debug("Adding to secdb:%p entry:%p owner:%p data:%p datasz:%"PRIu32"(0x%"PRIx32")",
 	      secdb, new, &new->owner, &new->data, datasz, datasz);
-	list_add_tail(&new->list, &secdb->entries);
 	debug("nsigs:%zd -> %zd", secdb->nsigs, secdb->nsigs+1);
 	secdb->nsigs += 1;
 	if (secdb->nsigs == 1 &&
@@ -221,10 +484,10 @@ efi_secdb_add_entry_or_secdb(efi_secdb_t *top,
 			     size_t datasz,
 			     bool force_new_secdb)
 {
-	list_t *pos;
 	efi_secdb_t *secdb = NULL;
 	bool has_owner = false;
 	size_t sigsz;
+	uint64_t hash;
 	bool sort = false;
 	bool sort_data = false;
 	bool sort_descending = false;
@@ -258,19 +521,31 @@ efi_secdb_add_entry_or_secdb(efi_secdb_t *top,
 	sort_data = secdb->flags & (1ul << EFI_SECDB_SORT_DATA);
 	sort_descending = secdb->flags & (1ul << EFI_SECDB_SORT_DESCENDING);
 
-	for_each_secdb_entry(pos, &secdb->entries) {
-		secdb_entry_t *entry = list_entry(pos, secdb_entry_t, list);
-		if (!memcmp(data, &entry->data, datasz))
-			return 0;
-	}
+	hash = secdb_index_hash(data, datasz);
+	if (secdb_index_find(secdb, NULL, hash, data, datasz, NULL))
+		return 0;
 
 	debug("adding %zd(0x%lx) bytes of data", datasz, datasz);
-	secdb_add_entry_data(secdb, owner, data, datasz);
+	if (secdb_add_entry_data(secdb, owner, data, datasz, hash) < 0)
+		return -1;
 	if (sort_data && secdb->sigsz) {
+		int rc;
+
 		debug("sorting data %s", sort_descending ? "desc" : "asc");
-		cmp = sort_descending ? secdb_entry_cmp_descending
-				      : secdb_entry_cmp;
-		list_sort(&secdb->entries, cmp, &datasz);
+		/*
+		 * Only a list that's already sorted this way can take the
+		 * new entry by insertion; anything else gets sorted whole.
+		 */
+		if (secdb->sorted && secdb->sorted_descending == sort_descending)
+			rc = secdb_sort_new_entry(secdb, sort_descending);
+		else
+			rc = secdb_sort_entries(secdb, sort_descending);
+		if (rc < 0)
+			return -1;
+		secdb->sorted = true;
+		secdb->sorted_descending = sort_descending;
+	} else {
+		secdb->sorted = false;
 	}
 	if (sort) {
 		debug("sorting lists %s", sort_descending ? "desc" : "asc");
@@ -299,6 +574,8 @@ efi_secdb_add_entry(efi_secdb_t *top,
 int PUBLIC
 efi_secdb_set_bool(efi_secdb_t *secdb, efi_secdb_flag_t flag, bool value)
 {
+	list_t *pos;
+
 	if (!secdb) {
 		efi_error("invalid secdb");
 		errno = EINVAL;
@@ -315,6 +592,21 @@ efi_secdb_set_bool(efi_secdb_t *secdb, efi_secdb_flag_t flag, bool value)
 		secdb->flags |= (1ul << flag);
 	else
 		secdb->flags &= ~(1ul << flag);
+	secdb->sorted = false;
+
+	/*
+	 * The lists we already have take the new setting as well, so it
+	 * applies to whatever gets added to them next.
+	 */
+	for_each_secdb(pos, &secdb->list) {
+		efi_secdb_t *list = list_entry(pos, efi_secdb_t, list);
+
+		if (value)
+			list->flags |= (1ul << flag);
+		else
+			list->flags &= ~(1ul << flag);
+		list->sorted = false;
+	}
 
 	return 0;
 }
@@ -436,93 +728,127 @@ efi_secdb_parse(uint8_t *data, size_t datasz, efi_secdb_t **secdbp)
 	return 0;
 }
 
-struct visitor_state {
-	/* listnum from the previous invocation */
-	unsigned int listnum;
+/*
+ * the size of each signature in a list once it's realized, and whether
+ * that includes the owner
+ */
+static size_t
+secdb_realized_esd_size(efi_secdb_t *secdb, bool *has_owner)
+{
+	*has_owner = true;
+	if (secdb_entry_has_owner_from_type(secdb->algorithm, has_owner) < 0)
+		efi_error("could not determine signature type");
 
-	efi_signature_list_t *esl;
+	return secdb->entry_datasz + (*has_owner ? sizeof(efi_guid_t) : 0);
+}
 
-	char *buf;
-	size_t pos;
-};
+/*
+ * the exact size of the signature list file we'll realize
+ */
+static ssize_t
+secdb_realized_size(efi_secdb_t *top)
+{
+	size_t total = 0;
+	list_t *pos;
+
+	for_each_secdb(pos, &top->list) {
+		efi_secdb_t *secdb = list_entry(pos, efi_secdb_t, list);
+		bool has_owner;
+		size_t esdsz, listsz;
+
+		if (secdb->nsigs == 0)
+			continue;
+
+		esdsz = secdb_realized_esd_size(secdb, &has_owner);
+		if (MUL(secdb->nsigs, esdsz, &listsz) ||
+		    ADD(listsz, sizeof(efi_signature_list_t), &listsz) ||
+		    listsz > UINT32_MAX ||
+		    ADD(total, listsz, &total) ||
+		    total > SSIZE_MAX) {
+			errno = EOVERFLOW;
+			efi_error("signature list is too large");
+			return -1;
+		}
+	}
+
+	return total;
+}
+
+static void
+secdb_realize_esl(efi_secdb_t *secdb, size_t esdsz, efi_signature_list_t *esl)
+{
+	memset(esl, 0, sizeof(*esl));
+	memcpy(&esl->signature_type, secdb_guid_from_type(secdb->algorithm),
+	       sizeof(efi_guid_t));
+	esl->signature_list_size = sizeof(*esl) + secdb->nsigs * esdsz;
+	esl->signature_header_size = 0;
+	esl->signature_size = esdsz;
+}
 
 /*
- * realize a signature list file from our internal representation into
+ * the realized signature is the owner followed by the data, which is
+ * exactly how our entries store it
  */
-static efi_secdb_visitor_status_t
-secdb_realize_visitor(unsigned int listnum,
-		      unsigned int signum,
-		      const efi_guid_t * const owner,
-		      const efi_secdb_type_t algorithm,
-		      const void * const header,
-		      const size_t headersz,
-		      const efi_secdb_data_t * const data,
-		      const size_t datasz,
-		      void *closure)
-{
-	struct visitor_state *state = closure;
-	const efi_guid_t *alg = secdb_guid_from_type(algorithm);
-	char *buf;
-	size_t allocsz, esdsz;
-	ptrdiff_t skew;
-	efi_signature_list_t *esl;
-	efi_signature_data_t *esd;
-	bool has_owner = true;
-	int rc;
+static inline const void *
+secdb_realized_esd(secdb_entry_t *entry, bool has_owner)
+{
+	return has_owner ? (const void *)&entry->owner
+			 : (const void *)&entry->data;
+}
 
-	rc = secdb_entry_has_owner_from_type(algorithm, &has_owner);
-	if (rc < 0)
-		efi_error("could not determine signature type");
+static_assert(offsetof(secdb_entry_t, data) ==
+	      offsetof(secdb_entry_t, owner) + sizeof(efi_guid_t),
+	      "secdb_entry_t data must immediately follow owner");
+
+/*
+ * realize a signature list file from our internal representation into a
+ * buffer.  If buf is NULL or bufsize is 0, just return the size needed.
+ */
+PUBLIC ssize_t
+efi_secdb_realize_buf(efi_secdb_t *top, void *buf, size_t bufsize)
+{
+	uint8_t *pos = buf;
+	ssize_t needed;
+	list_t *lpos;
 
-	esdsz = datasz + (has_owner ? sizeof(efi_guid_t) : 0);
+	if (!top) {
+		errno = EINVAL;
+		efi_error("invalid secdb");
+		return -1;
+	}
 
-	debug("listnum:%d signum:%d has_owner:%d", listnum, signum, has_owner);
-	if (listnum > state->listnum || signum == 0) {
-		allocsz = state->pos + sizeof(state->esl) + headersz + esdsz;
-		allocsz = ALIGN_UP(allocsz, page_size);
-		buf = realloc(state->buf, allocsz);
-		if (!buf) {
-			efi_error("could not allocate %zd bytes", allocsz);
-			return EFI_SECDB_VISITOR_ERROR;
-		}
-		esl = (efi_signature_list_t *)(buf + state->pos);
-		state->buf = buf;
-		state->esl = esl;
-		memset(buf + state->pos, 0, allocsz - state->pos);
-
-		memcpy(&esl->signature_type, alg, sizeof(efi_guid_t));
-		esl->signature_list_size = sizeof(efi_signature_list_t) + headersz;
-		esl->signature_header_size = headersz;
-		esl->signature_size = esdsz;
-		state->pos += sizeof(*esl);
-		if (header && headersz > 0)
-			memcpy(buf+state->pos, header, headersz);
-		state->pos += headersz;
-		esd = (efi_signature_data_t *)(buf + state->pos);
-	} else {
-		allocsz = ALIGN_UP(state->pos + esdsz, page_size);
-		buf = realloc(state->buf, allocsz);
-		skew = buf - state->buf;
-		if (!buf) {
-			efi_error("could not allocate %zd bytes", allocsz);
-			return EFI_SECDB_VISITOR_ERROR;
-		}
-		memset(buf + state->pos, 0, allocsz - state->pos);
-		esl = (efi_signature_list_t *)((char *)state->esl + skew);
-		state->buf = buf;
-		state->esl = esl;
-		esd = (efi_signature_data_t *)(buf + state->pos);
+	needed = secdb_realized_size(top);
+	if (needed < 0 || !buf || bufsize == 0)
+		return needed;
+
+	if (bufsize < (size_t)needed) {
+		errno = ENOSPC;
+		efi_error("needed %zd bytes but buffer is %zd bytes",
+			  needed, bufsize);
+		return -1;
 	}
-	debug("esl[%u]:%p esd[%u]:%p", listnum, esl, signum, esd);
 
-	memcpy(&esd->signature_owner, owner, sizeof(efi_guid_t));
-	memcpy(&esd->signature_data[0], data, datasz);
-	esl->signature_list_size += esdsz;
+	for_each_secdb(lpos, &top->list) {
+		efi_secdb_t *secdb = list_entry(lpos, efi_secdb_t, list);
+		secdb_entry_t *entry;
+		bool has_owner;
+		size_t esdsz;
 
-	state->pos += esdsz;
-	state->listnum = listnum;
+		if (secdb->nsigs == 0)
+			continue;
 
-	return EFI_SECDB_VISITOR_CONTINUE;
+		esdsz = secdb_realized_esd_size(secdb, &has_owner);
+		secdb_realize_esl(secdb, esdsz, (efi_signature_list_t *)pos);
+		pos += sizeof(efi_signature_list_t);
+
+		for_each_secdb_entry(entry, secdb) {
+			memcpy(pos, secdb_realized_esd(entry, has_owner),
+			       esdsz);
+			pos += esdsz;
+		}
+	}
+
+	return needed;
 }
 
 /*
@@ -531,20 +857,110 @@ secdb_realize_visitor(unsigned int listnum,
 PUBLIC int
 efi_secdb_realize(efi_secdb_t *secdb, void **out, size_t *outsize)
 {
+	ssize_t size;
+	void *buf;
 
-	struct visitor_state state = { 0, };
+	size = efi_secdb_realize_buf(secdb, NULL, 0);
+	if (size < 0)
+		return -1;
 
-	state.buf = calloc(1, page_size);
-	state.esl = (efi_signature_list_t *)state.buf;
-	if (!state.buf) {
-		efi_error("could not allocate %zd bytes", page_size);
-		return EFI_SECDB_VISITOR_ERROR;
+	buf = malloc(size ? size : 1);
+	if (!buf) {
+		efi_error("could not allocate %zd bytes", size);
+		return -1;
 	}
 
-	efi_secdb_visit_entries(secdb, secdb_realize_visitor, &state);
+	if (size > 0 && efi_secdb_realize_buf(secdb, buf, size) < 0) {
+		free(buf);
+		return -1;
+	}
 
-	*out = state.buf;
-	*outsize = state.pos;
+	*out = buf;
+	*outsize = size;
+
+	return 0;
+}
+
+static int
+writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t rc = writev(fd, iov, iovcnt);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc < 0) {
+			efi_error("could not write signature list");
+			return -1;
+		}
+
+		while (iovcnt > 0 && (size_t)rc >= iov->iov_len) {
+			rc -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+	return 0;
+}
+
+/*
+ * realize a signature list file from our internal representation
+ * straight to a file descriptor, without building it in memory first
+ */
+PUBLIC int
+efi_secdb_realize_fd(efi_secdb_t *top, int fd)
+{
+	struct iovec iov[IOV_MAX];
+	efi_signature_list_t esl;
+	int iovcnt = 0;
+	list_t *lpos;
+
+	if (!top || fd < 0) {
+		errno = EINVAL;
+		efi_error("invalid parameter");
+		return -1;
+	}
+
+	if (secdb_realized_size(top) < 0)
+		return -1;
+
+	for_each_secdb(lpos, &top->list) {
+		efi_secdb_t *secdb = list_entry(lpos, efi_secdb_t, list);
+		secdb_entry_t *entry;
+		bool has_owner;
+		size_t esdsz;
+
+		if (secdb->nsigs == 0)
+			continue;
+
+		/* the ESL header lives on our stack, so send it now */
+		if (iovcnt > 0 && writev_all(fd, iov, iovcnt) < 0)
+			return -1;
+		iovcnt = 0;
+
+		esdsz = secdb_realized_esd_size(secdb, &has_owner);
+		secdb_realize_esl(secdb, esdsz, &esl);
+		iov[iovcnt].iov_base = &esl;
+		iov[iovcnt++].iov_len = sizeof(esl);
+
+		for_each_secdb_entry(entry, secdb) {
+			if (iovcnt == IOV_MAX) {
+				if (writev_all(fd, iov, iovcnt) < 0)
+					return -1;
+				iovcnt = 0;
+			}
+			iov[iovcnt].iov_base =
+				(void *)secdb_realized_esd(entry, has_owner);
+			iov[iovcnt++].iov_len = esdsz;
+		}
+	}
+
+	if (iovcnt > 0 && writev_all(fd, iov, iovcnt) < 0)
+		return -1;
 
 	return 0;
 }
@@ -556,24 +972,11 @@ efi_secdb_realize(efi_secdb_t *secdb, void **out, size_t *outsize)
 void
 secdb_free_entry(efi_secdb_t *secdb)
 {
-	list_t *pos = NULL, *tmp = NULL;
-
 	if (!secdb)
 		return;
 
-	for_each_secdb_entry_safe(pos, tmp, &secdb->entries) {
-		secdb_entry_t *entry = list_entry(pos, secdb_entry_t, list);
-		bool has_owner = true;
-		int rc;
-
-		rc = secdb_entry_has_owner_from_type(secdb->algorithm, &has_owner);
-		if (rc < 0)
-			efi_error("could not determine signature type");
-
-		list_del(&entry->list);
-		xfree(entry);
-	}
-
+	xfree(secdb->entries);
+	xfree(secdb->index);
 	memset(secdb, 0, sizeof(*secdb));
 	xfree(secdb);
 }
@@ -603,7 +1006,7 @@ secdb_visit_entries(efi_secdb_t *secdb, int i,
 		    void *closure)
 {
 	int j = 0;
-	list_t *pos;
+	secdb_entry_t *entry;
 	size_t datasz;
 	bool has_owner = true;
 	int rc;
@@ -615,13 +1018,9 @@ secdb_visit_entries(efi_secdb_t *secdb, int i,
 	}
 	datasz = secdb->sigsz - (has_owner ? sizeof(efi_guid_t) : 0);
 
-	for_each_secdb_entry(pos, &secdb->entries) {
-		secdb_entry_t *entry = list_entry(pos, secdb_entry_t, list);
+	for_each_secdb_entry(entry, secdb) {
 		efi_secdb_visitor_status_t status;
 
-		debug("secdb[%d]:%p entry[%d]:%p pos:%p = {%p, %p}",
-		      i, secdb, j, entry, pos,
-		      pos ? pos->prev : 0, pos ? pos->next : 0);
 		debug("secdb[%d]:%p entry[%d]:%p owner:"GUID_FORMAT" data:%p-%p datasz:%zd",
 		      i, secdb, j, entry, GUID_FORMAT_ARGS(&entry->owner),
 		      &entry->data, &entry->data+datasz, datasz);
@@ -683,8 +1082,8 @@ bytecmp(const void *ap, const void *bp, size_t sz)
 int
 secdb_entry_cmp(const void *ap, const void *bp, void *state)
 {
-	const secdb_entry_t *a = *(const secdb_entry_t **)ap;
-	const secdb_entry_t *b = *(const secdb_entry_t **)bp;
+	const secdb_entry_t *a = ap;
+	const secdb_entry_t *b = bp;
 	size_t sigsz = *(size_t *)state;
 	int rc;
 
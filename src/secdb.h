@@ -27,7 +27,10 @@ typedef struct {
 } secdb_alg_t;
 
 struct secdb_entry {
-	list_t list;
+	uint64_t hash;			// index hash of data
+	size_t index_next;		// slot + 1 of the next entry in our
+					// index bucket, or 0
+	bool deleted;			// slot is free until the next compaction
 	efi_guid_t owner;
 	efi_secdb_data_t data;
 };
@@ -38,6 +41,9 @@ typedef struct secdb_entry secdb_entry_t;
  * {owner, algorithm, size}; i.e. all efi_guid_x509_sha512 with the same     *
  * owner can go on the same entry, but each efi_guid_x509_cert of a          *
  * different size needs its own                                              *
+ *                                                                           *
+ * The signature data entries of each list are stored back to back in one   *
+ * arena, entry_stride bytes apart, with a hash index of their slots.        *
  *****************************************************************************/
 struct efi_secdb {
 	list_t list;			// link to our next signature sublist
@@ -49,14 +55,22 @@ struct efi_secdb {
 	uint32_t sigsz;			// size of each signature
 	size_t nsigs;			// number of signatures
 	void *header;			// unused
-	list_t entries;			// list of signature data entries
+
+	uint8_t *entries;		// arena of signature data entries
+	size_t entries_size;		// allocated size of the arena
+	size_t entry_datasz;		// data size of each entry
+	size_t entry_stride;		// distance between entries
+	size_t nslots;			// slots used, including deleted ones
+	bool sorted;			// entries are sorted by data...
+	bool sorted_descending;		// ... in this direction
+
+	size_t *index;			// hash buckets of slot + 1, or 0
+	size_t index_size;		// number of hash buckets
 };
 
 #define for_each_secdb(pos, head) list_for_each(pos, head)
 #define for_each_secdb_safe(pos, n, head) list_for_each_safe(pos, n, head)
 #define for_each_secdb_prev(pos, head) list_for_each_prev(pos, head)
-#define for_each_secdb_entry(pos, head) list_for_each(pos, head)
-#define for_each_secdb_entry_safe(pos, n, head) list_for_each_safe(pos, n, head)
 
 extern const secdb_alg_t PUBLIC efi_secdb_algs_[EFI_SECDB_TYPE_MAX];
 
@@ -206,6 +220,31 @@ secdb_size(efi_secdb_t *secdb)
 	return sz;
 }
 
+static inline secdb_entry_t *
+secdb_entry_at(efi_secdb_t *secdb, size_t slot)
+{
+	return (secdb_entry_t *)(secdb->entries + slot * secdb->entry_stride);
+}
+
+/*
+ * find the next live entry at or after *slot, and move *slot past it
+ */
+static inline secdb_entry_t *
+secdb_next_entry(efi_secdb_t *secdb, size_t *slot)
+{
+	while (*slot < secdb->nslots) {
+		secdb_entry_t *entry = secdb_entry_at(secdb, (*slot)++);
+
+		if (!entry->deleted)
+			return entry;
+	}
+	return NULL;
+}
+
+#define for_each_secdb_entry(pos, secdb)				\
+	for (size_t pos##_slot_ = 0;					\
+	     ((pos) = secdb_next_entry((secdb), &pos##_slot_)) != NULL; )
+
 /*
  * compare secdb_entry_t items
  */
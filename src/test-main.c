@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * test-main.c - the command line shared by the library check programs
+ */
+
+#include "fix_coverity.h" // IWYU pragma: keep
+
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test-main.h"
+
+int verbosity = 0;
+unsigned long iterations = TEST_LOOP_COUNT;
+
+static void __attribute__((__noreturn__))
+usage(int ret)
+{
+	FILE *out = ret == EXIT_SUCCESS ? stdout : stderr;
+
+	fprintf(out,
+		"Usage: %s [OPTION...] TEST...\n"
+		"%s  TEST is one of:\n"
+		"  ",
+		program_invocation_short_name, test_program.description);
+	for (size_t i = 0; i < test_program.ntests; i++)
+		fprintf(out, "%s%s", i ? ", " : "", test_program.tests[i].name);
+	fprintf(out, "\n\n");
+	if (test_program.timed)
+		fprintf(out,
+			"  -n, --iterations=<n>  Repeat each timed loop <n> times (default %d)\n",
+			TEST_LOOP_COUNT);
+	fprintf(out,
+		"  -v, --verbose         %s\n"
+		"  -?, --help            Show this help message\n",
+		test_program.verbose_help);
+	exit(ret);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *sopts = test_program.timed ? "n:v?" : "v?";
+	const struct option lopts[] = {
+		{"help", no_argument, 0, '?'},
+		{"verbose", no_argument, 0, 'v'},
+		{"iterations", required_argument, 0, 'n'},
+		{0, 0, 0, 0}
+	};
+	int ret = EXIT_SUCCESS;
+	int c;
+
+	while ((c = getopt_long(argc, argv, sopts, lopts, NULL)) != -1) {
+		char *end = NULL;
+
+		switch (c) {
+		case 'n':
+			if (!test_program.timed)
+				usage(EXIT_FAILURE);
+			errno = 0;
+			iterations = strtoul(optarg, &end, 10);
+			if (errno || !end || *end || iterations == 0)
+				errx(EXIT_FAILURE, "invalid iteration count \"%s\"",
+				     optarg);
+			break;
+		case 'v':
+			verbosity += 1;
+			break;
+		case '?':
+			usage(optopt ? EXIT_FAILURE : EXIT_SUCCESS);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+		}
+	}
+
+	if (optind == argc)
+		usage(EXIT_FAILURE);
+
+	for (int i = optind; i < argc; i++) {
+		const struct test *test = NULL;
+
+		for (size_t j = 0; j < test_program.ntests; j++) {
+			if (!strcmp(argv[i], test_program.tests[j].name)) {
+				test = &test_program.tests[j];
+				break;
+			}
+		}
+		if (!test) {
+			warnx("unknown test \"%s\"", argv[i]);
+			usage(EXIT_FAILURE);
+		}
+		if (test->test() < 0) {
+			warnx("%s test failed", test->name);
+			ret = EXIT_FAILURE;
+		}
+	}
+
+	return ret;
+}
+
+// vim:fenc=utf-8:tw=75:noet
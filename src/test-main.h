@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ * test-main.h - the command line shared by the library check programs
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TEST_LOOP_COUNT 100
+
+struct test {
+	const char *name;
+	int (*test)(void);
+};
+
+/*
+ * Each check program defines test_program; test-main.c parses the command
+ * line and runs every TEST named on it from tests.
+ */
+struct test_program {
+	const char *description;	/* --help text before the TEST list */
+	const char *verbose_help;	/* --help text for -v */
+	bool timed;			/* accept -n for timed loops */
+	const struct test *tests;
+	size_t ntests;
+};
+
+extern const struct test_program test_program;
+
+extern int verbosity;
+extern unsigned long iterations;
+
+// vim:fenc=utf-8:tw=75:noet
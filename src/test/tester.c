@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -156,6 +157,45 @@ int do_test(struct test *test)
 			   EFI_VARIABLE_NON_VOLATILE))
 		report_error(test, ret, rc, "get test failed: wrong attributes\n");
 
+	printf("testing efi_get_variable_snapshot()\n");
+	efi_variable_snapshot_entry_t *snapshot = NULL;
+	size_t n_snapshot = 0;
+	bool found = false;
+	rc = efi_get_variable_snapshot(&snapshot, &n_snapshot);
+	if (rc < 0)
+		report_error(test, ret, rc, "snapshot test failed: %m\n");
+
+	for (size_t i = 0; i < n_snapshot; i++) {
+		efi_guid_t guid = TEST_GUID;
+
+		if (memcmp(&snapshot[i].guid, &guid, sizeof(guid)) ||
+		    strcmp(snapshot[i].name, test->name))
+			continue;
+		found = snapshot[i].data_size == test->size &&
+			snapshot[i].attributes == attributes &&
+			(test->size == 0 ||
+			 !memcmp(snapshot[i].data, testdata, test->size));
+		break;
+	}
+	efi_free_variable_snapshot(snapshot);
+	if (!found)
+		report_error(test, ret, -1, "snapshot test failed: variable missing or wrong\n");
+
+	printf("testing efi_stat_variable()\n");
+	datasize = 0;
+	attributes = 0;
+	rc = efi_stat_variable(TEST_GUID, test->name, &datasize, &attributes);
+	if (rc < 0)
+		report_error(test, ret, rc, "stat test failed: %m\n");
+
+	if (datasize != test->size)
+		report_error(test, ret, -1, "stat test failed: wrong size: %zd should be %zd\n", datasize, test->size);
+
+	if (attributes != (EFI_VARIABLE_BOOTSERVICE_ACCESS |
+			   EFI_VARIABLE_RUNTIME_ACCESS |
+			   EFI_VARIABLE_NON_VOLATILE))
+		report_error(test, ret, rc, "stat test failed: wrong attributes\n");
+
 	printf("testing efi_get_variable_attributes()\n");
 	rc = efi_get_variable_attributes(TEST_GUID, test->name, &attributes);
 	if (rc < 0)
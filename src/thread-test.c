@@ -10,15 +10,19 @@
 #include <efivar.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <inttypes.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+
 #define LOOP_COUNT 100
 
 static int verbosity = 0;
@@ -97,6 +101,321 @@ static void *loop_get_variable_size_test(void *_ __attribute__((__unused__)))
 	return TEST_SUCCESS;
 }
 
+#define ENUMERATE_VARIABLES 32
+#define ENUMERATE_GUID EFI_GUID(0x84be9c3e,0x8a32,0x42c0,0x891c,0x4c,0xd3,0xb0,0x72,0xbe,0xcc)
+
+static int count_variables(unsigned depth)
+{
+	efi_variable_iter_t *iter = NULL;
+	efi_guid_t *guid = NULL;
+	char *name = NULL;
+	int count = 0;
+	int result;
+
+	result = efi_variable_iter_new(&iter);
+	if (result < 0) {
+		warn("efi_variable_iter_new failed");
+		return -1;
+	}
+
+	while ((result = efi_variable_iter_next(iter, &guid, &name)) > 0) {
+		efi_guid_t expected = ENUMERATE_GUID;
+
+		if (memcmp(guid, &expected, sizeof(expected)) ||
+		    strncmp(name, "enum", 4)) {
+			warnx("unexpected variable \"%s\"", name);
+			count = -1;
+			break;
+		}
+		/* a nested walk must not disturb this one */
+		if (depth > 0 && count == ENUMERATE_VARIABLES / 2 &&
+		    count_variables(depth - 1) != ENUMERATE_VARIABLES) {
+			warnx("nested enumeration failed");
+			count = -1;
+			break;
+		}
+		count++;
+	}
+	if (result < 0) {
+		warn("efi_variable_iter_next failed");
+		count = -1;
+	}
+
+	efi_variable_iter_free(iter);
+	return count;
+}
+
+static void *loop_enumerate_test(void *_ __attribute__((__unused__)))
+{
+	if (verbosity >= 2)
+		printf("[DEBUG] test running on new thread!\n");
+	for (unsigned i = 0; i < LOOP_COUNT; i++) {
+		int result;
+
+		result = count_variables(1);
+		if (result != ENUMERATE_VARIABLES) {
+			warnx("fail, iteration=%u, found %d variables, expected %d",
+			      i, result, ENUMERATE_VARIABLES);
+			return TEST_FAIL;
+		} else if (verbosity >= 2) {
+			printf("[DEBUG] iteration=%u, found %d variables\n", i, result);
+		}
+	}
+	return TEST_SUCCESS;
+}
+
+static void *loop_cache_test(void *_ __attribute__((__unused__)))
+{
+	if (verbosity >= 2)
+		printf("[DEBUG] test running on new thread!\n");
+	for (unsigned i = 0; i < LOOP_COUNT; i++) {
+		unsigned n = i % ENUMERATE_VARIABLES;
+		char name[16];
+		uint8_t *data = NULL;
+		size_t size = 0;
+		uint32_t attributes = 0;
+		int result;
+
+		snprintf(name, sizeof(name), "enum%u", n);
+		result = efi_get_variable(ENUMERATE_GUID, name, &data, &size,
+					  &attributes);
+		if (result < 0 || size != 1 || data[0] != n) {
+			warnx("fail, iteration=%u, result=%d size=%zd",
+			      i, result, size);
+			free(data);
+			return TEST_FAIL;
+		}
+		free(data);
+	}
+	return TEST_SUCCESS;
+}
+
+#define CACHE_ATTRS (EFI_VARIABLE_BOOTSERVICE_ACCESS |	\
+		     EFI_VARIABLE_RUNTIME_ACCESS |		\
+		     EFI_VARIABLE_NON_VOLATILE)
+
+/*
+ * Check that a get after a cached one returns data ending in the
+ * expected bytes, or fails with ENOENT when expected is NULL.  Only the
+ * tail is compared because in a scratch directory, which isn't really
+ * efivarfs, an append writes the attributes again along with the data.
+ */
+static int check_cached_variable(const char *name, const uint8_t *expected,
+				 size_t expected_size, const char *after)
+{
+	uint8_t *data = NULL;
+	size_t size = 0;
+	uint32_t attributes = 0;
+	int result;
+
+	result = efi_get_variable(ENUMERATE_GUID, name, &data, &size,
+				  &attributes);
+	if (!expected) {
+		if (result == 0 || errno != ENOENT) {
+			warnx("%s still found after %s", name, after);
+			free(data);
+			return -1;
+		}
+		return 0;
+	}
+	if (result < 0 || size < expected_size ||
+	    memcmp(data + size - expected_size, expected, expected_size)) {
+		warnx("%s returned stale data after %s", name, after);
+		free(data);
+		return -1;
+	}
+	free(data);
+	return 0;
+}
+
+/*
+ * Write a variable's efivarfs file directly, behind the library's back,
+ * the way another process would.
+ */
+static int write_behind_cache(const char *name, const uint8_t *data,
+			      size_t size)
+{
+	const char *path = getenv("EFIVARFS_PATH");
+	efi_guid_t guid = ENUMERATE_GUID;
+	uint32_t attributes = CACHE_ATTRS;
+	char *guidstr = NULL;
+	char *filename = NULL;
+	int fd = -1;
+	int rc = -1;
+
+	if (efi_guid_to_str(&guid, &guidstr) < 0 ||
+	    asprintf(&filename, "%s%s-%s", path, name, guidstr) < 0) {
+		warn("could not make the path for %s", name);
+		goto out;
+	}
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0 ||
+	    write(fd, &attributes, sizeof(attributes)) != sizeof(attributes) ||
+	    write(fd, data, size) != (ssize_t)size) {
+		warn("could not write %s", filename);
+		goto out;
+	}
+	rc = 0;
+out:
+	if (fd >= 0)
+		close(fd);
+	free(filename);
+	free(guidstr);
+	return rc;
+}
+
+static int remove_behind_cache(const char *name)
+{
+	const char *path = getenv("EFIVARFS_PATH");
+	efi_guid_t guid = ENUMERATE_GUID;
+	char *guidstr = NULL;
+	char *filename = NULL;
+	int rc = -1;
+
+	if (efi_guid_to_str(&guid, &guidstr) < 0 ||
+	    asprintf(&filename, "%s%s-%s", path, name, guidstr) < 0) {
+		warn("could not make the path for %s", name);
+		goto out;
+	}
+	rc = unlink(filename);
+	if (rc < 0)
+		warn("could not remove %s", filename);
+out:
+	free(filename);
+	free(guidstr);
+	return rc;
+}
+
+/*
+ * Once the cache holds the enum* variables, change some of them, both
+ * with the library's own calls and by writing the files directly, and
+ * make sure the next get sees each change.
+ */
+static int cache_invalidation_test(void)
+{
+	const uint8_t set[] = { 0x40 };
+	const uint8_t appended[] = { 0x41 };
+	const uint8_t outside[] = { 0x51, 0x52, 0x53 };
+	const uint8_t created[] = { 0x61 };
+	const uint8_t orig[] = { 0, 1, 2 };
+
+	/* the library's own writes */
+	if (check_cached_variable("enum0", &orig[0], 1, "caching") < 0 ||
+	    efi_set_variable(ENUMERATE_GUID, "enum0", (uint8_t *)set,
+			     sizeof(set), CACHE_ATTRS, 0600) < 0 ||
+	    check_cached_variable("enum0", set, sizeof(set),
+				  "efi_set_variable()") < 0 ||
+	    efi_append_variable(ENUMERATE_GUID, "enum0",
+				(uint8_t *)appended, sizeof(appended),
+				CACHE_ATTRS) < 0 ||
+	    check_cached_variable("enum0", appended, sizeof(appended),
+				  "efi_append_variable()") < 0 ||
+	    efi_del_variable(ENUMERATE_GUID, "enum0") < 0 ||
+	    check_cached_variable("enum0", NULL, 0,
+				  "efi_del_variable()") < 0)
+		return -1;
+
+	/* and somebody else's, which the cache only hears about by inotify */
+	if (!getenv("EFIVARFS_PATH"))
+		return 0;
+	if (check_cached_variable("enum1", &orig[1], 1, "caching") < 0 ||
+	    write_behind_cache("enum1", outside, sizeof(outside)) < 0 ||
+	    check_cached_variable("enum1", outside, sizeof(outside),
+				  "an outside write") < 0 ||
+	    check_cached_variable("enum2", &orig[2], 1, "caching") < 0 ||
+	    remove_behind_cache("enum2") < 0 ||
+	    check_cached_variable("enum2", NULL, 0,
+				  "an outside delete") < 0 ||
+	    check_cached_variable("enum0", NULL, 0, "caching") < 0 ||
+	    write_behind_cache("enum0", created, sizeof(created)) < 0 ||
+	    check_cached_variable("enum0", created, sizeof(created),
+				  "an outside create") < 0)
+		return -1;
+	return 0;
+}
+
+#define UPDATE_NAME "counter"
+
+static unsigned long update_retries;
+
+/*
+ * Every thread increments one shared counter variable LOOP_COUNT times
+ * with efi_update_variable_if(), re-reading it whenever another thread
+ * got there first; no increment may be lost.
+ */
+static void *loop_update_test(void *_ __attribute__((__unused__)))
+{
+	unsigned long retries = 0;
+
+	if (verbosity >= 2)
+		printf("[DEBUG] test running on new thread!\n");
+	for (unsigned i = 0; i < LOOP_COUNT; i++) {
+		int result;
+
+		do {
+			uint8_t *data = NULL;
+			size_t size = 0;
+			uint32_t attributes = 0;
+			uint32_t value;
+
+			result = efi_get_variable(ENUMERATE_GUID, UPDATE_NAME,
+						  &data, &size, &attributes);
+			if (result < 0 || size != sizeof(value)) {
+				warnx("fail, iteration=%u, result=%d size=%zd",
+				      i, result, size);
+				free(data);
+				return TEST_FAIL;
+			}
+			memcpy(&value, data, sizeof(value));
+			value += 1;
+			result = efi_update_variable_if(ENUMERATE_GUID,
+							UPDATE_NAME,
+							data, size,
+							(uint8_t *)&value,
+							sizeof(value),
+							attributes, 0600);
+			free(data);
+			if (result < 0 && errno != ESTALE) {
+				warn("fail, iteration=%u, efi_update_variable_if",
+				     i);
+				return TEST_FAIL;
+			}
+			if (result < 0)
+				retries += 1;
+		} while (result < 0);
+	}
+	__atomic_add_fetch(&update_retries, retries, __ATOMIC_RELAXED);
+	return TEST_SUCCESS;
+}
+
+static int setup_enumerate_test(void)
+{
+	for (unsigned i = 0; i < ENUMERATE_VARIABLES; i++) {
+		char name[16];
+		uint8_t data = i;
+		int result;
+
+		snprintf(name, sizeof(name), "enum%u", i);
+		result = efi_set_variable(ENUMERATE_GUID, name, &data,
+					  sizeof(data), CACHE_ATTRS, 0600);
+		if (result < 0) {
+			warn("efi_set_variable(%s) failed", name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void cleanup_enumerate_test(void)
+{
+	for (unsigned i = 0; i < ENUMERATE_VARIABLES; i++) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "enum%u", i);
+		efi_del_variable(ENUMERATE_GUID, name);
+	}
+}
+
 static int multithreaded_test(size_t count, void *(*test_func)(void *))
 {
 	pthread_t *threads = alloca(sizeof(pthread_t) * count);
@@ -114,6 +433,58 @@ static int multithreaded_test(size_t count, void *(*test_func)(void *))
 	return (worst_result == TEST_SUCCESS) ? 0 : -1;
 }
 
+static int update_test(size_t count)
+{
+	uint32_t value = 0;
+	uint8_t *data = NULL;
+	size_t size = 0;
+	uint32_t attributes = 0;
+	struct timespec start, end;
+	int rc;
+
+	rc = efi_update_variable_if(ENUMERATE_GUID, UPDATE_NAME, NULL, 0,
+				    (uint8_t *)&value, sizeof(value),
+				    EFI_VARIABLE_BOOTSERVICE_ACCESS |
+				    EFI_VARIABLE_RUNTIME_ACCESS |
+				    EFI_VARIABLE_NON_VOLATILE, 0600);
+	if (rc < 0) {
+		warn("efi_update_variable_if(%s) failed", UPDATE_NAME);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rc = multithreaded_test(count, loop_update_test);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (rc == 0) {
+		rc = efi_get_variable(ENUMERATE_GUID, UPDATE_NAME, &data,
+				      &size, &attributes);
+		if (rc < 0 || size != sizeof(value)) {
+			warn("efi_get_variable(%s) failed", UPDATE_NAME);
+			rc = -1;
+		} else {
+			memcpy(&value, data, sizeof(value));
+			if (value != count * LOOP_COUNT) {
+				warnx("counter is %"PRIu32", expected %zu",
+				      value, count * LOOP_COUNT);
+				rc = -1;
+			}
+		}
+		free(data);
+	}
+	if (rc == 0 && verbosity >= 1) {
+		double secs = (end.tv_sec - start.tv_sec) +
+			      (end.tv_nsec - start.tv_nsec) / 1e9;
+
+		printf("%zu updates in %.3fs (%.0f/s), %lu retries\n",
+		       count * LOOP_COUNT, secs, count * LOOP_COUNT / secs,
+		       update_retries);
+	}
+
+	efi_del_variable(ENUMERATE_GUID, UPDATE_NAME);
+	return rc;
+}
+
 static void __attribute__((__noreturn__))
 usage(int ret)
 {
@@ -122,6 +493,7 @@ usage(int ret)
 		"Usage: %s [OPTION...]\n"
 		"  -v, --verbose                     be more verbose\n"
 		"  -t, --thread-count N              use N threads\n"
+		"  -T, --test TEST                   run TEST (size, enumerate, cache, update)\n"
 		"Help options:\n"
 		"  -?, --help                        Show this help message\n"
 		"      --usage                       Display brief usage message\n",
@@ -132,11 +504,13 @@ usage(int ret)
 int main(int argc, char *argv[])
 {
 	unsigned long thread_count = 64;
-	char *sopts = "vt:?";
+	char *sopts = "vt:T:?";
+	const char *test = "size";
 	struct option lopts[] = {
 		{"help", no_argument, 0, '?'},
 		{"quiet", no_argument, 0, 'q'},
 		{"thread-count", no_argument, 0, 't'},
+		{"test", required_argument, 0, 'T'},
 		{"usage", no_argument, 0, 0},
 		{"verbose", no_argument, 0, 'v'},
 		{0, 0, 0, 0},
@@ -155,6 +529,9 @@ int main(int argc, char *argv[])
 			if (errno == ERANGE || errno == EINVAL)
 				err(1, "invalid argument for -t: %s", optarg);
 			break;
+		case 'T':
+			test = optarg;
+			break;
 		case 'v':
 			verbosity += 1;
 			break;
@@ -170,7 +547,38 @@ int main(int argc, char *argv[])
 
 	if (verbosity >= 1)
 		printf("thread count %lu\n", thread_count);
-	rc = multithreaded_test(thread_count, loop_get_variable_size_test);
+	if (!strcmp(test, "size")) {
+		rc = multithreaded_test(thread_count,
+					loop_get_variable_size_test);
+	} else if (!strcmp(test, "enumerate")) {
+		rc = setup_enumerate_test();
+		if (rc == 0)
+			rc = multithreaded_test(thread_count,
+						loop_enumerate_test);
+		cleanup_enumerate_test();
+	} else if (!strcmp(test, "cache")) {
+		rc = setup_enumerate_test();
+		if (rc == 0)
+			rc = efi_variable_cache_enable();
+		if (rc == 0)
+			rc = multithreaded_test(thread_count, loop_cache_test);
+		if (rc == 0)
+			rc = cache_invalidation_test() < 0 ? 1 : 0;
+		if (rc == 0 && verbosity >= 1) {
+			efi_variable_cache_stats_t stats;
+
+			efi_get_variable_cache_stats(&stats);
+			printf("cache hits %"PRIu64" misses %"PRIu64"\n",
+			       stats.hits, stats.misses);
+		}
+		efi_variable_cache_disable();
+		cleanup_enumerate_test();
+	} else if (!strcmp(test, "update")) {
+		rc = update_test(thread_count);
+	} else {
+		warnx("unknown test \"%s\"", test);
+		usage(EXIT_FAILURE);
+	}
 	if (verbosity >= 0)
 		printf("thread test %s\n", rc == 0 ? "passed" : "failed");
 	return rc;
@@ -25,6 +25,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <tgmath.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "include/efivar/efivar.h"
@@ -32,87 +33,113 @@
 #include "compiler.h"
 #include "list.h"
 
+/*
+ * Read all of fd into *buf, which has *bufalloc bytes allocated and is
+ * grown with realloc() as needed; pass NULL and 0 to have one allocated.
+ * The buffer belongs to the caller on both success and failure, so it can
+ * be reused across reads.  On success the data is followed by a NUL, and
+ * its length (not counting the NUL) is stored in *filesize.
+ *
+ * For regular files the allocation is sized from st_size up front, so
+ * the common case is one allocation and two read() calls.  Pseudo-files
+ * that report a size of 0 fall back to doubling the buffer.
+ */
 static inline int UNUSED
-read_file(int fd, uint8_t **result, size_t *bufsize)
+read_file_buf(int fd, uint8_t **buf, size_t *bufalloc, size_t *filesize)
 {
-	uint8_t *p;
+	struct stat statbuf;
 	size_t size = 4096;
-	size_t filesize = 0;
-	ssize_t s = 0;
-	uint8_t *buf, *newbuf;
-
-	if (!(newbuf = calloc(size, sizeof (uint8_t)))) {
-		efi_error("could not allocate memory");
-		*result = buf = NULL;
-		*bufsize = 0;
-		return -1;
+	size_t pos = 0;
+	uint8_t *newbuf;
+	ssize_t s;
+
+	if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0 &&
+	    (uintmax_t)statbuf.st_size < SSIZE_MAX)
+		size = (size_t)statbuf.st_size + 1;
+
+	if (*bufalloc < size || *buf == NULL) {
+		newbuf = realloc(*buf, size);
+		if (!newbuf) {
+			efi_error("could not allocate memory");
+			return -1;
+		}
+		*buf = newbuf;
+		*bufalloc = size;
 	}
-	buf = newbuf;
 
 	do {
-		p = buf + filesize;
-		/* size - filesize shouldn't exceed SSIZE_MAX because we're
-		 * only allocating 4096 bytes at a time and we're checking that
-		 * before doing so. */
-		s = read(fd, p, size - filesize);
+		if (pos == *bufalloc) {
+			/* See if we're going to overrun and return an error
+			 * instead. */
+			if (*bufalloc > SSIZE_MAX / 2) {
+				errno = ENOMEM;
+				efi_error("could not read from file");
+				return -1;
+			}
+			newbuf = realloc(*buf, *bufalloc * 2);
+			if (!newbuf) {
+				efi_error("could not allocate memory");
+				return -1;
+			}
+			*buf = newbuf;
+			*bufalloc *= 2;
+		}
+
+		s = read(fd, *buf + pos, *bufalloc - pos);
 		if (s < 0 && errno == EAGAIN) {
 			/*
 			 * if we got EAGAIN, there's a good chance we've hit
 			 * the kernel rate limiter.  Doing more reads is just
-			 * going to make it worse, so instead, give it a rest.
+			 * going to make it worse, so instead, give it a rest
+			 * of one rate limit interval rather than spinning.
 			 */
-			sched_yield();
+			struct timespec ts = { 0, 10000000 };
+			nanosleep(&ts, NULL);
+			continue;
+		} else if (s < 0 && errno == EINTR) {
 			continue;
 		} else if (s < 0) {
-			int saved_errno = errno;
-			free(buf);
-			*result = buf = NULL;
-			*bufsize = 0;
-			errno = saved_errno;
 			efi_error("could not read from file");
 			return -1;
 		}
-		filesize += s;
+		pos += s;
 		/* only exit for empty reads */
-		if (s == 0)
-			break;
-		if (filesize >= size) {
-			/* See if we're going to overrun and return an error
-			 * instead. */
-			if (size > (size_t)-1 - 4096) {
-				free(buf);
-				*result = buf = NULL;
-				*bufsize = 0;
-				errno = ENOMEM;
-				efi_error("could not read from file");
-				return -1;
-			}
-			newbuf = realloc(buf, size + 4096);
-			if (newbuf == NULL) {
-				int saved_errno = errno;
-				free(buf);
-				*result = buf = NULL;
-				*bufsize = 0;
-				errno = saved_errno;
-				efi_error("could not allocate memory");
-				return -1;
-			}
-			buf = newbuf;
-			memset(buf + size, '\0', 4096);
-			size += 4096;
-		}
-	} while (1);
+	} while (s != 0);
+
+	/* The loop only ends with room left over, so this always fits. */
+	(*buf)[pos] = '\0';
+	*filesize = pos;
+	return 0;
+}
+
+static inline int UNUSED
+read_file(int fd, uint8_t **result, size_t *bufsize)
+{
+	uint8_t *buf = NULL;
+	size_t bufalloc = 0;
+	size_t filesize = 0;
+	uint8_t *newbuf;
+	int rc;
 
-	newbuf = realloc(buf, filesize+1);
-	if (!newbuf) {
+	rc = read_file_buf(fd, &buf, &bufalloc, &filesize);
+	if (rc < 0) {
+		int saved_errno = errno;
 		free(buf);
-		*result = buf = NULL;
-		efi_error("could not allocate memory");
+		*result = NULL;
+		*bufsize = 0;
+		errno = saved_errno;
 		return -1;
 	}
-	newbuf[filesize] = '\0';
-	*result = newbuf;
-	*bufsize = filesize+1;
+
+	/* Give back the slack from files that had no size hint. */
+	if (bufalloc - filesize > 4096) {
+		newbuf = realloc(buf, filesize + 1);
+		if (newbuf)
+			buf = newbuf;
+	}
+
+	*result = buf;
+	*bufsize = filesize + 1;
 	return 0;
 }
 
@@ -127,6 +154,22 @@ lcm(uint64_t x, uint64_t y)
 	return (x / n) * y;
 }
 
+/*
+ * 64-bit FNV-1a over len bytes.  Start from FNV1A_64_INIT, and pass the
+ * previous result back in as hash to continue over another buffer.
+ */
+#define FNV1A_64_INIT 0xcbf29ce484222325ull
+
+static inline uint64_t UNUSED
+fnv1a_64(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+	return hash;
+}
+
 #define xfree(x) ({ if (x) { free(x); x = NULL; } })
 
 #ifndef strdupa
@@ -202,56 +245,101 @@ lcm(uint64_t x, uint64_t y)
 
 extern size_t HIDDEN page_size;
 
+/*
+ * Like get_file(), but reads into a caller-owned buffer that is grown as
+ * needed; see read_file_buf().  Returns the number of bytes read plus the
+ * trailing NUL, as get_file() does.
+ */
 static inline ssize_t UNUSED
-get_file(uint8_t **result, const char * const fmt, ...)
+vget_file_buf(uint8_t **buf, size_t *bufalloc, const char * const fmt,
+	      va_list ap)
 {
 	char *path;
-	uint8_t *buf = NULL;
-	size_t bufsize = 0;
+	size_t filesize = 0;
 	ssize_t rc;
-	va_list ap;
 	int error;
 	int fd;
 
-	if (result == NULL) {
-		efi_error("invalid parameter 'result'");
+	if (buf == NULL || bufalloc == NULL) {
+		efi_error("invalid parameter 'buf'");
 		return -1;
 	}
 
-	va_start(ap, fmt);
 	rc = vasprintfa(&path, fmt, ap);
-	va_end(ap);
 	if (rc < 0) {
 		efi_error("could not allocate memory");
 		return -1;
 	}
 
-	fd = open(path, O_RDONLY);
+	fd = open(path, O_RDONLY|O_CLOEXEC);
 	if (fd < 0) {
 		efi_error("could not open file \"%s\" for reading",
 			  path);
 		return -1;
 	}
 
-	rc = read_file(fd, &buf, &bufsize);
+	rc = read_file_buf(fd, buf, bufalloc, &filesize);
 	error = errno;
 	close(fd);
 	errno = error;
 
-	if (rc < 0 || bufsize < 1) {
-		/*
-		 * I don't think this can happen, but I can't convince
-		 * cov-scan
-		 */
-		if (buf)
-			free(buf);
-		*result = NULL;
+	if (rc < 0) {
 		efi_error("could not read file \"%s\"", path);
 		return -1;
 	}
 
+	return filesize + 1;
+}
+
+static inline ssize_t UNUSED
+get_file_buf(uint8_t **buf, size_t *bufalloc, const char * const fmt, ...)
+{
+	va_list ap;
+	ssize_t rc;
+
+	va_start(ap, fmt);
+	rc = vget_file_buf(buf, bufalloc, fmt, ap);
+	va_end(ap);
+
+	return rc;
+}
+
+static inline ssize_t UNUSED
+get_file(uint8_t **result, const char * const fmt, ...)
+{
+	uint8_t *buf = NULL;
+	size_t bufalloc = 0;
+	uint8_t *newbuf;
+	ssize_t rc;
+	va_list ap;
+	int error;
+
+	if (result == NULL) {
+		efi_error("invalid parameter 'result'");
+		return -1;
+	}
+
+	va_start(ap, fmt);
+	rc = vget_file_buf(&buf, &bufalloc, fmt, ap);
+	va_end(ap);
+
+	if (rc < 1) {
+		error = errno;
+		free(buf);
+		*result = NULL;
+		errno = error;
+		return -1;
+	}
+
+	/* Give back the slack from files that had no size hint. */
+	if (bufalloc - (size_t)rc >= 4096) {
+		newbuf = realloc(buf, rc);
+		if (newbuf)
+			buf = newbuf;
+	}
+
 	*result = buf;
-	return bufsize;
+	return rc;
 }
 
 static inline void UNUSED
@@ -10,12 +10,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
+#include <time.h>
 
 #include "efivar.h"
 
@@ -258,24 +260,113 @@ err:
 }
 
 static int
-vars_get_variable_attributes(efi_guid_t guid, const char *name,
-			    uint32_t *attributes)
+pread_field(int fd, const char *path, void *buf, size_t size, off_t offset)
 {
+	ssize_t rc;
+
+	efi_ratelimit_acquire(1);
+	do {
+		rc = pread(fd, buf, size, offset);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0) {
+		efi_error("pread(%s) failed", path);
+		return -1;
+	}
+	if ((size_t)rc != size) {
+		errno = EIO;
+		efi_error("short read of %s (%zd of %zd)", path, rc, size);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read just the DataSize and/or Attributes fields out of raw_var, rather
+ * than the whole ~2kB structure.
+ */
+static int
+vars_read_header(efi_guid_t guid, const char *name, size_t *size,
+		 uint32_t *attributes)
+{
+	int errno_value;
 	int ret = -1;
+	char *path = NULL;
+	int fd = -1;
+	int rc;
+	bool sixtyfour = is_64bit();
+
+	rc = asprintf(&path, "%s%s-" GUID_FORMAT "/raw_var", get_vars_path(),
+		      name, GUID_FORMAT_ARGS(&guid));
+	if (rc < 0) {
+		efi_error("asprintf failed");
+		goto err;
+	}
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if (fd < 0) {
+		efi_error("open(%s, O_RDONLY) failed", path);
+		goto err;
+	}
+
+	if (size) {
+		uint64_t size64 = 0;
+		uint32_t size32 = 0;
+		void *field = sixtyfour ? (void *)&size64 : (void *)&size32;
+		size_t fieldsz = sixtyfour ? sizeof(size64) : sizeof(size32);
+		off_t offset = sixtyfour
+			? offsetof(efi_kernel_variable_64_t, DataSize)
+			: offsetof(efi_kernel_variable_32_t, DataSize);
+
+		if (pread_field(fd, path, field, fieldsz, offset) < 0)
+			goto err;
+		*size = sixtyfour ? size64 : size32;
+	}
 
-	uint8_t *data;
-	size_t data_size;
-	uint32_t attribs;
+	if (attributes) {
+		off_t offset = sixtyfour
+			? offsetof(efi_kernel_variable_64_t, Attributes)
+			: offsetof(efi_kernel_variable_32_t, Attributes);
 
-	ret = efi_get_variable(guid, name, &data, &data_size, &attribs);
-	if (ret < 0) {
-		efi_error("efi_get_variable() failed");
-		return ret;
+		if (pread_field(fd, path, attributes, sizeof(*attributes),
+				offset) < 0)
+			goto err;
 	}
 
-	*attributes = attribs;
-	if (data)
-		free(data);
+	ret = 0;
+err:
+	errno_value = errno;
+
+	if (fd >= 0)
+		close(fd);
+
+	if (path)
+		free(path);
+
+	errno = errno_value;
+	return ret;
+}
+
+static int
+vars_get_variable_attributes(efi_guid_t guid, const char *name,
+			    uint32_t *attributes)
+{
+	int ret;
+
+	ret = vars_read_header(guid, name, NULL, attributes);
+	if (ret < 0)
+		efi_error("vars_read_header() failed");
+	return ret;
+}
+
+static int
+vars_stat_variable(efi_guid_t guid, const char *name, size_t *size,
+		   uint32_t *attributes)
+{
+	int ret;
+
+	ret = vars_read_header(guid, name, size, attributes);
+	if (ret < 0)
+		efi_error("vars_read_header() failed");
 	return ret;
 }
 
@@ -290,16 +381,6 @@ vars_get_variable(efi_guid_t guid, const char *name, uint8_t **data,
 	char *path = NULL;
 	int rc;
 	int fd = -1;
-	int ratelimit;
-
-	/*
-	 * The kernel rate limiter hits us if we go faster than 100 efi
-	 * variable reads per second as non-root.  So if we're not root, just
-	 * delay this long after each read.  The user is not going to notice.
-	 *
-	 * 1s / 100 = 10000us.
-	 */
-	ratelimit = geteuid() == 0 ? 0 : 10000;
 
 	rc = asprintf(&path, "%s%s-" GUID_FORMAT "/raw_var", get_vars_path(),
 		      name, GUID_FORMAT_ARGS(&guid));
@@ -314,7 +395,12 @@ vars_get_variable(efi_guid_t guid, const char *name, uint8_t **data,
 		goto err;
 	}
 
-	usleep(ratelimit);
+	/*
+	 * The kernel rate limiter hits us if we go faster than 100 efi
+	 * variable reads per second as non-root; raw_var is read in one
+	 * read() plus the EOF.
+	 */
+	efi_ratelimit_acquire(2);
 	rc = read_file(fd, &buf, &bufsize);
 	if (rc < 0) {
 		efi_error("read_file(%s) failed", path);
@@ -628,6 +714,150 @@ vars_get_next_variable_name(efi_guid_t **guid, char **name)
 	return rc;
 }
 
+static int
+vars_variable_iter_new(efi_variable_iter_t **iter)
+{
+	int rc;
+	const char *vp = get_vars_path();
+	rc = generic_variable_iter_new(vp, iter);
+	if (rc < 0)
+		efi_error("generic_variable_iter_new(%s,...) failed", vp);
+	return rc;
+}
+
+static int
+vars_get_variable_snapshot(efi_variable_snapshot_entry_t **entries,
+			   size_t *n_entries)
+{
+	struct var_snapshot vs = { 0, };
+	const char *path = get_vars_path();
+	size_t guidlen = strlen("8be4df61-93ca-11d2-aa0d-00e098032b8c");
+	union {
+		efi_kernel_variable_32_t var32;
+		efi_kernel_variable_64_t var64;
+		uint8_t raw[sizeof(efi_kernel_variable_64_t) + 1];
+	} kvar;
+	size_t kvarsz;
+	struct dirent *de;
+	DIR *dir = NULL;
+	int dfd;
+	int fd = -1;
+	int ret = -1;
+	int errno_value;
+
+	kvarsz = is_64bit() ? sizeof(kvar.var64) : sizeof(kvar.var32);
+
+	dir = opendir(path);
+	if (!dir) {
+		efi_error("opendir(%s) failed", path);
+		goto err;
+	}
+
+	dfd = dirfd(dir);
+	if (dfd < 0) {
+		efi_error("dirfd failed");
+		goto err;
+	}
+
+	while ((de = readdir(dir)) != NULL) {
+		char raw_var[NAME_MAX + 9];
+		size_t namelen = strlen(de->d_name);
+		efi_guid_t guid;
+		size_t filled = 0;
+		size_t data_size;
+		uint32_t attributes;
+		uint8_t *data, *buf;
+
+		/* this also skips new_var and del_var */
+		if (namelen < guidlen + 2 || namelen > NAME_MAX)
+			continue;
+
+		if (text_to_guid(de->d_name + namelen - guidlen, &guid) < 0) {
+			errno = EINVAL;
+			efi_error("text_to_guid(%s) failed", de->d_name);
+			goto err;
+		}
+
+		memcpy(raw_var, de->d_name, namelen);
+		strcpy(raw_var + namelen, "/raw_var");
+
+		fd = openat(dfd, raw_var, O_RDONLY|O_CLOEXEC);
+		if (fd < 0) {
+			if (errno == ENOENT)
+				continue;
+			efi_error("openat(%s%s) failed", path, raw_var);
+			goto err;
+		}
+
+		efi_ratelimit_acquire(2);
+		while (filled < sizeof(kvar.raw)) {
+			ssize_t rc = read(fd, kvar.raw + filled,
+					  sizeof(kvar.raw) - filled);
+			if (rc < 0 && (errno == EAGAIN || errno == EINTR)) {
+				struct timespec ts = { 0, 10000000 };
+				nanosleep(&ts, NULL);
+				continue;
+			} else if (rc < 0) {
+				efi_error("read(%s%s) failed", path, raw_var);
+				goto err;
+			}
+			if (rc == 0)
+				break;
+			filled += rc;
+		}
+		close(fd);
+		fd = -1;
+
+		if (filled != kvarsz) {
+			errno = EFBIG;
+			efi_error("file size is wrong for %s (%zd of %zd)",
+				  raw_var, filled, kvarsz);
+			goto err;
+		}
+
+		if (kvarsz == sizeof(kvar.var64)) {
+			data = kvar.var64.Data;
+			data_size = kvar.var64.DataSize;
+			attributes = kvar.var64.Attributes;
+		} else {
+			data = kvar.var32.Data;
+			data_size = kvar.var32.DataSize;
+			attributes = kvar.var32.Attributes;
+		}
+		if (data_size > sizeof(kvar.var64.Data)) {
+			errno = EFBIG;
+			efi_error("data size is wrong for %s (%zd)",
+				  raw_var, data_size);
+			goto err;
+		}
+
+		buf = var_snapshot_reserve(&vs, 0, data_size);
+		if (!buf)
+			goto err;
+		memcpy(buf, data, data_size);
+		if (var_snapshot_commit(&vs, &guid, de->d_name,
+					namelen - guidlen - 1, attributes,
+					0, data_size) < 0)
+			goto err;
+	}
+
+	if (var_snapshot_finish(&vs, entries, n_entries) < 0)
+		goto err;
+
+	ret = 0;
+err:
+	errno_value = errno;
+
+	if (fd >= 0)
+		close(fd);
+	if (dir)
+		closedir(dir);
+	var_snapshot_free(&vs);
+
+	errno = errno_value;
+	return ret;
+}
+
 struct efi_var_operations vars_ops = {
 	.name = "vars",
 	.probe = vars_probe,
@@ -636,7 +866,10 @@ struct efi_var_operations vars_ops = {
 	.get_variable = vars_get_variable,
 	.get_variable_attributes = vars_get_variable_attributes,
 	.get_variable_size = vars_get_variable_size,
+	.stat_variable = vars_stat_variable,
 	.get_next_variable_name = vars_get_next_variable_name,
+	.variable_iter_new = vars_variable_iter_new,
+	.get_variable_snapshot = vars_get_variable_snapshot,
 	.chmod_variable = vars_chmod_variable,
 };
 